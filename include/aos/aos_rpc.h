@@ -73,6 +73,13 @@ struct aos_rpc_handler_data {
     struct event_closure resume_fn;
 };
 
+/// turns capabilities into bytes and back, to send them over UMP
+struct aos_rpc_cap_codec {
+    size_t size;  ///< bytes taken by a serialized capability
+    errval_t (*encode)(struct capref cap, void *buf);
+    errval_t (*decode)(void *buf, struct capref *cap);
+};
+
 /**
  * @brief represents an RPC binding
  *
@@ -84,9 +91,20 @@ struct aos_rpc {
     union {
         struct {
             struct lmp_chan channel;
+            // frame shared with the other end for large messages, or NULL_CAP
+            struct capref   bulk_frame;
+            // halves of the frame in which each end writes its messages
+            void           *bulk_send;
+            void           *bulk_recv;
         } lmp;
         struct {
             struct ump_chan channel;
+            // serializes the capabilities sent over the channel, or NULL
+            const struct aos_rpc_cap_codec *cap_codec;
+            // the message being sent, with its capabilities serialized in front of the data
+            void  *wire;
+            size_t wire_bufsize;
+            size_t wire_size;
         } ump;
     };
     struct waitset *waitset;
@@ -132,6 +150,26 @@ errval_t aos_rpc_lmp_accept(struct aos_rpc *rpc, struct handler_closure handler,
 errval_t aos_rpc_ump_connect(struct aos_rpc *rpc, struct capref frame, bool primary,
                              struct waitset *waitset);
 
+/**
+ * @brief allows capabilities to be sent over a UMP channel
+ *
+ * @param[in] rpc    the UMP channel
+ * @param[in] codec  serializes the capabilities, both ends of the channel need one
+ *
+ * Serializing capabilities requires the monitor invocations, so only init can do this.
+ */
+void aos_rpc_ump_set_cap_codec(struct aos_rpc *rpc, const struct aos_rpc_cap_codec *codec);
+
+/**
+ * @brief Lets the receivers of a UMP channel sleep until a message arrives instead of polling.
+ *
+ * @param[in] rpc   the UMP channel
+ * @param[in] core  the core of the other end, both ends of the channel need to set it
+ *
+ * Ringing the doorbell of another core requires the IPI capability, so only init can do this.
+ */
+void aos_rpc_ump_set_doorbell(struct aos_rpc *rpc, coreid_t core);
+
 void aos_rpc_destroy_server(struct aos_rpc *rpc_server);
 
 errval_t aos_rpc_send_blocking_varsize(struct aos_rpc *rpc, const void *buf, size_t size,
@@ -468,8 +506,18 @@ errval_t aos_rpc_filesystem_is_directory(struct aos_rpc *chan, const char *path,
 
 errval_t aos_rpc_filesystem_stat(struct aos_rpc *chan, struct fat32_handle *fat32_handle_addr, struct fs_fileinfo *file_info);
 
+// returns a read-only frame with the page of the file at offset, shared with the other mappings of the page
+errval_t aos_rpc_filesystem_map_page(struct aos_rpc *chan, struct fat32_handle *fat32_handle_addr, size_t offset,
+                                     struct capref *frame, size_t *len);
+
 errval_t aos_rpc_test_suite_run(struct aos_rpc *rpc, struct test_suite_config config);
 
+// starts a dispatcher of the calling domain on another core
+errval_t aos_rpc_span_start(struct aos_rpc *rpc, coreid_t core, struct capref dcb,
+                            struct capref vroot, struct capref dispframe);
+// stops a dispatcher of the calling domain on another core
+errval_t aos_rpc_span_stop(struct aos_rpc *rpc, coreid_t core, struct capref dcb);
+
 errval_t aos_rpc_cap_delete_remote(struct aos_rpc *rpc, struct capref root, capaddr_t src,
                                    uint8_t level);
 errval_t aos_rpc_cap_revoke_remote(struct aos_rpc *rpc, struct capref root, capaddr_t src,
@@ -542,6 +590,14 @@ errval_t simple_async_proc_setup(simple_async_response_handler response_handler)
 
 struct simple_async_channel* aos_rpc_get_async_channel(void);
 
+/**
+ * @brief Opens a further RPC channel to the init process of this core
+ *
+ * Its calls are not interleaved with the ones on the other channels of the domain, and only
+ * dispatch the events of the channel itself.
+ */
+errval_t aos_rpc_open_init_channel(struct aos_rpc *rpc);
+
 
 size_t aos_rpc_checksum(void *buf, size_t size);
 
@@ -17,6 +17,10 @@ struct aos_generic_rpc_request {
         AOS_RPC_REQUEST_TYPE_TEST_SUITE,
         AOS_RPC_REQUEST_TYPE_DISTCAP,
         AOS_RPC_REQUEST_TYPE_NETWORK,
+        AOS_RPC_REQUEST_TYPE_ECHO,
+        AOS_RPC_REQUEST_TYPE_MEMSERVER_RETURN,
+        AOS_RPC_REQUEST_TYPE_SPAN,
+        AOS_RPC_REQUEST_TYPE_SETUP_RPC_CHANNEL,
     } type;
 };
 
@@ -31,7 +35,9 @@ struct aos_generic_rpc_response {
         AOS_RPC_RESPONSE_TYPE_PROC_MGMT,
         AOS_RPC_RESPONSE_TYPE_TEST_SUITE,
         AOS_RPC_RESPONSE_TYPE_DISTCAP,
-        AOS_RPC_RESPONSE_TYPE_NETWORK
+        AOS_RPC_RESPONSE_TYPE_NETWORK,
+        AOS_RPC_RESPONSE_TYPE_ECHO,
+        AOS_RPC_RESPONSE_TYPE_SPAN
     } type;
     errval_t err;
 };
@@ -55,6 +61,15 @@ struct aos_generic_string_rpc_response {
     struct aos_generic_rpc_response base;
 };
 
+/// the payload following the request comes back after the response, used to measure the channels
+struct aos_echo_rpc_request {
+    struct aos_generic_rpc_request base;
+};
+
+struct aos_echo_rpc_response {
+    struct aos_generic_rpc_response base;
+};
+
 struct aos_memserver_rpc_request {
     struct aos_generic_rpc_request base;
     size_t                         size;
@@ -66,6 +81,32 @@ struct aos_memserver_rpc_response {
     size_t                          retbytes;
 };
 
+/// hands a batch of memory back to the memory server of the BSP core, the capability is attached
+struct aos_memserver_return_rpc_request {
+    struct aos_generic_rpc_request base;
+};
+
+struct aos_memserver_return_rpc_response {
+    struct aos_generic_rpc_response base;
+};
+
+/// starts or stops a dispatcher of a domain on another core, the dispatcher
+/// capability and for starting the root CNode of the domain are attached
+struct aos_span_rpc_request {
+    struct aos_generic_rpc_request base;
+    enum {
+        AOS_RPC_SPAN_START,
+        AOS_RPC_SPAN_STOP,
+    } stype;
+    coreid_t  core;       ///< the core of the dispatcher
+    capaddr_t vroot;      ///< address of the vspace root in the cspace of the domain
+    capaddr_t dispframe;  ///< address of the dispatcher frame in the cspace of the domain
+};
+
+struct aos_span_rpc_response {
+    struct aos_generic_rpc_response base;
+};
+
 struct aos_terminal_rpc_request {
     struct aos_generic_rpc_request base;
     enum { AOS_TERMINAL_RPC_REQUEST_TYPE_PUTCHAR, AOS_TERMINAL_RPC_REQUEST_TYPE_GETCHAR } ttype;
@@ -168,6 +209,10 @@ struct aos_proc_mgmt_rpc_wait_response {
     int                             exit_code;
 };
 
+// Reads and writes above the inline buffer size go through a frame shared per handle
+#define AOS_FILESYSTEM_INLINE_SIZE     512
+#define AOS_FILESYSTEM_BULK_FRAME_SIZE (64 * BASE_PAGE_SIZE)
+
 struct aos_filesystem_request {
     struct aos_generic_rpc_request base;
     enum {
@@ -186,6 +231,12 @@ struct aos_filesystem_request {
         AOS_RPC_FILESYSTEM_RMFILE,
         AOS_RPC_FILESYSTEM_IS_DIRECTORY,
         AOS_RPC_FILESYSTEM_STAT,
+        AOS_RPC_FILESYSTEM_SHARE_FRAME,
+        AOS_RPC_FILESYSTEM_READ_BULK,
+        AOS_RPC_FILESYSTEM_WRITE_BULK,
+        AOS_RPC_FILESYSTEM_SERVER_INIT,
+        AOS_RPC_FILESYSTEM_MAP_PAGE,
+        AOS_RPC_FILESYSTEM_READ_PAGE,
     } request_type;
 };
 
@@ -276,13 +327,53 @@ struct aos_filesystem_rpc_stat_request {
     struct fat32_handle* fat32_handle_addr;
 };
 
+// The frame to use for the bulk requests of the handle is sent along as capability.
+// Init passes it on to the filesystem server, which keeps it until the handle is closed.
+struct aos_filesystem_rpc_share_frame_request {
+    struct aos_filesystem_request base;
+    struct fat32_handle* fat32_handle_addr;
+};
+
+// The data is read into or written from the frame shared for the handle
+struct aos_filesystem_rpc_bulk_request {
+    struct aos_filesystem_request base;
+    struct fat32_handle* fat32_handle_addr;
+    size_t offset;
+    size_t len;
+};
+
+// Asks for a read-only frame holding the page of the file at offset. The frame
+// comes from the page cache of init and is shared by all the mappings of the page.
+struct aos_filesystem_rpc_map_page_request {
+    struct aos_filesystem_request base;
+    struct fat32_handle* fat32_handle_addr;
+    size_t offset;
+};
+
+// Reads a page of the file at offset without moving the position of the handle.
+// Sent by init to the filesystem server to fill its page cache.
+struct aos_filesystem_rpc_read_page_request {
+    struct aos_filesystem_request base;
+    struct fat32_handle* fat32_handle_addr;
+    size_t offset;
+};
+
+// Sent by the filesystem server once it has mounted the card (or failed to)
+struct aos_filesystem_rpc_server_init_request {
+    struct aos_filesystem_request base;
+    errval_t err;
+};
+
 struct aos_filesystem_response {
     struct aos_generic_rpc_response base;
 };
 
+// Files are identified by the location of their directory entry, which does
+// not change while the file exists
 struct aos_filesystem_rpc_open_response {
     struct aos_filesystem_response base;
     struct fat32_handle* fat32_handle_addr;
+    uint64_t file_id;
 };
 
 struct aos_filesystem_rpc_read_response {
@@ -298,6 +389,16 @@ struct aos_filesystem_rpc_write_response {
     size_t bytes_written;
 };
 
+struct aos_filesystem_rpc_share_frame_response {
+    struct aos_filesystem_response base;
+};
+
+struct aos_filesystem_rpc_bulk_response {
+    struct aos_filesystem_response base;
+    struct fat32_handle* fat32_handle_addr;
+    size_t len;
+};
+
 struct aos_filesystem_rpc_seek_response {
     struct aos_filesystem_response base;
     struct fat32_handle* fat32_handle_addr;
@@ -343,10 +444,24 @@ struct aos_filesystem_rpc_is_directory_response {
 struct aos_filesystem_rpc_mkfile_response {
     struct aos_filesystem_response base;
     struct fat32_handle *fat32_handle_addr;
+    uint64_t file_id;
 };
 
 struct aos_filesystem_rpc_rmfile_response {
     struct aos_filesystem_response base;
+    uint64_t file_id;
+};
+
+// The frame is sent along as capability, len is the part of the page inside the file
+struct aos_filesystem_rpc_map_page_response {
+    struct aos_filesystem_response base;
+    size_t len;
+};
+
+struct aos_filesystem_rpc_read_page_response {
+    struct aos_filesystem_response base;
+    size_t len;
+    char buffer[BASE_PAGE_SIZE];
 };
 
 struct aos_filesystem_rpc_stat_response {
@@ -428,6 +543,7 @@ struct aos_network_ping_response {
     TEST(frame_alloc)                                                                              \
     TEST(frame_page_fault_handler)                                                                 \
     TEST(frame_page_fault_handler_no_write)                                                        \
+    TEST(fault_around)                                                                             \
     TEST(frame_map_huge_frame)                                                                     \
     TEST(stress_frame_alloc)                                                                       \
     TEST(stress_frame_alloc_arbitrary_sizes)                                                       \
@@ -436,7 +552,15 @@ struct aos_network_ping_response {
     TEST(stress_frame_alloc_with_pagefault_handler)                                                \
     TEST(concurrent_paging)                                                                        \
     TEST(proc_spawn)                                                                               \
-    TEST(stress_proc_mgmt)
+    TEST(stress_proc_mgmt)                                                                         \
+    TEST(ump_bench)                                                                                \
+    TEST(mm_bench)                                                                                 \
+    TEST(malloc_bench)                                                                             \
+    TEST(string_bench)                                                                             \
+    TEST(zero_pool)                                                                                \
+    TEST(zero_pool_grant)                                                                          \
+    TEST(taskpool)                                                                                 \
+    TEST(fs_buffering)
 
 #define TEST_SUITE_GENERATE_FN(TEST)   errval_t test_##TEST(bool quick, bool verbose);
 #define TEST_SUITE_DEFINE_FN(TEST)     errval_t test_##TEST(bool quick, bool verbose)
@@ -52,6 +52,10 @@ struct ram_alloc_state {
     uint64_t default_maxlimit;
     size_t early_alloc_size;
     size_t early_alloc_offset;
+    // chunk obtained from the memory server that small allocations are carved from
+    struct capref cache_cap;
+    size_t cache_size;
+    size_t cache_offset;
 };
 
 
@@ -52,6 +52,7 @@ void disp_enable(dispatcher_handle_t handle);
 
 
 void disp_arch_init(dispatcher_handle_t handle);
+void disp_arch_span(dispatcher_handle_t handle, dispatcher_handle_t from);
 
 /**
  * \brief Resume execution of a given register state
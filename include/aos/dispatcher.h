@@ -92,11 +92,26 @@ struct dispatcher_generic {
     /// list of polled channels
     struct waitset_chanstate *polled_channels;
 
+    /// number of rounds the polled channels are checked before yielding
+    uint32_t poll_spin;
+    /// whether the senders of the polled channels were told that we sleep
+    bool poll_sleeping;
+
     struct notificator *notificators;
 
     struct capref recv_slots[MAX_RECV_SLOTS];///< Queued cap recv slots
     int8_t recv_slot_count;                 ///< number of currently queued recv slots
 
+    /// Threads handed to this dispatcher by the other dispatchers of the domain
+    struct thread *incoming;
+    /// Protects the incoming threads, taken by the dispatchers of all cores
+    spinlock_t incoming_lock;
+    /// whether the dispatcher waits for its doorbell to receive threads
+    bool incoming_sleeping;
+    /// Thread leaving the dispatcher, handed over once its state is saved
+    struct thread *outgoing;
+    /// Exited thread, whose exit lock is released once its stack is unused
+    struct thread *exiting;
 };
 
 #endif // BARRELFISH_DISPATCHER_H
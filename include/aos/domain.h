@@ -47,6 +47,17 @@ struct ram_alloc_state *get_ram_alloc_state(void);
 struct slot_alloc_state *get_slot_alloc_state(void);
 struct proc_mgmt_state  *get_proc_mgmt_state(void);
 
+bool domain_is_spanned(void);
+bool domain_has_dispatcher(coreid_t core_id);
+errval_t domain_new_dispatcher(coreid_t core_id, domain_spanned_callback_t callback,
+                               void *callback_arg);
+errval_t domain_thread_create_on(coreid_t core_id, thread_func_t start_func,
+                                 void *arg, struct thread **newthread);
+errval_t domain_thread_create_on_varstack(coreid_t core_id, thread_func_t start_func,
+                                          void *arg, size_t stacksize,
+                                          struct thread **newthread);
+errval_t domain_thread_move_to(struct thread *thread, coreid_t core_id);
+
 __END_DECLS
 
 #endif
@@ -364,6 +364,17 @@ static inline errval_t invoke_dispatcher_resume(struct capref dispatcher)
     return cap_invoke1(dispatcher, DispatcherCmd_Resume).error;
 }
 
+/**
+ * \brief Ring the doorbell of a core, using any dispatcher capability.
+ *
+ * Wakes the dispatchers on that core which wait for their doorbell.
+ */
+static inline errval_t invoke_dispatcher_notify(struct capref dispatcher,
+                                                coreid_t core)
+{
+    return cap_invoke2(dispatcher, DispatcherCmd_Notify, core).error;
+}
+
 
 static inline errval_t
 invoke_dispatcher_properties(struct capref dispatcher,
@@ -10,6 +10,7 @@
 #define __KERNEL_CAP_INVOCATIONS
 
 #include <aos/aos.h>
+#include <barrelfish_kpi/zero_pool.h>
 
 #define DEBUG_INVOCATION(x...)
 
@@ -33,6 +34,22 @@ invoke_monitor_spawn_core(hwid_t core_id, enum cpu_type cpu_type,
                        entry, context, psci_use_hvc).error;
 }
 
+/**
+ * \brief Ring the doorbell of a core.
+ *
+ * Wakes the dispatchers on that core which sleep until their channels get
+ * a message.
+ *
+ * \param core_id    ID of the core
+ */
+static inline errval_t
+invoke_ipi_notify(coreid_t core_id)
+{
+    DEBUG_INVOCATION("%s: called from %p\n", __FUNCTION__,
+            __builtin_return_address(0));
+    return cap_invoke2(cap_ipi, IPICmd_Send_Notify, core_id).error;
+}
+
 static inline errval_t
 invoke_monitor_create_cap(uint64_t *raw, capaddr_t caddr, int level,
         capaddr_t slot, coreid_t owner)
@@ -172,6 +189,37 @@ physaddr_forge(struct capref dest, genpaddr_t base, gensize_t bytes,
                                      dest.slot, coreid);
 }
 
+/**
+ * \brief Donate free RAM to the zero pool of the CPU driver.
+ *
+ * \param ram    RAM cap to the memory, owned by this core
+ *
+ * The CPU driver zeroes the memory while the core is idle, so that retyping
+ * it later does not have to. It refuses memory that has caps other than RAM
+ * caps, or that other cores know about.
+ */
+static inline errval_t
+invoke_kernel_zero_pool_add(struct capref ram)
+{
+    DEBUG_INVOCATION("%s: called from %p\n", __FUNCTION__,
+            __builtin_return_address(0));
+    return cap_invoke5(cap_kernel, KernelCmd_Zero_pool_add,
+                       get_cap_addr(cap_root), get_cap_level(cap_root),
+                       get_cap_addr(ram), get_cap_level(ram)).error;
+}
 
+/**
+ * \brief Get the statistics of the zero pool of the CPU driver.
+ *
+ * \param stats  Returns the statistics
+ */
+static inline errval_t
+invoke_kernel_zero_pool_stats(struct zero_pool_stats *stats)
+{
+    DEBUG_INVOCATION("%s: called from %p\n", __FUNCTION__,
+            __builtin_return_address(0));
+    return cap_invoke2(cap_kernel, KernelCmd_Zero_pool_stats,
+                       (uintptr_t)stats).error;
+}
 
 #endif /* __KERNEL_CAP_INVOCATIONS */
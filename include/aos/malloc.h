@@ -0,0 +1,42 @@
+/**
+ * \file
+ * \brief Size-class malloc with per-thread caches
+ */
+
+/*
+ * Copyright (c) 2022, The University of British Columbia
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef LIBBARRELFISH_MALLOC_H
+#define LIBBARRELFISH_MALLOC_H
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/// largest request served from the size classes, larger blocks get their own mapping
+#define MALLOC_SMALL_MAX (8 * 1024)
+
+/// size of the spans the objects of a size class are carved from
+#define MALLOC_SPAN_SIZE (64 * 1024)
+
+struct aos_malloc_stats {
+    size_t spans;         ///< spans owned by the size classes
+    size_t span_bytes;    ///< bytes of those spans available for objects
+    size_t used_bytes;    ///< bytes of the objects handed out, including the thread caches
+    size_t large_blocks;  ///< blocks mapped for requests above MALLOC_SMALL_MAX
+    size_t large_bytes;   ///< bytes mapped for those blocks
+};
+
+errval_t aos_malloc_init(void);
+void aos_malloc_thread_exit(void);
+void aos_malloc_get_stats(struct aos_malloc_stats *stats);
+
+__END_DECLS
+
+#endif // LIBBARRELFISH_MALLOC_H
@@ -22,6 +22,9 @@
 #define PAGING_EXCEPT_STACK_SIZE (1 << 16)
 #define PAGING_PAGE_ALIGN(x)     (((x) + BASE_PAGE_SIZE - 1) & ~(BASE_PAGE_SIZE - 1))
 
+// most bytes a page fault maps in a region, unless set with paging_set_fault_around()
+#define PAGING_FAULT_AROUND_DEFAULT (16 * BASE_PAGE_SIZE)
+
 // forward declarations
 struct thread;
 struct paging_state;
@@ -106,6 +109,23 @@ errval_t paging_free_state_foreign(struct paging_state *st);
  */
 errval_t paging_alloc(struct paging_state *st, void **buf, size_t bytes, size_t alignment);
 
+/**
+ * @brief reserves a region of virtual memory whose pages are provided by a pager
+ *
+ * @param[in]  st     paging state of the address space to create the mapping in
+ * @param[out] buf    returns the virtual address of the region
+ * @param[in]  bytes  size of the region
+ * @param[in]  flags  mapping flags of the pages
+ * @param[in]  fill   called on the first access to a page to get the frame to map
+ * @param[in]  arg    argument passed to fill
+ *
+ * @return SYS_ERR_OK on success, LIB_ERR_* on failure
+ *
+ * The region is released with paging_unmap().
+ */
+errval_t paging_map_pager(struct paging_state *st, void **buf, size_t bytes, paging_flags_t flags,
+                          paging_pager_fn fill, void *arg);
+
 
 /**
  * @brief maps a frame at a free virtual address region and returns its address
@@ -286,6 +306,31 @@ errval_t paging_unmap(struct paging_state *st, const void *region);
  */
 errval_t try_map(struct paging_state *st, lvaddr_t vaddr);
 
+/**
+ * @brief sets how many bytes a page fault in a lazily mapped region may map at most
+ *
+ * @param[in] st         paging state of the virtual address space
+ * @param[in] vaddr      virtual address contained within an allocated region
+ * @param[in] max_bytes  largest window, BASE_PAGE_SIZE maps only the faulting page
+ *
+ * @return SYS_ERR_OK on success, LIB_ERR_* on failure.
+ *
+ * A fault maps the faulting page and the ones following it with a single frame. The
+ * window starts at one page and doubles while the faults of the region are sequential.
+ */
+errval_t paging_set_fault_around(struct paging_state *st, lvaddr_t vaddr, size_t max_bytes);
+
+/**
+ * @brief returns how many page faults try_map served and how many pages they mapped
+ *
+ * @param[in]  st      paging state of the virtual address space
+ * @param[out] faults  number of page faults
+ * @param[out] pages   number of pages mapped by them
+ * @param[out] mapped  number of those pages that were not unmapped or decommitted since
+ */
+void paging_get_fault_stats(struct paging_state *st, size_t *faults, size_t *pages,
+                            size_t *mapped);
+
 errval_t dev_frame_map(struct capref dev_cap, struct capability dev_frame, genpaddr_t base,
                        gensize_t size, void **buf);
 
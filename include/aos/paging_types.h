@@ -18,6 +18,7 @@
 
 #include <aos/solution.h>
 #include <aos/rb_tree.h>
+#include <aos/thread_sync.h>
 
 #include <pthread.h>
 
@@ -42,8 +43,13 @@
 
 typedef int paging_flags_t;
 
-extern bool mm_mutex_init;
-extern struct thread_mutex mm_mutex;
+/// frames of the lazily mapped entries of an L3 table (see try_map)
+struct page_table_lazy {
+   /// frame allocated for the entry, it belongs to the page table and is destroyed with the
+   /// last entry mapping it
+   struct capref frames[VMSAv8_64_PTABLE_NUM_ENTRIES];
+   uint16_t pages[VMSAv8_64_PTABLE_NUM_ENTRIES];   ///< page of the frame the entry maps
+};
 
 struct page_table {
    enum objtype type;                            ///< type of the page table
@@ -51,18 +57,50 @@ struct page_table {
    struct capref page_table;                     ///< page table capability TODO rename? (cap?)
    struct capref mapping;                        ///< mapping capability (from parent to this) [NULL_CAP for L0]
    union page_table_entry {
-       struct page_table *pt;                   ///< if type != L3
-       struct capref frame_cap;                 ///< if type == L3 (mapping to the frame)
+       struct page_table *pt;                   ///< if type != L3 and not a block
+       struct capref frame_cap;                 ///< if type == L3 or a block (mapping to the frame)
    } entries[VMSAv8_64_PTABLE_NUM_ENTRIES];     ///< entries within the page table
    // TODO we can potentially use this bit for type != L3
    /// "bit-array" indicating whether the corresponding index was allocated lazily (if type == L3)
    /// we need this as lazily allocated frames are treated slightly different (see try_map)
    int32_t lazy[(VMSAv8_64_PTABLE_NUM_ENTRIES + 32 - 1) / 32];
+   /// "bit-array" indicating whether the corresponding index maps a frame directly as a
+   /// 1 GB (if type == L1) or 2 MB (if type == L2) block instead of a page table
+   int32_t block[(VMSAv8_64_PTABLE_NUM_ENTRIES + 32 - 1) / 32];
+   /// "bit-array" indicating whether the corresponding index is mapped together with the one
+   /// before it, all of them refer to the mapping capability of the first one (if type == L3)
+   int32_t tail[(VMSAv8_64_PTABLE_NUM_ENTRIES + 32 - 1) / 32];
+   /// frames of the lazily mapped entries (if type == L3), allocated with the first of them and
+   /// freed with the last one
+   struct page_table_lazy *lazy_frames;
    uint16_t num_children;                       ///< counts the number of non-NULL children.
 };
 
 struct rb_tree;
 
+/// fills the page at offset into a region mapped with a pager, returns the frame to map there
+typedef errval_t (*paging_pager_fn)(void *arg, size_t offset, struct capref *frame);
+
+/// region of virtual memory whose pages are provided by a pager when first accessed
+struct paging_pager_region {
+   lvaddr_t base;                                ///< start of the region
+   size_t bytes;                                 ///< size of the region
+   paging_flags_t flags;                         ///< flags the pages are mapped with
+   paging_pager_fn fill;                         ///< provides the frame of a page
+   void *arg;                                    ///< argument passed to fill
+   struct capref *frames;                        ///< frame mapped at each page, NULL_CAP if none yet,
+                                                 ///< protected by pt_mutex
+   struct paging_pager_region *next;
+};
+
+/// range of the virtual address space, free (size > 0) or allocated (size == 0)
+struct paging_vregion {
+   struct rb_node node;                          ///< node in the tree of virtual memory, first
+   size_t fault_max;                             ///< most bytes mapped by a single page fault
+   size_t fault_window;                          ///< bytes mapped by the last page fault
+   lvaddr_t fault_next;                          ///< address following the last page fault
+};
+
 /// struct to store the paging state of a process' virtual address space.
 struct paging_state {
    /// slot allocator to be used for this paging state
@@ -74,6 +112,7 @@ struct paging_state {
    /// slab allocator used for page_table items
    struct slab_allocator page_table_allocator;
    struct slab_allocator rb_node_allocator;
+   struct slab_allocator lazy_frames_allocator;
 
    /// "root-level" page table.
    struct page_table l0;
@@ -83,10 +122,24 @@ struct paging_state {
    /// to be able to slab_grow we must extend the buffer by sizeof(struct slab_head), see slab.c:56
    char _page_table_buf[sizeof(struct slab_head) + 12 * sizeof(struct page_table)];
    /// TODO: set the initial minimum amount needed for this buffer
-   char _rb_node_buf[sizeof(struct slab_head) + 12 * sizeof(struct rb_node)];
+   char _rb_node_buf[sizeof(struct slab_head) + 12 * sizeof(struct paging_vregion)];
 
    bool _refill_slab_pt;  ///< True iff we are in the process of refilling page_table_allocator
    bool _refill_slab_rb;  ///< True iff we are in the process of refilling rb_node_allocator
+   bool _refill_slab_lazy;  ///< True iff we are in the process of refilling lazy_frames_allocator
+
+   /// protects virtual_memory, rb_node_allocator, pagers and the fault counters
+   struct thread_mutex vaddr_mutex;
+   /// protects the page tables, page_table_allocator, lazy_frames_allocator and the frames of the
+   /// pagers
+   struct thread_mutex pt_mutex;
+
+   /// regions whose pages are provided by a pager instead of fresh frames
+   struct paging_pager_region *pagers;
+
+   size_t faults;                                ///< page faults served by try_map
+   size_t fault_pages;                           ///< pages mapped by them
+   size_t fault_pages_mapped;                    ///< those still mapped, protected by pt_mutex
 };
 
 
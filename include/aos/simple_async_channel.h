@@ -32,6 +32,8 @@ struct simple_request {
         void* data;
         size_t size;
     } send;
+    // capability sent along with the request, or NULL_CAP
+    struct capref cap;
 
     void* meta;
 };
@@ -68,6 +70,8 @@ struct simple_async_channel {
 
 void simple_async_init(struct simple_async_channel* async, struct aos_rpc* rpc, simple_async_response_handler response_handler);
 void simple_async_request(struct simple_async_channel* async, void* data, size_t size, simple_async_callback callback, void* meta);
+void simple_async_request_with_cap(struct simple_async_channel* async, void* data, size_t size, struct capref cap, simple_async_callback callback, void* meta);
+struct capref simple_async_recv_cap(struct simple_async_channel* async);
 void simple_async_respond(struct simple_async_channel* async, struct simple_response* res);
 
 #endif
@@ -0,0 +1,74 @@
+/**
+ * \file
+ * \brief Work-stealing task pool
+ */
+
+/*
+ * Copyright (c) 2022, The University of British Columbia
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_TASKPOOL_H
+#define BARRELFISH_TASKPOOL_H
+
+#include <sys/cdefs.h>
+
+#include <aos/waitset.h>
+#include <aos/dispatch.h>
+#include <barrelfish_kpi/spinlocks_arch.h>
+
+__BEGIN_DECLS
+
+struct taskpool;
+
+typedef void (*task_func_t)(void *arg);
+typedef void (*task_range_func_t)(void *arg, size_t begin, size_t end);
+typedef void *(*task_future_func_t)(void *arg);
+
+/// Tasks spawned together, task_sync() waits for all of them
+struct task_group {
+    struct taskpool *pool;
+    size_t pending;            ///< number of tasks that did not finish yet
+};
+
+/// Result of a task or of any other asynchronous operation
+struct task_future {
+    spinlock_t lock;
+    bool done;
+    void *result;
+    struct taskpool *pool;     ///< pool that computes the result, if any
+
+    /// event to deliver once done, see task_future_register()
+    struct waitset *waitset;
+    struct event_closure closure;
+    dispatcher_handle_t disp;  ///< dispatcher owning the waitset
+    struct waitset_chanstate chan;
+};
+
+errval_t taskpool_create(size_t nworkers, struct taskpool **retpool);
+void taskpool_destroy(struct taskpool *pool);
+size_t taskpool_get_nworkers(struct taskpool *pool);
+
+void task_group_init(struct task_group *group, struct taskpool *pool);
+errval_t task_spawn(struct task_group *group, task_func_t func, void *arg);
+void task_sync(struct task_group *group);
+
+errval_t task_parallel_for(struct taskpool *pool, size_t begin, size_t end, size_t grain,
+                           task_range_func_t func, void *arg);
+
+void task_future_init(struct task_future *future);
+errval_t task_async(struct taskpool *pool, struct task_future *future,
+                    task_future_func_t func, void *arg);
+void task_future_complete(struct task_future *future, void *result);
+bool task_future_is_done(struct task_future *future);
+errval_t task_future_register(struct task_future *future, struct waitset *ws,
+                              struct event_closure closure);
+void *task_future_wait(struct task_future *future, struct waitset *ws);
+
+__END_DECLS
+
+#endif // BARRELFISH_TASKPOOL_H
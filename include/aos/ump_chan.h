@@ -6,12 +6,34 @@
 #include <aos/waitset_chan.h>
 #include <aos/debug.h>
 
+/*
+ * Each direction of a channel uses one half of the shared frame. Its first cache
+ * line holds the number of lines the receiver has consumed, the other ones form a
+ * ring of messages, one per cache line. The number of lines in the ring follows
+ * from the size of the frame given to ump_chan_init().
+ *
+ * The control word of a line carries the lap of the ring in which it was written,
+ * so the receiver never has to clear it: a line is ready once it carries the
+ * current lap. The sender publishes a batch of lines with a single barrier, and
+ * the receiver only writes back how far it got every quarter of the ring, which
+ * keeps the line of the index from bouncing between the cores on every message.
+ *
+ * The line of the index also tells whether the receiver went to sleep waiting for
+ * the channel. If the channel has a doorbell, the sender rings it after publishing
+ * lines to a sleeping receiver, otherwise the receiver keeps polling.
+ */
+
 #define UMP_LINE_SIZE (8ull)
 #define UMP_CONTROL_WORD_IDX (UMP_LINE_SIZE - 1)
 #define UMP_MSG_MAX_SIZE (sizeof(uintptr_t) * (UMP_LINE_SIZE - 1))
 
-#define UMP_MSG_MORE      (1ull << 63)
-#define UMP_MSG_SIZE_MASK (~UMP_MSG_MORE)
+#define UMP_MSG_SIZE_MASK  (0xffull)
+#define UMP_MSG_MORE       (1ull << 8)
+#define UMP_MSG_LAP_SHIFT  16
+#define UMP_MSG_LAP_MASK   (~0ull >> UMP_MSG_LAP_SHIFT)
+
+/// size of the frames of the channels between the cores, giving rings of 127 lines
+#define UMP_CHAN_DEFAULT_FRAME_SIZE (4 * BASE_PAGE_SIZE)
 
 struct ump_line {
     uintptr_t words[UMP_LINE_SIZE];
@@ -27,81 +49,184 @@ struct ump_chan {
     struct capref frame;
 
     struct {
-        struct waitset_chanstate waitset_state; 
+        struct waitset_chanstate waitset_state;
         struct ump_line* buf;
+        // lines consumed by the receiver, as published by it
+        volatile uintptr_t* ack;
+        // set by the receiver while it waits for the doorbell
+        volatile uintptr_t* sleeping;
         size_t size;
-        size_t offset;
+        // lines written so far
+        size_t pos;
+        // last value read from ack
+        size_t acked;
     } send;
 
     struct {
         struct waitset_chanstate waitset_state;
         struct ump_line* buf;
+        volatile uintptr_t* ack;
+        volatile uintptr_t* sleeping;
         size_t size;
-        size_t offset;
+        // lines read so far
+        size_t pos;
+        // last value written to ack
+        size_t acked;
     } recv;
+
+    // whether to ring the doorbell of the receiving core when it sleeps
+    bool doorbell;
+    coreid_t doorbell_core;
 };
 
 errval_t ump_chan_init(struct ump_chan* chan, struct capref frame, bool primary);
+void ump_chan_set_doorbell(struct ump_chan* chan, coreid_t core);
+void ump_chan_notify(struct ump_chan* chan);
 
+static inline uintptr_t ump_chan_lap(size_t pos, size_t size) {
+    return (pos / size + 1) & UMP_MSG_LAP_MASK;
+}
+
+// number of lines that can be written without overwriting unread ones
+static inline size_t ump_chan_send_space(struct ump_chan* chan) {
+    if (chan->send.pos - chan->send.acked >= chan->send.size) {
+        // only look at the line of the receiver once our copy says the ring is full
+        chan->send.acked = *chan->send.ack;
+    }
+    return chan->send.size - (chan->send.pos - chan->send.acked);
+}
+
+static inline bool ump_chan_line_ready(struct ump_chan* chan, size_t pos) {
+    struct ump_line* line = chan->recv.buf + pos % chan->recv.size;
+    uintptr_t control = line->words[UMP_CONTROL_WORD_IDX];
+    return (control >> UMP_MSG_LAP_SHIFT) == ump_chan_lap(pos, chan->recv.size);
+}
 
 static inline bool ump_chan_can_send(struct ump_chan* chan) {
-    struct ump_line* line = chan->send.buf + chan->send.offset;
-    return line->words[UMP_CONTROL_WORD_IDX] == 0;
+    return ump_chan_send_space(chan) > 0;
 }
 
 static inline bool ump_chan_can_recv(struct ump_chan* chan) {
-    struct ump_line* line = chan->recv.buf + chan->recv.offset;
-    return line->words[UMP_CONTROL_WORD_IDX] != 0;
+    return ump_chan_line_ready(chan, chan->recv.pos);
 }
 
-static inline errval_t ump_chan_send(struct ump_chan* chan, const struct ump_msg* msg) {
-    if (!ump_chan_can_send(chan)) {
+/**
+ * @brief sends as many of the messages as there is space for in the ring
+ *
+ * @param[in]  chan   the channel to send on
+ * @param[in]  msgs   the messages, one per line
+ * @param[in]  count  number of messages
+ * @param[out] sent   number of messages sent
+ *
+ * @return SYS_ERR_OK if at least one message was sent, LIB_ERR_UMP_CHAN_FULL otherwise
+ */
+static inline errval_t ump_chan_send_batch(struct ump_chan* chan, const struct ump_msg* msgs,
+                                           size_t count, size_t* sent) {
+    size_t n = MIN(count, ump_chan_send_space(chan));
+    *sent = n;
+    if (n == 0) {
         return LIB_ERR_UMP_CHAN_FULL;
     }
 
     // writes are never speculated, hence no barrier is necessary
 
-    struct ump_line* line = chan->send.buf + chan->send.offset;
-    memcpy(line->words, msg->data, msg->size);
-
-    uintptr_t control = msg->size | (msg->more ? UMP_MSG_MORE : 0);
+    for (size_t i = 0; i < n; i++) {
+        struct ump_line* line = chan->send.buf + (chan->send.pos + i) % chan->send.size;
+        memcpy(line->words, msgs[i].data, msgs[i].size);
+    }
 
-    // written data must be visible before control word
+    // written data must be visible before any of the control words
     dmb();
 
-    line->words[UMP_CONTROL_WORD_IDX] = control;
+    for (size_t i = 0; i < n; i++) {
+        size_t pos = chan->send.pos + i;
+        struct ump_line* line = chan->send.buf + pos % chan->send.size;
+        line->words[UMP_CONTROL_WORD_IDX] = msgs[i].size | (msgs[i].more ? UMP_MSG_MORE : 0)
+                                            | (ump_chan_lap(pos, chan->send.size) << UMP_MSG_LAP_SHIFT);
+    }
+
+    chan->send.pos += n;
 
-    chan->send.offset = (chan->send.offset + 1) % chan->send.size;
+    if (chan->doorbell) {
+        // the control words must be visible before we look whether the receiver sleeps
+        dmb();
+        if (*chan->send.sleeping) {
+            ump_chan_notify(chan);
+        }
+    }
 
     return SYS_ERR_OK;
 }
 
-static inline errval_t ump_chan_recv(struct ump_chan* chan, struct ump_msg* msg) {
-    if (!ump_chan_can_recv(chan)) {
+static inline errval_t ump_chan_send(struct ump_chan* chan, const struct ump_msg* msg) {
+    size_t sent;
+    return ump_chan_send_batch(chan, msg, 1, &sent);
+}
+
+/**
+ * @brief receives the messages available in the ring, up to the end of the current one
+ *
+ * @param[in]  chan      the channel to receive from
+ * @param[out] msgs      returns the messages, one per line
+ * @param[in]  count     maximum number of messages to receive
+ * @param[out] received  number of messages received
+ *
+ * @return SYS_ERR_OK if at least one message was received, LIB_ERR_UMP_CHAN_EMPTY otherwise
+ *
+ * The batch ends with the first line that is not followed by more fragments, so that
+ * every message is handed out separately.
+ */
+static inline errval_t ump_chan_recv_batch(struct ump_chan* chan, struct ump_msg* msgs,
+                                           size_t count, size_t* received) {
+    size_t n = 0;
+    while (n < count && ump_chan_line_ready(chan, chan->recv.pos + n)) {
+        struct ump_line* line = chan->recv.buf + (chan->recv.pos + n) % chan->recv.size;
+        uintptr_t control = line->words[UMP_CONTROL_WORD_IDX];
+        msgs[n].size = control & UMP_MSG_SIZE_MASK;
+        msgs[n].more = control & UMP_MSG_MORE;
+        n++;
+        if (!msgs[n - 1].more) {
+            break;
+        }
+    }
+    *received = n;
+    if (n == 0) {
         return LIB_ERR_UMP_CHAN_EMPTY;
     }
 
-    struct ump_line* line = chan->recv.buf + chan->recv.offset;
-    uintptr_t control = line->words[UMP_CONTROL_WORD_IDX];
-    msg->size = control & UMP_MSG_SIZE_MASK;
-    msg->more = control & UMP_MSG_MORE;
-
     // avoid data being prefetched speculatively
     dmb();
 
-    memcpy(msg->data, line->words, msg->size);
-
-    // data must be read before clearing control word visible to writer
-    dmb();
+    for (size_t i = 0; i < n; i++) {
+        struct ump_line* line = chan->recv.buf + (chan->recv.pos + i) % chan->recv.size;
+        memcpy(msgs[i].data, line->words, msgs[i].size);
+    }
 
-    // clear control word after reading data
-    line->words[UMP_CONTROL_WORD_IDX] = 0;
+    chan->recv.pos += n;
 
-    chan->recv.offset = (chan->recv.offset + 1) % chan->recv.size;
+    // the sender has at least three quarters of the ring left until we tell it more
+    if (chan->recv.pos - chan->recv.acked >= MAX(chan->recv.size / 4, 1)) {
+        // data must be read before the lines are handed back to the writer
+        dmb();
+        *chan->recv.ack = chan->recv.pos;
+        chan->recv.acked = chan->recv.pos;
+    }
 
     return SYS_ERR_OK;
 }
 
+static inline errval_t ump_chan_recv(struct ump_chan* chan, struct ump_msg* msg) {
+    size_t received;
+    return ump_chan_recv_batch(chan, msg, 1, &received);
+}
+
+// tells the sender whether it has to ring the doorbell after its next lines
+static inline void ump_chan_set_sleeping(struct ump_chan* chan, bool sleeping) {
+    if (*chan->recv.sleeping != sleeping) {
+        *chan->recv.sleeping = sleeping;
+    }
+}
+
 errval_t ump_chan_register_recv(struct ump_chan *chan, struct waitset *ws, struct event_closure closure);
 errval_t ump_chan_register_send(struct ump_chan *chan, struct waitset *ws, struct event_closure closure);
 
@@ -118,4 +243,4 @@ static inline bool ump_err_is_transient(errval_t err) {
            err_no(err) == LIB_ERR_UMP_CHAN_EMPTY;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -116,6 +116,9 @@ struct waitset {
 };
 
 void poll_channels_disabled(dispatcher_handle_t handle);
+bool poll_channels_havework_disabled(dispatcher_handle_t handle);
+void poll_channels_sleep_disabled(dispatcher_handle_t handle);
+void poll_channels_wake_disabled(dispatcher_handle_t handle);
 
 void waitset_init(struct waitset *ws);
 errval_t waitset_destroy(struct waitset *ws);
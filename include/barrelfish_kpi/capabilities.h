@@ -448,6 +448,8 @@ enum kernel_cmd {
     KernelCmd_Suspend_kcb_sched,  ///< suspend/resume kcb scheduler
     KernelCmd_Get_platform,       ///< Get architecture platform
     KernelCmd_ReclaimRAM,         ///< Retrieve stored ram caps from KCB
+    KernelCmd_Zero_pool_add,      ///< Donate free RAM to be zeroed in the background
+    KernelCmd_Zero_pool_stats,    ///< Get the statistics of the zero pool
     KernelCmd_Count
 };
 
@@ -467,6 +469,7 @@ enum dispatcher_cmd {
     DispatcherCmd_Vmwrite,           ///< Execute vmwrite on the current and active VMCS
     DispatcherCmd_Vmptrld,           ///< Make VMCS clear and inactive
     DispatcherCmd_Vmclear,           ///< Make VMCS current and active
+    DispatcherCmd_Notify,            ///< Ring the doorbell of a core
 };
 
 /**
@@ -545,6 +548,7 @@ enum id_cmd {
 enum ipi_cmd {
     IPICmd_Send_Start,  ///< Send Startup IPI to a destination core
     IPICmd_Send_Init,   ///< Send Init IPI to a destination core
+    IPICmd_Send_Notify, ///< Ring the doorbell of a destination core
 };
 
 /**
@@ -47,6 +47,7 @@ struct dispatcher_shared_generic {
 
     systime_t   systime;                        ///< System time when last dispatched/resumed (W/O to kernel)
     systime_t   wakeup;                         ///< System time at which to wake dispatcher from sleep (R/O by kernel, on yield)
+    uint32_t    doorbell;                       ///< Sleep until the doorbell of the core rings (cleared by kernel on wakeup)
 
     char        name[DISP_NAME_LEN];            ///< Name of domain, for debugging purposes
 
@@ -84,6 +85,7 @@ static inline void dump_dispatcher(struct dispatcher_shared_generic *disp)
     printf("  dispatcher_trap               = 0x%" PRIxLVADDR "\n", disp->dispatcher_trap );
     printf("  systime      = 0x%" PRIuSYSTIME "\n", disp->systime );
     printf("  wakeup       = 0x%" PRIuSYSTIME "\n", disp->wakeup );
+    printf("  doorbell     = %d\n", disp->doorbell );
     printf("  name         = %.*s\n", DISP_NAME_LEN, disp->name );
     printf("  curr_core_id = 0x%" PRIxCOREID "\n", disp->curr_core_id );
 }
@@ -0,0 +1,31 @@
+/**
+ * \file
+ * \brief Statistics of the pool of pre-zeroed memory of a CPU driver
+ */
+
+/*
+ * Copyright (c) 2022, The University of British Columbia
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_KPI_ZERO_POOL_H
+#define BARRELFISH_KPI_ZERO_POOL_H
+
+#include <stdint.h>
+
+/// Struct that can be used to request the zero pool statistics
+struct zero_pool_stats {
+    uint64_t pending_bytes;    ///< donated memory still waiting to be zeroed
+    uint64_t zeroed_bytes;     ///< memory zeroed ahead of time and not yet retyped
+    uint64_t sync_bytes;       ///< bytes zeroed during retypes
+    uint64_t sync_ns;          ///< time spent zeroing during retypes
+    uint64_t idle_bytes;       ///< bytes zeroed while the core was idle
+    uint64_t idle_ns;          ///< time spent zeroing while the core was idle
+    uint64_t prezeroed_bytes;  ///< bytes retypes found zeroed already
+};
+
+#endif
@@ -5,6 +5,31 @@
 #ifndef AOS2023_TEAM09_HAND_IN_BLOCKDRIVER_H
 #define AOS2023_TEAM09_HAND_IN_BLOCKDRIVER_H
 
+#include <aos/event_queue.h>
+#include <drivers/sdhc.h>
+
+enum block_request_type {
+    BLOCK_REQUEST_READ,
+    BLOCK_REQUEST_WRITE,
+};
+
+// Asynchronous request. It belongs to the driver from submission until its
+// completion closure has been run on the waitset given to block_driver_async_init.
+struct block_request {
+    enum block_request_type type;
+    int lba;
+    size_t count;
+    void *buf;
+
+    errval_t err;  // Outcome of the request, valid in the completion
+    struct event_closure completion;
+
+    // Internal state of the driver
+    size_t done;
+    struct block_request *next;
+    struct event_queue_node qnode;
+};
+
 struct block_driver {
     struct capref sdhc_cap;
     lvaddr_t sdhc_vaddr;
@@ -15,16 +40,37 @@ struct block_driver {
     lpaddr_t write_paddr;
     lpaddr_t read_paddr;
 
-    struct thread_mutex mm_mutex;
+    // DMA buffer for multi-block transfers
+    struct capref bulk_frame;
+    lvaddr_t bulk_vaddr;
+    lpaddr_t bulk_paddr;
+
+    struct thread_mutex mutex;
 
     struct sdhc_s *driver_structure;
+
+    // Queue of asynchronous requests, the head one is being transferred
+    bool async_enabled;
+    struct block_request *queue_head;
+    struct block_request *queue_tail;
+    size_t in_flight_count;
+    struct event_queue completions;
 };
 
 errval_t read_block(struct block_driver *b_driver, int lba, void *block);
 errval_t write_block(struct block_driver *b_driver, int lba, void *block);
+errval_t read_blocks(struct block_driver *b_driver, int lba, size_t count, void *blocks);
+errval_t write_blocks(struct block_driver *b_driver, int lba, size_t count, const void *blocks);
+errval_t flush_blocks(struct block_driver *b_driver);
+void block_cache_stats(struct block_driver *b_driver, struct sdhc_cache_stats *stats);
+
+errval_t block_driver_async_init(struct block_driver *b_driver, struct waitset *ws);
+errval_t submit_block_requests(struct block_driver *b_driver, struct block_request **reqs, size_t count);
 
 errval_t benchmark_read(struct block_driver *b_driver, size_t number_runs);
 errval_t benchmark_write(struct block_driver *b_driver, size_t number_runs);
+errval_t benchmark_cache(struct block_driver *b_driver, size_t number_runs);
+errval_t benchmark_async(struct block_driver *b_driver, size_t number_runs);
 
 void test_driver(struct block_driver *b_driver);
 errval_t launch_driver(struct block_driver *b_driver);
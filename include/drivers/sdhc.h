@@ -20,7 +20,21 @@
 #define SDHC_BLOCK_SIZE 512
 #define SDHC_TEST_BLOCK 20
 
+// Largest number of blocks moved by a single CMD18/CMD25 transfer
+#define SDHC_MAX_BLOCKS_PER_TRANSFER 128
+
+// Default block cache geometry: 256 sets of 8 lines, i.e. 1 MiB of blocks
+#define SDHC_CACHE_DEFAULT_SETS 256
+#define SDHC_CACHE_DEFAULT_WAYS 8
+
 struct sdhc_s;
+
+struct sdhc_cache_stats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t writebacks;
+};
 /**
  * Allocate and initialize the SDHC driver. Ensure that base is mapped as
  * read/write and nocache. The sd struct must be freed by the caller.
@@ -59,13 +73,17 @@ errval_t sdhc_read_mbr(struct sdhc_s* sd, void * scratch, lpaddr_t scratch_p,
  * Write a block of SDHC_BLOCK_LEN bytes located at source to block index.
  * The caller must ensure the right memory fences are in place and the DMA
  * of the device can actually read from physical memory.
- * This call will block until the data has been written.
+ * If source_virtual is set and the cache is in write-back mode, the block is
+ * only stored in the cache and reaches the card on eviction or on
+ * sdhc_flush_cache(). Otherwise this call will block until the data has been
+ * written.
  *
- * \param sd        The driver struct
- * \param index     The block index to write
- * \param source    Physical address of the data to read from
+ * \param sd             The driver struct
+ * \param index          The block index to write
+ * \param source         Physical address of the data to read from
+ * \param source_virtual Virtual address of the data, 0 to bypass the cache
  */
-errval_t sdhc_write_block(struct sdhc_s* sd, int index, lpaddr_t source);
+errval_t sdhc_write_block(struct sdhc_s* sd, int index, lpaddr_t source, lvaddr_t source_virtual);
 
 /**
  * Read block number index of SDHC_BLOCK_LEN bytes to physical address dest
@@ -78,4 +96,90 @@ errval_t sdhc_write_block(struct sdhc_s* sd, int index, lpaddr_t source);
  * \param dest      Physical address where to write
  */
 errval_t sdhc_read_block(struct sdhc_s *sd, int index, lpaddr_t dest, lvaddr_t dest_virtual);
+
+/**
+ * Read count consecutive blocks starting at index with a single multi-block
+ * command (CMD18) into the physically contiguous buffer at dest.
+ * The same cache maintenance rules as for sdhc_read_block() apply.
+ *
+ * \param sd           The driver struct
+ * \param index        The first block index to read
+ * \param count        Number of blocks, at most SDHC_MAX_BLOCKS_PER_TRANSFER
+ * \param dest         Physical address where to write
+ * \param dest_virtual Virtual address of dest
+ */
+errval_t sdhc_read_blocks(struct sdhc_s *sd, int index, size_t count, lpaddr_t dest,
+                          lvaddr_t dest_virtual);
+
+/**
+ * Write count consecutive blocks starting at index with a single multi-block
+ * command (CMD25) from the physically contiguous buffer at source. Unlike
+ * single block writes, this call always writes through to the card.
+ *
+ * \param sd             The driver struct
+ * \param index          The first block index to write
+ * \param count          Number of blocks, at most SDHC_MAX_BLOCKS_PER_TRANSFER
+ * \param source         Physical address of the data to read from
+ * \param source_virtual Virtual address of source, 0 if not mapped
+ */
+errval_t sdhc_write_blocks(struct sdhc_s *sd, int index, size_t count, lpaddr_t source,
+                           lvaddr_t source_virtual);
+
+/**
+ * Start a transfer of count blocks without waiting for it to complete. The
+ * controller raises its interrupt once the transfer is done or failed, after
+ * which sdhc_poll_transfer must be called. Only one transfer can be in flight
+ * and no other function of the driver may be used until it completed.
+ *
+ * \param sd        The driver struct
+ * \param is_write  Write to the card instead of reading from it
+ * \param index     The first block index
+ * \param count     Number of blocks, at most SDHC_MAX_BLOCKS_PER_TRANSFER
+ * \param paddr     Physical address of the buffer
+ * \param vaddr     Virtual address of the buffer, 0 if not mapped
+ */
+errval_t sdhc_start_transfer(struct sdhc_s *sd, bool is_write, int index, size_t count,
+                             lpaddr_t paddr, lvaddr_t vaddr);
+
+/**
+ * Check whether the transfer started by sdhc_start_transfer completed. Once
+ * done is set, the returned error is the outcome of the transfer.
+ *
+ * \param sd        The driver struct
+ * \param done      Set if no transfer is in flight anymore
+ */
+errval_t sdhc_poll_transfer(struct sdhc_s *sd, bool *done);
+
+/**
+ * Write all dirty blocks of the cache back to the card, in block order.
+ *
+ * \param sd        The driver struct
+ */
+errval_t sdhc_flush_cache(struct sdhc_s *sd);
+
+/**
+ * Flush the cache and replace it by one of nb_sets * nb_ways blocks.
+ *
+ * \param sd        The driver struct
+ * \param nb_sets   Number of sets, must be a power of two
+ * \param nb_ways   Number of blocks per set
+ */
+errval_t sdhc_cache_resize(struct sdhc_s *sd, size_t nb_sets, size_t nb_ways);
+
+/**
+ * Switch the cache between write-back and write-through mode. Switching to
+ * write-through flushes the cache first.
+ *
+ * \param sd         The driver struct
+ * \param write_back Whether writes should be deferred
+ */
+errval_t sdhc_cache_set_write_back(struct sdhc_s *sd, bool write_back);
+
+/**
+ * Returns the hit/miss/eviction/writeback counters of the cache.
+ *
+ * \param sd        The driver struct
+ * \param stats     Returns the counters
+ */
+void sdhc_cache_get_stats(struct sdhc_s *sd, struct sdhc_cache_stats *stats);
 #endif
@@ -55,6 +55,11 @@
 #define NUMBER_DIRECTORY_PER_BLOCK 16
 #define FAT_ENTRIES_PER_SECTOR 128
 
+// In-memory window of the FAT, loaded in aligned groups of FAT_CACHE_PREFETCH sectors
+#define FAT_CACHE_SECTORS 256
+#define FAT_CACHE_PREFETCH 8
+#define FAT_CACHE_EMPTY 0xffffffff
+
 #define FIND_NAME_MATCH 0
 #define FIND_FREE_ENTRY 1
 #define FIND_USED_ENTRY 2
@@ -72,6 +77,13 @@ struct fat32_entry {
     uint32_t file_size;
 } __attribute__((packed));
 
+// Run of clusters that are contiguous on the disk
+struct fat32_extent {
+    uint32_t file_cluster;    // Index of the first cluster of the run in the file
+    uint32_t cluster_number;  // First cluster of the run on the disk
+    uint32_t nb_clusters;
+};
+
 struct fat32_handle {
     // Current entry
     struct fat32_entry entry;
@@ -88,6 +100,17 @@ struct fat32_handle {
     // Entries about the parent - required to modify entry
     uint32_t parent_cluster_number;
     uint32_t parent_cluster_offset;
+    // Extent map of the file, built on first use and dropped when the chain changes
+    struct fat32_extent *extents;
+    uint32_t nb_extents;
+    bool extents_valid;
+};
+
+struct fat32_fat_cache {
+    uint32_t sector[FAT_CACHE_SECTORS];  // FAT sector held by each slot, FAT_CACHE_EMPTY if none
+    bool dirty[FAT_CACHE_SECTORS];
+    uint32_t data[FAT_CACHE_SECTORS][FAT_ENTRIES_PER_SECTOR];
+    uint32_t prefetch[FAT_CACHE_PREFETCH][FAT_ENTRIES_PER_SECTOR];
 };
 
 struct fat32_filesystem {
@@ -100,6 +123,7 @@ struct fat32_filesystem {
     uint16_t numbers_sectors_reserved;
     uint8_t  fat32_number;
     uint32_t next_free_cluster_hint;
+    struct fat32_fat_cache *fat_cache;
 };
 
 // Attribute management
@@ -125,6 +149,9 @@ void create_directory_entry(struct fat32_entry *entry, const char *name, uint32_
 
 // Handle management
 void close_handle(struct fat32_handle *handle);
+void fat32_handle_invalidate_extents(struct fat32_handle *handle);
+errval_t fat32_handle_lookup_cluster(struct fat32_filesystem *fs, struct fat32_handle *handle, uint32_t file_cluster, uint32_t *cluster_number, uint32_t *nb_contiguous);
+errval_t fat32_handle_offset_to_lba(struct fat32_filesystem *fs, struct fat32_handle *handle, uint32_t offset, uint32_t *lba);
 
 // Cluster management
 uint32_t get_cluster_number(const struct fat32_entry *entry);
@@ -138,6 +165,12 @@ uint32_t get_number_additional_clusters(struct fat32_filesystem *fs, uint32_t ne
 uint32_t get_lba_from_cluster(const struct fat32_filesystem *fat_fs, uint32_t cluster_number);
 errval_t fat32_get_next_cluster(const struct fat32_filesystem *fat_mount, uint32_t cluster_number, uint32_t *ret_cluster_number);
 
+// FAT cache
+errval_t fat32_fat_cache_init(struct fat32_filesystem *fs);
+errval_t fat32_fat_get(const struct fat32_filesystem *fs, uint32_t cluster_number, uint32_t *value);
+errval_t fat32_fat_set(const struct fat32_filesystem *fs, uint32_t cluster_number, uint32_t value);
+errval_t fat32_fat_flush(const struct fat32_filesystem *fs);
+
 // Walk functions
 errval_t fat32_read_directory(struct fat32_filesystem *fs, const struct fat32_entry *entry, size_t *nb_entries, struct fat32_entry **out_directories);
 errval_t fat32_read_file(struct fat32_filesystem *fs, const struct fat32_entry *entry, size_t *size, void **out_data);
@@ -156,6 +189,7 @@ errval_t fat32_write(struct fat32_filesystem *fs, struct fat32_handle *handle, c
 errval_t fat32_file_seek(struct fat32_filesystem *fs, struct fat32_handle *handle, uint32_t pos);
 errval_t fat32_seek(struct fat32_filesystem *fs, struct fat32_handle *handle,enum fs_seekpos whence,off_t offset);
 errval_t fat32_tell(struct fat32_filesystem *fs, struct fat32_handle *handle, size_t *pos);
+errval_t fat32_sync(struct fat32_filesystem *fs);
 
 // Directory functions - read
 errval_t fat32_open_directory(struct fat32_filesystem *fs, const char *path, struct fat32_handle **handle);
@@ -166,7 +200,6 @@ errval_t fat32_setup_empty_directory(struct fat32_filesystem *fs, struct fat32_h
 errval_t fat32_is_directory(struct fat32_filesystem *fs, const char *path, bool *is_path_directory);
 
 // Cluster functions
-errval_t fat32_write_fat_table(struct fat32_filesystem *fs, uint32_t idx, void *block);
 errval_t fat32_cluster_clean(struct fat32_filesystem *fs, uint32_t cluster_number);
 errval_t fat32_cluster_malloc(struct fat32_filesystem *fs, uint32_t number_cluster, uint32_t *first_cluster_number);
 errval_t fat32_traverse_chain(struct fat32_filesystem *fs, uint32_t start_cluster_number, uint32_t *nb_clusters_traversed, uint32_t *last_cluster_number);
@@ -60,4 +60,51 @@ errval_t filesystem_init(void);
  */
 errval_t filesystem_mount(const char *path, const char *uri);
 
+/**
+ * @brief writes the data buffered for a file descriptor to the filesystem
+ *
+ * @param fd  file descriptor of an open file
+ *
+ * @return SYS_ERR_OK on success
+ *         errval on failure
+ *
+ * Writes are otherwise sent once the buffer is full, on seek and on close.
+ */
+errval_t fs_fsync(int fd);
+
+/**
+ * @brief statistics about the buffering of the file descriptors of this process
+ */
+struct fs_buffer_stats {
+    size_t rpcs_sent;   ///< filesystem requests sent for reads, writes and seeks
+    size_t rpcs_saved;  ///< requests avoided compared to sending every call to the server
+};
+
+void fs_get_buffer_stats(struct fs_buffer_stats *stats);
+
+/**
+ * @brief maps a file read-only into the address space
+ *
+ * @param path  path of the file to map
+ * @param buf   returns the address of the mapping
+ * @param size  returns the size of the file
+ *
+ * @return SYS_ERR_OK on success
+ *         errval on failure
+ *
+ * Pages are read on first access and shared with the other domains mapping the
+ * same file. A page shows the file as it was when the page was first mapped.
+ */
+errval_t fs_map_file(const char *path, void **buf, size_t *size);
+
+/**
+ * @brief removes a mapping created with fs_map_file
+ *
+ * @param buf  address returned by fs_map_file
+ *
+ * @return SYS_ERR_OK on success
+ *         errval on failure
+ */
+errval_t fs_unmap_file(void *buf);
+
 #endif /* INCLUDE_FS_FS_H_ */
@@ -21,6 +21,7 @@
 #include <aos/types.h>
 #include <aos/capabilities.h>
 #include <aos/slab.h>
+#include <aos/thread_sync.h>
 #include "slot_alloc.h"
 #include <pthread.h>
 
@@ -32,19 +33,39 @@ typedef errval_t (*slot_alloc_refill_fn_t)(struct slot_allocator *ca);
 struct region_info;
 struct block_info;
 
+/*
+ * Free blocks are kept twice: in a tree ordered by address, which finds the neighbours
+ * to merge with on free and serves allocations constrained to a range, and in one list
+ * per size class, the power of two below the size, which serves the other allocations
+ * without looking at blocks that are too small. The tree is a treap whose priorities
+ * are a hash of the address, so it stays balanced without rebalancing state.
+ */
+
+/// number of size classes, one per power of two
+#define MM_NUM_CLASSES 64
+
 struct region_info {
     struct capref cap;
     uintptr_t reg_addr;
     size_t reg_size;
+    // bytes of the region in free blocks
+    size_t free_size;
 
     struct region_info* next;
-    struct block_info* free_head;
 };
 
 struct block_info {
     uintptr_t block_addr;
     uintptr_t block_size;
+    struct region_info* region;
+
+    // tree of free blocks ordered by address
+    struct block_info* left;
+    struct block_info* right;
+    uint32_t priority;
 
+    // list of free blocks of the same size class
+    struct block_info* prev;
     struct block_info* next;
 };
 
@@ -64,12 +85,16 @@ struct mm {
     size_t slab_free_slots;
 
     struct region_info* region_head;
+    struct block_info* free_tree;
+    struct block_info* free_classes[MM_NUM_CLASSES];
 
     size_t mem_available;
     size_t mem_total;
 
     bool refilling_slot;
     bool refilling_slab;
+
+    struct thread_mutex mutex;       ///< protects the instance, taken nested
 };
 
 void mm_log(struct mm* mm);
@@ -131,6 +156,24 @@ errval_t mm_destroy(struct mm *mm) __attribute__((warn_unused_result));
 errval_t mm_add(struct mm *mm, struct capref cap) __attribute__((warn_unused_result));
 
 
+/**
+ * @brief removes memory resources that were added to the memory manager
+ *
+ * @param[in]  mm      memory manager instance to remove resources from
+ * @param[in]  base    base address of the capability that was added
+ * @param[out] retcap  returns the capability that was added
+ *
+ * @return error value indicating the success of the operation
+ *  - @retval SYS_ERR_OK              on success
+ *  - @retval MM_ERR_NOT_FOUND        if no capability with this base address was added
+ *  - @retval MM_ERR_ALREADY_ALLOCATED if parts of the memory are still allocated
+ *
+ * @note: the ownership of the capability is transferred back to the caller
+ */
+errval_t mm_remove(struct mm *mm, genpaddr_t base, struct capref *retcap)
+    __attribute__((warn_unused_result));
+
+
 /**
  * @brief allocates memory with the requested size and alignment
  *
@@ -295,6 +338,16 @@ size_t mm_mem_available(struct mm *mm);
 size_t mm_mem_total(struct mm *mm);
 
 
+/**
+ * @brief returns the size of the largest free block of the memory manager
+ *
+ * @param[in] mm   memory manager instance to query
+ *
+ * @return the size in bytes of the largest allocation that can be satisfied
+ */
+size_t mm_mem_largest_free(struct mm *mm);
+
+
 /**
  * @brief obtains the range of free memory of the memory allocator instance
  *
@@ -16,9 +16,10 @@
  * @brief represents an elf image in memory
  */
 struct elfimg {
-    struct capref mem;   ///< frame capability backing the elf image
-    void         *buf;   ///< pointer to the virtual address of the image in memory
-    size_t        size;  ///< the size of the image in bytes
+    struct capref  mem;    ///< frame capability backing the elf image
+    void          *buf;    ///< pointer to the virtual address of the image in memory
+    size_t         size;   ///< the size of the image in bytes
+    struct capref *pages;  ///< frame of each page of the image if not backed by mem, or NULL
 };
 
 /**
@@ -30,9 +31,10 @@ struct elfimg {
  */
 static inline void elfimg_init_with_cap(struct elfimg *img, struct capref mem, size_t size)
 {
-    img->mem  = mem;
-    img->buf  = NULL;
-    img->size = size;
+    img->mem   = mem;
+    img->buf   = NULL;
+    img->size  = size;
+    img->pages = NULL;
 }
 
 
@@ -47,9 +49,10 @@ static inline void elfimg_init_with_cap(struct elfimg *img, struct capref mem, s
  */
 static inline void elfimg_init_with_mem(struct elfimg *img, void *buf, size_t size)
 {
-    img->mem  = NULL_CAP;
-    img->buf  = buf;
-    img->size = size;
+    img->mem   = NULL_CAP;
+    img->buf   = buf;
+    img->size  = size;
+    img->pages = NULL;
 }
 
 /**
@@ -126,8 +126,19 @@ errval_t spawn_load_elf(struct bootinfo *bi, const char *name, struct elfimg *im
 errval_t spawn_load_with_bootinfo(struct spawninfo *si, struct bootinfo *bi, const char *name,
                                   domainid_t pid);
 
-errval_t spawn_load_filesystem(const char *path, struct elfimg *img, int *argc,
-                               char ***argv);
+/**
+ * @brief sets up the image of a program read from the filesystem
+ *
+ * @param[in]  path   path of the program on the card, followed by its arguments
+ * @param[in]  buf    buffer holding the content of the file
+ * @param[in]  size   size of the file in bytes
+ * @param[in]  pages  frame of each page of the file, shared with the child, may be NULL
+ * @param[out] img    image of the program
+ * @param[out] argc   number of arguments, may be NULL
+ * @param[out] argv   arguments parsed from the path, may be NULL
+ */
+errval_t spawn_load_filesystem(const char *path, void *buf, size_t size, struct capref *pages,
+                               struct elfimg *img, int *argc, char ***argv);
 
 errval_t spawn_load_mapped(struct spawninfo *si, struct elfimg *img, int argc,
                            const char *argv[], int capc, struct capref caps[], domainid_t pid,
@@ -222,6 +222,10 @@ void nosave_handle_irq(void)
 #endif
         wakeup_check(systime_now());
         dispatch(schedule());
+    } else if (irq == GIC_DOORBELL_SGI) {
+        platform_acknowledge_irq(irq);
+        wakeup_doorbell();
+        dispatch(schedule());
     } else {
         platform_acknowledge_irq(irq);
         send_user_interrupt(irq);
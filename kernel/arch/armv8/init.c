@@ -30,6 +30,7 @@
 #include <sysreg.h>
 #include <arch/armv8/kernel_multiboot2.h>
 #include <arch/armv8/paging_kernel_arch.h>
+#include <arch/arm/gic.h>
 #include <arch/arm/platform.h>
 #include <systime.h>
 #include <coreboot.h>
@@ -234,6 +235,9 @@ arch_init(struct armv8_core_data *core_data) {
     MSG("Enabling timers\n");
     platform_timer_init(config_timeslice);
 
+    MSG("Enabling the doorbell interrupt\n");
+    platform_enable_interrupt(GIC_DOORBELL_SGI, 0, false, false);
+
     MSG("Setting coreboot spawn handler\n");
     coreboot_set_spawn_handler(CPU_ARM8, platform_boot_core);
 
@@ -320,6 +320,76 @@ paging_set_flags(union armv8_ttable_entry *entry, uintptr_t kpi_paging_flags)
     entry->page.af = 1;
 }
 
+/*
+ * Maps a frame with block entries of an L1 (1 GB) or L2 (2 MB) table. The lower and
+ * upper attributes of a block entry are at the same place as the ones of a page.
+ */
+static errval_t
+caps_map_block(struct capability* dest,
+               cslot_t            slot,
+               struct capability* src,
+               uintptr_t          kpi_paging_flags,
+               uintptr_t          offset,
+               uintptr_t          pte_count,
+               struct cte*        mapping_cte,
+               size_t             block_size)
+{
+    assert(0 == (kpi_paging_flags & ~KPI_PAGING_FLAGS_MASK));
+
+    if (slot + pte_count > VMSAv8_64_PTABLE_NUM_ENTRIES) {
+        if (slot >= VMSAv8_64_PTABLE_NUM_ENTRIES) {
+            return SYS_ERR_VNODE_SLOT_INVALID;
+        }
+        else {
+            return SYS_ERR_VM_MAP_SIZE;
+        }
+    }
+
+    // check offset within frame
+    if ((offset + pte_count * block_size > get_size(src)) ||
+        ((offset % block_size) != 0)) {
+        return SYS_ERR_FRAME_OFFSET_INVALID;
+    }
+
+    // Destination
+    lpaddr_t dest_lpaddr = gen_phys_to_local_phys(get_address(dest));
+    lvaddr_t dest_lvaddr = local_phys_to_mem(dest_lpaddr);
+
+    union armv8_ttable_entry *entry = (union armv8_ttable_entry *)dest_lvaddr + slot;
+    for (size_t i = 0; i < pte_count; i++) {
+        if (entry[i].d.valid) {
+            debug(SUBSYS_PAGING, "ARMv8 block @ 0x%lx: slot %d in use\n", dest_lpaddr, slot + i);
+            return SYS_ERR_VNODE_SLOT_INUSE;
+        }
+    }
+
+    lpaddr_t src_lpaddr = gen_phys_to_local_phys(get_address(src) + offset);
+    if ((src_lpaddr & (block_size - 1))) {
+        return SYS_ERR_VM_FRAME_UNALIGNED;
+    }
+
+    create_mapping_cap(mapping_cte, src, cte_for_cap(dest), slot, pte_count);
+
+    for (size_t i = 0; i < pte_count; i++) {
+        entry->raw = 0;
+
+        paging_set_flags(entry, kpi_paging_flags);
+        entry->block_l2.valid = 1;
+        entry->block_l2.mb0 = 0;
+        // the address is aligned to the block, so it sits in the bits of the base field
+        entry->raw |= src_lpaddr + i * block_size;
+
+        debug(SUBSYS_PAGING, "block mapping %08"PRIxLVADDR"[%"PRIuCSLOT"] @%p = %08"PRIx64"\n",
+               dest_lvaddr, slot, entry, entry->raw);
+
+        entry++;
+    }
+
+    sysreg_invalidate_tlb();
+
+    return SYS_ERR_OK;
+}
+
 static errval_t
 caps_map_l0(struct capability* dest,
             cslot_t            slot,
@@ -393,7 +463,10 @@ caps_map_l1(struct capability* dest,
             uintptr_t          pte_count,
             struct cte*        mapping_cte)
 {
-    (void)kpi_paging_flags;
+    if (src->type == ObjType_Frame || src->type == ObjType_DevFrame) {
+        return caps_map_block(dest, slot, src, kpi_paging_flags, offset, pte_count,
+                              mapping_cte, VMSAv8_64_L1_BLOCK_SIZE);
+    }
 
     if (slot >= VMSAv8_64_PTABLE_NUM_ENTRIES) {
         debug(SUBSYS_PAGING, "slot = %"PRIuCSLOT"\n",slot);
@@ -456,8 +529,10 @@ static errval_t caps_map_l2(struct capability *dest, cslot_t slot, struct capabi
                             uintptr_t kpi_paging_flags, uintptr_t offset,
                             uintptr_t pte_count, struct cte *mapping_cte)
 {
-    // make compiler happy about unused parameters
-    (void)kpi_paging_flags;
+    if (src->type == ObjType_Frame || src->type == ObjType_DevFrame) {
+        return caps_map_block(dest, slot, src, kpi_paging_flags, offset, pte_count,
+                              mapping_cte, VMSAv8_64_L2_BLOCK_SIZE);
+    }
 
     if (slot >= VMSAv8_64_PTABLE_NUM_ENTRIES) {
         debug(SUBSYS_PAGING, "slot = %" PRIuCSLOT "\n", slot);
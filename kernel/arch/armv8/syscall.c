@@ -34,6 +34,7 @@
 #include <arch/arm/platform.h>
 #include <arch/arm/syscall_arm.h>
 #include <serial.h>
+#include <zero_pool.h>
 
 // helper macros  for invocation handler definitions
 #define INVOCATION_HANDLER(func) \
@@ -127,6 +128,38 @@ handle_dispatcher_properties(
                                      sa->arg4, sa->arg5, sa->arg6, weight);
 }
 
+static errval_t notify_core(coreid_t core_id)
+{
+    // the target list of an SGI only covers the first 16 cores of a cluster
+    if (core_id >= platform_get_core_count() || core_id > 15) {
+        return SYS_ERR_NOTIFY_CORE_INVALID;
+    }
+
+    gic_raise_softirq(core_id, GIC_DOORBELL_SGI);
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Ring the doorbell of a core on behalf of a dispatcher.
+ *
+ * Lets the dispatchers of a domain spanning several cores wake each other
+ * up without holding the IPI capability.
+ */
+static struct sysret
+handle_dispatcher_notify(
+    struct capability* to,
+    arch_registers_state_t* context,
+    int argc
+    )
+{
+    assert(2 == argc);
+    (void)to;
+
+    struct registers_aarch64_syscall_args* sa = &context->syscall_args;
+
+    return SYSRET(notify_core(sa->arg1));
+}
+
 static struct sysret
 handle_dispatcher_perfmon(
     struct capability* to,
@@ -810,6 +843,32 @@ INVOCATION_HANDLER(monitor_reclaim_ram)
     return sys_monitor_reclaim_ram(ret_cn_addr, ret_cn_level, ret_slot);
 }
 
+INVOCATION_HANDLER(monitor_zero_pool_add)
+{
+    (void)kernel_cap;
+    INVOCATION_PRELUDE(5);
+    capaddr_t root_addr = sa->arg1;
+    uint8_t root_bits   = sa->arg2;
+    capaddr_t cptr      = sa->arg3;
+    uint8_t bits        = sa->arg4;
+
+    return sys_monitor_zero_pool_add(root_addr, root_bits, cptr, bits);
+}
+
+INVOCATION_HANDLER(monitor_zero_pool_stats)
+{
+    (void)kernel_cap;
+    INVOCATION_PRELUDE(2);
+    // check args
+    if (!access_ok(ACCESS_WRITE, sa->arg1, sizeof(struct zero_pool_stats))) {
+        return SYSRET(SYS_ERR_INVALID_USER_BUFFER);
+    }
+
+    zero_pool_get_stats((struct zero_pool_stats*)sa->arg1);
+
+    return SYSRET(SYS_ERR_OK);
+}
+
 /**
  * \brief Spawn a new core and create a kernel cap for it.
  */
@@ -834,6 +893,18 @@ monitor_spawn_core(
     return sys_monitor_spawn_core(core_id, cpu_type, entry, context_id);
 }
 
+/**
+ * \brief Ring the doorbell of a core, waking the dispatchers waiting for it.
+ */
+INVOCATION_HANDLER(ipi_send_notify)
+{
+    (void)kernel_cap;
+
+    INVOCATION_PRELUDE(2);
+
+    return SYSRET(notify_core(sa->arg1));
+}
+
 static struct sysret
 monitor_identify_cap(
     struct capability *kernel_cap,
@@ -1052,7 +1123,8 @@ static invocation_t invocations[ObjType_Num][CAP_MAX_CMD] = {
         [DispatcherCmd_Properties]  = handle_dispatcher_properties,
         [DispatcherCmd_PerfMon]     = handle_dispatcher_perfmon,
         [DispatcherCmd_DumpPTables] = dispatcher_dump_ptables,
-        [DispatcherCmd_DumpCapabilities] = dispatcher_dump_capabilities
+        [DispatcherCmd_DumpCapabilities] = dispatcher_dump_capabilities,
+        [DispatcherCmd_Notify]      = handle_dispatcher_notify
     },
     [ObjType_KernelControlBlock] = {
         [KCBCmd_Identify] = handle_kcb_identify
@@ -1163,9 +1235,12 @@ static invocation_t invocations[ObjType_Num][CAP_MAX_CMD] = {
         [KernelCmd_Unlock_cap]        = monitor_unlock_cap,
         [KernelCmd_Get_platform]        = monitor_get_platform,
         [KernelCmd_ReclaimRAM]        = monitor_reclaim_ram,
+        [KernelCmd_Zero_pool_add]     = monitor_zero_pool_add,
+        [KernelCmd_Zero_pool_stats]   = monitor_zero_pool_stats,
     },
     [ObjType_IPI] = {
         [IPICmd_Send_Start]  = monitor_spawn_core,
+        [IPICmd_Send_Notify] = ipi_send_notify,
     },
     [ObjType_ID] = {
         [IDCmd_Identify] = handle_idcap_identify
@@ -178,8 +178,9 @@ errval_t caps_delete_last(struct cte *cte, struct cte *ret_ram_cap)
             dcb_current = NULL;
         }
 
-        // Remove from wakeup queue
+        // Remove from wakeup and doorbell queues
         wakeup_remove(dcb);
+        wakeup_doorbell_remove(dcb);
 
         // Notify monitor
         if (monitor_ep.u.endpointlmp.listener == dcb) {
@@ -31,6 +31,7 @@
 #include <trace/trace.h>
 #include <trace_definitions/trace_defs.h>
 #include <wakeup.h>
+#include <zero_pool.h>
 #include <bitmacros.h>
 
 // XXX: remove
@@ -526,17 +527,7 @@ static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
     TRACE(KERNEL_CAPOPS, ZERO_OBJECTS, retype_seqnum);
     assert(type < ObjType_Num);
 
-    // Virtual address of the memory the kernel object resides in
-    // XXX: A better of doing this,
-    // this is creating caps that the kernel cannot address.
-    // It assumes that the cap is not of the type which will have to zeroed out.
-    lvaddr_t lvaddr;
-    if(lpaddr < PADDR_SPACE_LIMIT) {
-        lvaddr = local_phys_to_mem(lpaddr);
-    } else {
-        lvaddr = 0;
-    }
-
+    // The zero pool skips the parts of the memory it has zeroed ahead of time
     switch (type) {
 
     case ObjType_Frame:
@@ -544,7 +535,7 @@ static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
         debug(SUBSYS_CAPS, "Frame: zeroing %zu bytes @%#"PRIxLPADDR"\n",
                 (size_t)objsize * count, lpaddr);
         TRACE(KERNEL, BZERO, 1);
-        memset((void*)lvaddr, 0, objsize * count);
+        zero_pool_clear(lpaddr, objsize * count);
         TRACE(KERNEL, BZERO, 0);
         break;
 
@@ -554,7 +545,7 @@ static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
                 type == ObjType_L1CNode ? 1 : 2, (size_t)objsize * count,
                 lpaddr);
         TRACE(KERNEL, BZERO, 1);
-        memset((void*)lvaddr, 0, objsize * count);
+        zero_pool_clear(lpaddr, objsize * count);
         TRACE(KERNEL, BZERO, 0);
         break;
 
@@ -583,7 +574,7 @@ static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
         debug(SUBSYS_CAPS, "VNode: zeroing %zu bytes @%#"PRIxLPADDR"\n",
                 (size_t)objsize * count, lpaddr);
         TRACE(KERNEL, BZERO, 1);
-        memset((void*)lvaddr, 0, objsize * count);
+        zero_pool_clear(lpaddr, objsize * count);
         TRACE(KERNEL, BZERO, 0);
         break;
 
@@ -591,7 +582,7 @@ static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
         debug(SUBSYS_CAPS, "Dispatcher: zeroing %zu bytes @%#"PRIxLPADDR"\n",
                 ((size_t) OBJSIZE_DISPATCHER) * count, lpaddr);
         TRACE(KERNEL, BZERO, 1);
-        memset((void*)lvaddr, 0, OBJSIZE_DISPATCHER * count);
+        zero_pool_clear(lpaddr, OBJSIZE_DISPATCHER * count);
         TRACE(KERNEL, BZERO, 0);
         break;
 
@@ -599,13 +590,17 @@ static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
         debug(SUBSYS_CAPS, "KCB: zeroing %zu bytes @%#"PRIxLPADDR"\n",
                 ((size_t) OBJSIZE_KCB) * count, lpaddr);
         TRACE(KERNEL, BZERO, 1);
-        memset((void*)lvaddr, 0, OBJSIZE_KCB * count);
+        zero_pool_clear(lpaddr, OBJSIZE_KCB * count);
         TRACE(KERNEL, BZERO, 0);
         break;
 
     default:
         debug(SUBSYS_CAPS, "Not zeroing %zu bytes @%#"PRIxLPADDR" for type %d\n",
                 (size_t)objsize * count, lpaddr, (int)type);
+        if (type != ObjType_RAM) {
+            // e.g. device frames are writable without having been zeroed
+            zero_pool_forget(lpaddr, objsize * count);
+        }
         break;
 
     }
@@ -686,6 +681,9 @@ static errval_t caps_create(enum objtype type, lpaddr_t lpaddr, gensize_t size,
         if (err_is_fail(err)) {
             return err;
         }
+    } else {
+        // the objects belong to another core, which may write to the memory
+        zero_pool_forget(lpaddr, objsize * count);
     }
 
     size_t dest_i = 0;
@@ -1406,6 +1404,9 @@ errval_t caps_create_from_existing(struct capability *root, capaddr_t cnode_cptr
 
     dest->mdbnode.owner = owner;
 
+    // forged or foreign caps bypass the retype that would clear the memory
+    zero_pool_forget_cap(&dest->cap);
+
     err = mdb_insert(dest);
     assert(err_is_ok(err));
 
@@ -20,6 +20,7 @@
 #include <kcb.h>
 #include <wakeup.h>
 #include <systime.h>
+#include <zero_pool.h>
 #include <barrelfish_kpi/syscalls.h>
 #include <barrelfish_kpi/lmp.h>
 #include <trace/trace.h>
@@ -63,6 +64,7 @@ void __attribute__ ((noreturn)) dispatch(struct dcb *dcb)
     // If we have nothing to do we should call something other than dispatch
     if (dcb == NULL) {
         dcb_current = NULL;
+        zero_pool_idle();
         wait_for_interrupt();
     }
 
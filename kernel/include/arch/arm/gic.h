@@ -23,6 +23,9 @@
 #define GIC_IRQ_1_TO_N            (0x1)
 #define GIC_IRQ_N_TO_N            (0x0)
 
+// Software generated interrupt used as the doorbell of user-level channels
+#define GIC_DOORBELL_SGI          (1)
+
 /*
  * generic interrupt controller functionality
  */
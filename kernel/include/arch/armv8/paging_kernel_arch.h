@@ -183,24 +183,33 @@ static inline size_t get_pte_size(void) {
     return PTABLE_ENTRY_SIZE;
 }
 
+/// larger ranges are flushed from the TLBs as a whole
+#define TLB_FLUSH_SELECTIVE_MAX (64 * BASE_PAGE_SIZE)
+
+/*
+ * Unmapping and changing mappings flushes the TLBs of all cores, as the page
+ * tables may be in use by a spanned domain on another core.
+ */
+
 static inline void do_one_tlb_flush(genvaddr_t vaddr)
 {
-    (void)vaddr;
-    // TODO: figure out selective flushing for ARMv8
-    sysreg_invalidate_tlb();
+    sysreg_invalidate_tlb_va_is(vaddr);
 }
 
 static inline void do_selective_tlb_flush(genvaddr_t vaddr, genvaddr_t vend)
 {
-    (void)vaddr;
-    (void)vend;
-    // TODO: figure out selective flushing for ARMv8
-    sysreg_invalidate_tlb();
+    if (vend - vaddr > TLB_FLUSH_SELECTIVE_MAX) {
+        sysreg_invalidate_tlb_is();
+        return;
+    }
+    for (; vaddr < vend; vaddr += BASE_PAGE_SIZE) {
+        sysreg_invalidate_tlb_va_is(vaddr);
+    }
 }
 
 static inline void do_full_tlb_flush(void)
 {
-    sysreg_invalidate_tlb();
+    sysreg_invalidate_tlb_is();
 }
 
 
@@ -266,6 +266,33 @@ sysreg_invalidate_tlb(void) {
     __asm volatile("tlbi vmalle1");
 }
 
+/**
+ * \brief Invalidate the TLBs of all cores in the inner shareable domain.
+ *
+ * The dispatchers of a spanned domain share its page tables, so translations
+ * that are removed or changed have to leave the TLBs of the other cores too.
+ */
+static inline void
+sysreg_invalidate_tlb_is(void) {
+    __asm volatile("dsb ishst\n"
+                   "tlbi vmalle1is\n"
+                   "dsb ish\n"
+                   "isb" : : : "memory");
+}
+
+/**
+ * \brief Invalidate the translation of a virtual address, for all ASIDs, in
+ * the TLBs of all cores in the inner shareable domain.
+ */
+static inline void
+sysreg_invalidate_tlb_va_is(uint64_t vaddr) {
+    uint64_t page = (vaddr >> 12) & 0xfffffffffffULL;
+    __asm volatile("dsb ishst\n"
+                   "tlbi vaae1is, %[page]\n"
+                   "dsb ish\n"
+                   "isb" : : [page] "r" (page) : "memory");
+}
+
 static inline uint8_t
 sysreg_get_cpu_id(void) {
     uint8_t mpidr;
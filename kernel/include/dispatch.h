@@ -50,6 +50,8 @@ struct dcb {
     uint64_t            domain_id;      ///< ID of dispatcher's domain
     systime_t           wakeup_time;    ///< Time to wakeup this dispatcher
     struct dcb          *wakeup_prev, *wakeup_next; ///< Next/prev in timeout queue
+    struct dcb          *doorbell_next; ///< Next in doorbell queue
+    bool                doorbell_wait;  ///< Whether this DCB is in the doorbell queue
 
     struct dcb          *next;          ///< Next DCB in schedule
     struct dcb          *prev;          ///< Previous DCB in schedule
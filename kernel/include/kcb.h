@@ -62,6 +62,10 @@ struct kcb {
     /// make the scheduler work correctly
     /// wakeup queue head
     struct dcb *wakeup_queue_head;
+    /// dispatchers waiting for the doorbell of this core
+    struct dcb *doorbell_queue_head;
+    /// doorbell rang while none of the waiting dispatchers was asleep
+    bool doorbell_missed;
     /// last value of kernel_now before shutdown/migration
     //needs to be signed because it's possible to migrate a kcb onto a cpu
     //driver whose kernel_now > this kcb's kernel_off.
@@ -138,4 +138,6 @@ struct sysret sys_monitor_clear_step(capaddr_t ret_cn_addr,
 struct sysret sys_monitor_reclaim_ram(capaddr_t retcn_addr,
                                       uint8_t retcn_level,
                                       cslot_t ret_slot);
+struct sysret sys_monitor_zero_pool_add(capaddr_t root_addr, uint8_t root_level,
+                                        capaddr_t cptr, uint8_t level);
 #endif
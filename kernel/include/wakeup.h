@@ -16,5 +16,9 @@ void wakeup_remove(struct dcb *dcb);
 void wakeup_set(struct dcb *dcb, systime_t waketime);
 void wakeup_check(systime_t now);
 bool wakeup_is_pending(void);
+void wakeup_doorbell_wait(struct dcb *dcb);
+void wakeup_doorbell_remove(struct dcb *dcb);
+void wakeup_doorbell(void);
+bool wakeup_doorbell_missed(void);
 
 #endif
@@ -0,0 +1,29 @@
+/**
+ * \file
+ * \brief Pool of memory zeroed ahead of retypes
+ */
+
+/*
+ * Copyright (c) 2022, The University of British Columbia
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef KERNEL_ZERO_POOL_H
+#define KERNEL_ZERO_POOL_H
+
+#include <barrelfish_kpi/zero_pool.h>
+
+struct capability;
+
+errval_t zero_pool_add(lpaddr_t base, size_t bytes);
+void zero_pool_clear(lpaddr_t base, size_t bytes);
+void zero_pool_forget(lpaddr_t base, size_t bytes);
+void zero_pool_forget_cap(struct capability *cap);
+void zero_pool_idle(void);
+void zero_pool_get_stats(struct zero_pool_stats *stats);
+
+#endif
@@ -20,6 +20,7 @@
 #include <mdb/mdb_tree.h>
 #include <dispatch.h>
 #include <distcaps.h>
+#include <zero_pool.h>
 
 static errval_t sys_double_lookup(capaddr_t rptr, uint8_t rlevel,
                                   capaddr_t tptr, uint8_t tlevel,
@@ -102,6 +103,11 @@ struct sysret sys_monitor_remote_relations(capaddr_t root_addr, uint8_t root_lev
         mdb_set_relations(cte, relations, mask);
     }
 
+    if (relations & mask) {
+        // other cores may get to write the memory
+        zero_pool_forget_cap(&cte->cap);
+    }
+
     relations = 0;
     if (cte->mdbnode.remote_copies) {
         relations |= RRELS_COPY_BIT;
@@ -223,6 +229,10 @@ struct sysret sys_set_cap_owner(capaddr_t root_addr, uint8_t root_level, capaddr
 
     cte->mdbnode.owner = owner;
 
+    if (owner != my_core_id) {
+        zero_pool_forget_cap(&cte->cap);
+    }
+
     TRACE_CAP(cte);
 
     struct cte *pred = cte;
@@ -525,3 +535,42 @@ struct sysret sys_monitor_reclaim_ram(capaddr_t retcn_addr,
 
     return SYSRET(caps_reclaim_ram(retslot));
 }
+
+struct sysret sys_monitor_zero_pool_add(capaddr_t root_addr, uint8_t root_level,
+                                        capaddr_t cptr, uint8_t level)
+{
+    errval_t err;
+
+    struct cte *cte;
+    err = sys_double_lookup(root_addr, root_level, cptr, level, &cte);
+    if (err_is_fail(err)) {
+        return SYSRET(err);
+    }
+
+    if (cte->cap.type != ObjType_RAM) {
+        return SYSRET(SYS_ERR_INVALID_SOURCE_TYPE);
+    }
+
+    // other cores must not be able to write to the memory behind our back
+    if (cte->mdbnode.owner != my_core_id || cte->mdbnode.locked
+        || cte->mdbnode.remote_copies || cte->mdbnode.remote_descs) {
+        return SYSRET(SYS_ERR_ZERO_POOL_SHARED);
+    }
+
+    // nothing but RAM may exist for the memory, its descendants follow it in the mdb
+    genpaddr_t base = get_address(&cte->cap);
+    gensize_t bytes = get_size(&cte->cap);
+    for (struct cte *next = mdb_successor(cte);
+         next != NULL && get_address(&next->cap) < base + bytes;
+         next = mdb_successor(next)) {
+        if (next->cap.type != ObjType_RAM) {
+            return SYSRET(SYS_ERR_REVOKE_FIRST);
+        }
+        if (next->mdbnode.owner != my_core_id || next->mdbnode.locked
+            || next->mdbnode.remote_copies || next->mdbnode.remote_descs) {
+            return SYSRET(SYS_ERR_ZERO_POOL_SHARED);
+        }
+    }
+
+    return SYSRET(zero_pool_add(gen_phys_to_local_phys(base), bytes));
+}
@@ -118,21 +118,7 @@ memmove(void *dst, const void *src, size_t sz)
 }
 #endif
 
-void *
-memcpy(void *dst, const void *src, size_t len)
-{
-    char *d = dst;
-    const char *s = src;
-
-    /* check that we don't overlap (should use memmove()) */
-    assert((src < dst && (char *)src + len <= (char *)dst)
-           || (dst < src && (char *)dst + len <= (char *)src));
-
-    while (len--)
-        *d++ = *s++;
-
-    return dst;
-}
+// memcpy, memmove and memset are in arch/armv8
 
 char *
 strchr(const char *s, int c)
@@ -760,9 +760,12 @@ struct sysret sys_yield(capaddr_t target)
     // this is what the dispatcher wants), otherwise why call yield?
     dcb_current->disabled = false;
 
+    // The doorbell may have rung after the dispatcher looked at its channels
+    bool doorbell_missed = disp->doorbell && wakeup_doorbell_missed();
+
     // Remove from queue when no work and no more messages and no missed wakeup
     systime_t wakeup = disp->wakeup;
-    if (!disp->haswork && disp->lmp_delivered == disp->lmp_seen
+    if (!disp->haswork && disp->lmp_delivered == disp->lmp_seen && !doorbell_missed
         && (wakeup == 0 || wakeup > (systime_now() + kcb_current->kernel_off))) {
 
         trace_event(TRACE_SUBSYS_NNET, TRACE_EVENT_NNET_SCHED_REMOVE,
@@ -774,6 +777,9 @@ struct sysret sys_yield(capaddr_t target)
         if (wakeup != 0) {
             wakeup_set(dcb_current, wakeup);
         }
+        if (disp->doorbell) {
+            wakeup_doorbell_wait(dcb_current);
+        }
     } else {
         // Otherwise yield for the timeslice
         scheduler_yield(dcb_current);
@@ -110,3 +110,68 @@ bool wakeup_is_pending(void)
 {
     return kcb_current->wakeup_queue_head != NULL;
 }
+
+/// Wake the given DCB on the next doorbell of this core
+void wakeup_doorbell_wait(struct dcb *dcb)
+{
+    assert(dcb != NULL);
+
+    if (!dcb->doorbell_wait) {
+        dcb->doorbell_wait = true;
+        dcb->doorbell_next = kcb_current->doorbell_queue_head;
+        kcb_current->doorbell_queue_head = dcb;
+    }
+}
+
+void wakeup_doorbell_remove(struct dcb *dcb)
+{
+    if (!dcb->doorbell_wait) {
+        return;
+    }
+
+    for (struct dcb **d = &kcb_current->doorbell_queue_head; *d != NULL;
+         d = &(*d)->doorbell_next) {
+        if (*d == dcb) {
+            *d = dcb->doorbell_next;
+            break;
+        }
+    }
+    dcb->doorbell_next = NULL;
+    dcb->doorbell_wait = false;
+}
+
+/// The doorbell of this core rang, wake all dispatchers waiting for it
+void wakeup_doorbell(void)
+{
+    struct dcb *d = kcb_current->doorbell_queue_head, *next = NULL;
+    bool woken = false;
+    for (; d != NULL; d = next) {
+        next = d->doorbell_next;
+        d->doorbell_next = NULL;
+        d->doorbell_wait = false;
+
+        struct dispatcher_shared_generic *disp =
+            get_dispatcher_shared_generic(d->disp);
+        // dispatchers that are running again have already looked at their channels
+        if (disp->doorbell) {
+            disp->doorbell = 0;
+            woken = true;
+        }
+        make_runnable(d);
+        schedule_now(d);
+    }
+    kcb_current->doorbell_queue_head = NULL;
+
+    // a dispatcher may be about to yield after deciding to wait for the doorbell
+    if (!woken) {
+        kcb_current->doorbell_missed = true;
+    }
+}
+
+/// Returns whether the doorbell rang without waking anyone, and forgets about it
+bool wakeup_doorbell_missed(void)
+{
+    bool missed = kcb_current->doorbell_missed;
+    kcb_current->doorbell_missed = false;
+    return missed;
+}
@@ -0,0 +1,345 @@
+/**
+ * \file
+ * \brief Pool of memory zeroed ahead of retypes
+ *
+ * Creating Frames, CNodes and other kernel objects requires the memory to be
+ * zeroed, which caps_zero_objects() used to do with one memset during the
+ * retype. For large frames, this stalls the core for the whole time.
+ *
+ * The memory server donates the RAM it does not hand out to the pool. The
+ * donated ranges are zeroed in chunks whenever the core has nothing to run,
+ * and a later retype only zeroes the parts of the objects that are not known
+ * to be zero already.
+ *
+ * Memory only stays in the pool as long as no caps other than RAM exist for
+ * it on this core, and no other core knows about it. Every operation that
+ * could make it writable removes it from the pool: retypes clear it, foreign
+ * caps and caps handed to other cores forget it.
+ */
+
+/*
+ * Copyright (c) 2022, The University of British Columbia
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <kernel.h>
+#include <string.h>
+#include <systime.h>
+#include <cap_predicates.h>
+#include <zero_pool.h>
+
+#if defined(__aarch64__)
+#include <sysreg.h>
+#endif
+
+/// number of disjoint ranges each of the lists can hold
+#define ZERO_POOL_RANGES 128
+
+/// granularity at which the idle loop zeroes memory
+#define ZERO_POOL_IDLE_CHUNK (64 * 1024)
+
+/// maximum amount of memory zeroed each time the core goes idle
+#define ZERO_POOL_IDLE_BUDGET (1024 * 1024)
+
+struct zero_range {
+    lpaddr_t base;
+    size_t   bytes;
+};
+
+/// ranges sorted by address, adjacent ranges are merged
+struct zero_list {
+    struct zero_range ranges[ZERO_POOL_RANGES];
+    size_t            count;
+};
+
+/// donated memory that has not been zeroed yet
+static struct zero_list pending;
+
+/// memory that is known to contain only zeroes
+static struct zero_list zeroed;
+
+static struct {
+    uint64_t  sync_bytes;
+    systime_t sync_time;
+    uint64_t  idle_bytes;
+    systime_t idle_time;
+    uint64_t  prezeroed_bytes;
+} zero_stats;
+
+static void list_delete(struct zero_list *list, size_t i)
+{
+    memmove(&list->ranges[i], &list->ranges[i + 1],
+            (list->count - i - 1) * sizeof(struct zero_range));
+    list->count--;
+}
+
+/**
+ * \brief Removes [base, end) from the ranges of the list.
+ *
+ * If splitting a range would need more entries than there are, the upper part
+ * of it is dropped. Forgetting memory is always safe, it merely gets zeroed
+ * again when it is retyped.
+ */
+static void list_remove(struct zero_list *list, lpaddr_t base, lpaddr_t end)
+{
+    size_t i = 0;
+    while (i < list->count) {
+        struct zero_range *r = &list->ranges[i];
+        lpaddr_t r_end = r->base + r->bytes;
+
+        if (r_end <= base) {
+            i++;
+            continue;
+        }
+        if (r->base >= end) {
+            break;
+        }
+
+        if (r->base < base && r_end > end) {
+            // hole in the middle of the range
+            if (list->count < ZERO_POOL_RANGES) {
+                memmove(&list->ranges[i + 2], &list->ranges[i + 1],
+                        (list->count - i - 1) * sizeof(struct zero_range));
+                list->ranges[i + 1].base  = end;
+                list->ranges[i + 1].bytes = r_end - end;
+                list->count++;
+            }
+            r->bytes = base - r->base;
+            break;
+        } else if (r->base < base) {
+            r->bytes = base - r->base;
+            i++;
+        } else if (r_end > end) {
+            r->base  = end;
+            r->bytes = r_end - end;
+            break;
+        } else {
+            list_delete(list, i);
+        }
+    }
+}
+
+/**
+ * \brief Adds [base, end) to the list, merging it with the ranges it touches.
+ *
+ * \return false if the list has no entry left for it
+ */
+static bool list_insert(struct zero_list *list, lpaddr_t base, lpaddr_t end)
+{
+    size_t i = 0;
+    while (i < list->count && list->ranges[i].base + list->ranges[i].bytes < base) {
+        i++;
+    }
+
+    if (i < list->count && list->ranges[i].base <= end) {
+        struct zero_range *r = &list->ranges[i];
+        lpaddr_t new_base = r->base < base ? r->base : base;
+        lpaddr_t new_end  = r->base + r->bytes > end ? r->base + r->bytes : end;
+        while (i + 1 < list->count && list->ranges[i + 1].base <= new_end) {
+            struct zero_range *next = &list->ranges[i + 1];
+            if (next->base + next->bytes > new_end) {
+                new_end = next->base + next->bytes;
+            }
+            list_delete(list, i + 1);
+        }
+        r->base  = new_base;
+        r->bytes = new_end - new_base;
+        return true;
+    }
+
+    if (list->count == ZERO_POOL_RANGES) {
+        return false;
+    }
+    memmove(&list->ranges[i + 1], &list->ranges[i],
+            (list->count - i) * sizeof(struct zero_range));
+    list->ranges[i].base  = base;
+    list->ranges[i].bytes = end - base;
+    list->count++;
+    return true;
+}
+
+static bool list_contains(struct zero_list *list, lpaddr_t base, lpaddr_t end)
+{
+    for (size_t i = 0; i < list->count; i++) {
+        struct zero_range *r = &list->ranges[i];
+        if (r->base <= base && end <= r->base + r->bytes) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void zero_memory(lpaddr_t base, lpaddr_t end)
+{
+    memset((void *)local_phys_to_mem(base), 0, end - base);
+}
+
+static bool irq_pending(void)
+{
+#if defined(__aarch64__)
+    // ISR_EL1 shows pending interrupts even though they are masked in the kernel
+    return (sysreg_read_isr_el1() & 0xc0) != 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * \brief Donates memory to the pool, to be zeroed when the core is idle.
+ *
+ * The caller has to make sure that no caps other than RAM caps exist for the
+ * memory, and that none of them is known to another core.
+ */
+errval_t zero_pool_add(lpaddr_t base, size_t bytes)
+{
+    lpaddr_t end = base + bytes;
+    if (bytes == 0 || !local_phys_is_valid(end - 1)) {
+        return SYS_ERR_ZERO_POOL_RANGE;
+    }
+
+    if (list_contains(&zeroed, base, end)) {
+        return SYS_ERR_OK;
+    }
+
+    list_remove(&zeroed, base, end);
+    list_remove(&pending, base, end);
+    if (!list_insert(&pending, base, end)) {
+        return SYS_ERR_ZERO_POOL_FULL;
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Zeroes memory that is about to hold new objects, and removes it from
+ *        the pool.
+ *
+ * Only the parts of the memory that are not known to be zero are written.
+ */
+void zero_pool_clear(lpaddr_t base, size_t bytes)
+{
+    lpaddr_t end = base + bytes;
+    systime_t start = systime_now();
+    uint64_t written = 0;
+
+    lpaddr_t pos = base;
+    for (size_t i = 0; i < zeroed.count && zeroed.ranges[i].base < end; i++) {
+        struct zero_range *r = &zeroed.ranges[i];
+        lpaddr_t r_end = r->base + r->bytes;
+        if (r_end <= pos) {
+            continue;
+        }
+
+        lpaddr_t hit_base = r->base > pos ? r->base : pos;
+        lpaddr_t hit_end  = r_end < end ? r_end : end;
+        if (hit_base > pos) {
+            zero_memory(pos, hit_base);
+            written += hit_base - pos;
+        }
+        zero_stats.prezeroed_bytes += hit_end - hit_base;
+        pos = hit_end;
+    }
+    if (pos < end) {
+        zero_memory(pos, end);
+        written += end - pos;
+    }
+
+    list_remove(&zeroed, base, end);
+    list_remove(&pending, base, end);
+
+    if (written > 0) {
+        zero_stats.sync_bytes += written;
+        zero_stats.sync_time += systime_now() - start;
+    }
+}
+
+/**
+ * \brief Removes memory from the pool without zeroing it.
+ */
+void zero_pool_forget(lpaddr_t base, size_t bytes)
+{
+    list_remove(&zeroed, base, base + bytes);
+    list_remove(&pending, base, base + bytes);
+}
+
+/**
+ * \brief Removes the memory a capability refers to from the pool.
+ */
+void zero_pool_forget_cap(struct capability *cap)
+{
+    gensize_t bytes = get_size(cap);
+    if (bytes > 0) {
+        zero_pool_forget(gen_phys_to_local_phys(get_address(cap)), bytes);
+    }
+}
+
+/**
+ * \brief Zeroes donated memory while there is nothing else to do.
+ *
+ * Called before the core waits for interrupts. Stops once the budget is
+ * used up or an interrupt is pending, so that the wakeup is delayed by one
+ * chunk at most.
+ */
+void zero_pool_idle(void)
+{
+    if (pending.count == 0) {
+        return;
+    }
+
+    systime_t start = systime_now();
+    uint64_t done = 0;
+
+    while (pending.count > 0 && done < ZERO_POOL_IDLE_BUDGET && !irq_pending()) {
+        if (zeroed.count == ZERO_POOL_RANGES) {
+            // the zeroed memory could not be recorded
+            break;
+        }
+
+        struct zero_range *r = &pending.ranges[0];
+        lpaddr_t base = r->base;
+        size_t bytes = r->bytes < ZERO_POOL_IDLE_CHUNK ? r->bytes : ZERO_POOL_IDLE_CHUNK;
+
+        zero_memory(base, base + bytes);
+
+        r->base += bytes;
+        r->bytes -= bytes;
+        if (r->bytes == 0) {
+            list_delete(&pending, 0);
+        }
+
+        bool inserted = list_insert(&zeroed, base, base + bytes);
+        assert(inserted);
+        (void)inserted;
+
+        done += bytes;
+    }
+
+    if (done > 0) {
+        zero_stats.idle_bytes += done;
+        zero_stats.idle_time += systime_now() - start;
+    }
+}
+
+static uint64_t list_bytes(struct zero_list *list)
+{
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        bytes += list->ranges[i].bytes;
+    }
+    return bytes;
+}
+
+void zero_pool_get_stats(struct zero_pool_stats *stats)
+{
+    stats->pending_bytes   = list_bytes(&pending);
+    stats->zeroed_bytes    = list_bytes(&zeroed);
+    stats->sync_bytes      = zero_stats.sync_bytes;
+    stats->sync_ns         = systime_to_ns(zero_stats.sync_time);
+    stats->idle_bytes      = zero_stats.idle_bytes;
+    stats->idle_ns         = systime_to_ns(zero_stats.idle_time);
+    stats->prezeroed_bytes = zero_stats.prezeroed_bytes;
+}
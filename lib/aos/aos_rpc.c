@@ -19,11 +19,50 @@
 #include <aos/simple_async_channel.h>
 #include <argparse/argparse.h>
 
+#include "domain_priv.h"
+
 #define RPC_LMP_MSG_MORE      (1ull << 63)
 #define RPC_LMP_MSG_HASCAP    (1ull << 62)
-#define RPC_LMP_MSG_SIZE_MASK (~(RPC_LMP_MSG_MORE | RPC_LMP_MSG_HASCAP))
+#define RPC_LMP_MSG_BULK      (1ull << 61)
+#define RPC_LMP_MSG_SIZE_MASK (~(RPC_LMP_MSG_MORE | RPC_LMP_MSG_HASCAP | RPC_LMP_MSG_BULK))
 #define RPC_LMP_MSG_MAX_SIZE  ((LMP_MSG_LENGTH - 1) * sizeof(uintptr_t))
 
+/*
+ * Large messages over LMP go through a frame shared by the two ends of the
+ * channel instead of being split into many LMP messages. The server allocates
+ * the frame when it starts listening and hands it to the client along with the
+ * ack of the channel setup. Each direction has its own half of the frame, and a
+ * single LMP message tells the receiver where the data is. The sender only uses
+ * its half once the receiver copied the previous message out of it, otherwise
+ * the message is split as usual.
+ */
+
+// Messages of at least this size go through the shared frame
+#define RPC_LMP_BULK_THRESHOLD   (4 * RPC_LMP_MSG_MAX_SIZE)
+#define RPC_LMP_BULK_FRAME_SIZE  (4 * BASE_PAGE_SIZE)
+#define RPC_LMP_BULK_AREA_SIZE   (RPC_LMP_BULK_FRAME_SIZE / 2)
+#define RPC_LMP_BULK_HEADER_SIZE 64
+
+struct rpc_lmp_bulk_area {
+    // set by the sender once the data is written, cleared by the receiver once it copied it
+    volatile uintptr_t full;
+    uint8_t            reserved[RPC_LMP_BULK_HEADER_SIZE - sizeof(uintptr_t)];
+    uint8_t            data[RPC_LMP_BULK_AREA_SIZE - RPC_LMP_BULK_HEADER_SIZE];
+};
+STATIC_ASSERT_SIZEOF(struct rpc_lmp_bulk_area, RPC_LMP_BULK_AREA_SIZE);
+
+// Number of UMP lines written or read at once
+#define RPC_UMP_BATCH 16
+
+/*
+ * A message over UMP starts with the number of capabilities sent along, followed
+ * by the capabilities serialized by the codec of the channel, and then the data.
+ * All the capabilities of a message thus go over the channel at once.
+ */
+struct rpc_ump_header {
+    size_t capc;
+};
+
 struct aos_rpc      rpc_to_init;
 struct thread_mutex rpc_mutex;
 struct simple_async_channel proc_async;
@@ -59,12 +98,30 @@ static errval_t transport_try_send(struct aos_rpc *rpc, bool *more)
         bool hascap = rpc->send_caps_offset < rpc->send_caps_size;
         struct capref sendcap    = hascap ? rpc->send_buf.caps[rpc->send_caps_offset] : NULL_CAP;
         size_t        send_size  = MIN(rpc->send_size - rpc->send_offset, RPC_LMP_MSG_MAX_SIZE);
-        size_t        new_offset = rpc->send_offset + send_size;
-        size_t        new_caps_offset = MIN(rpc->send_caps_offset + 1, rpc->send_caps_size);
+
+        // the whole message goes through the shared frame if it is large and the frame is free
+        struct rpc_lmp_bulk_area *bulk = rpc->lmp.bulk_send;
+        bool use_bulk = bulk != NULL && rpc->send_offset == 0
+                        && rpc->send_size >= RPC_LMP_BULK_THRESHOLD
+                        && rpc->send_size <= sizeof(bulk->data) && !bulk->full;
+        if (use_bulk) {
+            send_size = rpc->send_size;
+            memcpy(bulk->data, rpc->send_buf.data, send_size);
+            // the data must be visible before the message announcing it
+            dmb();
+            bulk->full = 1;
+            // offset of the data in the half of the frame
+            words[0] = 0;
+        } else {
+            memcpy(words, rpc->send_buf.data + rpc->send_offset, send_size);
+        }
+
+        size_t new_offset      = rpc->send_offset + send_size;
+        size_t new_caps_offset = MIN(rpc->send_caps_offset + 1, rpc->send_caps_size);
 
         *more       = new_offset < rpc->send_size || new_caps_offset < rpc->send_caps_size;
-        size_t meta = send_size | (*more ? RPC_LMP_MSG_MORE : 0) | (hascap ? RPC_LMP_MSG_HASCAP : 0);
-        memcpy(words, rpc->send_buf.data + rpc->send_offset, send_size);
+        size_t meta = send_size | (*more ? RPC_LMP_MSG_MORE : 0) | (hascap ? RPC_LMP_MSG_HASCAP : 0)
+                      | (use_bulk ? RPC_LMP_MSG_BULK : 0);
 
         // debug_print_cap_at_capref(lc->remote_cap);
         err = lmp_ep_send(lc->remote_cap, LMP_FLAG_SYNC, sendcap, LMP_MSG_LENGTH, meta, words[0],
@@ -73,26 +130,35 @@ static errval_t transport_try_send(struct aos_rpc *rpc, bool *more)
         if (!err_is_fail(err)) {
             rpc->send_offset      = new_offset;
             rpc->send_caps_offset = new_caps_offset;
-        } 
+        } else if (use_bulk) {
+            // the receiver never learnt about the data, the message is sent again later
+            bulk->full = 0;
+        }
 
     } else if (rpc->transport == AOS_RPC_UMP) {
-        struct ump_chan *uc         = &rpc->ump.channel;
-        struct ump_msg   msg        = {};
-        size_t           send_size  = MIN(rpc->send_size - rpc->send_offset, UMP_MSG_MAX_SIZE);
-        size_t           new_offset = rpc->send_offset + send_size;
-
-        memcpy(msg.data, rpc->send_buf.data + rpc->send_offset, send_size);
-        msg.size = send_size;
-        msg.more = new_offset < rpc->send_size;
-
-        // TODO what do we do if there is a cap? We should probably emit an error
-
-        err = ump_chan_send(uc, &msg);
+        struct ump_chan *uc = &rpc->ump.channel;
+        struct ump_msg   msgs[RPC_UMP_BATCH];
+
+        // split as much of the message as fits into a batch
+        size_t count  = 0;
+        size_t offset = rpc->send_offset;
+        do {
+            size_t send_size = MIN(rpc->ump.wire_size - offset, UMP_MSG_MAX_SIZE);
+            memcpy(msgs[count].data, rpc->ump.wire + offset, send_size);
+            offset += send_size;
+            msgs[count].size = send_size;
+            msgs[count].more = offset < rpc->ump.wire_size;
+            count++;
+        } while (count < RPC_UMP_BATCH && offset < rpc->ump.wire_size);
+
+        size_t sent;
+        err = ump_chan_send_batch(uc, msgs, count, &sent);
 
         if (!err_is_fail(err)) {
-            rpc->send_offset = new_offset;
+            rpc->send_offset += sent * UMP_MSG_MAX_SIZE;
+            rpc->send_offset = MIN(rpc->send_offset, rpc->ump.wire_size);
         }
-        *more = msg.more;
+        *more = err_is_fail(err) || msgs[sent - 1].more;
     } else {
         assert(!"Invalid transport");
     }
@@ -122,7 +188,21 @@ static errval_t transport_try_recv(struct aos_rpc *rpc, bool *more)
         size_t hascap = (meta & RPC_LMP_MSG_HASCAP) != 0;
 
         ensure_recv_capacity(rpc, rpc->recv_offset + size);
-        memcpy(rpc->recv_buf.data + rpc->recv_offset, &words[1], size);
+        if (meta & RPC_LMP_MSG_BULK) {
+            struct rpc_lmp_bulk_area *bulk   = rpc->lmp.bulk_recv;
+            size_t                    offset = words[1];
+            if (bulk == NULL || offset > sizeof(bulk->data) || size > sizeof(bulk->data) - offset) {
+                return LIB_ERR_RPC_RECV_LMP;
+            }
+            // avoid the data being read before the message
+            dmb();
+            memcpy(rpc->recv_buf.data + rpc->recv_offset, bulk->data + offset, size);
+            // the data must be read before the sender may reuse the frame
+            dmb();
+            bulk->full = 0;
+        } else {
+            memcpy(rpc->recv_buf.data + rpc->recv_offset, &words[1], size);
+        }
         rpc->recv_offset += size;
 
         if (hascap) {
@@ -139,8 +219,9 @@ static errval_t transport_try_recv(struct aos_rpc *rpc, bool *more)
 
     } else if (rpc->transport == AOS_RPC_UMP) {
         struct ump_chan *uc = &rpc->ump.channel;
-        struct ump_msg   msg;
-        err = ump_chan_recv(uc, &msg);
+        struct ump_msg   msgs[RPC_UMP_BATCH];
+        size_t           received;
+        err = ump_chan_recv_batch(uc, msgs, RPC_UMP_BATCH, &received);
 
         if (err_is_fail(err)) {
             // set more to true to indicate that we should try again
@@ -148,10 +229,12 @@ static errval_t transport_try_recv(struct aos_rpc *rpc, bool *more)
             return err;
         }
 
-        *more = msg.more;
-        ensure_recv_capacity(rpc, rpc->recv_offset + msg.size);
-        memcpy(rpc->recv_buf.data + rpc->recv_offset, msg.data, msg.size);
-        rpc->recv_offset += msg.size;
+        *more = msgs[received - 1].more;
+        ensure_recv_capacity(rpc, rpc->recv_offset + received * UMP_MSG_MAX_SIZE);
+        for (size_t i = 0; i < received; i++) {
+            memcpy(rpc->recv_buf.data + rpc->recv_offset, msgs[i].data, msgs[i].size);
+            rpc->recv_offset += msgs[i].size;
+        }
     } else {
         assert(!"Invalid transport");
     }
@@ -159,6 +242,78 @@ static errval_t transport_try_recv(struct aos_rpc *rpc, bool *more)
     return err;
 }
 
+// puts the capabilities to send in front of the data, as the message goes over the channel
+static errval_t transport_ump_prepare_send(struct aos_rpc *rpc)
+{
+    errval_t err = SYS_ERR_OK;
+
+    const struct aos_rpc_cap_codec *codec = rpc->ump.cap_codec;
+    size_t capc = rpc->send_caps_size;
+    if (capc > 0 && codec == NULL) {
+        return LIB_ERR_RPC_UMP_NO_CAP_CODEC;
+    }
+
+    size_t caps_bytes = capc > 0 ? capc * codec->size : 0;
+    size_t size       = sizeof(struct rpc_ump_header) + caps_bytes + rpc->send_size;
+    if (rpc->ump.wire_bufsize < size) {
+        void *wire = realloc(rpc->ump.wire, size);
+        if (wire == NULL) {
+            return LIB_ERR_MALLOC_FAIL;
+        }
+        rpc->ump.wire         = wire;
+        rpc->ump.wire_bufsize = size;
+    }
+
+    struct rpc_ump_header *header = rpc->ump.wire;
+    header->capc                  = capc;
+    for (size_t i = 0; i < capc; i++) {
+        err = codec->encode(rpc->send_buf.caps[i], rpc->ump.wire + sizeof(*header) + i * codec->size);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+    memcpy(rpc->ump.wire + sizeof(*header) + caps_bytes, rpc->send_buf.data, rpc->send_size);
+    rpc->ump.wire_size = size;
+
+    return SYS_ERR_OK;
+}
+
+// takes the capabilities off the front of a message received over UMP
+static errval_t transport_ump_finish_recv(struct aos_rpc *rpc)
+{
+    errval_t err = SYS_ERR_OK;
+
+    const struct aos_rpc_cap_codec *codec  = rpc->ump.cap_codec;
+    struct rpc_ump_header          *header = rpc->recv_buf.data;
+    if (rpc->recv_size < sizeof(*header)) {
+        return LIB_ERR_RPC_RECV_UMP;
+    }
+
+    size_t capc = header->capc;
+    if (capc > 0 && codec == NULL) {
+        return LIB_ERR_RPC_UMP_NO_CAP_CODEC;
+    }
+    size_t caps_bytes = capc > 0 ? capc * codec->size : 0;
+    if (rpc->recv_size - sizeof(*header) < caps_bytes) {
+        return LIB_ERR_RPC_RECV_UMP;
+    }
+
+    ensure_recv_cap_capacity(rpc, capc);
+    for (size_t i = 0; i < capc; i++) {
+        err = codec->decode(rpc->recv_buf.data + sizeof(*header) + i * codec->size,
+                            &rpc->recv_buf.caps[i]);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+    rpc->recv_caps_size = capc;
+
+    rpc->recv_size -= sizeof(*header) + caps_bytes;
+    memmove(rpc->recv_buf.data, rpc->recv_buf.data + sizeof(*header) + caps_bytes, rpc->recv_size);
+
+    return SYS_ERR_OK;
+}
+
 static errval_t transport_register_send(struct aos_rpc *rpc, struct event_closure closure)
 {
     errval_t err = SYS_ERR_OK;
@@ -230,6 +385,21 @@ static void transport_recv_handler(void *arg)
         rpc->recv_caps_size   = rpc->recv_caps_offset;
         rpc->recv_offset      = 0;
         rpc->recv_caps_offset = 0;
+        if (rpc->transport == AOS_RPC_UMP) {
+            err = transport_ump_finish_recv(rpc);
+            if (err_is_fail(err)) {
+                // a malformed message from the peer must not take us down, drop it
+                // and keep waiting for the next one
+                DEBUG_ERR(err, "dropping malformed UMP message");
+                rpc->recv_size      = 0;
+                rpc->recv_caps_size = 0;
+                err = transport_register_recv(rpc, MKCLOSURE(transport_recv_handler, arg));
+                if (err_is_fail(err)) {
+                    DEBUG_ERR(err, "transport_register_recv");
+                }
+                return;
+            }
+        }
         if (rpc->recv_handler.handler) {
             rpc->recv_handler.handler(rpc, rpc->recv_handler.data);
         }
@@ -240,6 +410,12 @@ static errval_t _lmp_init_late_client(struct aos_rpc *rpc);
 
 errval_t aos_rpc_send(struct aos_rpc *rpc)
 {
+    if (rpc->transport == AOS_RPC_UMP) {
+        errval_t err = transport_ump_prepare_send(rpc);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
     return transport_register_send(rpc, MKCLOSURE(transport_send_handler, rpc));
 }
 
@@ -271,9 +447,12 @@ errval_t aos_rpc_send_blocking_varsize(struct aos_rpc *rpc, const void *buf, siz
 {
     errval_t err = SYS_ERR_OK;
 
+    // the channels of a spanned domain are served by its home dispatcher
+    dispatcher_handle_t from = domain_enter_home();
+
     err = _lmp_init_late_client(rpc);
     if (err_is_fail(err)) {
-        return err;
+        goto out;
     }
 
     rpc->send_buf.data = (void *)buf;
@@ -288,10 +467,12 @@ errval_t aos_rpc_send_blocking_varsize(struct aos_rpc *rpc, const void *buf, siz
     while (waiting) {
         err = event_dispatch(rpc->waitset);
         if (err_is_fail(err)) {
-            return err;
+            goto out;
         }
     }
 
+out:
+    domain_leave_home(from);
     return err;
 }
 
@@ -309,9 +490,11 @@ errval_t aos_rpc_recv_blocking_varsize(struct aos_rpc *rpc, void **buf, size_t *
 {
     errval_t err = SYS_ERR_OK;
 
+    dispatcher_handle_t from = domain_enter_home();
+
     err = _lmp_init_late_client(rpc);
     if (err_is_fail(err)) {
-        return err;
+        goto out;
     }
 
     bool waiting = true;
@@ -320,7 +503,7 @@ errval_t aos_rpc_recv_blocking_varsize(struct aos_rpc *rpc, void **buf, size_t *
     while (waiting) {
         err = event_dispatch(rpc->waitset);
         if (err_is_fail(err)) {
-            return err;
+            goto out;
         }
     }
 
@@ -333,6 +516,8 @@ errval_t aos_rpc_recv_blocking_varsize(struct aos_rpc *rpc, void **buf, size_t *
     if (capsize != NULL)
         *capsize = rpc->recv_caps_size;
 
+out:
+    domain_leave_home(from);
     return err;
 }
 
@@ -415,6 +600,19 @@ errval_t aos_rpc_ump_connect(struct aos_rpc *rpc, struct capref frame, bool prim
 }
 
 
+void aos_rpc_ump_set_cap_codec(struct aos_rpc *rpc, const struct aos_rpc_cap_codec *codec)
+{
+    assert(rpc->transport == AOS_RPC_UMP);
+    rpc->ump.cap_codec = codec;
+}
+
+void aos_rpc_ump_set_doorbell(struct aos_rpc *rpc, coreid_t core)
+{
+    assert(rpc->transport == AOS_RPC_UMP);
+    ump_chan_set_doorbell(&rpc->ump.channel, core);
+}
+
+
 static errval_t _lmp_init_late_client(struct aos_rpc *rpc)
 {
     if (rpc->late_init_done) {
@@ -457,6 +655,21 @@ static errval_t _lmp_init_late_client(struct aos_rpc *rpc)
         return LIB_ERR_RPC_INIT_LATE;
     }
 
+    // the server may share a frame for large messages, it sends through the first half
+    if (!capref_is_null(cap)) {
+        void *bulk;
+        err = paging_map_frame_attr(get_current_paging_state(), &bulk, RPC_LMP_BULK_FRAME_SIZE,
+                                    cap, VREGION_FLAGS_READ_WRITE);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "failed to map the bulk frame, using plain messages");
+            cap_destroy(cap);
+        } else {
+            rpc->lmp.bulk_frame = cap;
+            rpc->lmp.bulk_recv  = bulk;
+            rpc->lmp.bulk_send  = bulk + RPC_LMP_BULK_AREA_SIZE;
+        }
+    }
+
 #if DEBUG_AOS_RPC
     debug_printf("aos_rpc_init: done\n");
 #endif
@@ -502,6 +715,10 @@ static void _lmp_setup_handler(void *arg)
     rpc->send_size = sizeof(ack);
     // TODO check if sendbuf is large enough
     memcpy(rpc->send_buf.data, &ack, sizeof(ack));
+    if (!capref_is_null(rpc->lmp.bulk_frame)) {
+        rpc->send_buf.caps[0] = rpc->lmp.bulk_frame;
+        rpc->send_caps_size   = 1;
+    }
 
     aos_rpc_send(rpc);
 }
@@ -530,7 +747,24 @@ errval_t aos_rpc_lmp_listen(struct aos_rpc *rpc, struct capref *retcap)
     rpc->send_buf.caps      = malloc(sizeof(struct capref));
     rpc->send_buf.caps_size = 1;
 
+    // the frame for large messages, the channel works without it if we are short of memory
+    struct capref bulk_frame;
+    err = frame_alloc(&bulk_frame, RPC_LMP_BULK_FRAME_SIZE, NULL);
+    if (err_is_ok(err)) {
+        void *bulk;
+        err = paging_map_frame_attr(get_current_paging_state(), &bulk, RPC_LMP_BULK_FRAME_SIZE,
+                                    bulk_frame, VREGION_FLAGS_READ_WRITE);
+        if (err_is_ok(err)) {
+            rpc->lmp.bulk_frame = bulk_frame;
+            rpc->lmp.bulk_send  = bulk;
+            rpc->lmp.bulk_recv  = bulk + RPC_LMP_BULK_AREA_SIZE;
+        } else {
+            cap_destroy(bulk_frame);
+        }
+    }
+
     *retcap = rpc->lmp.channel.local_cap;
+    err     = SYS_ERR_OK;
 
     return err;
 }
@@ -563,6 +797,10 @@ errval_t aos_rpc_lmp_accept(struct aos_rpc *rpc, struct handler_closure handler,
 void aos_rpc_destroy_server(struct aos_rpc *rpc)
 {
     lmp_chan_destroy(&rpc->lmp.channel);
+    if (!capref_is_null(rpc->lmp.bulk_frame)) {
+        paging_unmap(get_current_paging_state(), rpc->lmp.bulk_send);
+        cap_destroy(rpc->lmp.bulk_frame);
+    }
     free(rpc->recv_buf.data);
     free(rpc->send_buf.data);
     memset(rpc, 0, sizeof(*rpc));
@@ -1406,17 +1644,199 @@ errval_t aos_rpc_filesystem_open(struct aos_rpc *chan, char *path, struct fat32_
     return res.base.base.err;
 }
 
+/*
+ * Bulk filesystem transfers: the first large read or write on a handle
+ * shares a frame with the filesystem server, after which the data goes
+ * through the frame and the messages only carry offsets and lengths.
+ */
+struct fs_bulk_frame {
+    struct fat32_handle  *fat32_handle_addr;
+    struct capref         frame;
+    void                 *buf;
+    struct fs_bulk_frame *next;
+};
+
+static struct fs_bulk_frame *fs_bulk_frames = NULL;
+// protects fs_bulk_frames, held while a frame is shared so a handle never gets two
+static struct thread_mutex fs_bulk_frames_mutex = THREAD_MUTEX_INITIALIZER;
+
+static void _filesystem_free_bulk_frame(struct fs_bulk_frame *bulk)
+{
+    paging_unmap(get_current_paging_state(), bulk->buf);
+    cap_destroy(bulk->frame);
+    free(bulk);
+}
+
+static errval_t _filesystem_get_bulk_frame(struct aos_rpc *chan, struct fat32_handle *fat32_handle_addr,
+                                           struct fs_bulk_frame **ret_bulk)
+{
+    thread_mutex_lock(&fs_bulk_frames_mutex);
+    for (struct fs_bulk_frame *bulk = fs_bulk_frames; bulk != NULL; bulk = bulk->next) {
+        if (bulk->fat32_handle_addr == fat32_handle_addr) {
+            thread_mutex_unlock(&fs_bulk_frames_mutex);
+            *ret_bulk = bulk;
+            return SYS_ERR_OK;
+        }
+    }
+
+    errval_t err;
+    struct fs_bulk_frame *bulk = malloc(sizeof(struct fs_bulk_frame));
+    if (bulk == NULL) {
+        err = LIB_ERR_MALLOC_FAIL;
+        goto out;
+    }
+    bulk->fat32_handle_addr = fat32_handle_addr;
+
+    err = frame_alloc(&bulk->frame, AOS_FILESYSTEM_BULK_FRAME_SIZE, NULL);
+    if (err_is_fail(err)) {
+        free(bulk);
+        goto out;
+    }
+
+    err = paging_map_frame(get_current_paging_state(), &bulk->buf, AOS_FILESYSTEM_BULK_FRAME_SIZE,
+                           bulk->frame);
+    if (err_is_fail(err)) {
+        cap_destroy(bulk->frame);
+        free(bulk);
+        goto out;
+    }
+
+    struct aos_filesystem_rpc_share_frame_request req;
+    req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
+    req.base.request_type = AOS_RPC_FILESYSTEM_SHARE_FRAME;
+    req.fat32_handle_addr = fat32_handle_addr;
+
+    err = aos_rpc_send_blocking(chan, &req, sizeof(req), bulk->frame);
+    if (err_is_ok(err)) {
+        struct aos_filesystem_rpc_share_frame_response res;
+        err = aos_rpc_recv_blocking(chan, &res, sizeof(res), NULL, NULL);
+        if (err_is_ok(err)) {
+            err = res.base.base.err;
+        }
+    }
+    if (err_is_fail(err)) {
+        _filesystem_free_bulk_frame(bulk);
+        goto out;
+    }
+
+    bulk->next = fs_bulk_frames;
+    fs_bulk_frames = bulk;
+    *ret_bulk = bulk;
+
+out:
+    thread_mutex_unlock(&fs_bulk_frames_mutex);
+    return err;
+}
+
+static void _filesystem_release_bulk_frame(struct fat32_handle *fat32_handle_addr)
+{
+    struct fs_bulk_frame *found = NULL;
+
+    thread_mutex_lock(&fs_bulk_frames_mutex);
+    struct fs_bulk_frame **prev = &fs_bulk_frames;
+    for (struct fs_bulk_frame *bulk = fs_bulk_frames; bulk != NULL; bulk = bulk->next) {
+        if (bulk->fat32_handle_addr == fat32_handle_addr) {
+            *prev = bulk->next;
+            found = bulk;
+            break;
+        }
+        prev = &bulk->next;
+    }
+    thread_mutex_unlock(&fs_bulk_frames_mutex);
+
+    if (found != NULL) {
+        _filesystem_free_bulk_frame(found);
+    }
+}
+
+static errval_t _filesystem_bulk_transfer(struct aos_rpc *chan, struct fs_bulk_frame *bulk, bool is_write,
+                                          size_t len, size_t *transferred)
+{
+    struct aos_filesystem_rpc_bulk_request req;
+    req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
+    req.base.request_type = is_write ? AOS_RPC_FILESYSTEM_WRITE_BULK : AOS_RPC_FILESYSTEM_READ_BULK;
+    req.fat32_handle_addr = bulk->fat32_handle_addr;
+    req.offset = 0;
+    req.len = len;
+
+    errval_t err = aos_rpc_send_blocking(chan, &req, sizeof(req), NULL_CAP);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    struct aos_filesystem_rpc_bulk_response res;
+    err = aos_rpc_recv_blocking(chan, &res, sizeof(res), NULL, NULL);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    *transferred = res.len;
+    return res.base.base.err;
+}
+
+static errval_t _filesystem_read_bulk(struct aos_rpc *chan, struct fs_bulk_frame *bulk, void *buf, size_t len,
+                                      size_t *bytes_read)
+{
+    while (*bytes_read < len) {
+        size_t chunk = MIN(AOS_FILESYSTEM_BULK_FRAME_SIZE, len - *bytes_read);
+        size_t read;
+        errval_t err = _filesystem_bulk_transfer(chan, bulk, false, chunk, &read);
+        if (err_is_fail(err)) {
+            return err;
+        }
+
+        memcpy(buf + *bytes_read, bulk->buf, read);
+        *bytes_read += read;
+
+        // End of the file
+        if (read < chunk) {
+            break;
+        }
+    }
+
+    return SYS_ERR_OK;
+}
+
+static errval_t _filesystem_write_bulk(struct aos_rpc *chan, struct fs_bulk_frame *bulk, void *buf, size_t len,
+                                       size_t *bytes_written)
+{
+    while (*bytes_written < len) {
+        size_t chunk = MIN(AOS_FILESYSTEM_BULK_FRAME_SIZE, len - *bytes_written);
+        memcpy(bulk->buf, buf + *bytes_written, chunk);
+
+        size_t written;
+        errval_t err = _filesystem_bulk_transfer(chan, bulk, true, chunk, &written);
+        if (err_is_fail(err)) {
+            return err;
+        }
+        // a server making no progress would keep us here forever
+        if (written == 0) {
+            return FS_ERR_WRITE;
+        }
+
+        *bytes_written += written;
+    }
+
+    return SYS_ERR_OK;
+}
+
 errval_t aos_rpc_filesystem_read(struct aos_rpc *chan, struct fat32_handle* fat32_handle_addr, void *buf, size_t len, size_t *bytes_read) {
     *bytes_read = 0;
     void *current_buffer = buf;
 
+    // Large reads go through the shared frame, small ones stay inline
+    struct fs_bulk_frame *bulk;
+    if (len > AOS_FILESYSTEM_INLINE_SIZE && err_is_ok(_filesystem_get_bulk_frame(chan, fat32_handle_addr, &bulk))) {
+        return _filesystem_read_bulk(chan, bulk, buf, len, bytes_read);
+    }
+
     while(*bytes_read < len) {
         const size_t size_structure = sizeof(struct aos_filesystem_rpc_read_request);
         struct aos_filesystem_rpc_read_request req;
         req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
         req.base.request_type = AOS_RPC_FILESYSTEM_READ;
         req.fat32_handle_addr = fat32_handle_addr;
-        req.len = MIN(512,len - *bytes_read);
+        req.len = MIN(AOS_FILESYSTEM_INLINE_SIZE,len - *bytes_read);
 
         errval_t err = aos_rpc_send_blocking(chan, &req, size_structure, NULL_CAP);
         if (err_is_fail(err)) {
@@ -1449,13 +1869,19 @@ errval_t aos_rpc_filesystem_write(struct aos_rpc *chan, struct fat32_handle* fat
     *bytes_written = 0;
     void *current_buffer = buf;
 
+    // Large writes go through the shared frame, small ones stay inline
+    struct fs_bulk_frame *bulk;
+    if (len > AOS_FILESYSTEM_INLINE_SIZE && err_is_ok(_filesystem_get_bulk_frame(chan, fat32_handle_addr, &bulk))) {
+        return _filesystem_write_bulk(chan, bulk, buf, len, bytes_written);
+    }
+
     while(*bytes_written < len) {
         const size_t size_structure = sizeof(struct aos_filesystem_rpc_write_request);
         struct aos_filesystem_rpc_write_request req;
         req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
         req.base.request_type = AOS_RPC_FILESYSTEM_WRITE;
         req.fat32_handle_addr = fat32_handle_addr;
-        req.len = MIN(512,len - *bytes_written);
+        req.len = MIN(AOS_FILESYSTEM_INLINE_SIZE,len - *bytes_written);
         memcpy(req.buffer, current_buffer, req.len);
 
         errval_t err = aos_rpc_send_blocking(chan, &req, size_structure, NULL_CAP);
@@ -1532,6 +1958,9 @@ errval_t aos_rpc_filesystem_close(struct aos_rpc *chan, struct fat32_handle *fat
     req.base.request_type = AOS_RPC_FILESYSTEM_CLOSE;
     req.fat32_handle_addr = fat32_handle_addr;
 
+    // The server unmaps its side of the frame when closing the handle
+    _filesystem_release_bulk_frame(fat32_handle_addr);
+
     errval_t err = aos_rpc_send_blocking(chan, &req, size_structure, NULL_CAP);
     if (err_is_fail(err))
         return err;
@@ -1740,6 +2169,36 @@ errval_t aos_rpc_filesystem_stat(struct aos_rpc *chan, struct fat32_handle *fat3
     return res.base.base.err;
 }
 
+errval_t aos_rpc_filesystem_map_page(struct aos_rpc *chan, struct fat32_handle *fat32_handle_addr, size_t offset,
+                                     struct capref *frame, size_t *len) {
+    struct aos_filesystem_rpc_map_page_request req;
+    req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
+    req.base.request_type = AOS_RPC_FILESYSTEM_MAP_PAGE;
+    req.fat32_handle_addr = fat32_handle_addr;
+    req.offset = offset;
+
+    errval_t err = aos_rpc_send_blocking(chan, &req, sizeof(req), NULL_CAP);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    struct aos_filesystem_rpc_map_page_response res;
+    err = aos_rpc_recv_blocking(chan, &res, sizeof(res), NULL, frame);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    if (err_is_fail(res.base.base.err)) {
+        return res.base.base.err;
+    }
+    if (capref_is_null(*frame)) {
+        return LIB_ERR_CAP_WAS_NULL;
+    }
+
+    *len = res.len;
+
+    return SYS_ERR_OK;
+}
+
 
 errval_t aos_rpc_test_suite_run(struct aos_rpc *rpc, struct test_suite_config config)
 {
@@ -1765,6 +2224,77 @@ errval_t aos_rpc_test_suite_run(struct aos_rpc *rpc, struct test_suite_config co
     return res.base.err;
 }
 
+/**
+ * @brief requests init on another core to start a dispatcher of the calling domain
+ *
+ * @param[in] chan       the RPC channel to use (init channel)
+ * @param[in] core       the core to run the dispatcher on
+ * @param[in] dcb        the dispatcher capability
+ * @param[in] vroot      the vspace root of the domain
+ * @param[in] dispframe  the frame holding the dispatcher
+ *
+ * @return SYS_ERR_OK on success, or error value on failure
+ */
+errval_t aos_rpc_span_start(struct aos_rpc *rpc, coreid_t core, struct capref dcb,
+                            struct capref vroot, struct capref dispframe)
+{
+    struct aos_span_rpc_request req = {
+        .base = { .type = AOS_RPC_REQUEST_TYPE_SPAN },
+        .stype = AOS_RPC_SPAN_START,
+        .core = core,
+        .vroot = get_cap_addr(vroot),
+        .dispframe = get_cap_addr(dispframe),
+    };
+    struct capref caps[2] = { dcb, cap_root };
+    errval_t err = aos_rpc_send_blocking_varsize(rpc, &req, sizeof(req), caps, 2);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    struct aos_span_rpc_response res;
+    err = _rpc_recv_and_validate(rpc, (struct aos_generic_rpc_response *)&res, sizeof(res), NULL);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    if (res.base.type != AOS_RPC_RESPONSE_TYPE_SPAN) {
+        return SYS_ERR_GUARD_MISMATCH;
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * @brief requests init on another core to stop a dispatcher of the calling domain
+ *
+ * @param[in] chan  the RPC channel to use (init channel)
+ * @param[in] core  the core the dispatcher runs on
+ * @param[in] dcb   the dispatcher capability
+ *
+ * @return SYS_ERR_OK on success, or error value on failure
+ */
+errval_t aos_rpc_span_stop(struct aos_rpc *rpc, coreid_t core, struct capref dcb)
+{
+    struct aos_span_rpc_request req = {
+        .base = { .type = AOS_RPC_REQUEST_TYPE_SPAN },
+        .stype = AOS_RPC_SPAN_STOP,
+        .core = core,
+    };
+    errval_t err = _rpc_prepare_and_send(rpc, (struct aos_generic_rpc_request *)&req,
+                                         sizeof(req), dcb);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    struct aos_span_rpc_response res;
+    err = _rpc_recv_and_validate(rpc, (struct aos_generic_rpc_response *)&res, sizeof(res), NULL);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    if (res.base.type != AOS_RPC_RESPONSE_TYPE_SPAN) {
+        return SYS_ERR_GUARD_MISMATCH;
+    }
+    return SYS_ERR_OK;
+}
+
 errval_t aos_rpc_cap_retype_remote(struct aos_rpc *rpc, struct capref src_root,
                                    struct capref dest_root, capaddr_t src, gensize_t offset,
                                    enum objtype new_type, gensize_t objsize, size_t count,
@@ -2069,3 +2599,55 @@ struct simple_async_channel* aos_rpc_get_async_channel(void){
 
     return &proc_async;
 }
+
+errval_t aos_rpc_open_init_channel(struct aos_rpc *rpc)
+{
+    errval_t err;
+
+    // the calls on the channel only dispatch its own events
+    struct waitset *ws = malloc(sizeof(struct waitset));
+    if (ws == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    waitset_init(ws);
+
+    struct capref lmp_cap;
+    err = aos_rpc_lmp_listen(rpc, &lmp_cap);
+    if (err_is_fail(err)) {
+        goto out_ws;
+    }
+
+    struct aos_generic_rpc_request setup_req;
+    setup_req.type = AOS_RPC_REQUEST_TYPE_SETUP_RPC_CHANNEL;
+    err = aos_rpc_send_blocking(get_init_rpc(), &setup_req, sizeof(setup_req), lmp_cap);
+    if (err_is_fail(err)) {
+        aos_rpc_destroy_server(rpc);
+        goto out_ws;
+    }
+
+    bool is_setup = false;
+    err = aos_rpc_lmp_accept(rpc, MKHANDLER(_init_rpc_handler_done, &is_setup), ws);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "init is connecting to a channel we cannot accept on");
+    }
+    while (!is_setup) {
+        err = event_dispatch(ws);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "in event_dispatch");
+        }
+    }
+    // the endpoints were exchanged by the accept, this end is the client from now on
+    rpc->late_init_done = true;
+
+    struct aos_generic_rpc_response res;
+    err = aos_rpc_recv_blocking(get_init_rpc(), &res, sizeof(res), NULL, NULL);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    return res.err;
+
+out_ws:
+    waitset_destroy(ws);
+    free(ws);
+    return err;
+}
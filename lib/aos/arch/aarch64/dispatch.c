@@ -265,3 +265,15 @@ void disp_arch_init(dispatcher_handle_t handle)
     disp->crit_pc_low                     = (lvaddr_t)disp_resume_context;
     disp->crit_pc_high                    = (lvaddr_t)disp_resume_context_epilog;
 }
+
+/**
+ * \brief Architecture-specific setup of a dispatcher spanning the domain to
+ *        another core, copied from one of its existing dispatchers
+ */
+void disp_arch_span(dispatcher_handle_t handle, dispatcher_handle_t from)
+{
+    struct dispatcher_shared_aarch64 *disp =
+        get_dispatcher_shared_aarch64(handle);
+
+    disp->got_base = get_dispatcher_shared_aarch64(from)->got_base;
+}
@@ -15,15 +15,17 @@
 #include <aos/syscall_arch.h>
 #include <barrelfish_kpi/syscalls.h>
 
+#include "domain_priv.h"
+
 STATIC_ASSERT_SIZEOF(struct sysret, 2 * sizeof(uintptr_t));
 STATIC_ASSERT_OFFSETOF(struct sysret, error, 0 * sizeof(uintptr_t));
 STATIC_ASSERT_OFFSETOF(struct sysret, value, 1 * sizeof(uintptr_t));
 STATIC_ASSERT(SYSCALL_REG == 0, "Bad register for system call argument.");
 
-struct sysret
-syscall(uint64_t num, uint64_t arg1, uint64_t arg2, uint64_t arg3,
-        uint64_t arg4, uint64_t arg5, uint64_t arg6, uint64_t arg7,
-        uint64_t arg8, uint64_t arg9, uint64_t arg10, uint64_t arg11)
+static struct sysret
+syscall_local(uint64_t num, uint64_t arg1, uint64_t arg2, uint64_t arg3,
+              uint64_t arg4, uint64_t arg5, uint64_t arg6, uint64_t arg7,
+              uint64_t arg8, uint64_t arg9, uint64_t arg10, uint64_t arg11)
 {
     register uint64_t ret1 __asm("x0")  = num;
     register uint64_t ret2 __asm("x1")  = arg1;
@@ -48,6 +50,26 @@ syscall(uint64_t num, uint64_t arg1, uint64_t arg2, uint64_t arg3,
     return (struct sysret){/*error*/ ret1, /*value*/ ret2};
 }
 
+struct sysret
+syscall(uint64_t num, uint64_t arg1, uint64_t arg2, uint64_t arg3,
+        uint64_t arg4, uint64_t arg5, uint64_t arg6, uint64_t arg7,
+        uint64_t arg8, uint64_t arg9, uint64_t arg10, uint64_t arg11)
+{
+    union syscall_info si = { .raw = num };
+    if (si.sc.syscall != SYSCALL_INVOKE) {
+        return syscall_local(num, arg1, arg2, arg3, arg4, arg5, arg6, arg7,
+                             arg8, arg9, arg10, arg11);
+    }
+
+    // only the CPU driver of the home core knows the capabilities of a
+    // spanned domain, invoke them from there
+    dispatcher_handle_t from = domain_enter_home();
+    struct sysret ret = syscall_local(num, arg1, arg2, arg3, arg4, arg5, arg6,
+                                      arg7, arg8, arg9, arg10, arg11);
+    domain_leave_home(from);
+    return ret;
+}
+
 //
 // System call wrappers
 //
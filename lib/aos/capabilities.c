@@ -668,8 +668,15 @@ errval_t frame_create(struct capref dest, size_t bytes, size_t *retbytes)
 
     bytes = ROUND_UP(bytes, BASE_PAGE_SIZE);
 
+    // large frames try to start at a block boundary, so that they can be mapped as blocks
     struct capref ram;
-    err = ram_alloc(&ram, bytes);
+    err = LIB_ERR_RAM_ALLOC_MS_CONSTRAINTS;
+    if (bytes >= LARGE_PAGE_SIZE) {
+        err = ram_alloc_aligned(&ram, bytes, LARGE_PAGE_SIZE);
+    }
+    if (err_is_fail(err)) {
+        err = ram_alloc(&ram, bytes);
+    }
     if (err_is_fail(err)) {
         if (err_no(err) == MM_ERR_NOT_FOUND || err_no(err) == LIB_ERR_RAM_ALLOC_WRONG_SIZE) {
             return err_push(err, LIB_ERR_RAM_ALLOC_MS_CONSTRAINTS);
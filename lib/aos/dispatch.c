@@ -104,10 +104,14 @@ void disp_run(dispatcher_handle_t handle)
     lmp_channels_retry_send_disabled(handle);
 #endif // CONFIG_INTERCONNECT_DRIVER_LMP
     // Check polled channels
+    poll_channels_wake_disabled(handle);
     poll_channels_disabled(handle);
 
     check_notificators_disabled(handle);
 
+    // Take the threads handed over by the other dispatchers of the domain
+    thread_receive_incoming_disabled(handle);
+
     // Run, saving state of previous thread if required
     thread_run_disabled(handle);
 
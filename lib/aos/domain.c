@@ -2,11 +2,17 @@
  * \file
  * \brief Manage domain spanning cores
  *
- * \bug Need to specify how big the default thread on the spanned dispatcher
- * should be because we cannot dynamically grow our stacks
+ * A domain spans another core with a dispatcher of its own on that core,
+ * which shares the vspace and the cspace with the dispatcher the domain
+ * started with (its home dispatcher). Threads are handed between the
+ * dispatchers, the waitsets and the run queues stay per dispatcher.
  *
- * \bug Can only do domain_new_dispatcher() when no other dispatchers have
- * threads (except for the internal interdisp-thread).
+ * The state of the memory and capability management lives on the home
+ * dispatcher. Threads on other cores move home for the duration of cap
+ * invocations and RPCs, as the CPU driver of their core does not know about
+ * the capabilities of the domain.
+ *
+ * \bug Killing a spanned domain does not stop its dispatchers on other cores.
  */
 
 /*
@@ -21,6 +27,7 @@
 
 #include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <aos/aos.h>
 #include <aos/curdispatcher_arch.h>
 #include <aos/dispatcher_arch.h>
@@ -28,11 +35,33 @@
 #include <barrelfish_kpi/domain_params.h>
 #include <arch/registers.h>
 #include <aos/dispatch.h>
+#include <aos/aos_rpc.h>
+#include <aos/paging.h>
 #include "arch/threads.h"
+#include "domain_priv.h"
 #include "init.h"
 #include "threads_priv.h"
 #include "waitset_chan_priv.h"
 
+/// A dispatcher of the domain
+struct span_disp {
+    dispatcher_handle_t handle;  ///< the dispatcher, or 0 if there is none on the core
+    struct capref       dcb;     ///< its dispatcher control block, if created here
+    struct capref       frame;   ///< the frame holding it, if created here
+};
+
+/// dispatchers of the domain, indexed by their core
+static struct span_disp span_disps[MAX_COREID];
+
+/// dispatcher holding the state shared by all dispatchers, 0 until spanned
+static dispatcher_handle_t home_disp;
+
+/// Returns the dispatcher that holds the state of the domain
+static inline dispatcher_handle_t domain_state_disp(void)
+{
+    return home_disp != 0 ? home_disp : curdispatcher();
+}
+
 /**
  * \brief set the core_id.
  *
@@ -135,7 +164,7 @@ struct waitset *get_default_waitset(void)
  */
 struct morecore_state *get_morecore_state(void)
 {
-    dispatcher_handle_t handle = curdispatcher();
+    dispatcher_handle_t handle = domain_state_disp();
     struct dispatcher_generic* disp = get_dispatcher_generic(handle);
     return &disp->core_state.c.morecore_state;
 }
@@ -145,14 +174,14 @@ struct morecore_state *get_morecore_state(void)
  */
 struct paging_state *get_current_paging_state(void)
 {
-    dispatcher_handle_t handle = curdispatcher();
+    dispatcher_handle_t handle = domain_state_disp();
     struct dispatcher_generic *disp = get_dispatcher_generic(handle);
     return disp->core_state.c.paging_state;
 }
 
 void set_current_paging_state(struct paging_state *st)
 {
-    dispatcher_handle_t handle = curdispatcher();
+    dispatcher_handle_t handle = domain_state_disp();
     struct dispatcher_generic *disp = get_dispatcher_generic(handle);
     disp->core_state.c.paging_state = st;
 }
@@ -162,7 +191,7 @@ void set_current_paging_state(struct paging_state *st)
  */
 struct ram_alloc_state *get_ram_alloc_state(void)
 {
-    dispatcher_handle_t handle = curdispatcher();
+    dispatcher_handle_t handle = domain_state_disp();
     struct dispatcher_generic* disp = get_dispatcher_generic(handle);
     return &disp->core_state.c.ram_alloc_state;
 }
@@ -172,7 +201,7 @@ struct ram_alloc_state *get_ram_alloc_state(void)
  */
 struct slot_alloc_state *get_slot_alloc_state(void)
 {
-    dispatcher_handle_t handle = curdispatcher();
+    dispatcher_handle_t handle = domain_state_disp();
     struct dispatcher_generic* disp = get_dispatcher_generic(handle);
     return &disp->core_state.c.slot_alloc_state;
 }
@@ -182,7 +211,7 @@ struct slot_alloc_state *get_slot_alloc_state(void)
  */
 struct proc_mgmt_state *get_proc_mgmt_state(void)
 {
-    dispatcher_handle_t        handle = curdispatcher();
+    dispatcher_handle_t        handle = domain_state_disp();
     struct dispatcher_generic *disp   = get_dispatcher_generic(handle);
     return &disp->core_state.c.proc_mgmt_state;
 }
@@ -192,7 +221,7 @@ struct proc_mgmt_state *get_proc_mgmt_state(void)
  */
 void set_init_chan(struct aos_chan *initchan)
 {
-    dispatcher_handle_t handle = curdispatcher();
+    dispatcher_handle_t handle = domain_state_disp();
     struct dispatcher_generic* disp = get_dispatcher_generic(handle);
     disp->core_state.c.init_chan = initchan;
 }
@@ -202,7 +231,7 @@ void set_init_chan(struct aos_chan *initchan)
  */
 struct aos_chan *get_init_chan(void)
 {
-    dispatcher_handle_t handle = curdispatcher();
+    dispatcher_handle_t handle = domain_state_disp();
     struct dispatcher_generic* disp = get_dispatcher_generic(handle);
     return disp->core_state.c.init_chan;
 }
@@ -212,7 +241,7 @@ struct aos_chan *get_init_chan(void)
  */
 void set_init_rpc(struct aos_rpc *initrpc)
 {
-    dispatcher_handle_t handle = curdispatcher();
+    dispatcher_handle_t handle = domain_state_disp();
     struct dispatcher_generic* disp = get_dispatcher_generic(handle);
     disp->core_state.c.init_rpc = initrpc;
 }
@@ -222,7 +251,305 @@ void set_init_rpc(struct aos_rpc *initrpc)
  */
 struct aos_rpc *get_init_rpc(void)
 {
-    dispatcher_handle_t handle = curdispatcher();
+    dispatcher_handle_t handle = domain_state_disp();
     struct dispatcher_generic* disp = get_dispatcher_generic(handle);
     return disp->core_state.c.init_rpc;
 }
+
+/**
+ * \brief Returns whether the domain has dispatchers on more than one core
+ */
+bool domain_is_spanned(void)
+{
+    return home_disp != 0;
+}
+
+/**
+ * \brief Returns the dispatcher of the domain on the given core, or 0
+ */
+static dispatcher_handle_t domain_get_disp(coreid_t core_id)
+{
+    if (core_id >= MAX_COREID) {
+        return 0;
+    }
+    if (home_disp == 0) {
+        return core_id == disp_get_core_id() ? curdispatcher() : 0;
+    }
+    return span_disps[core_id].handle;
+}
+
+/**
+ * \brief Returns whether the domain has a dispatcher on the given core
+ */
+bool domain_has_dispatcher(coreid_t core_id)
+{
+    return domain_get_disp(core_id) != 0;
+}
+
+/// First code run by a new dispatcher, while disabled and on its stack
+static void domain_span_entry(dispatcher_handle_t handle)
+{
+    disp_init_disabled(handle);
+
+    // there are no threads yet, wait for the first one to be handed over
+    thread_run_disabled(handle);
+}
+
+/**
+ * \brief Creates a dispatcher for the domain on another core
+ *
+ * The new dispatcher shares the vspace and the cspace of the domain, and
+ * starts without any threads. Use domain_thread_create_on() to run threads
+ * on it.
+ *
+ * \param core_id       the core to span to
+ * \param callback      if not NULL, called with the result once done
+ * \param callback_arg  argument passed to the callback
+ *
+ * \returns SYS_ERR_OK on success, or error value on failure
+ */
+errval_t domain_new_dispatcher(coreid_t core_id, domain_spanned_callback_t callback,
+                               void *callback_arg)
+{
+    errval_t err;
+    struct capref dcb, frame;
+    void *buf;
+
+    // the capabilities are only manipulated by the home dispatcher
+    dispatcher_handle_t from = domain_enter_home();
+    dispatcher_handle_t home = curdispatcher();
+    struct dispatcher_generic *home_gen = get_dispatcher_generic(home);
+
+    if (core_id >= MAX_COREID) {
+        err = MON_ERR_INVALID_CORE_ID;
+        goto out;
+    }
+    if (core_id == home_gen->core_id || span_disps[core_id].handle != 0) {
+        err = PROC_MGMT_ERR_ALREADY_SPANNED;
+        goto out;
+    }
+
+    err = slot_alloc(&dcb);
+    if (err_is_fail(err)) {
+        err = err_push(err, LIB_ERR_SLOT_ALLOC);
+        goto out;
+    }
+    err = dispatcher_create(dcb);
+    if (err_is_fail(err)) {
+        slot_free(dcb);
+        err = err_push(err, SPAWN_ERR_CREATE_DISPATCHER);
+        goto out;
+    }
+
+    err = frame_alloc(&frame, DISPATCHER_FRAME_SIZE, NULL);
+    if (err_is_fail(err)) {
+        err = err_push(err, SPAWN_ERR_CREATE_DISPATCHER_FRAME);
+        goto out_dcb;
+    }
+
+    err = paging_map_frame(get_current_paging_state(), &buf, DISPATCHER_FRAME_SIZE, frame);
+    if (err_is_fail(err)) {
+        err = err_push(err, SPAWN_ERR_MAP_DISPATCHER_TO_SELF);
+        goto out_frame;
+    }
+
+    dispatcher_handle_t handle = (dispatcher_handle_t)buf;
+    struct dispatcher_shared_generic *disp = get_dispatcher_shared_generic(handle);
+    struct dispatcher_shared_generic *home_shared = get_dispatcher_shared_generic(home);
+    struct dispatcher_generic *disp_gen = get_dispatcher_generic(handle);
+
+    disp->udisp = (lvaddr_t)handle;
+    disp->disabled = 1;
+    disp->systime_frequency = home_shared->systime_frequency;
+    strncpy(disp->name, home_shared->name, DISP_NAME_LEN);
+    disp_arch_span(handle, home);
+
+    disp_gen->core_id = core_id;
+    disp_gen->domain_id = home_gen->domain_id;
+    disp_gen->dcb_cap = dcb;
+    disp_gen->eh_frame = home_gen->eh_frame;
+    disp_gen->eh_frame_size = home_gen->eh_frame_size;
+    disp_gen->eh_frame_hdr = home_gen->eh_frame_hdr;
+    disp_gen->eh_frame_hdr_size = home_gen->eh_frame_hdr_size;
+    waitset_init(&disp_gen->core_state.c.default_waitset);
+
+    arch_registers_state_t *disabled_area = dispatcher_get_disabled_save_area(handle);
+    registers_set_initial(disabled_area, NULL, (lvaddr_t)domain_span_entry,
+                          (lvaddr_t)&disp_gen->stack[DISPATCHER_STACK_WORDS],
+                          handle, 0, 0, 0);
+
+    // from now on, the domain state is taken from the home dispatcher
+    bool first_span = home_disp == 0;
+    if (first_span) {
+        span_disps[home_gen->core_id].handle = home;
+        home_disp = home;
+    }
+
+    err = aos_rpc_span_start(get_init_rpc(), core_id, dcb, cap_vroot, frame);
+    if (err_is_fail(err)) {
+        err = err_push(err, LIB_ERR_DOMAIN_NEW_DISPATCHER);
+        if (first_span) {
+            span_disps[home_gen->core_id].handle = 0;
+            home_disp = 0;
+        }
+        paging_unmap(get_current_paging_state(), buf);
+        goto out_frame;
+    }
+
+    span_disps[core_id].dcb = dcb;
+    span_disps[core_id].frame = frame;
+    span_disps[core_id].handle = handle;
+    goto out;
+
+out_frame:
+    cap_destroy(frame);
+out_dcb:
+    cap_destroy(dcb);
+out:
+    domain_leave_home(from);
+    if (callback != NULL) {
+        callback(callback_arg, err);
+    }
+    return err;
+}
+
+/**
+ * \brief Creates a thread on the dispatcher of the domain on the given core
+ *
+ * \param core_id     the core to run the thread on
+ * \param start_func  function to run on the new thread
+ * \param arg         argument to pass to the function
+ * \param stacksize   size of the stack of the thread
+ * \param newthread   if not NULL, returns the new thread
+ *
+ * \returns SYS_ERR_OK on success, or error value on failure
+ */
+errval_t domain_thread_create_on_varstack(coreid_t core_id, thread_func_t start_func,
+                                          void *arg, size_t stacksize,
+                                          struct thread **newthread)
+{
+    errval_t err = SYS_ERR_OK;
+
+    dispatcher_handle_t target = domain_get_disp(core_id);
+    if (target == 0) {
+        return LIB_ERR_NO_SPANNED_DISP;
+    }
+
+    struct thread *thread = thread_create_unrunnable(start_func, arg, stacksize);
+    if (thread == NULL) {
+        return LIB_ERR_THREAD_CREATE;
+    }
+
+    dispatcher_handle_t handle = disp_disable();
+    thread->disp = target;
+    thread->coreid = core_id;
+    if (target == handle) {
+        thread_enqueue(thread, &get_dispatcher_generic(handle)->runq);
+    } else {
+        err = thread_hand_over_disabled(handle, thread);
+    }
+    disp_enable(handle);
+
+    if (newthread != NULL) {
+        *newthread = thread;
+    }
+    return err;
+}
+
+/**
+ * \brief Creates a thread with the default stack size on the given core
+ */
+errval_t domain_thread_create_on(coreid_t core_id, thread_func_t start_func,
+                                 void *arg, struct thread **newthread)
+{
+    return domain_thread_create_on_varstack(core_id, start_func, arg,
+                                            THREADS_DEFAULT_STACK_BYTES, newthread);
+}
+
+/**
+ * \brief Moves a thread to the dispatcher of the domain on the given core
+ *
+ * Only the calling thread can be moved, it returns on the new core.
+ *
+ * \param thread   the thread to move, must be the calling thread
+ * \param core_id  the core to continue on
+ *
+ * \returns SYS_ERR_OK on success, or error value on failure
+ */
+errval_t domain_thread_move_to(struct thread *thread, coreid_t core_id)
+{
+    if (thread != thread_self()) {
+        return LIB_ERR_THREAD_MIGRATE;
+    }
+
+    dispatcher_handle_t target = domain_get_disp(core_id);
+    if (target == 0) {
+        return LIB_ERR_NO_SPANNED_DISP;
+    }
+
+    thread_migrate_self(target);
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Moves the calling thread to the home dispatcher of a spanned domain
+ *
+ * Nothing happens if the domain is not spanned, if the thread already runs
+ * there, or if the dispatcher is disabled.
+ *
+ * \returns the dispatcher to pass to domain_leave_home(), or 0
+ */
+dispatcher_handle_t domain_enter_home(void)
+{
+    if (home_disp == 0) {
+        return 0;
+    }
+
+    dispatcher_handle_t handle = curdispatcher();
+    if (handle == home_disp || get_dispatcher_shared_generic(handle)->disabled) {
+        return 0;
+    }
+
+    thread_migrate_self(home_disp);
+    return handle;
+}
+
+/**
+ * \brief Moves the calling thread back after domain_enter_home()
+ *
+ * \param disp  the dispatcher returned by domain_enter_home()
+ */
+void domain_leave_home(dispatcher_handle_t disp)
+{
+    if (disp != 0) {
+        thread_migrate_self(disp);
+    }
+}
+
+/**
+ * \brief Stops the dispatchers of the domain on other cores
+ *
+ * Called before the domain exits. The calling thread continues on the home
+ * dispatcher.
+ */
+void domain_stop_dispatchers(void)
+{
+    if (home_disp == 0) {
+        return;
+    }
+
+    thread_migrate_self(home_disp);
+
+    for (coreid_t core = 0; core < MAX_COREID; core++) {
+        struct span_disp *span = &span_disps[core];
+        if (span->handle == 0 || span->handle == home_disp) {
+            continue;
+        }
+
+        errval_t err = aos_rpc_span_stop(get_init_rpc(), core, span->dcb);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "stopping the dispatcher on core %" PRIuCOREID, core);
+        }
+        span->handle = 0;
+    }
+}
@@ -0,0 +1,24 @@
+/**
+ * \file
+ * \brief Private interface of the domain spanning cores
+ */
+
+/*
+ * Copyright (c) 2022, The University of British Columbia
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef LIBBARRELFISH_DOMAIN_PRIV_H
+#define LIBBARRELFISH_DOMAIN_PRIV_H
+
+#include <barrelfish_kpi/dispatcher_handle.h>
+
+dispatcher_handle_t domain_enter_home(void);
+void domain_leave_home(dispatcher_handle_t disp);
+void domain_stop_dispatchers(void);
+
+#endif // LIBBARRELFISH_DOMAIN_PRIV_H
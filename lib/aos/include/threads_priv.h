@@ -13,6 +13,7 @@
 #include <aos/dispatcher_arch.h>
 #include <aos/except.h>
 #include <aos/capabilities.h>
+#include <aos/waitset.h>
 
 /// Maximum number of thread-local storage keys
 #define MAX_TLS         16
@@ -93,6 +94,13 @@ void thread_remove_from_queue(struct thread **queue, struct thread *thread);
 /* must only be called by dispatcher, while disabled */
 void thread_init_disabled(dispatcher_handle_t handle, bool init_domain);
 
+errval_t thread_hand_over_disabled(dispatcher_handle_t handle,
+                                   struct thread *thread);
+void thread_receive_incoming_disabled(dispatcher_handle_t handle);
+bool thread_incoming_havework_disabled(dispatcher_handle_t handle);
+void thread_incoming_sleep_disabled(dispatcher_handle_t handle);
+void thread_migrate_self(dispatcher_handle_t target);
+
 /// Returns true if there is non-threaded work to be done on this dispatcher
 /// (ie. if we still need to run)
 static inline bool havework_disabled(dispatcher_handle_t handle)
@@ -102,11 +110,22 @@ static inline bool havework_disabled(dispatcher_handle_t handle)
 #ifdef CONFIG_INTERCONNECT_DRIVER_LMP
             || disp->lmp_send_events_list != NULL
 #endif
-            || disp->polled_channels != NULL
+            || poll_channels_havework_disabled(handle)
             || disp->notificators != NULL
+            || thread_incoming_havework_disabled(handle)
             ;
 }
 
+/// Prepares the dispatcher for giving up the CPU: the polled channels are checked
+/// a last time, and the senders told to ring the doorbell if it may sleep.
+/// Returns whether it still needs to run.
+static inline bool sleep_prepare_disabled(dispatcher_handle_t handle)
+{
+    poll_channels_sleep_disabled(handle);
+    thread_incoming_sleep_disabled(handle);
+    return havework_disabled(handle);
+}
+
 void *thread_block(struct thread **queue);
 void *thread_block_disabled(dispatcher_handle_t handle, struct thread **queue);
 void *thread_block_and_release_spinlock_disabled(dispatcher_handle_t handle,
@@ -22,6 +22,7 @@
 #include <aos/dispatcher_arch.h>
 #include <barrelfish_kpi/dispatcher_shared.h>
 #include <aos/morecore.h>
+#include <aos/malloc.h>
 #include <aos/paging.h>
 #include <aos/aos_rpc.h>
 #include <aos/systime.h>
@@ -29,6 +30,7 @@
 #include "../../usr/iox/iox.h"
 
 #include "threads_priv.h"
+#include "domain_priv.h"
 #include "init.h"
 
 /// Are we the init domain (and thus need to take some special paths)?
@@ -49,6 +51,8 @@ void libc_exit(int status)
 #endif
     // exit causes the process to end
     // thread_exit(status);
+    // the dispatchers on the other cores would otherwise keep running
+    domain_stop_dispatchers();
     proc_mgmt_exit(status);
     // If we're not dead by now, we wait
     while (1) {}
@@ -177,6 +181,11 @@ errval_t barrelfish_init_onthread(struct spawn_domain_params *params)
         return err_push(err, LIB_ERR_MORECORE_INIT);
     }
 
+    err = aos_malloc_init();
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_MALLOC_INIT);
+    }
+
     lmp_endpoint_init();
 
     if (!init_domain) {
@@ -0,0 +1,551 @@
+/**
+ * \file
+ * \brief Size-class malloc with per-thread caches
+ */
+
+/*
+ * Copyright (c) 2022, The University of British Columbia
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <string.h>
+#include <aos/aos.h>
+#include <aos/malloc.h>
+#include <aos/paging.h>
+
+/*
+ * Requests up to MALLOC_SMALL_MAX bytes are rounded up to one of the size classes:
+ * steps of 16 bytes up to 128 bytes, then four classes per power of two. The objects
+ * of a class are carved from spans of MALLOC_SPAN_SIZE bytes that are aligned to
+ * their size and start with a header, so every object finds its span by rounding
+ * its address down.
+ *
+ * Every thread caches objects of each class in a list linked through the objects.
+ * malloc and free only touch this list, objects move between the cache and the spans
+ * in batches under the lock of the class. Spans without any objects in use go back
+ * to a pool shared by all the classes.
+ *
+ * Larger requests get a lazily mapped region of their own, which is unmapped again
+ * by free. Its header is at the start of the region, which is aligned like a span,
+ * so free tells both apart by the magic value it finds there.
+ *
+ * The spans are carved from lazily mapped arenas as well. Pages of an object that
+ * were never used are only touched while no lock of the allocator is held, as the
+ * page fault may have to allocate memory itself.
+ */
+
+// hooks of the libc malloc, see lib/libc/sys/barrelfish/oldmalloc.c
+typedef void *(*alt_malloc_t)(size_t bytes);
+extern alt_malloc_t alt_malloc;
+typedef void (*alt_free_t)(void *p);
+extern alt_free_t alt_free;
+typedef void *(*alt_realloc_t)(void *p, size_t bytes);
+extern alt_realloc_t alt_realloc;
+
+#define MALLOC_NUM_CLASSES 32
+
+#define MALLOC_SPAN_MAGIC  0x5ba25ba2U
+#define MALLOC_LARGE_MAGIC 0x1a7e1a7eU
+
+/// bytes in front of a large block, keeps the block aligned to a cache line
+#define MALLOC_LARGE_HEADER 64
+
+/// address space reserved at once for the spans
+#define MALLOC_ARENA_SIZE (256 * 1024 * 1024)
+
+/// pages mapped around a faulting page of the arenas and the large blocks
+#define MALLOC_FAULT_AROUND (16 * BASE_PAGE_SIZE)
+
+/// bytes a thread caches of each size class, at most MALLOC_CACHE_MAX objects
+#define MALLOC_CACHE_BYTES (32 * 1024)
+#define MALLOC_CACHE_MAX   256
+
+/// empty spans the pool keeps committed, the memory of further ones is decommitted
+#define MALLOC_SPAN_CACHE 8
+
+struct malloc_span {
+    uint32_t magic;
+    uint32_t class;
+    // objects of the span that are in use or in a thread cache
+    uint32_t used;
+    // whether the span is in the list of spans of its class with objects left
+    bool     partial;
+    // objects given back to the span, linked through their first word
+    void    *free;
+    // next object that was never handed out, and the end of the last one
+    lvaddr_t bump;
+    lvaddr_t end;
+    struct malloc_span *next;
+    struct malloc_span *prev;
+};
+
+#define MALLOC_SPAN_FIRST ROUND_UP(sizeof(struct malloc_span), 64)
+
+struct malloc_large {
+    uint32_t magic;
+    // size of the mapped region
+    size_t   bytes;
+};
+
+struct malloc_class {
+    struct thread_mutex mutex;
+    // spans with objects left
+    struct malloc_span *partial;
+    size_t              spans;
+    // objects in use or in a thread cache
+    size_t              used;
+    size_t              size;
+    // objects a thread caches at most
+    size_t              cache_max;
+    // objects moved between a thread cache and the spans at once
+    size_t              batch;
+};
+
+struct malloc_bin {
+    // linked through the first word of the objects
+    void  *head;
+    size_t count;
+};
+
+static struct malloc_class malloc_classes[MALLOC_NUM_CLASSES];
+
+static struct {
+    struct thread_mutex mutex;
+    // empty spans, linked through next
+    struct malloc_span *free;
+    size_t              nfree;
+    lvaddr_t            arena_next;
+    lvaddr_t            arena_end;
+    size_t              large_blocks;
+    size_t              large_bytes;
+} malloc_pool;
+
+static __thread struct malloc_bin malloc_cache[MALLOC_NUM_CLASSES];
+
+static inline size_t _malloc_class(size_t bytes)
+{
+    if (bytes <= 128) {
+        return bytes == 0 ? 0 : (bytes - 1) / 16;
+    }
+    // 2^p < bytes <= 2^(p + 1), the two bits below the leading one pick the class
+    size_t p = 63 - __builtin_clzl(bytes - 1);
+    return 8 + (p - 7) * 4 + (((bytes - 1) >> (p - 2)) & 3);
+}
+
+static inline size_t _malloc_class_size(size_t class)
+{
+    if (class < 8) {
+        return (class + 1) * 16;
+    }
+    size_t p = 7 + (class - 8) / 4;
+    return (1UL << p) + (((class - 8) % 4 + 1) << (p - 2));
+}
+
+static errval_t _malloc_arena_reserve(lvaddr_t *base)
+{
+    struct paging_state *st = get_current_paging_state();
+
+    void    *buf;
+    errval_t err = paging_alloc(st, &buf, MALLOC_ARENA_SIZE, MALLOC_SPAN_SIZE);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    paging_set_fault_around(st, (lvaddr_t)buf, MALLOC_FAULT_AROUND);
+
+    *base = (lvaddr_t)buf;
+    return SYS_ERR_OK;
+}
+
+static struct malloc_span *_malloc_span_get(void)
+{
+    struct malloc_span *span = NULL;
+
+    thread_mutex_lock(&malloc_pool.mutex);
+    while (span == NULL) {
+        if (malloc_pool.free != NULL) {
+            span             = malloc_pool.free;
+            malloc_pool.free = span->next;
+            malloc_pool.nfree--;
+        } else if (malloc_pool.arena_next < malloc_pool.arena_end) {
+            span = (struct malloc_span *)malloc_pool.arena_next;
+            malloc_pool.arena_next += MALLOC_SPAN_SIZE;
+        } else {
+            // reserving address space may allocate memory, so it happens without the lock
+            thread_mutex_unlock(&malloc_pool.mutex);
+            lvaddr_t arena;
+            errval_t err = _malloc_arena_reserve(&arena);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "malloc: could not reserve an arena");
+                return NULL;
+            }
+            thread_mutex_lock(&malloc_pool.mutex);
+            // if another thread got an arena meanwhile, the rest of it only costs address space
+            malloc_pool.arena_next = arena;
+            malloc_pool.arena_end  = arena + MALLOC_ARENA_SIZE;
+        }
+    }
+    thread_mutex_unlock(&malloc_pool.mutex);
+
+    return span;
+}
+
+static void _malloc_span_put(struct malloc_span *span)
+{
+    span->magic = 0;
+
+    thread_mutex_lock(&malloc_pool.mutex);
+    bool keep = malloc_pool.nfree < MALLOC_SPAN_CACHE;
+    thread_mutex_unlock(&malloc_pool.mutex);
+
+    if (!keep) {
+        // the page of the header stays, the others are faulted in again once the span is used
+        errval_t err = paging_decommit(get_current_paging_state(),
+                                       (lvaddr_t)span + BASE_PAGE_SIZE,
+                                       MALLOC_SPAN_SIZE - BASE_PAGE_SIZE);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "malloc: could not decommit a span");
+        }
+    }
+
+    thread_mutex_lock(&malloc_pool.mutex);
+    span->next       = malloc_pool.free;
+    malloc_pool.free = span;
+    malloc_pool.nfree++;
+    thread_mutex_unlock(&malloc_pool.mutex);
+}
+
+static void _malloc_span_init(struct malloc_span *span, size_t class)
+{
+    size_t size = malloc_classes[class].size;
+
+    span->magic   = MALLOC_SPAN_MAGIC;
+    span->class   = class;
+    span->used    = 0;
+    span->partial = false;
+    span->free    = NULL;
+    span->bump    = (lvaddr_t)span + MALLOC_SPAN_FIRST;
+    span->end     = span->bump + (MALLOC_SPAN_SIZE - MALLOC_SPAN_FIRST) / size * size;
+    span->next    = NULL;
+    span->prev    = NULL;
+}
+
+static void _malloc_span_link(struct malloc_class *cls, struct malloc_span *span)
+{
+    span->prev = NULL;
+    span->next = cls->partial;
+    if (cls->partial != NULL) {
+        cls->partial->prev = span;
+    }
+    cls->partial  = span;
+    span->partial = true;
+}
+
+static void _malloc_span_unlink(struct malloc_class *cls, struct malloc_span *span)
+{
+    if (span->prev != NULL) {
+        span->prev->next = span->next;
+    } else {
+        cls->partial = span->next;
+    }
+    if (span->next != NULL) {
+        span->next->prev = span->prev;
+    }
+    span->partial = false;
+}
+
+static bool _malloc_cache_refill(size_t class, struct malloc_bin *bin)
+{
+    struct malloc_class *cls = &malloc_classes[class];
+    void                *objs[MALLOC_CACHE_MAX / 2];
+    size_t               n = 0;
+
+    thread_mutex_lock(&cls->mutex);
+    while (cls->partial == NULL) {
+        thread_mutex_unlock(&cls->mutex);
+        struct malloc_span *span = _malloc_span_get();
+        if (span == NULL) {
+            return false;
+        }
+        _malloc_span_init(span, class);
+        thread_mutex_lock(&cls->mutex);
+        _malloc_span_link(cls, span);
+        cls->spans++;
+    }
+
+    while (n < cls->batch && cls->partial != NULL) {
+        struct malloc_span *span = cls->partial;
+        for (; n < cls->batch; n++) {
+            if (span->free != NULL) {
+                objs[n]    = span->free;
+                span->free = *(void **)span->free;
+            } else if (span->bump < span->end) {
+                objs[n] = (void *)span->bump;
+                span->bump += cls->size;
+            } else {
+                break;
+            }
+            span->used++;
+        }
+        if (span->free == NULL && span->bump >= span->end) {
+            _malloc_span_unlink(cls, span);
+        }
+    }
+    cls->used += n;
+    thread_mutex_unlock(&cls->mutex);
+
+    // objects that were never handed out may still have to be faulted in
+    for (size_t i = n; i > 0; i--) {
+        *(void **)objs[i - 1] = bin->head;
+        bin->head             = objs[i - 1];
+    }
+    bin->count += n;
+
+    return true;
+}
+
+static void _malloc_cache_flush(size_t class, struct malloc_bin *bin, size_t count)
+{
+    struct malloc_class *cls   = &malloc_classes[class];
+    struct malloc_span  *empty = NULL;
+
+    thread_mutex_lock(&cls->mutex);
+    for (size_t i = 0; i < count && bin->head != NULL; i++) {
+        void *obj = bin->head;
+        bin->head = *(void **)obj;
+        bin->count--;
+
+        struct malloc_span *span = (struct malloc_span *)ROUND_DOWN((lvaddr_t)obj, MALLOC_SPAN_SIZE);
+        *(void **)obj = span->free;
+        span->free    = obj;
+        span->used--;
+        cls->used--;
+
+        if (!span->partial) {
+            _malloc_span_link(cls, span);
+        }
+        // one span stays with the class for the next refill, the others go to the pool
+        if (span->used == 0 && (cls->partial != span || span->next != NULL)) {
+            _malloc_span_unlink(cls, span);
+            cls->spans--;
+            span->next = empty;
+            empty      = span;
+        }
+    }
+    thread_mutex_unlock(&cls->mutex);
+
+    while (empty != NULL) {
+        struct malloc_span *next = empty->next;
+        _malloc_span_put(empty);
+        empty = next;
+    }
+}
+
+static void *_malloc_large(size_t bytes)
+{
+    struct paging_state *st = get_current_paging_state();
+
+    if (bytes > SIZE_MAX - MALLOC_LARGE_HEADER - BASE_PAGE_SIZE) {
+        return NULL;
+    }
+    size_t size = ROUND_UP(bytes + MALLOC_LARGE_HEADER, BASE_PAGE_SIZE);
+
+    void    *buf;
+    errval_t err = paging_alloc(st, &buf, size, MALLOC_SPAN_SIZE);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "malloc: could not reserve %zu bytes", size);
+        return NULL;
+    }
+    paging_set_fault_around(st, (lvaddr_t)buf, MALLOC_FAULT_AROUND);
+
+    struct malloc_large *large = buf;
+    large->magic               = MALLOC_LARGE_MAGIC;
+    large->bytes               = size;
+
+    thread_mutex_lock(&malloc_pool.mutex);
+    malloc_pool.large_blocks++;
+    malloc_pool.large_bytes += size;
+    thread_mutex_unlock(&malloc_pool.mutex);
+
+    return (char *)buf + MALLOC_LARGE_HEADER;
+}
+
+static void _malloc_free_large(struct malloc_large *large)
+{
+    size_t size  = large->bytes;
+    large->magic = 0;
+
+    errval_t err = paging_unmap(get_current_paging_state(), large);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "free: could not unmap a block of %zu bytes", size);
+        return;
+    }
+
+    thread_mutex_lock(&malloc_pool.mutex);
+    malloc_pool.large_blocks--;
+    malloc_pool.large_bytes -= size;
+    thread_mutex_unlock(&malloc_pool.mutex);
+}
+
+static void *_malloc(size_t bytes)
+{
+    if (bytes > MALLOC_SMALL_MAX) {
+        return _malloc_large(bytes);
+    }
+
+    size_t             class = _malloc_class(bytes);
+    struct malloc_bin *bin   = &malloc_cache[class];
+    if (bin->head == NULL && !_malloc_cache_refill(class, bin)) {
+        return NULL;
+    }
+
+    void *obj = bin->head;
+    bin->head = *(void **)obj;
+    bin->count--;
+    return obj;
+}
+
+static void _free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    struct malloc_span *span = (struct malloc_span *)ROUND_DOWN((lvaddr_t)ptr, MALLOC_SPAN_SIZE);
+    if (span->magic == MALLOC_LARGE_MAGIC) {
+        _malloc_free_large((struct malloc_large *)span);
+        return;
+    }
+    if (span->magic != MALLOC_SPAN_MAGIC) {
+        debug_printf("free: %p was not allocated by malloc\n", ptr);
+        return;
+    }
+
+    struct malloc_class *cls = &malloc_classes[span->class];
+    struct malloc_bin   *bin = &malloc_cache[span->class];
+    *(void **)ptr            = bin->head;
+    bin->head                = ptr;
+    if (++bin->count > cls->cache_max) {
+        _malloc_cache_flush(span->class, bin, cls->batch);
+    }
+}
+
+static void *_realloc(void *ptr, size_t bytes)
+{
+    if (ptr == NULL) {
+        return _malloc(bytes);
+    }
+    if (bytes == 0) {
+        _free(ptr);
+        return NULL;
+    }
+
+    size_t              usable;
+    struct malloc_span *span = (struct malloc_span *)ROUND_DOWN((lvaddr_t)ptr, MALLOC_SPAN_SIZE);
+    if (span->magic == MALLOC_LARGE_MAGIC) {
+        usable = ((struct malloc_large *)span)->bytes - MALLOC_LARGE_HEADER;
+        // large blocks shrinking to less than half are moved to give the memory back
+        if (bytes <= usable && bytes > usable / 2) {
+            return ptr;
+        }
+    } else if (span->magic == MALLOC_SPAN_MAGIC) {
+        usable = malloc_classes[span->class].size;
+        if (bytes <= usable) {
+            return ptr;
+        }
+    } else {
+        debug_printf("realloc: %p was not allocated by malloc\n", ptr);
+        return NULL;
+    }
+
+    void *new = _malloc(bytes);
+    if (new == NULL) {
+        return NULL;
+    }
+    memcpy(new, ptr, MIN(bytes, usable));
+    _free(ptr);
+    return new;
+}
+
+/**
+ * @brief initializes the size classes and installs the allocator as the libc malloc
+ *
+ * @return SYS_ERR_OK on success, error value on failure
+ *
+ * Must be called before the first call to malloc.
+ */
+errval_t aos_malloc_init(void)
+{
+    for (size_t class = 0; class < MALLOC_NUM_CLASSES; class++) {
+        struct malloc_class *cls = &malloc_classes[class];
+        thread_mutex_init(&cls->mutex);
+        cls->partial   = NULL;
+        cls->spans     = 0;
+        cls->used      = 0;
+        cls->size      = _malloc_class_size(class);
+        cls->cache_max = MIN(MAX(MALLOC_CACHE_BYTES / cls->size, 4), MALLOC_CACHE_MAX);
+        cls->batch     = cls->cache_max / 2;
+    }
+    assert(_malloc_class(MALLOC_SMALL_MAX) == MALLOC_NUM_CLASSES - 1);
+
+    thread_mutex_init(&malloc_pool.mutex);
+    malloc_pool.free         = NULL;
+    malloc_pool.nfree        = 0;
+    malloc_pool.large_blocks = 0;
+    malloc_pool.large_bytes  = 0;
+
+    errval_t err = _malloc_arena_reserve(&malloc_pool.arena_next);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    malloc_pool.arena_end = malloc_pool.arena_next + MALLOC_ARENA_SIZE;
+
+    alt_malloc  = _malloc;
+    alt_free    = _free;
+    alt_realloc = _realloc;
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * @brief gives the objects cached by the calling thread back to their spans
+ *
+ * Called by a thread before it exits.
+ */
+void aos_malloc_thread_exit(void)
+{
+    for (size_t class = 0; class < MALLOC_NUM_CLASSES; class++) {
+        if (malloc_cache[class].head != NULL) {
+            _malloc_cache_flush(class, &malloc_cache[class], SIZE_MAX);
+        }
+    }
+}
+
+/**
+ * @brief returns how much memory the allocator holds and how much of it is in use
+ *
+ * @param[out] stats  filled in with the current numbers
+ */
+void aos_malloc_get_stats(struct aos_malloc_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    for (size_t class = 0; class < MALLOC_NUM_CLASSES; class++) {
+        struct malloc_class *cls     = &malloc_classes[class];
+        size_t               objects = (MALLOC_SPAN_SIZE - MALLOC_SPAN_FIRST) / cls->size;
+
+        thread_mutex_lock(&cls->mutex);
+        stats->spans += cls->spans;
+        stats->span_bytes += cls->spans * objects * cls->size;
+        stats->used_bytes += cls->used * cls->size;
+        thread_mutex_unlock(&cls->mutex);
+    }
+
+    thread_mutex_lock(&malloc_pool.mutex);
+    stats->large_blocks = malloc_pool.large_blocks;
+    stats->large_bytes  = malloc_pool.large_bytes;
+    thread_mutex_unlock(&malloc_pool.mutex);
+}
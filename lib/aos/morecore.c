@@ -113,6 +113,9 @@ errval_t morecore_init(size_t alignment)
 // Morecore allocates 256GB lazy blocks
 #define DEFAULT_LAZY_BLOCK_SIZE (1L << 38)
 
+// most bytes mapped by a page fault in the heap, the window grows with sequential faults
+#define MORECORE_FAULT_AROUND (64 * BASE_PAGE_SIZE)
+
 
 /**
  * @brief Morecore memory allocator to back the heap region with dynamically allocated memory
@@ -148,6 +151,7 @@ static void *morecore_alloc(size_t bytes, size_t *retbytes)
             debug_printf("Lazy page allocation failed in morecore_alloc\n");
             return NULL;
         }
+        paging_set_fault_around(get_current_paging_state(), (lvaddr_t)buf, MORECORE_FAULT_AROUND);
         if (bytes >= DEFAULT_LAZY_BLOCK_SIZE) {
             return buf;
         } else {
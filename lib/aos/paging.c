@@ -41,65 +41,86 @@ static struct paging_state current;
 #define PT_CLR_LAZY(pt, index) (pt)->lazy[(index) / 32] &= ~(1 << ((index) % 32));
 #define PT_IS_LAZY(pt, index)  (((pt)->lazy[(index) / 32] & (1 << ((index) % 32))) != 0)
 
-static inline errval_t _pt_ensure_slab_space(struct paging_state *st)
+#define PT_SET_BLOCK(pt, index) (pt)->block[(index) / 32] |= 1 << ((index) % 32);
+#define PT_CLR_BLOCK(pt, index) (pt)->block[(index) / 32] &= ~(1 << ((index) % 32));
+#define PT_IS_BLOCK(pt, index)  (((pt)->block[(index) / 32] & (1 << ((index) % 32))) != 0)
+
+#define PT_SET_TAIL(pt, index) (pt)->tail[(index) / 32] |= 1 << ((index) % 32);
+#define PT_CLR_TAIL(pt, index) (pt)->tail[(index) / 32] &= ~(1 << ((index) % 32));
+#define PT_IS_TAIL(pt, index)  (((pt)->tail[(index) / 32] & (1 << ((index) % 32))) != 0)
+
+/*
+ * The address space of a paging state has two locks: vaddr_mutex protects the tree of regions,
+ * the pagers and the fault counters, pt_mutex protects the page tables and the frames the pagers
+ * provided for them. A thread never waits for
+ * one of them while holding the other one. Frames are allocated and slabs are refilled without
+ * holding either, refilling a slab maps memory and takes both of them itself.
+ */
+
+// refills the slab if it has no more than min_free objects left, unless it is being refilled
+// already. Requires no lock.
+static errval_t _slab_ensure_space(struct paging_state *st, struct slab_allocator *slabs,
+                                   struct thread_mutex *mutex, bool *refilling, size_t min_free,
+                                   size_t bytes)
 {
     errval_t err = SYS_ERR_OK;
 
-    // TODO: Do not duplicate the code for these two checks
-    if (st->_refill_slab_pt) {
-        if (slab_freecount(&st->page_table_allocator) == 0) {
-            // this should never happen! (we are now stuck...)
-            return LIB_ERR_SLAB_ALLOC_FAIL;
-        }
+    thread_mutex_lock_nested(mutex);
+    if (*refilling) {
+        // the refill maps its frame with what is left
+        bool empty = slab_freecount(slabs) == 0;
+        thread_mutex_unlock(mutex);
+        return empty ? LIB_ERR_SLAB_ALLOC_FAIL : SYS_ERR_OK;
+    }
+    if (slab_freecount(slabs) > min_free) {
+        thread_mutex_unlock(mutex);
         return SYS_ERR_OK;
     }
+    *refilling = true;
+    thread_mutex_unlock(mutex);
 
-    if (!st->_refill_slab_pt && slab_freecount(&st->page_table_allocator) <= 8) {
-        st->_refill_slab_pt = true;
-
-        struct capref cap;
-        err = st->slot_alloc->alloc(st->slot_alloc, &cap);
+    struct capref cap;
+    size_t        frame_size = 0;
+    void         *buf        = NULL;
+    err = st->slot_alloc->alloc(st->slot_alloc, &cap);
+    if (err_is_ok(err)) {
+        err = frame_create(cap, bytes, &frame_size);
         if (err_is_fail(err)) {
-            st->_refill_slab_pt = false;
-            return err;  // NOTE there is not much we can do at this point...
-        }
-        err = slab_refill_no_pagefault(&st->page_table_allocator, cap,
-                                       sizeof(struct slab_head) + 12 * sizeof(struct page_table));
-        if (err_is_fail(err)) {
-            st->_refill_slab_pt = false;
             assert(err_is_ok(st->slot_alloc->free(st->slot_alloc, cap)));
-            return err;  // NOTE there is not much we can do at this point...
+        } else {
+            err = paging_map_frame(get_current_paging_state(), &buf, frame_size, cap);
+            if (err_is_fail(err)) {
+                cap_destroy(cap);
+            }
         }
-        st->_refill_slab_pt = false;
     }
 
-    if (st->_refill_slab_rb) {
-        if (slab_freecount(&st->rb_node_allocator) == 0) {
-            // this should never happen! (we are now stuck...)
-            return LIB_ERR_SLAB_ALLOC_FAIL;
-        }
-        return SYS_ERR_OK;
+    thread_mutex_lock_nested(mutex);
+    if (err_is_ok(err)) {
+        slab_grow(slabs, buf, frame_size);
     }
+    *refilling = false;
+    thread_mutex_unlock(mutex);
+    return err;  // NOTE there is not much we can do at this point...
+}
 
-    if (!st->_refill_slab_rb && slab_freecount(&st->rb_node_allocator) <= 8) {
-        st->_refill_slab_rb = true;
-
-        struct capref cap;
-        err = st->slot_alloc->alloc(st->slot_alloc, &cap);
-        if (err_is_fail(err)) {
-            st->_refill_slab_rb = false;
-            return err;  // NOTE there is not much we can do at this point...
-        }
-        err = slab_refill_no_pagefault(&st->rb_node_allocator, cap,
-                                       sizeof(struct slab_head) + 12 * sizeof(struct rb_node));
-        if (err_is_fail(err)) {
-            st->_refill_slab_rb = false;
-            assert(err_is_ok(st->slot_alloc->free(st->slot_alloc, cap)));
-            return err;  // NOTE there is not much we can do at this point...
-        }
-        st->_refill_slab_rb = false;
+static inline errval_t _pt_ensure_slab_space(struct paging_state *st)
+{
+    errval_t err = _slab_ensure_space(st, &st->page_table_allocator, &st->pt_mutex,
+                                      &st->_refill_slab_pt, 8,
+                                      sizeof(struct slab_head) + 12 * sizeof(struct page_table));
+    if (err_is_fail(err)) {
+        return err;
     }
-    return SYS_ERR_OK;
+    return _slab_ensure_space(st, &st->rb_node_allocator, &st->vaddr_mutex, &st->_refill_slab_rb, 8,
+                              sizeof(struct slab_head) + 12 * sizeof(struct paging_vregion));
+}
+
+// a lazy mapping needs at most one new page_table_lazy, see try_map
+static inline errval_t _pt_ensure_lazy_slab_space(struct paging_state *st)
+{
+    return _slab_ensure_space(st, &st->lazy_frames_allocator, &st->pt_mutex, &st->_refill_slab_lazy,
+                              2, sizeof(struct slab_head) + 4 * sizeof(struct page_table_lazy));
 }
 
 /**
@@ -116,7 +137,6 @@ static inline errval_t _pt_ensure_slab_space(struct paging_state *st)
  */
 static errval_t pt_alloc(struct paging_state *st, enum objtype type, struct capref *ret)
 {
-    thread_mutex_lock_nested(&mm_mutex);
     assert(st != NULL);
     errval_t err = SYS_ERR_OK;
 
@@ -125,18 +145,15 @@ static errval_t pt_alloc(struct paging_state *st, enum objtype type, struct capr
     // try to get a slot from the slot allocator to hold the new page table
     err = st->slot_alloc->alloc(st->slot_alloc, ret);
     if (err_is_fail(err)) {
-        thread_mutex_unlock(&mm_mutex);
         return err_push(err, LIB_ERR_SLOT_ALLOC);
     }
 
     // create the vnode in the supplied slot
     err = vnode_create(*ret, type);
     if (err_is_fail(err)) {
-        thread_mutex_unlock(&mm_mutex);
         return err_push(err, LIB_ERR_VNODE_CREATE);
     }
 
-    thread_mutex_unlock(&mm_mutex);
     return SYS_ERR_OK;
 }
 
@@ -199,9 +216,12 @@ static inline void _pt_table_init(struct page_table *pt, enum objtype type, uint
     pt->index        = index;
     pt->num_children = 0;
     pt->type         = type;
+    pt->lazy_frames  = NULL;
 
     for (size_t entry = 0; entry < VMSAv8_64_PTABLE_NUM_ENTRIES; ++entry) {
         PT_CLR_LAZY(pt, entry);
+        PT_CLR_BLOCK(pt, entry);
+        PT_CLR_TAIL(pt, entry);
         if (pt->type != ObjType_VNode_AARCH64_l3) {
             pt->entries[entry].pt = NULL;
         } else {
@@ -230,7 +250,8 @@ static inline u_int16_t _pt_table_num_children(struct paging_state *st, struct p
 #ifdef PT_DEBUG_CHILD_COUNT
     u_int16_t num_children = 0;
     for (size_t entry = 0; entry < VMSAv8_64_PTABLE_NUM_ENTRIES; ++entry) {
-        if (pt->type == ObjType_VNode_AARCH64_l3 && !capref_is_null(pt->entries[entry].frame_cap)) {
+        if ((pt->type == ObjType_VNode_AARCH64_l3 || PT_IS_BLOCK(pt, entry))
+            && !capref_is_null(pt->entries[entry].frame_cap)) {
             ++num_children;
         } else if (pt->entries[entry].pt != NULL) {
             ++num_children;
@@ -262,6 +283,9 @@ static inline errval_t _pt_table_destroy(struct paging_state *st, struct page_ta
         // TODO handle the error correctly.
         return err;
     }
+    if ((*pt)->lazy_frames != NULL) {
+        slab_free(&st->lazy_frames_allocator, (*pt)->lazy_frames);
+    }
     slab_free(&st->page_table_allocator, *pt);
     *pt = NULL;
     return SYS_ERR_OK;
@@ -279,6 +303,12 @@ static inline errval_t _pt_table_locate_entry(struct paging_state *st, struct pa
 
     uint16_t index = _pt_get_type_index(type, addr);
 
+    // the entry maps a frame as a block, there is no page table below it
+    if (PT_IS_BLOCK(pt, index)) {
+        *entry = NULL;
+        return create_if_missing ? LIB_ERR_PMAP_EXISTING_MAPPING : SYS_ERR_OK;
+    }
+
     *entry = pt->entries[index].pt;
     if (*entry != NULL || !create_if_missing) {
         return SYS_ERR_OK;
@@ -338,37 +368,100 @@ static inline errval_t _pt_table_get_entry(struct paging_state *st, struct page_
     return _pt_table_locate_entry(st, pt, addr, flags, entry, true);
 }
 
+// maps as many pages of the range as are free in a row with a single mapping
 static inline errval_t _pt_table_map_frame(struct paging_state *st, struct page_table *ptl3,
                                            lvaddr_t addr, size_t bytes, struct capref frame,
-                                           size_t offset, int flags, bool lazy)
+                                           size_t offset, int flags, bool lazy, size_t *mapped)
 {
     errval_t err = SYS_ERR_OK;
     assert(st != NULL && ptl3 != NULL);
 
     uint16_t index = VMSAv8_64_L3_INDEX(addr);
+    size_t   count = DIVIDE_ROUND_UP(bytes, BASE_PAGE_SIZE);
+    assert(index + count <= VMSAv8_64_PTABLE_NUM_ENTRIES);
+
+    *mapped = BASE_PAGE_SIZE;
     // check that we are not overwriting an existing frame_cap!
     if (!capref_is_null(ptl3->entries[index].frame_cap)) {
         return SYS_ERR_OK;
     }
-    ++ptl3->num_children;
 
-    err = st->slot_alloc->alloc(st->slot_alloc, &ptl3->entries[index].frame_cap);
+    size_t pages = 1;
+    while (pages < count && capref_is_null(ptl3->entries[index + pages].frame_cap)) {
+        pages++;
+    }
+
+    if (lazy && ptl3->lazy_frames == NULL) {
+        ptl3->lazy_frames = slab_alloc(&st->lazy_frames_allocator);
+        if (ptl3->lazy_frames == NULL) {
+            return LIB_ERR_SLAB_ALLOC_FAIL;
+        }
+    }
+
+    struct capref mapping;
+    err = st->slot_alloc->alloc(st->slot_alloc, &mapping);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    // TODO is it correct to assume the offset should be used for the L3 mapping?
+    err = vnode_map(ptl3->page_table, frame, index, flags, offset, pages, mapping);
     if (err_is_fail(err)) {
+        st->slot_alloc->free(st->slot_alloc, mapping);
         return err;
     }
 
+    // every entry refers to the mapping, the ones after the first are marked as its tail
+    for (size_t i = 0; i < pages; i++) {
+        ptl3->entries[index + i].frame_cap = mapping;
+        if (i > 0) {
+            PT_SET_TAIL(ptl3, index + i);
+        }
+        if (lazy) {
+            // the frame has no other owner, it goes with the last of its pages
+            PT_SET_LAZY(ptl3, index + i);
+            ptl3->lazy_frames->frames[index + i] = frame;
+            ptl3->lazy_frames->pages[index + i]  = offset / BASE_PAGE_SIZE + i;
+        }
+    }
+    ptl3->num_children += pages;
     if (lazy) {
-        // TODO check that the frame is off size exactly BASE_PAGE_SIZE
-        //      we delete frames of lazily allocated pages.
-        PT_SET_LAZY(ptl3, index);
+        st->fault_pages_mapped += pages;
     }
 
-    // TODO is it correct to assume the offset should be used for the L3 mapping?
-    err = vnode_map(ptl3->page_table, frame, index, flags, offset,
-                    DIVIDE_ROUND_UP(bytes, BASE_PAGE_SIZE), ptl3->entries[index].frame_cap);
+    *mapped = pages * BASE_PAGE_SIZE;
+    return SYS_ERR_OK;
+}
+
+static inline errval_t _pt_table_map_block(struct paging_state *st, struct page_table *pt,
+                                           lvaddr_t addr, struct capref frame, size_t offset,
+                                           int flags)
+{
+    errval_t err = SYS_ERR_OK;
+    assert(st != NULL);
+    assert(pt->type == ObjType_VNode_AARCH64_l1 || pt->type == ObjType_VNode_AARCH64_l2);
+
+    uint16_t index = _pt_get_type_index(pt->type, addr);
+    // a page table or a block is already there, the caller maps pages instead
+    if (PT_IS_BLOCK(pt, index) || pt->entries[index].pt != NULL) {
+        return LIB_ERR_PMAP_EXISTING_MAPPING;
+    }
+
+    struct capref mapping;
+    err = st->slot_alloc->alloc(st->slot_alloc, &mapping);
     if (err_is_fail(err)) {
         return err;
     }
+
+    err = vnode_map(pt->page_table, frame, index, flags, offset, 1, mapping);
+    if (err_is_fail(err)) {
+        st->slot_alloc->free(st->slot_alloc, mapping);
+        return err;
+    }
+
+    ++pt->num_children;
+    pt->entries[index].frame_cap = mapping;
+    PT_SET_BLOCK(pt, index);
     return SYS_ERR_OK;
 }
 
@@ -400,11 +493,13 @@ static inline errval_t _vaddr_lookup(struct paging_state *st, lvaddr_t start_vad
  * @param[out] vaddr            Virtual address contained within the region to lookup
  * @param[out] start_vaddr      Starting virtual address of the identified region
  * @param[out] bytes            Size of the identified region
+ * @param[out] region           Returns the node of the region, may be NULL
  *
  * @return Either SYS_ERR_OK if no error occurred or an error indicating what went wrong otherwise.
  */
 static inline errval_t _vaddr_lookup_region(struct paging_state *st, lvaddr_t vaddr,
-                                            lvaddr_t *start_vaddr, size_t *bytes)
+                                            lvaddr_t *start_vaddr, size_t *bytes,
+                                            struct paging_vregion **region)
 {
     // look for the first node indicating the beginning of the allocated region
     struct rb_node *node = rb_tree_find_lower(&st->virtual_memory, vaddr);
@@ -425,6 +520,10 @@ static inline errval_t _vaddr_lookup_region(struct paging_state *st, lvaddr_t va
 
     *start_vaddr = node->start;
     *bytes       = succ->start - node->start;
+    if (region != NULL) {
+        // the nodes of the tree are the first member of their paging_vregion
+        *region = (struct paging_vregion *)node;
+    }
 
     return SYS_ERR_OK;
 }
@@ -451,6 +550,11 @@ static inline errval_t _vaddr_alloc_inner(struct paging_state *st, struct rb_nod
     node->start = vaddr;
     rb_tree_update_size(node, 0);
 
+    struct paging_vregion *region = (struct paging_vregion *)node;
+    region->fault_max             = PAGING_FAULT_AROUND_DEFAULT;
+    region->fault_window          = 0;
+    region->fault_next            = 0;
+
     // add a free range at the beginning and the end if necessary
     if (vaddr > original_start) {
         struct rb_node *left = slab_alloc(&st->rb_node_allocator);
@@ -625,16 +729,26 @@ errval_t paging_init_state(struct paging_state *st, lvaddr_t start_vaddr, struct
 
     st->_refill_slab_pt = false;
     st->_refill_slab_rb = false;
+    st->_refill_slab_lazy = false;
+    thread_mutex_init(&st->vaddr_mutex);
+    thread_mutex_init(&st->pt_mutex);
 
     // XXX we probably want to use a different refill function as this just allocates BASE_PAGE_SIZE
     //     M1 specific: we do not care about refill (we have space for enough page_tables by def.)
     slab_init(&st->page_table_allocator, sizeof(struct page_table), NULL);
     slab_grow(&st->page_table_allocator, (void *)&st->_page_table_buf, sizeof(st->_page_table_buf));
 
-    slab_init(&st->rb_node_allocator, sizeof(struct rb_node), NULL);
+    slab_init(&st->rb_node_allocator, sizeof(struct paging_vregion), NULL);
     slab_grow(&st->rb_node_allocator, (void *)&st->_rb_node_buf, sizeof(st->_rb_node_buf));
 
+    // filled with the first lazy mapping, see try_map
+    slab_init(&st->lazy_frames_allocator, sizeof(struct page_table_lazy), NULL);
+
     rb_tree_init(&st->virtual_memory);
+    st->pagers = NULL;
+    st->faults = 0;
+    st->fault_pages = 0;
+    st->fault_pages_mapped = 0;
 
     struct rb_node *range = slab_alloc(&st->rb_node_allocator);
     range->start          = start_vaddr;
@@ -654,11 +768,6 @@ errval_t paging_init_state(struct paging_state *st, lvaddr_t start_vaddr, struct
     err = thread_set_exception_handler(_paging_handle_exception, NULL, stack_base, stack_end, NULL,
                                        NULL);
 
-    if (!mm_mutex_init) {
-        thread_mutex_init(&mm_mutex);
-        mm_mutex_init = true;
-    }
-
     return err;
 }
 
@@ -676,11 +785,7 @@ errval_t paging_init_state(struct paging_state *st, lvaddr_t start_vaddr, struct
 errval_t paging_init_state_foreign(struct paging_state *st, lvaddr_t start_vaddr,
                                    struct capref root, struct slot_allocator *ca)
 {
-    errval_t err = SYS_ERR_OK;
-    thread_mutex_lock_nested(&mm_mutex);
-    err = paging_init_state(st, start_vaddr, root, ca);
-    thread_mutex_unlock(&mm_mutex);
-    return err;
+    return paging_init_state(st, start_vaddr, root, ca);
 }
 
 /**
@@ -758,44 +863,37 @@ errval_t paging_init_onthread(struct thread *t)
  */
 errval_t paging_alloc(struct paging_state *st, void **buf, size_t bytes, size_t alignment)
 {
-    thread_mutex_lock_nested(&mm_mutex);
-
     errval_t err = SYS_ERR_OK;
     if (!PT_CHK_ALIGN(alignment)) {
         // XXX should we return a SYS_ERR here instead?
-        thread_mutex_unlock(&mm_mutex);
         return err_push(err, MM_ERR_BAD_ALIGNMENT);
     }
 
     err = _pt_ensure_slab_space(st);
     if (err_is_fail(err)) {
-        thread_mutex_unlock(&mm_mutex);
         return err;
     }
 
-    size_t allocated_bytes;
-    err = _vaddr_alloc(st, buf, bytes, alignment, &allocated_bytes);
-    if (err_is_fail(err)) {
-        thread_mutex_unlock(&mm_mutex);
-        return err;
+    // large regions start at a block boundary, so that their frames can be mapped as blocks
+    if (bytes >= LARGE_PAGE_SIZE && alignment < LARGE_PAGE_SIZE) {
+        alignment = LARGE_PAGE_SIZE;
     }
 
-    thread_mutex_unlock(&mm_mutex);
-    return SYS_ERR_OK;
+    size_t allocated_bytes;
+    thread_mutex_lock_nested(&st->vaddr_mutex);
+    err = _vaddr_alloc(st, buf, bytes, alignment, &allocated_bytes);
+    thread_mutex_unlock(&st->vaddr_mutex);
+    return err;
 }
 
 
-static inline errval_t _paging_map_single_page(struct paging_state *st, lvaddr_t vaddr,
-                                               struct capref frame, size_t bytes, size_t offset,
-                                               int flags, bool lazy)
+// maps pages of the range that lie in the same L3 table, returns how many bytes it covered
+static inline errval_t _paging_map_pages(struct paging_state *st, lvaddr_t vaddr,
+                                         struct capref frame, size_t bytes, size_t offset,
+                                         int flags, bool lazy, size_t *mapped)
 {
     errval_t err = SYS_ERR_OK;
 
-    err = _pt_ensure_slab_space(st);
-    if (err_is_fail(err)) {
-        return err;
-    }
-
     // XXX think about how we want to handle the flags. Do we just set them on L3?
     // XXX we could refactor this code to be recursive. (i.e., directly resolve L3)
     struct page_table *ptl1;
@@ -818,7 +916,7 @@ static inline errval_t _paging_map_single_page(struct paging_state *st, lvaddr_t
 
     // XXX this is most likely using offset wrong?... (it refers to an offset within the frame)
     // printf("offset: %d\n", offset);
-    err = _pt_table_map_frame(st, ptl3, vaddr, bytes, frame, offset, flags, lazy);
+    err = _pt_table_map_frame(st, ptl3, vaddr, bytes, frame, offset, flags, lazy, mapped);
     if (err_is_fail(err)) {
         return err;
     }
@@ -827,10 +925,49 @@ static inline errval_t _paging_map_single_page(struct paging_state *st, lvaddr_t
 }
 
 
-// XXX requires that we have already allocated bytes starting from vaddr
+static inline errval_t _paging_map_block(struct paging_state *st, lvaddr_t vaddr,
+                                         struct capref frame, size_t offset, int flags,
+                                         size_t block_size)
+{
+    errval_t err = SYS_ERR_OK;
+
+    struct page_table *pt;
+    err = _pt_table_get_entry(st, &st->l0, vaddr, flags, &pt);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    if (block_size == LARGE_PAGE_SIZE) {
+        struct page_table *ptl1 = pt;
+        err = _pt_table_get_entry(st, ptl1, vaddr, flags, &pt);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    return _pt_table_map_block(st, pt, vaddr, frame, offset, flags);
+}
+
+// largest block the range at vaddr backed by the frame at paddr can be mapped with, if any
+static inline size_t _paging_block_size(lvaddr_t vaddr, genpaddr_t paddr, size_t bytes)
+{
+    if (bytes >= HUGE_PAGE_SIZE && (vaddr & (HUGE_PAGE_SIZE - 1)) == 0
+        && (paddr & (HUGE_PAGE_SIZE - 1)) == 0) {
+        return HUGE_PAGE_SIZE;
+    }
+    if (bytes >= LARGE_PAGE_SIZE && (vaddr & (LARGE_PAGE_SIZE - 1)) == 0
+        && (paddr & (LARGE_PAGE_SIZE - 1)) == 0) {
+        return LARGE_PAGE_SIZE;
+    }
+    return 0;
+}
+
+// XXX requires that we have already allocated bytes starting from vaddr. Requires no lock, takes
+//     the pt_mutex for one L3 table or block at a time. Lazily allocated pages are mapped by
+//     try_map itself.
 static inline errval_t _paging_map_vaddr(struct paging_state *st, lvaddr_t vaddr,
                                          struct capref frame, size_t bytes, size_t offset,
-                                         int flags, bool lazy)
+                                         int flags)
 {
     assert(st != NULL);
 
@@ -848,15 +985,43 @@ static inline errval_t _paging_map_vaddr(struct paging_state *st, lvaddr_t vaddr
         return LIB_ERR_RAM_ALLOC_WRONG_SIZE;
     }
 
+    size_t step;
     for (size_t curr_addr_to_map = vaddr; curr_addr_to_map < vaddr + bytes;
-         curr_addr_to_map += BASE_PAGE_SIZE) {
-        err = _paging_map_single_page(st, curr_addr_to_map, frame, BASE_PAGE_SIZE, offset, flags,
-                                      lazy);
+         curr_addr_to_map += step) {
+        // a step creates at most one table of each level
+        err = _pt_ensure_slab_space(st);
         if (err_is_fail(err)) {
             return err;
         }
 
-        offset += BASE_PAGE_SIZE;
+        thread_mutex_lock_nested(&st->pt_mutex);
+
+        step = _paging_block_size(curr_addr_to_map, frame_ident.base + offset,
+                                  vaddr + bytes - curr_addr_to_map);
+        if (step != 0) {
+            err = _paging_map_block(st, curr_addr_to_map, frame, offset, flags, step);
+            if (err_no(err) == LIB_ERR_PMAP_EXISTING_MAPPING) {
+                step = 0;
+            } else if (err_is_fail(err)) {
+                thread_mutex_unlock(&st->pt_mutex);
+                return err;
+            }
+        }
+
+        if (step == 0) {
+            // up to the end of the L3 table, where the next block could start
+            lvaddr_t table_end = ROUND_DOWN(curr_addr_to_map, LARGE_PAGE_SIZE) + LARGE_PAGE_SIZE;
+            size_t   run       = MIN(vaddr + bytes, table_end) - curr_addr_to_map;
+            err = _paging_map_pages(st, curr_addr_to_map, frame, run, offset, flags,
+                                    /*lazy=*/false, &step);
+            if (err_is_fail(err)) {
+                thread_mutex_unlock(&st->pt_mutex);
+                return err;
+            }
+        }
+
+        thread_mutex_unlock(&st->pt_mutex);
+        offset += step;
     }
 
     return SYS_ERR_OK;
@@ -877,27 +1042,36 @@ static inline errval_t _paging_map_vaddr(struct paging_state *st, lvaddr_t vaddr
 errval_t paging_map_frame_attr_offset(struct paging_state *st, void **buf, size_t bytes,
                                       struct capref frame, size_t offset, int flags)
 {
-    thread_mutex_lock_nested(&mm_mutex);
     assert(st != NULL && buf != NULL);
 
     errval_t err = SYS_ERR_OK;
-    err          = paging_alloc(st, buf, bytes, BASE_PAGE_SIZE);
+
+    // align the region like the frame, so that it can be mapped with blocks
+    size_t alignment = BASE_PAGE_SIZE;
+    struct frame_identity frame_ident;
+    if (bytes >= LARGE_PAGE_SIZE && err_is_ok(frame_identify(frame, &frame_ident))) {
+        genpaddr_t paddr = frame_ident.base + offset;
+        if (bytes >= HUGE_PAGE_SIZE && (paddr & (HUGE_PAGE_SIZE - 1)) == 0) {
+            alignment = HUGE_PAGE_SIZE;
+        } else if ((paddr & (LARGE_PAGE_SIZE - 1)) == 0) {
+            alignment = LARGE_PAGE_SIZE;
+        }
+    }
+
+    err = paging_alloc(st, buf, bytes, alignment);
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "paging_alloc failed");
-        thread_mutex_unlock(&mm_mutex);
         return err;
     }
     lvaddr_t vaddr = (lvaddr_t)*buf;
 
-    err = _paging_map_vaddr(st, vaddr, frame, bytes, offset, flags, /*lazy=*/false);
+    err = _paging_map_vaddr(st, vaddr, frame, bytes, offset, flags);
     if (err_is_fail(err)) {
         // TODO most likely we should free buf here and set it to NULL?
         //       and free the allocation again...
-        thread_mutex_unlock(&mm_mutex);
         return err;
     }
 
-    thread_mutex_unlock(&mm_mutex);
     return SYS_ERR_OK;
 }
 
@@ -919,152 +1093,333 @@ errval_t paging_map_frame_attr_offset(struct paging_state *st, void **buf, size_
 errval_t paging_map_fixed_attr_offset(struct paging_state *st, lvaddr_t vaddr, struct capref frame,
                                       size_t bytes, size_t offset, int flags)
 {
-    thread_mutex_lock_nested(&mm_mutex);
     // TODO Add more relevant checks for the input parameters.
     errval_t err = SYS_ERR_OK;
 
     err = _pt_ensure_slab_space(st);
     if (err_is_fail(err)) {
-        thread_mutex_unlock(&mm_mutex);
         return err;
     }
 
     size_t allocated_bytes = 0;
-    err                    = _vaddr_alloc_fixed(st, vaddr, bytes, &allocated_bytes);
+    thread_mutex_lock_nested(&st->vaddr_mutex);
+    err = _vaddr_alloc_fixed(st, vaddr, bytes, &allocated_bytes);
+    thread_mutex_unlock(&st->vaddr_mutex);
     if (err_is_fail(err)) {
         // TODO handle the error:
-        thread_mutex_unlock(&mm_mutex);
         return err;
     }
     assert(allocated_bytes > 0);
 
-    err = _paging_map_vaddr(st, vaddr, frame, allocated_bytes, offset, flags, /*lazy=*/false);
+    err = _paging_map_vaddr(st, vaddr, frame, allocated_bytes, offset, flags);
     if (err_is_fail(err)) {
         // TODO handle the error: free the allocated vaddr.
-        thread_mutex_unlock(&mm_mutex);
         return err;
     }
 
-    thread_mutex_unlock(&mm_mutex);
     return SYS_ERR_OK;
 }
 
 static inline errval_t _pt_table_lookup(struct paging_state *st, lvaddr_t vaddr,
-                                        struct page_table **ptl3)
+                                        struct page_table **ptl3, bool *block)
 {
     assert(st != NULL);
-    // XXX the code has a lot of common structure between the different levels (IMPROVE!)
-    *ptl3 = NULL;
+    *ptl3  = NULL;
+    *block = false;
+
+    struct page_table *pt = &st->l0;
+    while (pt->type != ObjType_VNode_AARCH64_l3) {
+        uint16_t index = _pt_get_type_index(pt->type, vaddr);
+        if (PT_IS_BLOCK(pt, index)) {
+            *block = true;
+            return SYS_ERR_OK;
+        }
+        pt = pt->entries[index].pt;
+        if (pt == NULL) {
+            return SYS_ERR_OK;
+        }
+    }
 
-    errval_t           err = SYS_ERR_OK;
-    struct page_table *ptl1;
-    err = _pt_table_locate_entry(st, &st->l0, vaddr, VREGION_FLAGS_READ, &ptl1,
-                                 /*create_page_if_missing=*/false);
-    if (err_is_fail(err)) {
-        return err;
+    *ptl3 = pt;
+    return SYS_ERR_OK;
+}
+
+// whether a page or block is mapped at vaddr
+static inline bool _paging_is_mapped(struct paging_state *st, lvaddr_t vaddr)
+{
+    struct page_table *ptl3;
+    bool               block;
+    _pt_table_lookup(st, vaddr, &ptl3, &block);
+    return block
+           || (ptl3 != NULL && !capref_is_null(ptl3->entries[VMSAv8_64_L3_INDEX(vaddr)].frame_cap));
+}
+
+// destroys a lazily allocated frame once no entry of the L3 table maps a page of it anymore, and
+// the frames of the table once it has no lazy entries left
+static inline errval_t _pt_table_put_lazy_frame(struct paging_state *st, struct page_table *ptl3,
+                                                struct capref frame)
+{
+    bool lazy_left = false;
+    for (size_t entry = 0; entry < VMSAv8_64_PTABLE_NUM_ENTRIES; entry++) {
+        if (!PT_IS_LAZY(ptl3, entry)) {
+            continue;
+        }
+        if (capcmp(ptl3->lazy_frames->frames[entry], frame)) {
+            return SYS_ERR_OK;
+        }
+        lazy_left = true;
     }
-    if (ptl1 == NULL) {
-        return SYS_ERR_OK;
+    if (!lazy_left) {
+        slab_free(&st->lazy_frames_allocator, ptl3->lazy_frames);
+        ptl3->lazy_frames = NULL;
     }
+    return cap_destroy(frame);
+}
 
-    struct page_table *ptl2;
-    err = _pt_table_locate_entry(st, ptl1, vaddr, VREGION_FLAGS_READ, &ptl2,
-                                 /*create_page_if_missing=*/false);
-    if (err_is_fail(err)) {
-        return err;
+// forgets the entries [from, to) whose mapping was removed, and their frame if it was allocated
+// lazily and no other entry maps it
+static inline errval_t _pt_table_clear_entries(struct paging_state *st, struct page_table *pt,
+                                               size_t from, size_t to)
+{
+    bool          lazy  = PT_IS_LAZY(pt, from);
+    struct capref frame = lazy ? pt->lazy_frames->frames[from] : NULL_CAP;
+    for (size_t entry = from; entry < to; entry++) {
+        --pt->num_children;
+        pt->entries[entry].frame_cap = NULL_CAP;
+        PT_CLR_LAZY(pt, entry);
+        PT_CLR_BLOCK(pt, entry);
+        PT_CLR_TAIL(pt, entry);
     }
-    if (ptl2 == NULL) {
+
+    if (!lazy) {
         return SYS_ERR_OK;
     }
+    st->fault_pages_mapped -= to - from;
+    return _pt_table_put_lazy_frame(st, pt, frame);
+}
 
-    err = _pt_table_locate_entry(st, ptl2, vaddr, VREGION_FLAGS_READ, ptl3,
-                                 /*create_page_if_missing=*/false);
+// maps the pages of the run [first, end) outside of [from, to) with mappings of their own, removes
+// the mapping of the run and forgets [from, to). Only lazily allocated frames are known to the page
+// tables, other runs cannot be split.
+static errval_t _pt_table_split_run(struct paging_state *st, struct page_table *ptl3, size_t first,
+                                    size_t end, size_t from, size_t to)
+{
+    errval_t err;
+    if (!PT_IS_LAZY(ptl3, first)) {
+        return LIB_ERR_PMAP_PARTIAL_UNMAP;
+    }
+
+    struct capref frame = ptl3->lazy_frames->frames[first];
+    struct capref left = NULL_CAP, right = NULL_CAP;
+    if (first < from) {
+        err = st->slot_alloc->alloc(st->slot_alloc, &left);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+    if (to < end) {
+        err = st->slot_alloc->alloc(st->slot_alloc, &right);
+        if (err_is_fail(err)) {
+            if (!capref_is_null(left)) {
+                st->slot_alloc->free(st->slot_alloc, left);
+            }
+            return err;
+        }
+    }
+
+    err = cap_destroy(ptl3->entries[first].frame_cap);
     if (err_is_fail(err)) {
+        if (!capref_is_null(left)) {
+            st->slot_alloc->free(st->slot_alloc, left);
+        }
+        if (!capref_is_null(right)) {
+            st->slot_alloc->free(st->slot_alloc, right);
+        }
         return err;
     }
-    if (ptl3 == NULL) {
-        return SYS_ERR_OK;
+
+    // lazily allocated pages are always mapped read-write, see try_map. A part that cannot be
+    // mapped again is lost like the ones being unmapped.
+    errval_t left_err = SYS_ERR_OK, right_err = SYS_ERR_OK;
+    if (first < from) {
+        left_err = vnode_map(ptl3->page_table, frame, first, VREGION_FLAGS_READ_WRITE,
+                             ptl3->lazy_frames->pages[first] * BASE_PAGE_SIZE, from - first, left);
+        for (size_t entry = first; entry < from && err_is_ok(left_err); entry++) {
+            ptl3->entries[entry].frame_cap = left;
+        }
+    }
+    if (to < end) {
+        right_err = vnode_map(ptl3->page_table, frame, to, VREGION_FLAGS_READ_WRITE,
+                              ptl3->lazy_frames->pages[to] * BASE_PAGE_SIZE, end - to, right);
+        for (size_t entry = to; entry < end && err_is_ok(right_err); entry++) {
+            ptl3->entries[entry].frame_cap = right;
+        }
+        PT_CLR_TAIL(ptl3, to);
     }
 
-    return SYS_ERR_OK;
+    err = _pt_table_clear_entries(st, ptl3, from, to);
+    if (err_is_fail(left_err)) {
+        st->slot_alloc->free(st->slot_alloc, left);
+        _pt_table_clear_entries(st, ptl3, first, from);
+        return left_err;
+    }
+    if (err_is_fail(right_err)) {
+        st->slot_alloc->free(st->slot_alloc, right);
+        _pt_table_clear_entries(st, ptl3, to, end);
+        return right_err;
+    }
+    return err;
 }
 
-static inline errval_t _unmap_single_frame(struct paging_state *st, lvaddr_t vaddr)
+/*
+ * Unmaps the pages or block mapped at [vaddr, limit) together with vaddr and returns the number of
+ * bytes from vaddr to their end. Pages of the same mapping outside of the range are mapped again on
+ * their own, a block reaching outside of it cannot be unmapped. Page tables left without entries
+ * are destroyed.
+ */
+static inline errval_t _unmap_single_frame(struct paging_state *st, lvaddr_t vaddr,
+                                           lvaddr_t limit, size_t *bytes)
 {
     assert(st != NULL);
-    // XXX the code has a lot of common structure between the different levels (IMPROVE!)
-    errval_t           err = SYS_ERR_OK;
-    struct page_table *ptl1;
-    err = _pt_table_locate_entry(st, &st->l0, vaddr, VREGION_FLAGS_READ, &ptl1,
-                                 /*create_page_if_missing=*/false);
-    if (err_is_fail(err)) {
-        return err;
+    errval_t err = SYS_ERR_OK;
+
+    struct page_table *path[4]  = { &st->l0, NULL, NULL, NULL };
+    uint16_t           index[4] = { VMSAv8_64_L0_INDEX(vaddr), VMSAv8_64_L1_INDEX(vaddr),
+                                    VMSAv8_64_L2_INDEX(vaddr), VMSAv8_64_L3_INDEX(vaddr) };
+    *bytes = BASE_PAGE_SIZE;
+
+    size_t level = 0;
+    for (; level < 3 && !PT_IS_BLOCK(path[level], index[level]); level++) {
+        path[level + 1] = path[level]->entries[index[level]].pt;
+        if (path[level + 1] == NULL) {
+            // We never mapped the page (can happen with lazy alloc)
+            // There is nothing to do
+            return SYS_ERR_OK;
+        }
     }
 
-    struct page_table *ptl2;
-    err = _pt_table_locate_entry(st, ptl1, vaddr, VREGION_FLAGS_READ, &ptl2,
-                                 /*create_page_if_missing=*/false);
-    if (err_is_fail(err)) {
-        return err;
+    struct page_table *pt = path[level];
+    uint16_t           i  = index[level];
+    if (level < 3) {
+        size_t   block_size  = level == 1 ? HUGE_PAGE_SIZE : LARGE_PAGE_SIZE;
+        lvaddr_t block_start = vaddr & ~(block_size - 1);
+        *bytes               = block_start + block_size - vaddr;
+        if (block_start < vaddr || block_start + block_size > limit) {
+            return LIB_ERR_PMAP_PARTIAL_UNMAP;
+        }
     }
 
-    struct page_table *ptl3;
-    err = _pt_table_locate_entry(st, ptl2, vaddr, VREGION_FLAGS_READ, &ptl3,
-                                 /*create_page_if_missing=*/false);
-    if (err_is_fail(err)) {
-        return err;
+    if (capref_is_null(pt->entries[i].frame_cap)) {
+        return SYS_ERR_OK;
     }
 
-    uint16_t l0_index = VMSAv8_64_L0_INDEX(vaddr);
-    uint16_t l1_index = VMSAv8_64_L1_INDEX(vaddr);
-    uint16_t l2_index = VMSAv8_64_L2_INDEX(vaddr);
-    uint16_t l3_index = VMSAv8_64_L3_INDEX(vaddr);
+    // pages mapped together go together, unless the run reaches outside of [vaddr, limit)
+    size_t first = i, end = i + 1, stop = i + 1;
+    if (level == 3) {
+        while (PT_IS_TAIL(pt, first)) {
+            first--;
+        }
+        while (end < VMSAv8_64_PTABLE_NUM_ENTRIES && PT_IS_TAIL(pt, end)) {
+            end++;
+        }
+        stop   = MIN(end, i + (limit - vaddr) / BASE_PAGE_SIZE);
+        *bytes = (stop - i) * BASE_PAGE_SIZE;
+    }
 
-    // We never mapped the page (can happen with lazy alloc)
-    // There is nothing to do
-    if (ptl3 == NULL) {
-        return SYS_ERR_OK;
+    // removes the pages from the hardware table, the frame stays with the caller, except for the
+    // ones that were allocated lazily, which have no other owner
+    if (first < i || stop < end) {
+        err = _pt_table_split_run(st, pt, first, end, i, stop);
+    } else {
+        err = cap_destroy(pt->entries[first].frame_cap);
+        if (err_is_ok(err)) {
+            err = _pt_table_clear_entries(st, pt, i, stop);
+        }
+    }
+    if (err_is_fail(err)) {
+        return err;
     }
 
-    if (PT_IS_LAZY(ptl3, l3_index)) {
-        if (capref_is_null(ptl3->entries[l3_index].frame_cap)) {
+    for (; level > 0; level--) {
+        if (_pt_table_num_children(st, path[level]) > 0) {
             return SYS_ERR_OK;
         }
-        err = cap_destroy(ptl3->entries[l3_index].frame_cap);
-        if (err_is_fail(err)) {
-            return err;
+        err = _pt_table_destroy(st, &path[level - 1]->entries[index[level - 1]].pt);
+        --path[level - 1]->num_children;
+    }
+
+    return SYS_ERR_OK;
+}
+
+static struct paging_pager_region *_pager_lookup(struct paging_state *st, lvaddr_t vaddr)
+{
+    for (struct paging_pager_region *pager = st->pagers; pager != NULL; pager = pager->next) {
+        if (vaddr >= pager->base && vaddr < pager->base + pager->bytes) {
+            return pager;
         }
-    } else {
-        assert(!capref_is_null(ptl3->entries[l3_index].frame_cap));
     }
+    return NULL;
+}
 
-    --ptl3->num_children;
-    ptl3->entries[l3_index].frame_cap = NULL_CAP;
+// asks the pager for the frame of the page at vaddr and maps it. Requires no lock.
+static errval_t _pager_map(struct paging_state *st, struct paging_pager_region *pager, lvaddr_t vaddr)
+{
+    errval_t err;
+    size_t   index = (vaddr - pager->base) / BASE_PAGE_SIZE;
 
-    uint16_t l3_num_children = _pt_table_num_children(st, ptl3);
-    if (l3_num_children > 0) {
-        return SYS_ERR_OK;
+    struct capref frame;
+    err = pager->fill(pager->arg, vaddr - pager->base, &frame);
+    if (err_is_fail(err)) {
+        return err;
     }
-    err = _pt_table_destroy(st, &ptl2->entries[l2_index].pt);
-    --ptl2->num_children;
 
-    uint16_t l2_num_children = _pt_table_num_children(st, ptl2);
-    if (l2_num_children > 0) {
-        return SYS_ERR_OK;
+    err = _pt_ensure_slab_space(st);
+    if (err_is_fail(err)) {
+        cap_destroy(frame);
+        return err;
     }
-    err = _pt_table_destroy(st, &ptl1->entries[l1_index].pt);
-    --ptl1->num_children;
 
-    uint16_t l1_num_children = _pt_table_num_children(st, ptl1);
-    if (l1_num_children > 0) {
+    thread_mutex_lock_nested(&st->pt_mutex);
+    if (_paging_is_mapped(st, vaddr)) {
+        // the fault of another thread on the page came first, its frame stays
+        thread_mutex_unlock(&st->pt_mutex);
+        cap_destroy(frame);
         return SYS_ERR_OK;
     }
-    err = _pt_table_destroy(st, &st->l0.entries[l0_index].pt);
-    --st->l0.num_children;
 
+    // the frame belongs to the pager region, unmapping the page only removes the mapping
+    size_t mapped;
+    err = _paging_map_pages(st, vaddr, frame, BASE_PAGE_SIZE, /*offset=*/0, pager->flags,
+                            /*lazy=*/false, &mapped);
+    if (err_is_fail(err)) {
+        thread_mutex_unlock(&st->pt_mutex);
+        cap_destroy(frame);
+        return err;
+    }
+
+    // the page may have been decommitted before, its old frame is not mapped anymore
+    struct capref old = pager->frames[index];
+    pager->frames[index] = frame;
+    thread_mutex_unlock(&st->pt_mutex);
+    if (!capref_is_null(old)) {
+        cap_destroy(old);
+    }
     return SYS_ERR_OK;
 }
 
+// takes the pager of the region at vaddr out of the list. Requires the vaddr_mutex.
+static struct paging_pager_region *_pager_remove(struct paging_state *st, lvaddr_t vaddr)
+{
+    for (struct paging_pager_region **prev = &st->pagers; *prev != NULL; prev = &(*prev)->next) {
+        struct paging_pager_region *pager = *prev;
+        if (pager->base == vaddr) {
+            *prev = pager->next;
+            return pager;
+        }
+    }
+    return NULL;
+}
+
 /**
  * @brief decommits any memory allocated to the given memory region
  *
@@ -1082,24 +1437,26 @@ static inline errval_t _unmap_single_frame(struct paging_state *st, lvaddr_t vad
 errval_t paging_decommit(struct paging_state *st, lvaddr_t vaddr, size_t bytes)
 {
     assert(st != NULL);
-    if ((vaddr & (BASE_PAGE_SIZE - 1)) == 0 || (bytes & (BASE_PAGE_SIZE - 1)) == 0 || bytes == 0)
+    if ((vaddr & (BASE_PAGE_SIZE - 1)) != 0 || (bytes & (BASE_PAGE_SIZE - 1)) != 0 || bytes == 0)
         return ERR_INVALID_ARGS;
 
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&st->pt_mutex);
 
     errval_t err;
 
     // TODO: check that this memory is indeed reserved
-    for (size_t offset = 0; offset < bytes; offset += BASE_PAGE_SIZE) {
-        err = _unmap_single_frame(st, vaddr + offset);
+    // pages mapped together with ones outside of the region are split off from them
+    size_t unmapped;
+    for (size_t offset = 0; offset < bytes; offset += unmapped) {
+        err = _unmap_single_frame(st, vaddr + offset, vaddr + bytes, &unmapped);
         if (err_is_fail(err)) {
             // TODO restore the mapping if we fail, otherwise we will partially unmap the frame.
-            thread_mutex_unlock(&mm_mutex);
+            thread_mutex_unlock(&st->pt_mutex);
             return err;
         }
     }
 
-    thread_mutex_unlock(&mm_mutex);
+    thread_mutex_unlock(&st->pt_mutex);
     return SYS_ERR_OK;
 }
 
@@ -1115,22 +1472,18 @@ errval_t paging_decommit(struct paging_state *st, lvaddr_t vaddr, size_t bytes)
  */
 errval_t paging_unmap(struct paging_state *st, const void *region)
 {
-    thread_mutex_lock_nested(&mm_mutex);
     assert(st != NULL);
 
     errval_t err = SYS_ERR_OK;
 
-    err = _pt_ensure_slab_space(st);
-    if (err_is_fail(err))
-        return err;
-
     // TODO handle NULL region correctly
     lvaddr_t vaddr = (lvaddr_t)region;
 
     size_t bytes;
+    thread_mutex_lock_nested(&st->vaddr_mutex);
     err = _vaddr_lookup(st, vaddr, &bytes);
+    thread_mutex_unlock(&st->vaddr_mutex);
     if (err_is_fail(err)) {
-        thread_mutex_unlock(&mm_mutex);
         return err;
     }
 
@@ -1139,25 +1492,95 @@ errval_t paging_unmap(struct paging_state *st, const void *region)
     // we should only have allocated aligned.
     assert(vaddr == ROUND_UP(vaddr, BASE_PAGE_SIZE));
 
-    // unmap each region: for now we unmap a single frame at a time
-    // OPTIMIZE once this works we can free all at the same level at once.
-    for (size_t offset = 0; offset < bytes; offset += BASE_PAGE_SIZE) {
-        err = _unmap_single_frame(st, vaddr + offset);
+    // unmap each region: one mapping at a time
+    thread_mutex_lock_nested(&st->pt_mutex);
+    size_t unmapped;
+    for (size_t offset = 0; offset < bytes; offset += unmapped) {
+        err = _unmap_single_frame(st, vaddr + offset, vaddr + bytes, &unmapped);
         if (err_is_fail(err)) {
             // TODO restore the mapping if we fail, otherwise we will partially unmap the frame.
-            thread_mutex_unlock(&mm_mutex);
+            thread_mutex_unlock(&st->pt_mutex);
             return err;
         }
     }
+    thread_mutex_unlock(&st->pt_mutex);
 
+    thread_mutex_lock_nested(&st->vaddr_mutex);
     err = _vaddr_free(st, vaddr);
     if (err_is_fail(err)) {
         // TODO handle the error correctly.
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&st->vaddr_mutex);
+        return err;
+    }
+    struct paging_pager_region *pager = _pager_remove(st, vaddr);
+    thread_mutex_unlock(&st->vaddr_mutex);
+
+    if (pager != NULL) {
+        for (size_t i = 0; i < pager->bytes / BASE_PAGE_SIZE; i++) {
+            if (!capref_is_null(pager->frames[i])) {
+                cap_destroy(pager->frames[i]);
+            }
+        }
+        free(pager->frames);
+        free(pager);
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * @brief reserves a region of virtual memory whose pages are provided by a pager
+ *
+ * @param[in]  st     paging state of the address space to create the mapping in
+ * @param[out] buf    returns the virtual address of the region
+ * @param[in]  bytes  size of the region
+ * @param[in]  flags  mapping flags of the pages
+ * @param[in]  fill   called on the first access to a page with the offset of the page in the region
+ * @param[in]  arg    argument passed to fill
+ *
+ * @return SYS_ERR_OK on success, LIB_ERR_* on failure.
+ *
+ * The frames returned by fill belong to the region and are destroyed once it is unmapped with
+ * paging_unmap(). fill runs in the page fault handler of the faulting thread.
+ */
+errval_t paging_map_pager(struct paging_state *st, void **buf, size_t bytes, paging_flags_t flags,
+                          paging_pager_fn fill, void *arg)
+{
+    assert(st != NULL && buf != NULL && fill != NULL);
+    if (bytes == 0) {
+        return ERR_INVALID_ARGS;
+    }
+    bytes = ROUND_UP(bytes, BASE_PAGE_SIZE);
+
+    struct paging_pager_region *pager = malloc(sizeof(struct paging_pager_region));
+    if (pager == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    pager->frames = malloc(bytes / BASE_PAGE_SIZE * sizeof(struct capref));
+    if (pager->frames == NULL) {
+        free(pager);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    for (size_t i = 0; i < bytes / BASE_PAGE_SIZE; i++) {
+        pager->frames[i] = NULL_CAP;
+    }
+    pager->bytes = bytes;
+    pager->flags = flags;
+    pager->fill = fill;
+    pager->arg = arg;
+
+    errval_t err = paging_alloc(st, buf, bytes, BASE_PAGE_SIZE);
+    if (err_is_fail(err)) {
+        free(pager->frames);
+        free(pager);
         return err;
     }
+    pager->base = (lvaddr_t)*buf;
 
-    thread_mutex_unlock(&mm_mutex);
+    thread_mutex_lock_nested(&st->vaddr_mutex);
+    pager->next = st->pagers;
+    st->pagers = pager;
+    thread_mutex_unlock(&st->vaddr_mutex);
     return SYS_ERR_OK;
 }
 
@@ -1176,58 +1599,148 @@ errval_t paging_unmap(struct paging_state *st, const void *region)
  */
 errval_t try_map(struct paging_state *st, lvaddr_t vaddr)
 {
-    thread_mutex_lock_nested(&mm_mutex);
-
     assert(st != NULL);
     assert(vaddr == ROUND_UP(vaddr, BASE_PAGE_SIZE));
 
     errval_t err = SYS_ERR_OK;
 
-    lvaddr_t start_vaddr = 0;
-    size_t   bytes       = 0;
-    err                  = _vaddr_lookup_region(st, vaddr, &start_vaddr, &bytes);
+    thread_mutex_lock_nested(&st->vaddr_mutex);
+
+    lvaddr_t               start_vaddr = 0;
+    size_t                 bytes       = 0;
+    struct paging_vregion *region      = NULL;
+    err = _vaddr_lookup_region(st, vaddr, &start_vaddr, &bytes, &region);
     if (err_is_fail(err)) {
         printf("vaddr: 0x%lx, start_vaddr: 0x%lx, bytes: %u\n", vaddr, start_vaddr, bytes);
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&st->vaddr_mutex);
         return err;
     }
 
-    // we now know the page was actually allocated.
-    struct page_table *ptl3;
-    err = _pt_table_lookup(st, vaddr, &ptl3);
-    if (err_is_fail(err)) {
-        return err;
+    // pages of a pager region come from the pager instead
+    struct paging_pager_region *pager = _pager_lookup(st, vaddr);
+
+    // a fault right after the pages of the previous one continues a sequential stream
+    size_t window = BASE_PAGE_SIZE;
+    if (pager == NULL && vaddr == region->fault_next) {
+        window = MIN(region->fault_window * 2, region->fault_max);
+        window = MAX(window, BASE_PAGE_SIZE);
     }
-    uint16_t index = VMSAv8_64_L3_INDEX(vaddr);
-    if (ptl3 != NULL && !capref_is_null(ptl3->entries[index].frame_cap)) {
+    window = MIN(window, start_vaddr + bytes - vaddr);
+    // a frame stays within one L3 table, which then knows of all the pages mapping it
+    window = MIN(window, ROUND_DOWN(vaddr, LARGE_PAGE_SIZE) + LARGE_PAGE_SIZE - vaddr);
+
+    thread_mutex_unlock(&st->vaddr_mutex);
+
+    // we now know the page was actually allocated.
+    thread_mutex_lock_nested(&st->pt_mutex);
+    if (_paging_is_mapped(st, vaddr)) {
         // page was already mapped. nothing to do here...
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&st->pt_mutex);
         return SYS_ERR_OK;
     }
 
-    // allocate a frame to map to.
+    // map the following pages up to the end of the region or the first one already mapped
+    size_t alloc_size = BASE_PAGE_SIZE;
+    while (alloc_size < window && !_paging_is_mapped(st, vaddr + alloc_size)) {
+        alloc_size += BASE_PAGE_SIZE;
+    }
+    thread_mutex_unlock(&st->pt_mutex);
+
+    if (pager != NULL) {
+        return _pager_map(st, pager, vaddr);
+    }
+
+    // allocate a frame to map to, the faulting page alone if there is not enough memory.
+    // Faults of other threads are served meanwhile.
     struct capref frame;
-    // XXX for now we just lazily map a single new page.
-    const size_t alloc_size = BASE_PAGE_SIZE;
-    err                     = frame_alloc(&frame, alloc_size, NULL);
+    err = frame_alloc(&frame, alloc_size, NULL);
+    if (err_is_fail(err) && alloc_size > BASE_PAGE_SIZE) {
+        alloc_size = BASE_PAGE_SIZE;
+        err        = frame_alloc(&frame, alloc_size, NULL);
+    }
     if (err_is_fail(err)) {
-        thread_mutex_unlock(&mm_mutex);
         return err;
     }
 
-    err = _paging_map_vaddr(st, vaddr, frame, alloc_size, /*offset=*/0, VREGION_FLAGS_READ_WRITE,
-                            /*lazy=*/true);
+    err = _pt_ensure_slab_space(st);
+    if (err_is_ok(err)) {
+        err = _pt_ensure_lazy_slab_space(st);
+    }
     if (err_is_fail(err)) {
-        // TODO handle the error correctly.
-        thread_mutex_unlock(&mm_mutex);
+        cap_destroy(frame);
+        return err;
+    }
+
+    thread_mutex_lock_nested(&st->pt_mutex);
+    if (_paging_is_mapped(st, vaddr)) {
+        // the fault of another thread on the page came first
+        thread_mutex_unlock(&st->pt_mutex);
+        cap_destroy(frame);
+        return SYS_ERR_OK;
+    }
+
+    // the pages stay within one L3 table. The ones mapped meanwhile are skipped, the frame is
+    // destroyed once the others are unmapped.
+    size_t step;
+    for (size_t offset = 0; offset < alloc_size; offset += step) {
+        err = _paging_map_pages(st, vaddr + offset, frame, alloc_size - offset, offset,
+                                VREGION_FLAGS_READ_WRITE, /*lazy=*/true, &step);
+        if (err_is_fail(err)) {
+            thread_mutex_unlock(&st->pt_mutex);
+            if (offset == 0) {
+                cap_destroy(frame);
+            }
+            return err;
+        }
+    }
+    thread_mutex_unlock(&st->pt_mutex);
+
+    // the region may have been unmapped meanwhile
+    thread_mutex_lock_nested(&st->vaddr_mutex);
+    if (err_is_ok(_vaddr_lookup_region(st, vaddr, &start_vaddr, &bytes, &region))) {
+        region->fault_window = window;
+        region->fault_next   = vaddr + alloc_size;
+    }
+    st->faults++;
+    st->fault_pages += alloc_size / BASE_PAGE_SIZE;
+    thread_mutex_unlock(&st->vaddr_mutex);
+
+    return SYS_ERR_OK;
+}
+
+errval_t paging_set_fault_around(struct paging_state *st, lvaddr_t vaddr, size_t max_bytes)
+{
+    thread_mutex_lock_nested(&st->vaddr_mutex);
+
+    lvaddr_t               start_vaddr;
+    size_t                 bytes;
+    struct paging_vregion *region;
+    errval_t err = _vaddr_lookup_region(st, vaddr, &start_vaddr, &bytes, &region);
+    if (err_is_fail(err)) {
+        thread_mutex_unlock(&st->vaddr_mutex);
         return err;
     }
 
-    thread_mutex_unlock(&mm_mutex);
+    region->fault_max = MAX(ROUND_DOWN(max_bytes, BASE_PAGE_SIZE), BASE_PAGE_SIZE);
+
+    thread_mutex_unlock(&st->vaddr_mutex);
     return SYS_ERR_OK;
 }
 
+void paging_get_fault_stats(struct paging_state *st, size_t *faults, size_t *pages,
+                            size_t *mapped)
+{
+    thread_mutex_lock_nested(&st->vaddr_mutex);
+    *faults = st->faults;
+    *pages  = st->fault_pages;
+    thread_mutex_unlock(&st->vaddr_mutex);
+
+    thread_mutex_lock_nested(&st->pt_mutex);
+    *mapped = st->fault_pages_mapped;
+    thread_mutex_unlock(&st->pt_mutex);
+}
+
 
 errval_t dev_frame_map(struct capref dev_cap, struct capability dev_frame, genpaddr_t base,
                        gensize_t size, void **buf)
@@ -16,13 +16,72 @@
 #include <aos/aos_rpc.h>
 #include <aos/core_state.h>
 
-/* remote (indirect through a channel) version of ram_alloc, for most domains */
-static errval_t ram_alloc_remote(struct capref *ret, size_t size, size_t alignment)
+/// size of the chunks requested from the memory server to serve small allocations
+#define RAM_CACHE_CHUNK_SIZE (256 * 1024)
+/// largest allocation served from the chunk, larger ones go to the memory server directly
+#define RAM_CACHE_MAX_ALLOC (64 * 1024)
+
+static errval_t ram_alloc_rpc(struct capref *ret, size_t size, size_t alignment)
 {
     size_t retbytes;
     return aos_rpc_get_ram_cap(aos_rpc_get_memory_channel(), size, alignment, ret, &retbytes);
 }
 
+/* remote (indirect through a channel) version of ram_alloc, for most domains */
+static errval_t ram_alloc_remote(struct capref *ret, size_t size, size_t alignment)
+{
+    errval_t err;
+
+    if (size > RAM_CACHE_MAX_ALLOC || alignment != BASE_PAGE_SIZE) {
+        return ram_alloc_rpc(ret, size, alignment);
+    }
+
+    struct ram_alloc_state *state = get_ram_alloc_state();
+
+    size = ROUND_UP(size, BASE_PAGE_SIZE);
+
+    // getting the slot may refill the slot allocator, which allocates memory itself
+    err = slot_alloc(ret);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_SLOT_ALLOC);
+    }
+
+    thread_mutex_lock_nested(&state->ram_alloc_lock);
+
+    if (state->cache_offset + size > state->cache_size) {
+        struct capref chunk;
+        err = ram_alloc_rpc(&chunk, RAM_CACHE_CHUNK_SIZE, BASE_PAGE_SIZE);
+        if (err_is_fail(err)) {
+            thread_mutex_unlock(&state->ram_alloc_lock);
+            slot_free(*ret);
+            return err;
+        }
+
+        // the allocations carved from the old chunk keep their memory
+        if (!capref_is_null(state->cache_cap)) {
+            cap_destroy(state->cache_cap);
+        }
+        state->cache_cap    = chunk;
+        state->cache_size   = RAM_CACHE_CHUNK_SIZE;
+        state->cache_offset = 0;
+    }
+
+    // claim the range before the retype, which may allocate again
+    size_t offset = state->cache_offset;
+    state->cache_offset += size;
+
+    err = cap_retype(*ret, state->cache_cap, offset, ObjType_RAM, size);
+
+    thread_mutex_unlock(&state->ram_alloc_lock);
+
+    if (err_is_fail(err)) {
+        slot_free(*ret);
+        return err_push(err, LIB_ERR_CAP_RETYPE);
+    }
+
+    return SYS_ERR_OK;
+}
+
 
 void ram_set_affinity(uint64_t minbase, uint64_t maxlimit)
 {
@@ -57,9 +116,12 @@ static errval_t ram_alloc_fixed(struct capref *ret, size_t size, size_t alignmen
         return ram_alloc_remote(ret, size, alignment);
     }
 
-    // we can only allocate an alignment of base page size
+    // we can only allocate an alignment of base page size, the memory server can do more
     if (alignment != BASE_PAGE_SIZE) {
-        return LIB_ERR_RAM_ALLOC_MS_CONSTRAINTS;
+        if (aos_rpc_get_memory_channel() == NULL) {
+            return LIB_ERR_RAM_ALLOC_MS_CONSTRAINTS;
+        }
+        return ram_alloc_remote(ret, size, alignment);
     }
 
     // we're about todo a retype, this requires a slot, the slot allocator should have enough...
@@ -157,6 +219,9 @@ errval_t ram_alloc_init(void)
     ram_alloc_state->ram_alloc_func   = NULL;
     ram_alloc_state->default_minbase  = 0;
     ram_alloc_state->default_maxlimit = 0;
+    ram_alloc_state->cache_cap        = NULL_CAP;
+    ram_alloc_state->cache_size       = 0;
+    ram_alloc_state->cache_offset     = 0;
 
     // now try to identify the supplied memory capability to get its size
     struct capref mem_cap = { .cnode = cnode_task, .slot = TASKCN_SLOT_EARLYMEM };
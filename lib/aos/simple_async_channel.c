@@ -29,6 +29,16 @@ static void simple_async_prepare_send(struct simple_async_channel* async) {
         async->rpc->send_buf.size = msg_size;
         async->rpc->send_size = msg_size;
 
+        async->rpc->send_caps_size = 0;
+        if (!capref_is_null(req->cap)) {
+            if (async->rpc->send_buf.caps_size < 1) {
+                async->rpc->send_buf.caps = realloc(async->rpc->send_buf.caps, sizeof(struct capref));
+                async->rpc->send_buf.caps_size = 1;
+            }
+            async->rpc->send_buf.caps[0] = req->cap;
+            async->rpc->send_caps_size = 1;
+        }
+
     } else if (async->current_sending == SIMPLE_ASYNC_RESPONSE) {
         if (async->responses.head == NULL) {
             async->current_sending = SIMPLE_ASYNC_REQUEST;
@@ -48,6 +58,7 @@ static void simple_async_prepare_send(struct simple_async_channel* async) {
         async->rpc->send_buf.data = msg;
         async->rpc->send_buf.size = msg_size;
         async->rpc->send_size = msg_size;
+        async->rpc->send_caps_size = 0;
     }
     // debug_printf("Sending async message of size %zu\n", async->rpc->send_buf.size);
     aos_rpc_send(async->rpc);
@@ -125,10 +136,16 @@ void simple_async_init(struct simple_async_channel* async, struct aos_rpc* rpc,
 }
 
 void simple_async_request(struct simple_async_channel* async, void* data, size_t size, simple_async_callback callback, void* meta) {
+    simple_async_request_with_cap(async, data, size, NULL_CAP, callback, meta);
+}
+
+// the capability is copied to the other end, the sender keeps its own
+void simple_async_request_with_cap(struct simple_async_channel* async, void* data, size_t size, struct capref cap, simple_async_callback callback, void* meta) {
     // allocate request
     struct simple_request* req = malloc(sizeof(struct simple_request));
     req->send.data = data;
     req->send.size = size;
+    req->cap = cap;
     req->callback = callback;
     req->meta = meta;
     req->next = NULL;
@@ -151,6 +168,14 @@ void simple_async_request(struct simple_async_channel* async, void* data, size_t
     }
 }
 
+// only valid in the handler of a request, the capability belongs to the receiver
+struct capref simple_async_recv_cap(struct simple_async_channel* async) {
+    if (async->rpc->recv_caps_size == 0) {
+        return NULL_CAP;
+    }
+    return async->rpc->recv_buf.caps[0];
+}
+
 void simple_async_respond(struct simple_async_channel* async, struct simple_response* res) {
     // enqueue res in async->responses and start send if queue was previously empty
     bool was_empty = async->requests.head == NULL && async->responses.head == NULL;
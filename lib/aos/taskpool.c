@@ -0,0 +1,758 @@
+/**
+ * \file
+ * \brief Work-stealing task pool
+ *
+ * Each worker of the pool is a thread with a Chase-Lev deque of tasks. The
+ * worker pushes and takes tasks at the bottom of its own deque, other workers
+ * steal from the top when theirs is empty. Threads that are not workers of
+ * the pool queue their tasks on a shared injection queue instead.
+ *
+ * The workers are spread over the dispatchers of the domain, so a pool
+ * created after the domain spanned other cores runs its tasks on all of them.
+ * Threads waiting in task_sync() or task_future_wait() run tasks themselves
+ * instead of blocking, and workers without work go to sleep after a while.
+ *
+ * Futures hold the result of a task, or of anything else completing them
+ * with task_future_complete(), such as the handler of an RPC. A future can
+ * deliver an event on a waitset once it is done.
+ */
+
+/*
+ * Copyright (c) 2022, The University of British Columbia
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <aos/aos.h>
+#include <aos/taskpool.h>
+#include <aos/waitset_chan.h>
+#include <aos/dispatcher_arch.h>
+#include <aos/curdispatcher_arch.h>
+#include "threads_priv.h"
+
+/// number of tasks each deque holds, a full deque spills to the injection queue
+#define TASKPOOL_DEQUE_SIZE 1024
+
+/// size of a cache line, to keep the ends of a deque apart
+#define TASKPOOL_CACHELINE 64
+
+/// rounds without finding work before a worker goes to sleep
+#define TASKPOOL_SPIN_ROUNDS 64
+
+/// number of range tasks task_parallel_for() aims for per worker by default
+#define TASKPOOL_RANGES_PER_WORKER 8
+
+struct task {
+    task_func_t func;
+    void *arg;
+    struct task_group *group;  ///< group to notify once done, or NULL
+    struct task *next;         ///< next task in the injection queue
+};
+
+/// Chase-Lev deque, the owner works at the bottom and thieves steal at the top
+struct task_deque {
+    int64_t top;
+    char pad[TASKPOOL_CACHELINE - sizeof(int64_t)];
+    int64_t bottom;
+    struct task *tasks[TASKPOOL_DEQUE_SIZE];
+};
+
+struct taskpool_worker {
+    struct task_deque deque;
+    struct taskpool *pool;
+    struct thread *thread;
+    uint64_t rand;             ///< state for picking victims
+};
+
+struct taskpool {
+    size_t nworkers;
+    struct taskpool_worker *workers;
+
+    /// tasks spawned by threads that are not workers of the pool
+    spinlock_t inject_lock;
+    struct task *inject_head, *inject_tail;
+
+    bool stop;
+
+    /// workers sleep on the condition once they run out of work
+    size_t sleepers;
+    struct thread_mutex sleep_lock;
+    struct thread_cond sleep_cond;
+};
+
+/// the worker the calling thread is, if any
+static __thread struct taskpool_worker *current_worker;
+
+static inline struct taskpool_worker *taskpool_self(struct taskpool *pool)
+{
+    struct taskpool_worker *self = current_worker;
+    return self != NULL && self->pool == pool ? self : NULL;
+}
+
+/*
+ * ===============================================================================================
+ * Deque
+ * ===============================================================================================
+ */
+
+/**
+ * \brief Pushes a task at the bottom of the deque, only called by its owner
+ *
+ * \return false if the deque is full
+ */
+static bool deque_push(struct task_deque *dq, struct task *task)
+{
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    if (b - t >= TASKPOOL_DEQUE_SIZE) {
+        return false;
+    }
+
+    __atomic_store_n(&dq->tasks[b % TASKPOOL_DEQUE_SIZE], task, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+/**
+ * \brief Takes the task at the bottom of the deque, only called by its owner
+ */
+static struct task *deque_take(struct task_deque *dq)
+{
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        // empty
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    struct task *task = __atomic_load_n(&dq->tasks[b % TASKPOOL_DEQUE_SIZE], __ATOMIC_RELAXED);
+    if (t == b) {
+        // last task, race against the thieves for it
+        if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, false, __ATOMIC_SEQ_CST,
+                                         __ATOMIC_RELAXED)) {
+            task = NULL;
+        }
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+/**
+ * \brief Steals the task at the top of the deque
+ *
+ * \return the task, or NULL if the deque is empty or another thread won it
+ */
+static struct task *deque_steal(struct task_deque *dq)
+{
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return NULL;
+    }
+
+    struct task *task = __atomic_load_n(&dq->tasks[t % TASKPOOL_DEQUE_SIZE], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, false, __ATOMIC_SEQ_CST,
+                                     __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return task;
+}
+
+static bool deque_is_empty(struct task_deque *dq)
+{
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    return t >= b;
+}
+
+/*
+ * ===============================================================================================
+ * Scheduling
+ * ===============================================================================================
+ */
+
+static void taskpool_inject(struct taskpool *pool, struct task *task)
+{
+    task->next = NULL;
+    acquire_spinlock(&pool->inject_lock);
+    if (pool->inject_tail == NULL) {
+        pool->inject_head = task;
+    } else {
+        pool->inject_tail->next = task;
+    }
+    pool->inject_tail = task;
+    release_spinlock(&pool->inject_lock);
+}
+
+static struct task *taskpool_take_injected(struct taskpool *pool)
+{
+    if (__atomic_load_n(&pool->inject_head, __ATOMIC_RELAXED) == NULL) {
+        return NULL;
+    }
+
+    acquire_spinlock(&pool->inject_lock);
+    struct task *task = pool->inject_head;
+    if (task != NULL) {
+        pool->inject_head = task->next;
+        if (pool->inject_head == NULL) {
+            pool->inject_tail = NULL;
+        }
+    }
+    release_spinlock(&pool->inject_lock);
+    return task;
+}
+
+static bool taskpool_has_work(struct taskpool *pool)
+{
+    if (__atomic_load_n(&pool->inject_head, __ATOMIC_RELAXED) != NULL) {
+        return true;
+    }
+    for (size_t i = 0; i < pool->nworkers; i++) {
+        if (!deque_is_empty(&pool->workers[i].deque)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Wakes a sleeping worker, if there is one, after work was queued
+ */
+static void taskpool_wake(struct taskpool *pool)
+{
+    // pairs with the fence in taskpool_sleep(), either the worker sees the work
+    // or we see the worker
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    thread_mutex_lock(&pool->sleep_lock);
+    thread_cond_signal(&pool->sleep_cond);
+    thread_mutex_unlock(&pool->sleep_lock);
+}
+
+static void taskpool_sleep(struct taskpool *pool)
+{
+    thread_mutex_lock(&pool->sleep_lock);
+    __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!taskpool_has_work(pool) && !__atomic_load_n(&pool->stop, __ATOMIC_RELAXED)) {
+        thread_cond_wait(&pool->sleep_cond, &pool->sleep_lock);
+    }
+    __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_RELAXED);
+    thread_mutex_unlock(&pool->sleep_lock);
+}
+
+static void taskpool_push(struct taskpool *pool, struct task *task)
+{
+    struct taskpool_worker *self = taskpool_self(pool);
+    if (self == NULL) {
+        taskpool_inject(pool, task);
+    } else if (!deque_push(&self->deque, task)) {
+        // the deque is full, so there is plenty of work to steal already
+        taskpool_inject(pool, task);
+    }
+    taskpool_wake(pool);
+}
+
+/**
+ * \brief Finds a task to run: from our own deque, the injection queue, or by
+ *        stealing from the other workers.
+ */
+static struct task *taskpool_find_task(struct taskpool *pool, struct taskpool_worker *self)
+{
+    struct task *task;
+
+    if (self != NULL) {
+        task = deque_take(&self->deque);
+        if (task != NULL) {
+            return task;
+        }
+    }
+
+    task = taskpool_take_injected(pool);
+    if (task != NULL) {
+        return task;
+    }
+
+    size_t start = 0;
+    if (self != NULL) {
+        // xorshift, to spread the thieves over the victims
+        self->rand ^= self->rand << 13;
+        self->rand ^= self->rand >> 7;
+        self->rand ^= self->rand << 17;
+        start = self->rand % pool->nworkers;
+    }
+    for (size_t i = 0; i < pool->nworkers; i++) {
+        struct taskpool_worker *victim = &pool->workers[(start + i) % pool->nworkers];
+        if (victim == self) {
+            continue;
+        }
+        task = deque_steal(&victim->deque);
+        if (task != NULL) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static void taskpool_run_task(struct task *task)
+{
+    struct task_group *group = task->group;
+
+    task->func(task->arg);
+    free(task);
+
+    if (group != NULL) {
+        __atomic_sub_fetch(&group->pending, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * \brief Runs one task of the pool on the calling thread
+ *
+ * \return false if there was no task to run
+ */
+static bool taskpool_help(struct taskpool *pool)
+{
+    struct task *task = taskpool_find_task(pool, taskpool_self(pool));
+    if (task == NULL) {
+        return false;
+    }
+    taskpool_run_task(task);
+    return true;
+}
+
+static int taskpool_worker_run(void *arg)
+{
+    struct taskpool_worker *self = arg;
+    struct taskpool *pool = self->pool;
+    size_t idle = 0;
+
+    current_worker = self;
+    while (!__atomic_load_n(&pool->stop, __ATOMIC_RELAXED)) {
+        struct task *task = taskpool_find_task(pool, self);
+        if (task != NULL) {
+            taskpool_run_task(task);
+            idle = 0;
+        } else if (++idle < TASKPOOL_SPIN_ROUNDS) {
+            thread_yield();
+        } else {
+            taskpool_sleep(pool);
+            idle = 0;
+        }
+    }
+    current_worker = NULL;
+
+    return 0;
+}
+
+/*
+ * ===============================================================================================
+ * Pool
+ * ===============================================================================================
+ */
+
+static void taskpool_stop_workers(struct taskpool *pool, size_t nworkers)
+{
+    thread_mutex_lock(&pool->sleep_lock);
+    __atomic_store_n(&pool->stop, true, __ATOMIC_RELAXED);
+    thread_cond_broadcast(&pool->sleep_cond);
+    thread_mutex_unlock(&pool->sleep_lock);
+
+    for (size_t i = 0; i < nworkers; i++) {
+        errval_t err = thread_join(pool->workers[i].thread, NULL);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "joining worker %zu of a task pool", i);
+        }
+    }
+}
+
+/**
+ * \brief Creates a task pool
+ *
+ * The workers are spread round robin over the dispatchers the domain has
+ * when the pool is created.
+ *
+ * \param nworkers  number of worker threads, 0 for one per dispatcher
+ * \param retpool   returns the new pool
+ *
+ * \returns SYS_ERR_OK on success, or error value on failure
+ */
+errval_t taskpool_create(size_t nworkers, struct taskpool **retpool)
+{
+    errval_t err;
+
+    coreid_t cores[MAX_COREID];
+    size_t ncores = 0;
+    for (coreid_t core = 0; core < MAX_COREID; core++) {
+        if (domain_has_dispatcher(core)) {
+            cores[ncores++] = core;
+        }
+    }
+    assert(ncores > 0);
+
+    if (nworkers == 0) {
+        nworkers = ncores;
+    }
+
+    struct taskpool *pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    pool->workers = calloc(nworkers, sizeof(*pool->workers));
+    if (pool->workers == NULL) {
+        free(pool);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    pool->nworkers = nworkers;
+    thread_mutex_init(&pool->sleep_lock);
+    thread_cond_init(&pool->sleep_cond);
+
+    for (size_t i = 0; i < nworkers; i++) {
+        struct taskpool_worker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->rand = 0x9e3779b97f4a7c15ULL * (i + 1);
+
+        err = domain_thread_create_on(cores[i % ncores], taskpool_worker_run, worker,
+                                      &worker->thread);
+        if (err_is_fail(err)) {
+            taskpool_stop_workers(pool, i);
+            free(pool->workers);
+            free(pool);
+            return err_push(err, LIB_ERR_TASKPOOL_CREATE);
+        }
+    }
+
+    *retpool = pool;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Stops the workers of the pool and frees it
+ *
+ * All tasks of the pool must have finished, i.e. all groups are synced and
+ * all futures of its tasks are done.
+ */
+void taskpool_destroy(struct taskpool *pool)
+{
+    assert(!taskpool_has_work(pool));
+
+    taskpool_stop_workers(pool, pool->nworkers);
+    free(pool->workers);
+    free(pool);
+}
+
+/**
+ * \brief Returns the number of worker threads of the pool
+ */
+size_t taskpool_get_nworkers(struct taskpool *pool)
+{
+    return pool->nworkers;
+}
+
+/*
+ * ===============================================================================================
+ * Task groups
+ * ===============================================================================================
+ */
+
+/**
+ * \brief Initialises a group of tasks run by the given pool
+ */
+void task_group_init(struct task_group *group, struct taskpool *pool)
+{
+    group->pool = pool;
+    group->pending = 0;
+}
+
+/**
+ * \brief Spawns a task in the group
+ *
+ * The task may run on any worker of the pool, or on a thread waiting in
+ * task_sync().
+ *
+ * \returns SYS_ERR_OK on success, or error value on failure
+ */
+errval_t task_spawn(struct task_group *group, task_func_t func, void *arg)
+{
+    struct task *task = malloc(sizeof(*task));
+    if (task == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    task->func = func;
+    task->arg = arg;
+    task->group = group;
+
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+    taskpool_push(group->pool, task);
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Waits until all tasks spawned in the group finished
+ *
+ * The calling thread runs tasks of the pool while it waits.
+ */
+void task_sync(struct task_group *group)
+{
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        if (!taskpool_help(group->pool)) {
+            thread_yield();
+        }
+    }
+}
+
+/// the part of a parallel for that is left to do
+struct task_range {
+    task_range_func_t func;
+    void *arg;
+    size_t begin, end;
+    size_t grain;
+    struct task_group *group;
+};
+
+/// splits the range in halves until it is small enough, spawning the upper halves
+static void task_range_run(void *arg)
+{
+    struct task_range *range = arg;
+
+    while (range->end - range->begin > range->grain) {
+        size_t mid = range->begin + (range->end - range->begin) / 2;
+
+        struct task_range *upper = malloc(sizeof(*upper));
+        if (upper == NULL) {
+            // do the rest on our own
+            break;
+        }
+        *upper = *range;
+        upper->begin = mid;
+
+        errval_t err = task_spawn(range->group, task_range_run, upper);
+        if (err_is_fail(err)) {
+            free(upper);
+            break;
+        }
+        range->end = mid;
+    }
+
+    range->func(range->arg, range->begin, range->end);
+    free(range);
+}
+
+/**
+ * \brief Calls func on subranges of [begin, end) in parallel and waits for all
+ *
+ * \param pool   the pool to run the subranges on
+ * \param begin  first index of the range
+ * \param end    index after the range
+ * \param grain  maximal size of a subrange, 0 to pick one from the number of workers
+ * \param func   function called for every subrange
+ * \param arg    argument passed to func
+ *
+ * \returns SYS_ERR_OK on success, or error value on failure
+ */
+errval_t task_parallel_for(struct taskpool *pool, size_t begin, size_t end, size_t grain,
+                           task_range_func_t func, void *arg)
+{
+    if (begin >= end) {
+        return SYS_ERR_OK;
+    }
+    if (grain == 0) {
+        grain = (end - begin) / (pool->nworkers * TASKPOOL_RANGES_PER_WORKER);
+        grain = MAX(grain, 1);
+    }
+
+    struct task_group group;
+    task_group_init(&group, pool);
+
+    struct task_range *range = malloc(sizeof(*range));
+    if (range == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    range->func = func;
+    range->arg = arg;
+    range->begin = begin;
+    range->end = end;
+    range->grain = grain;
+    range->group = &group;
+
+    task_range_run(range);
+    task_sync(&group);
+    return SYS_ERR_OK;
+}
+
+/*
+ * ===============================================================================================
+ * Futures
+ * ===============================================================================================
+ */
+
+/**
+ * \brief Initialises a future that is not done yet
+ */
+void task_future_init(struct task_future *future)
+{
+    future->lock = 0;
+    future->done = false;
+    future->result = NULL;
+    future->pool = NULL;
+    future->waitset = NULL;
+    future->disp = 0;
+    waitset_chanstate_init(&future->chan, CHANTYPE_OTHER);
+}
+
+struct task_async {
+    task_future_func_t func;
+    void *arg;
+    struct task_future *future;
+};
+
+static void task_async_run(void *arg)
+{
+    struct task_async *async = arg;
+    struct task_future *future = async->future;
+
+    void *result = async->func(async->arg);
+    free(async);
+    task_future_complete(future, result);
+}
+
+/**
+ * \brief Runs func in the pool, its return value becomes the result of the future
+ *
+ * \returns SYS_ERR_OK on success, or error value on failure
+ */
+errval_t task_async(struct taskpool *pool, struct task_future *future,
+                    task_future_func_t func, void *arg)
+{
+    struct task_async *async = malloc(sizeof(*async));
+    if (async == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    struct task *task = malloc(sizeof(*task));
+    if (task == NULL) {
+        free(async);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    async->func = func;
+    async->arg = arg;
+    async->future = future;
+    future->pool = pool;
+
+    task->func = task_async_run;
+    task->arg = async;
+    task->group = NULL;
+    taskpool_push(pool, task);
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Sets the result of the future and delivers its event, if registered
+ *
+ * Can be called by any thread of the domain, e.g. from the handler of an RPC.
+ */
+void task_future_complete(struct task_future *future, void *result)
+{
+    acquire_spinlock(&future->lock);
+    future->result = result;
+    __atomic_store_n(&future->done, true, __ATOMIC_RELEASE);
+    struct waitset *ws = future->waitset;
+    struct event_closure closure = future->closure;
+    dispatcher_handle_t disp = future->disp;
+    future->waitset = NULL;
+    release_spinlock(&future->lock);
+
+    if (ws == NULL) {
+        return;
+    }
+
+    // waitsets belong to one dispatcher, trigger it from there
+    dispatcher_handle_t here = curdispatcher();
+    if (disp != here) {
+        thread_migrate_self(disp);
+    }
+    errval_t err = waitset_chan_trigger_closure(ws, &future->chan, closure);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "delivering the event of a future");
+    }
+    if (disp != here) {
+        thread_migrate_self(here);
+    }
+}
+
+/**
+ * \brief Returns whether the future has its result
+ */
+bool task_future_is_done(struct task_future *future)
+{
+    return __atomic_load_n(&future->done, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * \brief Delivers closure on the waitset once the future is done
+ *
+ * The waitset must belong to the dispatcher of the calling thread. The
+ * future must stay valid until the closure ran.
+ *
+ * \returns SYS_ERR_OK on success, or error value on failure
+ */
+errval_t task_future_register(struct task_future *future, struct waitset *ws,
+                              struct event_closure closure)
+{
+    acquire_spinlock(&future->lock);
+    if (future->waitset != NULL) {
+        release_spinlock(&future->lock);
+        return LIB_ERR_CHAN_ALREADY_REGISTERED;
+    }
+    if (!future->done) {
+        future->waitset = ws;
+        future->closure = closure;
+        future->disp = curdispatcher();
+        release_spinlock(&future->lock);
+        return SYS_ERR_OK;
+    }
+    release_spinlock(&future->lock);
+
+    return waitset_chan_trigger_closure(ws, &future->chan, closure);
+}
+
+/**
+ * \brief Waits for the result of the future
+ *
+ * While waiting, the calling thread runs tasks of the pool computing the
+ * future and, if ws is not NULL, handles the events of ws. The latter lets
+ * a task wait for a future that an RPC handler on ws completes.
+ *
+ * \returns the result of the future
+ */
+void *task_future_wait(struct task_future *future, struct waitset *ws)
+{
+    while (!task_future_is_done(future)) {
+        if (future->pool != NULL && taskpool_help(future->pool)) {
+            continue;
+        }
+        if (ws != NULL && err_is_ok(event_dispatch_non_block(ws))) {
+            continue;
+        }
+        thread_yield();
+    }
+
+    // the completing thread may still hold the lock, wait until it let go of
+    // the future before the caller reuses it
+    acquire_spinlock(&future->lock);
+    release_spinlock(&future->lock);
+    return future->result;
+}
@@ -50,8 +50,10 @@ void thread_cond_wait(struct thread_cond *cond, struct thread_mutex *mutex)
         struct thread *wakeup = thread_mutex_unlock_disabled(disp, mutex);
 
         if(wakeup != NULL) {
-            assert(disp == wakeup->disp);
-            thread_resume(wakeup);
+            errval_t err = thread_hand_over_disabled(disp, wakeup);
+            if (err_is_fail(err)) {
+                USER_PANIC_ERR(err, "remote wakeup from condition wait");
+            }
         }
     }
 
@@ -84,7 +86,7 @@ void thread_cond_signal(struct thread_cond *cond)
     if (cond->queue != NULL) {
         wakeup = thread_unblock_one_disabled(disp, &cond->queue, NULL);
         if(wakeup != NULL) {
-            thread_resume(wakeup);
+            err = thread_hand_over_disabled(disp, wakeup);
         }
     }
     release_spinlock(&cond->lock);
@@ -112,20 +114,28 @@ void thread_cond_broadcast(struct thread_cond *cond)
 {
     struct thread *wakeupq = NULL;
     bool foreignwakeup = false;
+    errval_t err = SYS_ERR_OK;
 
     // Wakeup all waiting threads
     dispatcher_handle_t disp = disp_disable();
     acquire_spinlock(&cond->lock);
     wakeupq = thread_unblock_all_disabled(disp, &cond->queue, NULL);
     release_spinlock(&cond->lock);
-    disp_enable(disp);
 
     foreignwakeup = (wakeupq != NULL);
     // Now, wakeup all on foreign dispatchers
     while (wakeupq != NULL) {
         struct thread *wakeup = wakeupq;
         wakeupq = wakeupq->next;
-        thread_resume(wakeup);
+        errval_t wakeup_err = thread_hand_over_disabled(disp, wakeup);
+        if (err_is_ok(err)) {
+            err = wakeup_err;
+        }
+    }
+    disp_enable(disp);
+
+    if(err_is_fail(err)) {
+        USER_PANIC_ERR(err, "remote wakeup from condition broadcast");
     }
 
     if(foreignwakeup) {
@@ -284,7 +294,7 @@ void thread_mutex_unlock(struct thread_mutex *mutex)
     errval_t err = SYS_ERR_OK;
 
     if (wakeup != NULL) {
-        thread_resume(wakeup);
+        err = thread_hand_over_disabled(disp, wakeup);
     }
     disp_enable(disp);
 
@@ -364,11 +374,12 @@ void thread_sem_post(struct thread_sem *sem)
         sem->value++;
     }
 
+    release_spinlock(&sem->lock);
+
     if(wakeup != NULL) {
-        thread_resume(wakeup);
+        err = thread_hand_over_disabled(disp, wakeup);
     }
 
-    release_spinlock(&sem->lock);
     disp_enable(disp);
 
     if(err_is_fail(err)) {
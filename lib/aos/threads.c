@@ -23,6 +23,7 @@
 #include <aos/caddr.h>
 #include <aos/curdispatcher_arch.h>
 #include <aos/paging.h>
+#include <aos/malloc.h>
 #include <barrelfish_kpi/cpu_arch.h>
 #include <barrelfish_kpi/domain_params.h>
 #include <arch/registers.h>
@@ -327,7 +328,7 @@ void thread_run_disabled(dispatcher_handle_t handle)
         disp_resume(handle, &disp_gen->runq->regs);
     } else {
         // kernel gave us the CPU when we have nothing to do. block!
-        disp->haswork = havework_disabled(handle);
+        disp->haswork = sleep_prepare_disabled(handle);
         disp_gen->current = NULL;
         disp_yield_disabled(handle);
     }
@@ -538,8 +539,6 @@ struct thread *thread_create(thread_func_t start_func, void *arg)
 errval_t thread_join(struct thread *thread, int *retval)
 {
     assert(thread != NULL);
-    // this function should only be called for threads on same core
-    assert(thread->coreid == disp_get_core_id());
 
     thread_mutex_lock(&thread->exit_lock);
     if(thread->detached) {
@@ -855,7 +854,7 @@ static int cleanup_thread(void *arg)
         disp_resume(handle, &next->regs);
     } else {
         disp_gen->current = NULL;
-        disp->haswork = havework_disabled(handle);
+        disp->haswork = sleep_prepare_disabled(handle);
         disp_yield_disabled(handle);
     }
 
@@ -869,6 +868,9 @@ void thread_exit(int status)
 {
     struct thread *me = thread_self();
 
+    // the objects cached by the thread would be lost with its TLS block
+    aos_malloc_thread_exit();
+
     thread_mutex_lock(&me->exit_lock);
 
     // if this is the static thread, we don't need to do anything but cleanup
@@ -893,7 +895,7 @@ void thread_exit(int status)
             disp_resume(handle, &next->regs);
         } else {
             disp_gen->current = NULL;
-            disp->haswork = havework_disabled(handle);
+            disp->haswork = sleep_prepare_disabled(handle);
             disp_yield_disabled(handle);
         }
     }
@@ -931,12 +933,22 @@ void thread_exit(int status)
 
         // Disable and unlock exit lock
         dispatcher_handle_t handle = disp_disable();
-        struct thread *wakeup =
-            thread_mutex_unlock_disabled(handle, &me->exit_lock);
         struct dispatcher_generic *disp_gen = get_dispatcher_generic(handle);
         struct dispatcher_shared_generic *disp =
             get_dispatcher_shared_generic(handle);
 
+        if (domain_is_spanned()) {
+            // a joiner on another core frees our stack as soon as it gets the
+            // lock, so the dispatcher releases it once it left the stack
+            thread_remove_from_queue(&disp_gen->runq, me);
+            disp_gen->current = NULL;
+            disp_gen->exiting = me;
+            disp->haswork = true;
+            disp_yield_disabled(handle);
+        }
+
+        struct thread *wakeup =
+            thread_mutex_unlock_disabled(handle, &me->exit_lock);
         assert_disabled(wakeup == NULL);
 
         // run the next thread, if any
@@ -947,7 +959,7 @@ void thread_exit(int status)
             disp_resume(handle, &next->regs);
         } else {
             disp_gen->current = NULL;
-            disp->haswork = havework_disabled(handle);
+            disp->haswork = sleep_prepare_disabled(handle);
             disp_yield_disabled(handle);
         }
     }
@@ -1002,7 +1014,7 @@ void *thread_block_and_release_spinlock_disabled(dispatcher_handle_t handle,
     } else {
         assert_disabled(disp_gen->runq == NULL);
         disp_gen->current = NULL;
-        disp->haswork = havework_disabled(handle);
+        disp->haswork = sleep_prepare_disabled(handle);
         disp_save(handle, &me->regs, true, CPTR_NULL);
     }
 
@@ -1278,6 +1290,181 @@ void thread_init_remote(dispatcher_handle_t handle, struct thread *thread)
 }
 
 
+/**
+ * \brief Hand a runnable thread over to another dispatcher of the domain
+ *
+ * The thread is queued on the incoming threads of the dispatcher it belongs
+ * to, which moves it to its run queue the next time it runs. If that
+ * dispatcher is waiting for work, the doorbell of its core is rung.
+ * This function must only be called while disabled.
+ *
+ * \param handle Dispatcher pointer of the caller
+ * \param thread Thread to hand over, with its dispatcher already set
+ */
+errval_t thread_hand_over_disabled(dispatcher_handle_t handle,
+                                   struct thread *thread)
+{
+    struct dispatcher_generic *disp_gen = get_dispatcher_generic(handle);
+    struct dispatcher_generic *target = get_dispatcher_generic(thread->disp);
+
+    assert_disabled(thread->disp != handle);
+    assert_disabled(thread->state == THREAD_STATE_RUNNABLE);
+
+    acquire_spinlock(&target->incoming_lock);
+    thread_enqueue(thread, &target->incoming);
+    bool sleeping = target->incoming_sleeping;
+    target->incoming_sleeping = false;
+    release_spinlock(&target->incoming_lock);
+
+    if (sleeping) {
+        return invoke_dispatcher_notify(disp_gen->dcb_cap, target->core_id);
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Receive the threads handed over by the other dispatchers
+ *
+ * Also finishes the work threads leave behind when they migrate or exit, as
+ * it can only be done once the dispatcher no longer runs on their stacks.
+ * Called from the dispatcher (on its stack and while disabled!).
+ *
+ * \param handle Dispatcher pointer
+ */
+void thread_receive_incoming_disabled(dispatcher_handle_t handle)
+{
+    struct dispatcher_generic *disp_gen = get_dispatcher_generic(handle);
+    errval_t err;
+
+    if (disp_gen->outgoing != NULL) {
+        struct thread *outgoing = disp_gen->outgoing;
+        disp_gen->outgoing = NULL;
+        err = thread_hand_over_disabled(handle, outgoing);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "handing over a migrating thread");
+        }
+    }
+
+    if (disp_gen->exiting != NULL) {
+        struct thread *exiting = disp_gen->exiting;
+        disp_gen->exiting = NULL;
+        struct thread *wakeup =
+            thread_mutex_unlock_disabled(handle, &exiting->exit_lock);
+        if (wakeup != NULL) {
+            err = thread_hand_over_disabled(handle, wakeup);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "waking the joiner of an exited thread");
+            }
+        }
+    }
+
+    if (disp_gen->incoming == NULL && !disp_gen->incoming_sleeping) {
+        return;
+    }
+
+    acquire_spinlock(&disp_gen->incoming_lock);
+    struct thread *incoming = disp_gen->incoming;
+    disp_gen->incoming = NULL;
+    disp_gen->incoming_sleeping = false;
+    release_spinlock(&disp_gen->incoming_lock);
+
+    while (incoming != NULL) {
+        struct thread *thread = thread_dequeue(&incoming);
+        assert_disabled(thread->disp == handle);
+        if (!thread->paused) {
+            thread_enqueue(thread, &disp_gen->runq);
+        }
+    }
+}
+
+/**
+ * \brief Check for threads handed over by the other dispatchers
+ *
+ * The dispatcher may only leave the run queue of a spanned domain once the
+ * other dispatchers were told to ring the doorbell of our core, see
+ * thread_incoming_sleep_disabled().
+ *
+ * \returns true if the dispatcher has threads to receive
+ */
+bool thread_incoming_havework_disabled(dispatcher_handle_t handle)
+{
+    struct dispatcher_generic *disp_gen = get_dispatcher_generic(handle);
+
+    if (disp_gen->outgoing != NULL || disp_gen->exiting != NULL) {
+        return true;
+    }
+    if (!domain_is_spanned()) {
+        return false;
+    }
+
+    acquire_spinlock(&disp_gen->incoming_lock);
+    bool havework = disp_gen->incoming != NULL || !disp_gen->incoming_sleeping;
+    release_spinlock(&disp_gen->incoming_lock);
+    return havework;
+}
+
+/**
+ * \brief Tell the other dispatchers to ring the doorbell of our core
+ *
+ * Called before the dispatcher gives up the CPU, so that it can sleep until
+ * a thread is handed over to it.
+ */
+void thread_incoming_sleep_disabled(dispatcher_handle_t handle)
+{
+    struct dispatcher_generic *disp_gen = get_dispatcher_generic(handle);
+    struct dispatcher_shared_generic *disp =
+        get_dispatcher_shared_generic(handle);
+
+    if (disp_gen->outgoing != NULL || disp_gen->exiting != NULL
+        || !domain_is_spanned()) {
+        return;
+    }
+
+    acquire_spinlock(&disp_gen->incoming_lock);
+    bool sleeping = disp_gen->incoming == NULL;
+    disp_gen->incoming_sleeping = sleeping;
+    release_spinlock(&disp_gen->incoming_lock);
+
+    if (sleeping) {
+        disp->doorbell = 1;
+    }
+}
+
+/**
+ * \brief Move the calling thread to another dispatcher of the domain
+ *
+ * The thread leaves the run queue and saves its state. Its dispatcher then
+ * hands it over from the dispatcher stack, as the thread may run on the other
+ * core before this one stopped using the thread's stack.
+ *
+ * \param target Dispatcher to continue on
+ */
+void thread_migrate_self(dispatcher_handle_t target)
+{
+    dispatcher_handle_t handle = disp_disable();
+    struct dispatcher_generic *disp_gen = get_dispatcher_generic(handle);
+    struct dispatcher_shared_generic *disp =
+        get_dispatcher_shared_generic(handle);
+    struct thread *me = disp_gen->current;
+
+    if (target == handle) {
+        disp_enable(handle);
+        return;
+    }
+
+    assert_disabled(me->state == THREAD_STATE_RUNNABLE);
+
+    thread_remove_from_queue(&disp_gen->runq, me);
+    me->disp = target;
+    me->coreid = get_dispatcher_generic(target)->core_id;
+    disp_gen->current = NULL;
+    disp_gen->outgoing = me;
+    disp->haswork = true;
+
+    // continues on the target dispatcher
+    disp_save(handle, &me->regs, true, CPTR_NULL);
+}
+
 /**
  * \brief Pause (suspend execution of) the given thread, and optionally capture its register state
  *
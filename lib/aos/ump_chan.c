@@ -1,5 +1,6 @@
 #include <aos/aos.h>
 #include <aos/ump_chan.h>
+#include <aos/kernel_cap_invocations.h>
 #include "waitset_chan_priv.h"
 
 
@@ -20,21 +21,35 @@ errval_t ump_chan_init(struct ump_chan* chan, struct capref frame, bool primary)
         return err;
     }
 
+    // each half starts with the line holding the index and the sleeping flag of its receiver
     size_t lines = (id.bytes / sizeof(struct ump_line)) / 2;
+    if (lines < 2) {
+        return LIB_ERR_UMP_BUFSIZE_INVALID;
+    }
 
-    if (primary) {
-        chan->send.buf = (struct ump_line*)buf;
-        chan->recv.buf = chan->send.buf + lines;
-    } else {
-        chan->recv.buf = (struct ump_line*)buf;
-        chan->send.buf = chan->recv.buf + lines;
+    struct ump_line* first = (struct ump_line*)buf;
+    struct ump_line* second = first + lines;
+    if (!primary) {
+        first = second;
+        second = (struct ump_line*)buf;
     }
 
-    chan->send.size = lines;
-    chan->send.offset = 0;
+    chan->send.ack = &first->words[0];
+    chan->send.sleeping = &first->words[1];
+    chan->send.buf = first + 1;
+    chan->recv.ack = &second->words[0];
+    chan->recv.sleeping = &second->words[1];
+    chan->recv.buf = second + 1;
+
+    chan->send.size = lines - 1;
+    chan->send.pos = 0;
+    chan->send.acked = 0;
 
-    chan->recv.size = lines;
-    chan->recv.offset = 0;
+    chan->recv.size = lines - 1;
+    chan->recv.pos = 0;
+    chan->recv.acked = 0;
+
+    chan->doorbell = false;
 
     waitset_chanstate_init(&chan->send.waitset_state, CHANTYPE_UMP_OUT);
     waitset_chanstate_init(&chan->recv.waitset_state, CHANTYPE_UMP_IN);
@@ -44,6 +59,26 @@ errval_t ump_chan_init(struct ump_chan* chan, struct capref frame, bool primary)
     return err;
 }
 
+/**
+ * @brief lets the receiver sleep until a message arrives instead of polling the channel
+ *
+ * @param[in] chan  the channel
+ * @param[in] core  the core of the other end of the channel
+ *
+ * Ringing the doorbell requires the IPI capability, so both ends must have it.
+ */
+void ump_chan_set_doorbell(struct ump_chan* chan, coreid_t core) {
+    chan->doorbell_core = core;
+    chan->doorbell = true;
+}
+
+void ump_chan_notify(struct ump_chan* chan) {
+    errval_t err = invoke_ipi_notify(chan->doorbell_core);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "ringing the doorbell of core %" PRIuCOREID, chan->doorbell_core);
+    }
+}
+
 errval_t ump_chan_register_recv(struct ump_chan *chan, struct waitset *ws, struct event_closure closure) {
     errval_t err;
 
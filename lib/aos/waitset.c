@@ -240,6 +240,9 @@ void poll_channels_disabled(dispatcher_handle_t handle) {
         chan = chan->polled_next;
         prev_head = dp->polled_channels;
         if (chan_ready) {
+            if (chan->polled_prev->chantype == CHANTYPE_UMP_IN && dp->poll_sleeping) {
+                ump_chan_set_sleeping((struct ump_chan*)chan->polled_prev->chan_data, false);
+            }
             /* We already advanced so we use prev pointer here */
             errval_t err = waitset_chan_trigger_disabled(chan->polled_prev, handle);
             /* Shouldn't fail */
@@ -257,6 +260,122 @@ void poll_channels_disabled(dispatcher_handle_t handle) {
     } while (chan != prev_head);
 }
 
+#define POLL_SPIN_MIN 16
+#define POLL_SPIN_MAX 4096
+
+/// Tell the senders of the polled channels whether to ring the doorbell
+static void poll_channels_set_sleeping_disabled(dispatcher_handle_t handle, bool sleeping)
+{
+    struct dispatcher_generic *dp = get_dispatcher_generic(handle);
+    struct waitset_chanstate *chan = dp->polled_channels;
+
+    if (chan != NULL) {
+        do {
+            if (chan->chantype == CHANTYPE_UMP_IN) {
+                struct ump_chan* ump_chan = (struct ump_chan*)chan->chan_data;
+                if (ump_chan->doorbell) {
+                    ump_chan_set_sleeping(ump_chan, sleeping);
+                }
+            }
+            chan = chan->polled_next;
+        } while (chan != dp->polled_channels);
+    }
+    dp->poll_sleeping = sleeping;
+}
+
+/// Whether all polled channels are UMP receive channels whose sender rings the doorbell
+static bool poll_channels_can_sleep_disabled(dispatcher_handle_t handle)
+{
+    struct dispatcher_generic *dp = get_dispatcher_generic(handle);
+    struct waitset_chanstate *chan = dp->polled_channels;
+
+    if (chan == NULL) {
+        return true;
+    }
+    do {
+        if (chan->chantype != CHANTYPE_UMP_IN
+            || !((struct ump_chan*)chan->chan_data)->doorbell) {
+            return false;
+        }
+        chan = chan->polled_next;
+    } while (chan != dp->polled_channels);
+    return true;
+}
+
+/**
+ * \brief Check whether the dispatcher has to stay runnable for its polled channels
+ *
+ * It may only leave the run queue if all of them are UMP receive channels whose
+ * senders were told that we sleep, see poll_channels_sleep_disabled().
+ *
+ * \returns true if the dispatcher has to keep polling
+ */
+bool poll_channels_havework_disabled(dispatcher_handle_t handle)
+{
+    struct dispatcher_generic *dp = get_dispatcher_generic(handle);
+
+    if (dp->polled_channels == NULL) {
+        return false;
+    }
+    return !dp->poll_sleeping || !poll_channels_can_sleep_disabled(handle);
+}
+
+/**
+ * \brief Poll the channels a last time before the dispatcher gives up the CPU
+ *
+ * The channels are polled for a while, as a message caught this way saves the
+ * round trip through the scheduler. The number of rounds adapts to the traffic:
+ * it doubles whenever polling caught a message, and halves whenever it did not.
+ *
+ * If nothing arrived and all polled channels are UMP receive channels with a
+ * doorbell, their senders are told that we sleep, and the dispatcher may leave
+ * the run queue until the doorbell of its core rings.
+ */
+void poll_channels_sleep_disabled(dispatcher_handle_t handle)
+{
+    struct dispatcher_generic *dp = get_dispatcher_generic(handle);
+    struct dispatcher_shared_generic *disp = get_dispatcher_shared_generic(handle);
+
+    uint32_t spin = MAX(dp->poll_spin, POLL_SPIN_MIN);
+    for (uint32_t i = 0; i < spin; i++) {
+        if (dp->polled_channels == NULL) {
+            return;
+        }
+        poll_channels_disabled(handle);
+        if (dp->runq != NULL || disp->lmp_delivered != disp->lmp_seen) {
+            dp->poll_spin = MIN(spin * 2, POLL_SPIN_MAX);
+            return;
+        }
+    }
+    dp->poll_spin = MAX(spin / 2, POLL_SPIN_MIN);
+
+    if (dp->polled_channels == NULL || !poll_channels_can_sleep_disabled(handle)) {
+        return;
+    }
+
+    poll_channels_set_sleeping_disabled(handle, true);
+
+    // the senders must see that we sleep before we look at the channels a last time
+    dmb();
+
+    poll_channels_disabled(handle);
+    if (dp->runq == NULL) {
+        disp->doorbell = 1;
+    }
+}
+
+/// Tell the senders of the polled channels that we are running again
+void poll_channels_wake_disabled(dispatcher_handle_t handle)
+{
+    struct dispatcher_generic *dp = get_dispatcher_generic(handle);
+    struct dispatcher_shared_generic *disp = get_dispatcher_shared_generic(handle);
+
+    disp->doorbell = 0;
+    if (dp->poll_sleeping) {
+        poll_channels_set_sleeping_disabled(handle, false);
+    }
+}
+
 /// Re-register a channel (if persistent)
 static void reregister_channel(struct waitset *ws, struct waitset_chanstate *chan,
                                 dispatcher_handle_t handle)
@@ -25,11 +25,13 @@
 #include <aos/aos.h>
 #include <aos/aos_rpc.h>
 #include <aos/cache.h>
+#include <aos/inthandler.h>
 #include <grading/grading.h>
 #include <grading/io.h>
 #include <aos/systime.h>
 
 #include <drivers/sdhc.h>
+#include <drivers/gic_dist.h>
 #include <maps/imx8x_map.h>
 
 #include "../../include/block_driver/blockdriver.h"
@@ -47,6 +49,12 @@ errval_t _init_block_driver(struct block_driver *b_driver);
 
 errval_t _read_block(struct block_driver *b_driver, int lba, void *block);
 errval_t _write_block(struct block_driver *b_driver, int lba, void *block);
+errval_t _read_blocks(struct block_driver *b_driver, int lba, size_t count, void *blocks);
+errval_t _write_blocks(struct block_driver *b_driver, int lba, size_t count, const void *blocks);
+
+static void _drain_requests(struct block_driver *b_driver);
+
+#define BULK_FRAME_SIZE (SDHC_MAX_BLOCKS_PER_TRANSFER * SDHC_BLOCK_SIZE)
 
 errval_t _map_cap_to_driver(struct block_driver *b_driver) {
     errval_t err = SYS_ERR_OK;
@@ -118,7 +126,27 @@ errval_t _init_block_driver(struct block_driver *b_driver) {
 
     DEBUG_BLOCKDRIVER("RW frame for the driver is up\n");
 
-    thread_mutex_init(&mm_mutex);
+    err = frame_alloc(&b_driver->bulk_frame, BULK_FRAME_SIZE, &size);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    err = paging_map_frame_attr_offset(get_current_paging_state(), (void**)&b_driver->bulk_vaddr, size, b_driver->bulk_frame, 0, VREGION_FLAGS_READ_WRITE);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    struct capability bulk_frame_identity;
+    err = cap_direct_identify(b_driver->bulk_frame, &bulk_frame_identity);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    b_driver->bulk_paddr = get_address(&bulk_frame_identity);
+
+    DEBUG_BLOCKDRIVER("Bulk frame for the driver is up\n");
+
+    thread_mutex_init(&b_driver->mutex);
 
     DEBUG_BLOCKDRIVER("Mutex is ready \n");
 
@@ -140,9 +168,10 @@ errval_t _read_block(struct block_driver *b_driver, int lba, void *block) {
 }
 
 errval_t read_block(struct block_driver *b_driver, int lba, void *block) {
-    thread_mutex_lock(&b_driver->mm_mutex);
+    thread_mutex_lock(&b_driver->mutex);
+    _drain_requests(b_driver);
     errval_t err = _read_block(b_driver, lba, block);
-    thread_mutex_unlock(&b_driver->mm_mutex);
+    thread_mutex_unlock(&b_driver->mutex);
     return err;
 }
 
@@ -152,7 +181,7 @@ errval_t _write_block(struct block_driver *b_driver, int lba, void *block) {
     // Step 1) Flush the cache in the write range
     arm64_dcache_wb_range(b_driver->write_vaddr, SDHC_BLOCK_SIZE);
     // Step 2) Write to the block driver
-    err = sdhc_write_block(b_driver->driver_structure, lba, b_driver->write_paddr);
+    err = sdhc_write_block(b_driver->driver_structure, lba, b_driver->write_paddr, b_driver->write_vaddr);
     if(err_is_fail(err)) {
         return err;
     }
@@ -160,12 +189,253 @@ errval_t _write_block(struct block_driver *b_driver, int lba, void *block) {
 }
 
 errval_t write_block(struct block_driver *b_driver, int lba, void *block) {
-    thread_mutex_lock(&b_driver->mm_mutex);
+    thread_mutex_lock(&b_driver->mutex);
+    _drain_requests(b_driver);
     errval_t err = _write_block(b_driver, lba, block);
-    thread_mutex_unlock(&b_driver->mm_mutex);
+    thread_mutex_unlock(&b_driver->mutex);
+    return err;
+}
+
+errval_t _read_blocks(struct block_driver *b_driver, int lba, size_t count, void *blocks) {
+    errval_t err = SYS_ERR_OK;
+    // Split the request in chunks that fit into the bulk frame
+    while(count > 0) {
+        size_t chunk = MIN(count, SDHC_MAX_BLOCKS_PER_TRANSFER);
+        size_t chunk_size = chunk * SDHC_BLOCK_SIZE;
+        // Step 1) Flush the cache in the read range
+        arm64_dcache_wbinv_range(b_driver->bulk_vaddr, chunk_size);
+        // Step 2) Read from the block driver
+        err = sdhc_read_blocks(b_driver->driver_structure, lba, chunk, b_driver->bulk_paddr, b_driver->bulk_vaddr);
+        if(err_is_fail(err)) {
+            return err;
+        }
+        // Step 3) Copy the data into blocks
+        memcpy(blocks, (void*)b_driver->bulk_vaddr, chunk_size);
+
+        lba += chunk;
+        count -= chunk;
+        blocks += chunk_size;
+    }
+    return SYS_ERR_OK;
+}
+
+errval_t read_blocks(struct block_driver *b_driver, int lba, size_t count, void *blocks) {
+    thread_mutex_lock(&b_driver->mutex);
+    _drain_requests(b_driver);
+    errval_t err = _read_blocks(b_driver, lba, count, blocks);
+    thread_mutex_unlock(&b_driver->mutex);
+    return err;
+}
+
+errval_t _write_blocks(struct block_driver *b_driver, int lba, size_t count, const void *blocks) {
+    errval_t err = SYS_ERR_OK;
+    // Split the request in chunks that fit into the bulk frame
+    while(count > 0) {
+        size_t chunk = MIN(count, SDHC_MAX_BLOCKS_PER_TRANSFER);
+        size_t chunk_size = chunk * SDHC_BLOCK_SIZE;
+        memcpy((void*)b_driver->bulk_vaddr, blocks, chunk_size);
+        // Step 1) Flush the cache in the write range
+        arm64_dcache_wb_range(b_driver->bulk_vaddr, chunk_size);
+        // Step 2) Write to the block driver
+        err = sdhc_write_blocks(b_driver->driver_structure, lba, chunk, b_driver->bulk_paddr, b_driver->bulk_vaddr);
+        if(err_is_fail(err)) {
+            return err;
+        }
+
+        lba += chunk;
+        count -= chunk;
+        blocks += chunk_size;
+    }
+    return SYS_ERR_OK;
+}
+
+errval_t write_blocks(struct block_driver *b_driver, int lba, size_t count, const void *blocks) {
+    thread_mutex_lock(&b_driver->mutex);
+    _drain_requests(b_driver);
+    errval_t err = _write_blocks(b_driver, lba, count, blocks);
+    thread_mutex_unlock(&b_driver->mutex);
     return err;
 }
 
+errval_t flush_blocks(struct block_driver *b_driver) {
+    thread_mutex_lock(&b_driver->mutex);
+    _drain_requests(b_driver);
+    errval_t err = sdhc_flush_cache(b_driver->driver_structure);
+    thread_mutex_unlock(&b_driver->mutex);
+    return err;
+}
+
+void block_cache_stats(struct block_driver *b_driver, struct sdhc_cache_stats *stats) {
+    thread_mutex_lock(&b_driver->mutex);
+    sdhc_cache_get_stats(b_driver->driver_structure, stats);
+    thread_mutex_unlock(&b_driver->mutex);
+}
+
+/*
+ * Asynchronous requests
+ * =====================
+ * Requests are queued and transferred one after the other through the bulk
+ * frame. The SDHC interrupt signals the end of each transfer, upon which the
+ * next one is started right away and finished requests are handed to the
+ * completions queue. Synchronous calls drain the queue before using the card.
+ */
+static void _complete_request(struct block_driver *b_driver, errval_t err) {
+    struct block_request *req = b_driver->queue_head;
+    b_driver->queue_head = req->next;
+    if(b_driver->queue_head == NULL) {
+        b_driver->queue_tail = NULL;
+    }
+    req->err = err;
+    event_queue_add(&b_driver->completions, &req->qnode, req->completion);
+}
+
+static void _start_next_chunk(struct block_driver *b_driver) {
+    struct block_request *req;
+    while((req = b_driver->queue_head) != NULL) {
+        size_t chunk = MIN(req->count - req->done, SDHC_MAX_BLOCKS_PER_TRANSFER);
+        size_t chunk_size = chunk * SDHC_BLOCK_SIZE;
+        bool is_write = req->type == BLOCK_REQUEST_WRITE;
+        if(is_write) {
+            memcpy((void*)b_driver->bulk_vaddr, req->buf + req->done * SDHC_BLOCK_SIZE, chunk_size);
+            arm64_dcache_wb_range(b_driver->bulk_vaddr, chunk_size);
+        } else {
+            arm64_dcache_wbinv_range(b_driver->bulk_vaddr, chunk_size);
+        }
+        errval_t err = sdhc_start_transfer(b_driver->driver_structure, is_write, req->lba + req->done, chunk, b_driver->bulk_paddr, b_driver->bulk_vaddr);
+        if(err_is_ok(err)) {
+            b_driver->in_flight_count = chunk;
+            return;
+        }
+        _complete_request(b_driver, err);
+    }
+}
+
+static void _poll_in_flight(struct block_driver *b_driver) {
+    if(b_driver->in_flight_count == 0) {
+        return;
+    }
+
+    bool done;
+    errval_t err = sdhc_poll_transfer(b_driver->driver_structure, &done);
+    if(!done) {
+        return;
+    }
+
+    struct block_request *req = b_driver->queue_head;
+    size_t chunk = b_driver->in_flight_count;
+    b_driver->in_flight_count = 0;
+
+    if(err_is_fail(err)) {
+        _complete_request(b_driver, err);
+    } else {
+        if(req->type == BLOCK_REQUEST_READ) {
+            memcpy(req->buf + req->done * SDHC_BLOCK_SIZE, (void*)b_driver->bulk_vaddr, chunk * SDHC_BLOCK_SIZE);
+        }
+        req->done += chunk;
+        if(req->done == req->count) {
+            _complete_request(b_driver, SYS_ERR_OK);
+        }
+    }
+
+    _start_next_chunk(b_driver);
+}
+
+static void _drain_requests(struct block_driver *b_driver) {
+    while(b_driver->queue_head != NULL) {
+        _poll_in_flight(b_driver);
+        if(b_driver->queue_head != NULL) {
+            thread_yield();
+        }
+    }
+}
+
+static void _sdhc_interrupt(void *arg) {
+    struct block_driver *b_driver = arg;
+    thread_mutex_lock(&b_driver->mutex);
+    _poll_in_flight(b_driver);
+    thread_mutex_unlock(&b_driver->mutex);
+}
+
+errval_t block_driver_async_init(struct block_driver *b_driver, struct waitset *ws) {
+    errval_t err = SYS_ERR_OK;
+
+    event_queue_init(&b_driver->completions, ws, EVENT_QUEUE_CONTINUOUS);
+
+    struct capability dev_frame;
+    err = cap_direct_identify(cap_devices, &dev_frame);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    void *gic_buf;
+    err = dev_frame_map(cap_devices, dev_frame, IMX8X_GIC_DIST_BASE, IMX8X_GIC_DIST_SIZE, &gic_buf);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    struct gic_dist_s *gds;
+    err = gic_dist_init(&gds, gic_buf);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    struct capref irq_dst_cap;
+    err = inthandler_alloc_dest_irq_cap(IMX8X_SDHC2_INT, &irq_dst_cap);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    err = inthandler_setup(irq_dst_cap, ws, MKCLOSURE(_sdhc_interrupt, b_driver));
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    err = gic_dist_enable_interrupt(gds, IMX8X_SDHC2_INT, /*cpu_targets*/ 0b1, /*priority*/ 0);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    b_driver->async_enabled = true;
+
+    DEBUG_BLOCKDRIVER("Asynchronous requests are enabled\n");
+
+    return SYS_ERR_OK;
+}
+
+errval_t submit_block_requests(struct block_driver *b_driver, struct block_request **reqs, size_t count) {
+    if(!b_driver->async_enabled) {
+        return SDHCD_ERR_ASYNC_NOT_INIT;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        if(reqs[i]->count == 0 || reqs[i]->buf == NULL) {
+            return ERR_INVALID_ARGS;
+        }
+    }
+
+    thread_mutex_lock(&b_driver->mutex);
+    for(size_t i = 0; i < count; i++) {
+        struct block_request *req = reqs[i];
+        req->err = SYS_ERR_OK;
+        req->done = 0;
+        req->next = NULL;
+        if(b_driver->queue_tail == NULL) {
+            b_driver->queue_head = req;
+        } else {
+            b_driver->queue_tail->next = req;
+        }
+        b_driver->queue_tail = req;
+    }
+
+    // Nothing is in flight, so the controller is idle
+    if(b_driver->in_flight_count == 0) {
+        _start_next_chunk(b_driver);
+    }
+    thread_mutex_unlock(&b_driver->mutex);
+
+    return SYS_ERR_OK;
+}
+
 errval_t benchmark_read(struct block_driver *b_driver, size_t number_runs) {
     void *bloc = malloc(512);
     assert(!read_block(b_driver, 50, bloc));
@@ -189,6 +459,68 @@ errval_t benchmark_write(struct block_driver *b_driver, size_t number_runs) {
     return SYS_ERR_OK;
 }
 
+errval_t benchmark_cache(struct block_driver *b_driver, size_t number_runs) {
+    void *bloc = malloc(512);
+    struct sdhc_cache_stats stats;
+
+    // Fill the cache with the blocks we are going to hit
+    for(size_t lba = 50; lba < number_runs + 50;lba++) {
+        assert(!read_block(b_driver, lba, bloc));
+    }
+
+    for(size_t lba = 50; lba < number_runs + 50;lba++) {
+        uint64_t start = systime_now();
+        assert(!read_block(b_driver, lba, bloc));
+        uint64_t end = systime_now();
+        debug_printf("BENCHMARK OUTPUT READ CACHE HIT: %lu\n", systime_to_ns(end - start));
+    }
+
+    block_cache_stats(b_driver, &stats);
+    debug_printf("BENCHMARK CACHE STATS: hits %zu misses %zu evictions %zu writebacks %zu\n",
+                 stats.hits, stats.misses, stats.evictions, stats.writebacks);
+    free(bloc);
+    return SYS_ERR_OK;
+}
+
+static void _benchmark_async_done(void *arg) {
+    size_t *pending = arg;
+    (*pending)--;
+}
+
+errval_t benchmark_async(struct block_driver *b_driver, size_t number_runs) {
+    errval_t err = SYS_ERR_OK;
+    uint8_t *blocs = malloc(number_runs * SDHC_BLOCK_SIZE);
+    struct block_request *reqs = calloc(number_runs, sizeof(struct block_request));
+    struct block_request **req_ptrs = malloc(number_runs * sizeof(struct block_request *));
+    size_t pending = number_runs;
+
+    for(size_t i = 0; i < number_runs; i++) {
+        reqs[i].type = BLOCK_REQUEST_READ;
+        reqs[i].lba = 50 + i;
+        reqs[i].count = 1;
+        reqs[i].buf = blocs + i * SDHC_BLOCK_SIZE;
+        reqs[i].completion = MKCLOSURE(_benchmark_async_done, &pending);
+        req_ptrs[i] = &reqs[i];
+    }
+
+    uint64_t start = systime_now();
+    err = submit_block_requests(b_driver, req_ptrs, number_runs);
+    while(err_is_ok(err) && pending > 0) {
+        err = event_dispatch(b_driver->completions.waitset);
+    }
+    uint64_t end = systime_now();
+    debug_printf("BENCHMARK OUTPUT ASYNC READ: %lu\n", systime_to_us(end - start) / number_runs);
+    if(pending > 0) {
+        // Requests still belong to the driver
+        return err;
+    }
+
+    free(req_ptrs);
+    free(reqs);
+    free(blocs);
+    return err;
+}
+
 void test_driver(struct block_driver *b_driver) {
 
     char *block = (char*)malloc(512);
@@ -245,10 +245,125 @@ void create_directory_entry(struct fat32_entry *entry, const char *name, uint32_
 // Handle management
 void close_handle(struct fat32_handle *handle) {
     assert(handle != NULL && handle->path != NULL);
+    free(handle->extents);
     free(handle->path);
     free(handle);
 }
 
+void fat32_handle_invalidate_extents(struct fat32_handle *handle) {
+    free(handle->extents);
+    handle->extents = NULL;
+    handle->nb_extents = 0;
+    handle->extents_valid = false;
+}
+
+// Walk the cluster chain once and record its contiguous runs
+static errval_t fat32_handle_build_extents(struct fat32_filesystem *fs, struct fat32_handle *handle) {
+    errval_t err = SYS_ERR_OK;
+
+    fat32_handle_invalidate_extents(handle);
+
+    uint32_t cluster_number = get_cluster_number(&handle->entry);
+    uint32_t file_cluster = 0;
+    uint32_t capacity = 0;
+
+    while(cluster_number != 0 && !is_end_cluster(cluster_number)) {
+        if(cluster_number >= BAD_CLUSTER) {
+            return FAT_ERR_CLUSTER_BOUNDS;
+        }
+
+        struct fat32_extent *last = handle->nb_extents > 0 ? &handle->extents[handle->nb_extents - 1] : NULL;
+        if(last != NULL && last->cluster_number + last->nb_clusters == cluster_number) {
+            last->nb_clusters++;
+        } else {
+            if(handle->nb_extents == capacity) {
+                capacity = capacity == 0 ? 4 : 2 * capacity;
+                struct fat32_extent *extents = realloc(handle->extents, capacity * sizeof(struct fat32_extent));
+                if(extents == NULL) {
+                    fat32_handle_invalidate_extents(handle);
+                    return LIB_ERR_MALLOC_FAIL;
+                }
+                handle->extents = extents;
+            }
+            handle->extents[handle->nb_extents].file_cluster = file_cluster;
+            handle->extents[handle->nb_extents].cluster_number = cluster_number;
+            handle->extents[handle->nb_extents].nb_clusters = 1;
+            handle->nb_extents++;
+        }
+
+        err = fat32_get_next_cluster(fs, cluster_number, &cluster_number);
+        if(err_is_fail(err)) {
+            fat32_handle_invalidate_extents(handle);
+            return err;
+        }
+        file_cluster++;
+    }
+
+    handle->extents_valid = true;
+    return SYS_ERR_OK;
+}
+
+static struct fat32_extent *fat32_handle_find_extent(struct fat32_handle *handle, uint32_t file_cluster) {
+    if(handle->nb_extents == 0) {
+        return NULL;
+    }
+
+    // Last extent starting at or before file_cluster
+    uint32_t low = 0;
+    uint32_t high = handle->nb_extents;
+    while(high - low > 1) {
+        uint32_t mid = low + (high - low) / 2;
+        if(handle->extents[mid].file_cluster <= file_cluster) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    struct fat32_extent *extent = &handle->extents[low];
+    if(file_cluster >= extent->file_cluster + extent->nb_clusters) {
+        return NULL;
+    }
+    return extent;
+}
+
+errval_t fat32_handle_lookup_cluster(struct fat32_filesystem *fs, struct fat32_handle *handle, uint32_t file_cluster, uint32_t *cluster_number, uint32_t *nb_contiguous) {
+    errval_t err = SYS_ERR_OK;
+
+    struct fat32_extent *extent = handle->extents_valid ? fat32_handle_find_extent(handle, file_cluster) : NULL;
+    if(extent == NULL) {
+        // Another handle may have appended to the file since the map was built
+        err = fat32_handle_build_extents(fs, handle);
+        if(err_is_fail(err)) {
+            return err;
+        }
+        extent = fat32_handle_find_extent(handle, file_cluster);
+        if(extent == NULL) {
+            return FAT_ERR_CLUSTER_BOUNDS;
+        }
+    }
+
+    uint32_t offset = file_cluster - extent->file_cluster;
+    *cluster_number = extent->cluster_number + offset;
+    if(nb_contiguous != NULL) {
+        *nb_contiguous = extent->nb_clusters - offset;
+    }
+    return SYS_ERR_OK;
+}
+
+errval_t fat32_handle_offset_to_lba(struct fat32_filesystem *fs, struct fat32_handle *handle, uint32_t offset, uint32_t *lba) {
+    const uint32_t bytes_per_cluster = FAT_BLOCK_SIZE * fs->sectors_per_cluster;
+
+    uint32_t cluster_number;
+    errval_t err = fat32_handle_lookup_cluster(fs, handle, offset / bytes_per_cluster, &cluster_number, NULL);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    *lba = get_lba_from_cluster(fs, cluster_number) + (offset % bytes_per_cluster) / FAT_BLOCK_SIZE;
+    return SYS_ERR_OK;
+}
+
 // Cluster management
 uint32_t get_cluster_number(const struct fat32_entry
                             *entry) {
@@ -293,27 +408,151 @@ uint32_t get_lba_from_cluster(const struct fat32_filesystem *fat_fs, uint32_t cl
     return base + offset;
 }
 
-errval_t fat32_get_next_cluster(const struct fat32_filesystem *fat_mount, uint32_t cluster_number, uint32_t *ret_cluster_number) {
+// FAT cache
+errval_t fat32_fat_cache_init(struct fat32_filesystem *fs) {
+    fs->fat_cache = malloc(sizeof(struct fat32_fat_cache));
+    if(fs->fat_cache == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    for(int i = 0; i < FAT_CACHE_SECTORS; i++) {
+        fs->fat_cache->sector[i] = FAT_CACHE_EMPTY;
+        fs->fat_cache->dirty[i] = false;
+    }
+
+    return SYS_ERR_OK;
+}
+
+// Write count consecutive slots, holding consecutive sectors, to every FAT copy
+static errval_t fat32_fat_writeback(const struct fat32_filesystem *fs, size_t slot, size_t count) {
     errval_t err = SYS_ERR_OK;
+    struct fat32_fat_cache *cache = fs->fat_cache;
 
-    // Edge case with the root
-    if(cluster_number == 0) {
-        *ret_cluster_number = END_CLUSTER;
+    for(int i = 0; i < fs->fat32_number; i++) {
+        const uint32_t lba = i * fs->sectors_per_fat + fs->numbers_sectors_reserved + cache->sector[slot];
+        err = write_blocks(fs->b_driver, lba, count, (void *) cache->data[slot]);
+        if(err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    for(size_t i = slot; i < slot + count; i++) {
+        cache->dirty[i] = false;
+    }
+
+    return SYS_ERR_OK;
+}
+
+static errval_t fat32_fat_load(const struct fat32_filesystem *fs, uint32_t sector, uint32_t **entries) {
+    errval_t err = SYS_ERR_OK;
+    struct fat32_fat_cache *cache = fs->fat_cache;
+
+    const size_t slot = sector % FAT_CACHE_SECTORS;
+    if(cache->sector[slot] == sector) {
+        *entries = cache->data[slot];
         return SYS_ERR_OK;
     }
 
-    uint8_t data[FAT_BLOCK_SIZE];
-    uint32_t lba = fat_mount->numbers_sectors_reserved + cluster_number / FAT_ENTRIES_PER_SECTOR;
+    if(sector >= fs->sectors_per_fat) {
+        return FAT_ERR_CLUSTER_BOUNDS;
+    }
 
-    err = read_block(fat_mount->b_driver, lba, (void *) data);
-    if (err_is_fail(err)) {
+    // Chains are mostly allocated sequentially, so bring in the whole group
+    // of sectors around the missing one with a single multi-block read
+    const uint32_t first = ROUND_DOWN(sector, FAT_CACHE_PREFETCH);
+    const uint32_t count = MIN(FAT_CACHE_PREFETCH, fs->sectors_per_fat - first);
+    const size_t first_slot = first % FAT_CACHE_SECTORS;
+
+    for(size_t i = 0; i < count; i++) {
+        const size_t s = first_slot + i;
+        if(cache->dirty[s] && cache->sector[s] != first + i) {
+            err = fat32_fat_writeback(fs, s, 1);
+            if(err_is_fail(err)) {
+                return err;
+            }
+        }
+    }
+
+    err = read_blocks(fs->b_driver, fs->numbers_sectors_reserved + first, count, (void *) cache->prefetch);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        const size_t s = first_slot + i;
+        // Sectors already present may be more recent than the disk
+        if(cache->sector[s] != first + i) {
+            memcpy(cache->data[s], cache->prefetch[i], FAT_BLOCK_SIZE);
+            cache->sector[s] = first + i;
+        }
+    }
+
+    *entries = cache->data[slot];
+    return SYS_ERR_OK;
+}
+
+errval_t fat32_fat_get(const struct fat32_filesystem *fs, uint32_t cluster_number, uint32_t *value) {
+    uint32_t *entries;
+    errval_t err = fat32_fat_load(fs, cluster_number / FAT_ENTRIES_PER_SECTOR, &entries);
+    if(err_is_fail(err)) {
+        return err;
+    }
+
+    *value = entries[cluster_number % FAT_ENTRIES_PER_SECTOR];
+    return SYS_ERR_OK;
+}
+
+errval_t fat32_fat_set(const struct fat32_filesystem *fs, uint32_t cluster_number, uint32_t value) {
+    uint32_t *entries;
+    const uint32_t sector = cluster_number / FAT_ENTRIES_PER_SECTOR;
+    errval_t err = fat32_fat_load(fs, sector, &entries);
+    if(err_is_fail(err)) {
         return err;
     }
 
-    *ret_cluster_number = *(uint32_t * )(data + (cluster_number % FAT_ENTRIES_PER_SECTOR) * 4);
+    entries[cluster_number % FAT_ENTRIES_PER_SECTOR] = value;
+    fs->fat_cache->dirty[sector % FAT_CACHE_SECTORS] = true;
     return SYS_ERR_OK;
 }
 
+errval_t fat32_fat_flush(const struct fat32_filesystem *fs) {
+    errval_t err = SYS_ERR_OK;
+    struct fat32_fat_cache *cache = fs->fat_cache;
+
+    // Consecutive dirty sectors sit in consecutive slots, write them as one run
+    size_t slot = 0;
+    while(slot < FAT_CACHE_SECTORS) {
+        if(!cache->dirty[slot]) {
+            slot++;
+            continue;
+        }
+
+        size_t count = 1;
+        while(slot + count < FAT_CACHE_SECTORS && cache->dirty[slot + count]
+              && cache->sector[slot + count] == cache->sector[slot] + count) {
+            count++;
+        }
+
+        err = fat32_fat_writeback(fs, slot, count);
+        if(err_is_fail(err)) {
+            return err;
+        }
+        slot += count;
+    }
+
+    return SYS_ERR_OK;
+}
+
+errval_t fat32_get_next_cluster(const struct fat32_filesystem *fat_mount, uint32_t cluster_number, uint32_t *ret_cluster_number) {
+    // Edge case with the root
+    if(cluster_number == 0) {
+        *ret_cluster_number = END_CLUSTER;
+        return SYS_ERR_OK;
+    }
+
+    return fat32_fat_get(fat_mount, cluster_number, ret_cluster_number);
+}
+
 // Walk functions
 errval_t fat32_read_directory(struct fat32_filesystem *fs, const struct fat32_entry *entry, size_t *nb_entries, struct fat32_entry **out_directories) {
     errval_t err = SYS_ERR_OK;
@@ -563,6 +802,9 @@ errval_t fat32_resolve_path(const struct fat32_filesystem *fat_mount, const char
     output->is_directory = is_directory(&current_entry);
     output->parent_cluster_number = parent_cluster_number;
     output->parent_cluster_offset = parent_cluster_offset;
+    output->extents = NULL;
+    output->nb_extents = 0;
+    output->extents_valid = false;
 
     // Return the output -> NULL in case of failure and a value otherwise
     return SYS_ERR_OK;
@@ -636,7 +878,9 @@ errval_t fat32_close(struct fat32_filesystem *fs, struct fat32_handle *handle) {
         return FS_ERR_NOTFILE;
     }
     close_handle(handle);
-    return SYS_ERR_OK;
+
+    // Writes are cached by the block driver, make them durable on close
+    return fat32_sync(fs);
 }
 
 errval_t fat32_stat(struct fat32_filesystem *fs, const struct fat32_handle *handle, struct fs_fileinfo *file_info) {
@@ -658,6 +902,64 @@ errval_t fat32_stat(struct fat32_filesystem *fs, const struct fat32_handle *hand
     return SYS_ERR_OK;
 }
 
+/*
+ * A handle that reached the end of a cluster keeps pointing at it with
+ * relative_sector_from_cluster == sectors_per_cluster, the next cluster is
+ * only looked up once data past the boundary is accessed.
+ */
+static errval_t fat32_handle_next_cluster_if_required(struct fat32_filesystem *fs, struct fat32_handle *handle) {
+    errval_t err = SYS_ERR_OK;
+
+    if(handle->relative_sector_from_cluster < fs->sectors_per_cluster) {
+        return SYS_ERR_OK;
+    }
+
+    uint32_t next_cluster_number = 0;
+    err = fat32_get_next_cluster(fs, handle->current_cluster, &next_cluster_number);
+    if(err_is_fail(err)) {
+        return err;
+    }
+    assert(next_cluster_number < BAD_CLUSTER && next_cluster_number > 0);
+    handle->current_cluster = next_cluster_number;
+    handle->relative_sector_from_cluster -= fs->sectors_per_cluster;
+
+    return SYS_ERR_OK;
+}
+
+// Number of sectors (at most max_sectors) that are contiguous on disk from the handle position
+static errval_t fat32_contiguous_sectors(struct fat32_filesystem *fs, struct fat32_handle *handle, uint32_t max_sectors, uint32_t *nb_sectors) {
+    errval_t err = SYS_ERR_OK;
+
+    uint32_t available = fs->sectors_per_cluster - handle->relative_sector_from_cluster;
+    if(available < max_sectors) {
+        // Index of the current cluster in the file, the handle is never on a boundary here
+        uint32_t file_cluster = (handle->file_position / FAT_BLOCK_SIZE) / fs->sectors_per_cluster;
+        uint32_t cluster_number;
+        uint32_t nb_contiguous;
+        err = fat32_handle_lookup_cluster(fs, handle, file_cluster, &cluster_number, &nb_contiguous);
+        if(err_is_fail(err)) {
+            return err;
+        }
+        // A handle seeked past the end of the file is not in sync with its position
+        if(cluster_number == handle->current_cluster) {
+            available += (nb_contiguous - 1) * fs->sectors_per_cluster;
+        }
+    }
+
+    *nb_sectors = MIN(available, max_sectors);
+    return SYS_ERR_OK;
+}
+
+// Move the handle over nb_sectors sectors returned by fat32_contiguous_sectors
+static void fat32_handle_advance_sectors(struct fat32_filesystem *fs, struct fat32_handle *handle, uint32_t nb_sectors) {
+    assert(nb_sectors > 0);
+    uint32_t total = handle->relative_sector_from_cluster + nb_sectors;
+    uint32_t nb_clusters = (total - 1) / fs->sectors_per_cluster;
+    handle->current_cluster += nb_clusters;
+    handle->relative_sector_from_cluster = total - nb_clusters * fs->sectors_per_cluster;
+    handle->file_position += nb_sectors * FAT_BLOCK_SIZE;
+}
+
 errval_t fat32_read(struct fat32_filesystem *fs, struct fat32_handle *handle, void *data, size_t size, size_t *nb_bytes_read) {
     errval_t err = SYS_ERR_OK;
 
@@ -689,25 +991,39 @@ errval_t fat32_read(struct fat32_filesystem *fs, struct fat32_handle *handle, vo
 
     while(bytes_read_until_now < size) {
         // Step 1) Go to next_cluster if required
-        if(handle->relative_sector_from_cluster >= fs->sectors_per_cluster) {
-            uint32_t next_cluster_number = 0;
-            err = fat32_get_next_cluster(fs, handle->current_cluster, &next_cluster_number);
+        err = fat32_handle_next_cluster_if_required(fs, handle);
+        if(err_is_fail(err)) {
+            return err;
+        }
+
+        uint32_t lba = get_lba_from_cluster(fs, handle->current_cluster) + handle->relative_sector_from_cluster;
+        uint32_t buffer_start = handle->file_position % FAT_BLOCK_SIZE;
+
+        // Whole sectors -> read the contiguous run directly into the output
+        if(buffer_start == 0 && size - bytes_read_until_now >= FAT_BLOCK_SIZE) {
+            uint32_t nb_sectors;
+            err = fat32_contiguous_sectors(fs, handle, (size - bytes_read_until_now) / FAT_BLOCK_SIZE, &nb_sectors);
             if(err_is_fail(err)) {
                 return err;
             }
-            assert(next_cluster_number < BAD_CLUSTER && next_cluster_number > 0);
-            handle->current_cluster = next_cluster_number;
-            handle->relative_sector_from_cluster = 0;
+
+            err = read_blocks(fs->b_driver, lba, nb_sectors, data + bytes_read_until_now);
+            if (err_is_fail(err)) {
+                return err;
+            }
+
+            bytes_read_until_now += nb_sectors * FAT_BLOCK_SIZE;
+            fat32_handle_advance_sectors(fs, handle, nb_sectors);
+            continue;
         }
 
         // Step 2) Read block
-        err = read_block(fs->b_driver, get_lba_from_cluster(fs, handle->current_cluster) + handle->relative_sector_from_cluster, (void *) buffer);
+        err = read_block(fs->b_driver, lba, (void *) buffer);
         if (err_is_fail(err)) {
             return err;
         }
 
         // Step 3) Copy content into output
-        uint32_t buffer_start = handle->file_position % FAT_BLOCK_SIZE;
         uint32_t size_to_copy = MIN(FAT_BLOCK_SIZE - buffer_start, size - bytes_read_until_now);
         memcpy(data + bytes_read_until_now, buffer + buffer_start, size_to_copy);
 
@@ -757,6 +1073,9 @@ errval_t fat32_write(struct fat32_filesystem *fs, struct fat32_handle *handle, c
         if(err_is_fail(err)) {
             return err;
         }
+        if(nb_clusters_required > 0) {
+            fat32_handle_invalidate_extents(handle);
+        }
     }
 
     // Perform read and writes
@@ -764,11 +1083,35 @@ errval_t fat32_write(struct fat32_filesystem *fs, struct fat32_handle *handle, c
     uint32_t bytes_written_current = 0;
 
     while(bytes_written_current < size) {
+        // Go to next_cluster if required
+        err = fat32_handle_next_cluster_if_required(fs, handle);
+        if(err_is_fail(err)) {
+            return err;
+        }
+
         // Get parameters
         uint32_t current_offset = handle->file_position % FAT_BLOCK_SIZE;
         uint32_t bytes_to_write = MIN(FAT_BLOCK_SIZE - current_offset, size - bytes_written_current);
         uint32_t lba = get_lba_from_cluster(fs, handle->current_cluster) + handle->relative_sector_from_cluster;
 
+        // Whole sectors -> write the contiguous run in one go
+        if(current_offset == 0 && size - bytes_written_current >= FAT_BLOCK_SIZE) {
+            uint32_t nb_sectors;
+            err = fat32_contiguous_sectors(fs, handle, (size - bytes_written_current) / FAT_BLOCK_SIZE, &nb_sectors);
+            if(err_is_fail(err)) {
+                return err;
+            }
+
+            err = write_blocks(fs->b_driver, lba, nb_sectors, data + bytes_written_current);
+            if (err_is_fail(err)) {
+                return err;
+            }
+
+            bytes_written_current += nb_sectors * FAT_BLOCK_SIZE;
+            fat32_handle_advance_sectors(fs, handle, nb_sectors);
+            continue;
+        }
+
         // Read
         if(bytes_to_write < 512) {
             err = read_block(fs->b_driver, lba, (void *) bloc);
@@ -791,14 +1134,6 @@ errval_t fat32_write(struct fat32_filesystem *fs, struct fat32_handle *handle, c
         }
         bytes_written_current += bytes_to_write;
         handle->file_position += bytes_to_write;
-        if(handle->relative_sector_from_cluster >= fs->sectors_per_cluster) {
-            handle->relative_sector_from_cluster -= fs->sectors_per_cluster;
-            err = fat32_get_next_cluster(fs, handle->current_cluster, &handle->current_cluster);
-            if(err_is_fail(err)) {
-                return err;
-            }
-
-        }
         // Safety assertion
         assert(0 < handle->current_cluster && handle->current_cluster < BAD_CLUSTER);
     }
@@ -827,28 +1162,29 @@ errval_t fat32_file_seek(struct fat32_filesystem *fs, struct fat32_handle *handl
     }
 
     uint32_t position = MIN(pos,handle->entry.file_size);
-    uint32_t current_cluster = get_cluster_number(&handle->entry);
-    uint32_t nb_clusters = position / (FAT_BLOCK_SIZE * fs->sectors_per_cluster);
+    uint32_t nb_sectors = position / FAT_BLOCK_SIZE;
+    uint32_t file_cluster = nb_sectors / fs->sectors_per_cluster;
+    uint32_t relative_sector = nb_sectors % fs->sectors_per_cluster;
 
-    uint32_t current_cluster_count = 0;
-    if(handle->file_position / (FAT_BLOCK_SIZE * fs->sectors_per_cluster) <= nb_clusters) {
-        current_cluster_count = handle->file_position / (FAT_BLOCK_SIZE * fs->sectors_per_cluster);
-        current_cluster = handle->current_cluster;
+    // The end of a file filling its last cluster has no cluster of its own,
+    // stay at the end of the last cluster like reads and writes do
+    if(relative_sector == 0 && file_cluster > 0 && position == handle->entry.file_size) {
+        file_cluster--;
+        relative_sector = fs->sectors_per_cluster;
     }
 
-    while(current_cluster_count < nb_clusters) {
-        assert(current_cluster < BAD_CLUSTER);
-        err = fat32_get_next_cluster(fs, current_cluster, &current_cluster);
+    // Files without any cluster stay on cluster 0
+    uint32_t current_cluster = get_cluster_number(&handle->entry);
+    if(current_cluster != 0) {
+        err = fat32_handle_lookup_cluster(fs, handle, file_cluster, &current_cluster, NULL);
         if(err_is_fail(err)) {
             return err;
         }
-
-        current_cluster_count++;
     }
 
     // Update the handle
     handle->current_cluster = current_cluster;
-    handle->relative_sector_from_cluster = (pos / FAT_BLOCK_SIZE) % fs->sectors_per_cluster;
+    handle->relative_sector_from_cluster = relative_sector;
     handle->file_position = pos;
 
     return SYS_ERR_OK;
@@ -1084,20 +1420,20 @@ errval_t fat32_is_directory(struct fat32_filesystem *fs, const char *path, bool
     return SYS_ERR_OK;
 }
 
-// Cluster functions
-errval_t fat32_write_fat_table(struct fat32_filesystem *fs, uint32_t idx, void *block) {
-    errval_t err = SYS_ERR_OK;
+errval_t fat32_sync(struct fat32_filesystem *fs) {
+    if(fs == NULL) {
+        return VFS_ERR_UNKNOWN_FILESYSTEM;
+    }
 
-    for(int i = 0; i < fs->fat32_number;i++) {
-        err = write_block(fs->b_driver, i * fs->sectors_per_fat + idx, block);
-        if(err_is_fail(err)) {
-            return err;
-        }
+    errval_t err = fat32_fat_flush(fs);
+    if(err_is_fail(err)) {
+        return err;
     }
 
-    return SYS_ERR_OK;
+    return flush_blocks(fs->b_driver);
 }
 
+// Cluster functions
 errval_t fat32_cluster_clean(struct fat32_filesystem *fs, uint32_t cluster_number) {
     errval_t err = SYS_ERR_OK;
 
@@ -1121,63 +1457,63 @@ errval_t fat32_cluster_malloc(struct fat32_filesystem *fs, uint32_t number_clust
     // Safety assertion
     assert(number_clusters_to_allocate > 0);
 
-    uint32_t nb_allocated_sectors = 0;
-    uint32_t start_sector =  fs->next_free_cluster_hint / FAT_ENTRIES_PER_SECTOR - 1;
-    uint32_t current_sector = fs->next_free_cluster_hint / FAT_ENTRIES_PER_SECTOR;
-    uint32_t fat_table[FAT_ENTRIES_PER_SECTOR];
+    const uint32_t nb_clusters = fs->sectors_per_fat * FAT_ENTRIES_PER_SECTOR;
+    uint32_t nb_allocated_clusters = 0;
+    uint32_t first_allocated = END_CLUSTER;
+    uint32_t last_allocated = END_CLUSTER;
+    uint32_t cluster_number = fs->next_free_cluster_hint % nb_clusters;
 
-    uint32_t last_cluster_number = END_CLUSTER;
+    // Link the clusters in ascending order, so that the chain stays contiguous on the disk
+    for(uint32_t n = 0; n < nb_clusters && nb_allocated_clusters < number_clusters_to_allocate; n++) {
+        const uint32_t current_cluster = cluster_number;
+        cluster_number = (cluster_number + 1) % nb_clusters;
 
-    while(current_sector != start_sector && nb_allocated_sectors < number_clusters_to_allocate) {
-
-        const uint32_t current_lba = fs->numbers_sectors_reserved + current_sector;
+        // Edge case
+        if(current_cluster < 2) {
+            continue;
+        }
 
-        err = read_block(fs->b_driver, current_lba, (void *) fat_table);
+        uint32_t value;
+        err = fat32_fat_get(fs, current_cluster, &value);
         if(err_is_fail(err)) {
             return err;
         }
+        // Used -> skip
+        if(!is_cluster_free(value)) {
+            continue;
+        }
 
-        for(int i = 0; i < FAT_ENTRIES_PER_SECTOR;i++) {
-            // Edge case
-            if(current_sector == 0 && i < 2) {
-                continue;
-            }
-            // Used -> skip
-            if(!is_cluster_free(fat_table[i])) {
-                continue;
-            }
-
-            fat_table[i] = last_cluster_number;
-            last_cluster_number = i + FAT_ENTRIES_PER_SECTOR * current_sector;
-
-            err = fat32_cluster_clean(fs, get_lba_from_cluster(fs, last_cluster_number));
+        err = fat32_fat_set(fs, current_cluster, END_CLUSTER);
+        if(err_is_fail(err)) {
+            return err;
+        }
+        if(last_allocated == END_CLUSTER) {
+            first_allocated = current_cluster;
+        } else {
+            err = fat32_fat_set(fs, last_allocated, current_cluster);
             if(err_is_fail(err)) {
                 return err;
             }
-
-            nb_allocated_sectors++;
-
-            if(nb_allocated_sectors == number_clusters_to_allocate) {
-                break;
-            }
         }
+        last_allocated = current_cluster;
 
-        err = fat32_write_fat_table(fs, current_lba, (void*)fat_table);
+        err = fat32_cluster_clean(fs, current_cluster);
         if(err_is_fail(err)) {
-            assert(false);
             return err;
         }
 
-        current_sector = (current_sector + 1) % fs->sectors_per_fat;
+        nb_allocated_clusters++;
     }
 
-    if(nb_allocated_sectors < number_clusters_to_allocate) {
-        fat32_remove_chain(fs, last_cluster_number);
+    if(nb_allocated_clusters < number_clusters_to_allocate) {
+        if(first_allocated != END_CLUSTER) {
+            fat32_remove_chain(fs, first_allocated);
+        }
         return LIB_ERR_MALLOC_FAIL;
     }
 
-    *first_cluster_number = last_cluster_number;
-    fs->next_free_cluster_hint = last_cluster_number + 1;
+    *first_cluster_number = first_allocated;
+    fs->next_free_cluster_hint = last_allocated + 1;
 
     return SYS_ERR_OK;
 }
@@ -1188,27 +1524,16 @@ errval_t fat32_traverse_chain(struct fat32_filesystem *fs, uint32_t start_cluste
     // Security assertions
     assert(nb_clusters_traversed && last_cluster_number);
 
-    uint32_t fat_table[FAT_ENTRIES_PER_SECTOR];
     uint32_t current_cluster_number = start_cluster_number;
     uint32_t prev_cluster_number = 0;
     uint32_t count_nb_clusters_traversed = 0;
-    uint32_t lba = fs->numbers_sectors_reserved + current_cluster_number / FAT_ENTRIES_PER_SECTOR;
-    uint32_t prev_lba = lba-1;
 
     while(!is_end_cluster(current_cluster_number)) {
-        // New block -> read
-        if(lba != prev_lba) {
-            err = read_block(fs->b_driver, lba, (void *) fat_table);
-            if (err_is_fail(err)) {
-                return err;
-            }
-        }
-        // Update sector
         prev_cluster_number = current_cluster_number;
-        current_cluster_number = fat_table[current_cluster_number % FAT_ENTRIES_PER_SECTOR];
-        // Update lba address
-        prev_lba = lba;
-        lba = fs->numbers_sectors_reserved + current_cluster_number / FAT_ENTRIES_PER_SECTOR;
+        err = fat32_fat_get(fs, prev_cluster_number, &current_cluster_number);
+        if(err_is_fail(err)) {
+            return err;
+        }
         // Update number of clusters traversed
         count_nb_clusters_traversed++;
     }
@@ -1222,32 +1547,22 @@ errval_t fat32_traverse_chain(struct fat32_filesystem *fs, uint32_t start_cluste
 errval_t fat32_remove_chain(struct fat32_filesystem *fs, uint32_t cluster_number) {
     errval_t err = SYS_ERR_OK;
 
-    uint32_t fat_table[FAT_ENTRIES_PER_SECTOR];
-
-    uint32_t lba = fs->numbers_sectors_reserved + cluster_number / FAT_ENTRIES_PER_SECTOR;
-    uint32_t lba_last = lba - 1;
-
     while(!is_end_cluster(cluster_number)) {
-        if(lba_last != lba) {
-            err = read_block(fs->b_driver, lba, (void*) fat_table);
-            if (err_is_fail(err)) {
-                return err;
-            }
+        uint32_t new_cluster_number;
+        err = fat32_fat_get(fs, cluster_number, &new_cluster_number);
+        if(err_is_fail(err)) {
+            return err;
         }
 
-        uint32_t new_cluster_number = fat_table[cluster_number % FAT_ENTRIES_PER_SECTOR];
-        fat_table[cluster_number % FAT_ENTRIES_PER_SECTOR] = 0;
-        cluster_number = new_cluster_number;
-
-        lba_last = lba;
-        lba = fs->numbers_sectors_reserved + cluster_number / FAT_ENTRIES_PER_SECTOR;
+        err = fat32_fat_set(fs, cluster_number, 0);
+        if(err_is_fail(err)) {
+            return err;
+        }
 
-        if(lba_last != lba || is_end_cluster(cluster_number)) {
-            err = fat32_write_fat_table(fs, lba_last, (void*)fat_table);
-            if(err_is_fail(err)) {
-                return err;
-            }
+        if(cluster_number < fs->next_free_cluster_hint) {
+            fs->next_free_cluster_hint = cluster_number;
         }
+        cluster_number = new_cluster_number;
     }
 
     return SYS_ERR_OK;
@@ -1267,24 +1582,14 @@ errval_t fat32_increase_chain(struct fat32_filesystem *fs, uint32_t cluster_numb
         return err;
     }
 
-    uint32_t lba_address = fs->numbers_sectors_reserved + cluster_number / FAT_ENTRIES_PER_SECTOR;
-    uint32_t fat_table[FAT_ENTRIES_PER_SECTOR];
-    uint32_t offset = cluster_number % FAT_ENTRIES_PER_SECTOR;
-
-    err = read_block(fs->b_driver, lba_address, (void *) fat_table);
-    if (err_is_fail(err)) {
-        return err;
-    }
-
-    assert(fat_table[offset] >= END_CLUSTER);
-    fat_table[offset] = other_chain_start_number;
-
-    err = fat32_write_fat_table(fs, lba_address, (void*)fat_table);
+    uint32_t value;
+    err = fat32_fat_get(fs, cluster_number, &value);
     if(err_is_fail(err)) {
         return err;
     }
 
-    return SYS_ERR_OK;
+    assert(value >= END_CLUSTER);
+    return fat32_fat_set(fs, cluster_number, other_chain_start_number);
 }
 
 errval_t fat32_get_number_of_required_clusters(struct fat32_filesystem *fs, struct fat32_handle *handle, const uint32_t new_size, uint32_t *nb_clusters_required, uint32_t *last_cluster_number) {
@@ -1355,9 +1660,12 @@ errval_t fat32_remove(struct fat32_filesystem *fs, const char *path) {
     }
 
     handle.entry.name[0] = DIRECTORY_FREE_VALUE;
-    fat32_update_directory(fs, &handle);
+    err = fat32_update_directory(fs, &handle);
+    if (err_is_fail(err)) {
+        return err;
+    }
 
-    return SYS_ERR_OK;
+    return fat32_sync(fs);
 }
 
 errval_t fat32_check_directory_empty(struct fat32_filesystem *fs, struct fat32_handle *handle) {
@@ -1418,7 +1726,7 @@ errval_t fat32_remove_directory(struct fat32_filesystem *fs, const char *path) {
         return err;
     }
 
-    return SYS_ERR_OK;
+    return fat32_sync(fs);
 }
 
 // Creation functions
@@ -1442,6 +1750,9 @@ errval_t fat32_get_free_entry(struct fat32_filesystem *fs, struct fat32_handle *
     handle->relative_sector_from_cluster = 0;
     handle->parent_cluster_number = parent_cluster_number;
     handle->parent_cluster_offset = parent_cluster_offset;
+    handle->extents = NULL;
+    handle->nb_extents = 0;
+    handle->extents_valid = false;
 
     // In this case, we can simply increase the chain and it is enough
     if(index_in_new_cluster(fs,parent_cluster_offset)) {
@@ -1542,7 +1853,7 @@ errval_t fat32_create_entry(struct fat32_filesystem *fs, const char *path, bool
 
     // Free alloacted memory
     free(parent_path);
-    return err;
+    return fat32_sync(fs);
 }
 
 errval_t fat32_create(struct fat32_filesystem *fs, const char *path, struct fat32_handle **handle) {
@@ -1648,6 +1959,12 @@ errval_t mount_filesystem(void) {
         debug_printf("Failed to launch the block driver\n");
     }
 
+    // Asynchronous requests need the interrupt capability, which only init holds
+    err = block_driver_async_init(b_driver, get_default_waitset());
+    if(err_is_fail(err)) {
+        debug_printf("Asynchronous block requests are not available\n");
+    }
+
     // Step 1) Allocate fat32 data structure
     current_filesystem = malloc(sizeof(struct fat32_filesystem));
     current_filesystem->b_driver = b_driver;
@@ -1686,6 +2003,12 @@ errval_t mount_filesystem(void) {
         current_filesystem->numbers_sectors_reserved + (current_filesystem->fat32_number * current_filesystem->sectors_per_fat);
     set_cluster_number(&current_filesystem->root_directory, 0);
     set_directory(&current_filesystem->root_directory);
+    current_filesystem->next_free_cluster_hint = 2;
+
+    err = fat32_fat_cache_init(current_filesystem);
+    if(err_is_fail(err)) {
+        return err;
+    }
 
     // Step 5) Mount the filesystem
     print_filesystem(current_filesystem);
@@ -90,6 +90,221 @@ static void fdtab_free(int fd)
     fdtab[fd].handle = NULL;
     fdtab[fd].fd = 0;
     fdtab[fd].inherited = 0;
+    fdtab[fd].buffer = NULL;
+}
+
+/*
+ * Buffering
+ *
+ * Reads are served from a read-ahead buffer whose size doubles with every
+ * sequential refill, and small writes are collected until the buffer is full
+ * or the file is seeked, synced or closed.
+ */
+
+// Requests sent for reads, writes and seeks, and requests these calls would need unbuffered
+static size_t buffer_rpcs_sent = 0;
+static size_t buffer_rpcs_unbuffered = 0;
+
+static errval_t fdtab_buffer_reserve(struct fdtab_buffer *b, size_t capacity)
+{
+    if (b->capacity >= capacity) {
+        return SYS_ERR_OK;
+    }
+
+    char *data = realloc(b->data, capacity);
+    if (data == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    b->data = data;
+    b->capacity = capacity;
+    return SYS_ERR_OK;
+}
+
+// Send the pending writes to the server
+static errval_t fdtab_buffer_flush(struct fdtab_entry *e)
+{
+    struct fdtab_buffer *b = e->buffer;
+    if (!b->dirty) {
+        return SYS_ERR_OK;
+    }
+
+    size_t done = 0;
+    while (done < b->len) {
+        size_t retlen = 0;
+        errval_t err = aos_rpc_filesystem_write(aos_rpc_get_filesystem_channel(), e->handle, b->data + done,
+                                                b->len - done, &retlen);
+        buffer_rpcs_sent++;
+        if (err_is_ok(err) && retlen == 0) {
+            err = FS_ERR_WRITE;
+        }
+        if (err_is_fail(err)) {
+            // Keep what was not written for the next attempt
+            memmove(b->data, b->data + done, b->len - done);
+            b->offset += done;
+            b->len -= done;
+            return err;
+        }
+        done += retlen;
+    }
+
+    b->offset += b->len;
+    b->len = 0;
+    b->dirty = false;
+    return SYS_ERR_OK;
+}
+
+// Drop the read-ahead data, moving the server back to the position of the reader
+static errval_t fdtab_buffer_drop(struct fdtab_entry *e)
+{
+    struct fdtab_buffer *b = e->buffer;
+    assert(!b->dirty);
+
+    if (b->pos < b->len) {
+        errval_t err = aos_rpc_filesystem_seek(aos_rpc_get_filesystem_channel(), e->handle, b->offset + b->pos,
+                                               FS_SEEK_SET);
+        buffer_rpcs_sent++;
+        if (err_is_fail(err)) {
+            return err;
+        }
+        b->offset += b->pos;
+    } else {
+        b->offset += b->len;
+    }
+
+    b->len = 0;
+    b->pos = 0;
+    return SYS_ERR_OK;
+}
+
+errval_t fs_fsync(int fd)
+{
+    struct fdtab_entry *e = fdtab_get(fd);
+    if (e->type != FDTAB_TYPE_FILE) {
+        return FS_ERR_INVALID_FH;
+    }
+    return fdtab_buffer_flush(e);
+}
+
+void fs_get_buffer_stats(struct fs_buffer_stats *stats)
+{
+    stats->rpcs_sent = buffer_rpcs_sent;
+    stats->rpcs_saved = buffer_rpcs_unbuffered > buffer_rpcs_sent ? buffer_rpcs_unbuffered - buffer_rpcs_sent : 0;
+}
+
+/*
+ * File mappings: the pages of a mapped file are fetched from the page cache of
+ * init on the first access. The mapping has its own handle, so it does not
+ * depend on any file descriptor.
+ *
+ * The pages are fetched from the page fault handler, which may interrupt a
+ * call on the filesystem channel, even one of the faulting thread. They go
+ * over a channel of their own, opened with the first mapping, which serves one
+ * fault at a time.
+ */
+struct fs_mapping {
+    struct fat32_handle *handle;
+    void                *buf;
+    struct fs_mapping   *next;
+};
+
+static struct fs_mapping  *fs_mappings = NULL;
+static struct thread_mutex fs_mappings_mutex = THREAD_MUTEX_INITIALIZER;
+
+static struct aos_rpc      fs_mapping_chan;
+static bool                fs_mapping_chan_open = false;
+static struct thread_mutex fs_mapping_chan_mutex = THREAD_MUTEX_INITIALIZER;
+
+static errval_t fs_mapping_fill(void *arg, size_t offset, struct capref *frame)
+{
+    struct fs_mapping *m = arg;
+    size_t len;
+    thread_mutex_lock(&fs_mapping_chan_mutex);
+    errval_t err = aos_rpc_filesystem_map_page(&fs_mapping_chan, m->handle, offset, frame, &len);
+    thread_mutex_unlock(&fs_mapping_chan_mutex);
+    return err;
+}
+
+static errval_t fs_mapping_chan_ensure_open(void)
+{
+    errval_t err = SYS_ERR_OK;
+    thread_mutex_lock(&fs_mapping_chan_mutex);
+    if (!fs_mapping_chan_open) {
+        err = aos_rpc_open_init_channel(&fs_mapping_chan);
+        fs_mapping_chan_open = err_is_ok(err);
+    }
+    thread_mutex_unlock(&fs_mapping_chan_mutex);
+    return err;
+}
+
+errval_t fs_map_file(const char *path, void **buf, size_t *size)
+{
+    errval_t err;
+
+    err = fs_mapping_chan_ensure_open();
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    struct fs_mapping *m = malloc(sizeof(struct fs_mapping));
+    if (m == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    err = aos_rpc_filesystem_open(aos_rpc_get_filesystem_channel(), (char *)path, &m->handle);
+    if (err_is_fail(err)) {
+        free(m);
+        return err;
+    }
+
+    struct fs_fileinfo info;
+    err = aos_rpc_filesystem_stat(aos_rpc_get_filesystem_channel(), m->handle, &info);
+    if (err_is_ok(err) && info.type != FS_FILE) {
+        err = FS_ERR_NOTFILE;
+    }
+    if (err_is_ok(err) && info.size == 0) {
+        err = ERR_INVALID_ARGS;
+    }
+    if (err_is_ok(err)) {
+        err = paging_map_pager(get_current_paging_state(), &m->buf, info.size, VREGION_FLAGS_READ,
+                               fs_mapping_fill, m);
+    }
+    if (err_is_fail(err)) {
+        aos_rpc_filesystem_close(aos_rpc_get_filesystem_channel(), m->handle);
+        free(m);
+        return err;
+    }
+
+    thread_mutex_lock(&fs_mappings_mutex);
+    m->next = fs_mappings;
+    fs_mappings = m;
+    thread_mutex_unlock(&fs_mappings_mutex);
+
+    *buf = m->buf;
+    *size = info.size;
+    return SYS_ERR_OK;
+}
+
+errval_t fs_unmap_file(void *buf)
+{
+    struct fs_mapping *m = NULL;
+    thread_mutex_lock(&fs_mappings_mutex);
+    for (struct fs_mapping **prev = &fs_mappings; *prev != NULL; prev = &(*prev)->next) {
+        if ((*prev)->buf == buf) {
+            m = *prev;
+            *prev = m->next;
+            break;
+        }
+    }
+    thread_mutex_unlock(&fs_mappings_mutex);
+    if (m == NULL) {
+        return FS_ERR_NOT_MAPPED;
+    }
+
+    // faults on the mapping are served until it is gone, the list is not held meanwhile
+    errval_t err = paging_unmap(get_current_paging_state(), m->buf);
+    errval_t close_err = aos_rpc_filesystem_close(aos_rpc_get_filesystem_channel(), m->handle);
+    free(m);
+    return err_is_fail(err) ? err : close_err;
 }
 
 //XXX: flags are ignored...
@@ -137,15 +352,25 @@ static int fs_libc_open(char *path, int flags)
         return -1;
     }
 
+    // Files are opened at position 0, the buffer tracks the position from there
+    struct fdtab_buffer *buffer = calloc(1, sizeof(struct fdtab_buffer));
+    if (buffer == NULL) {
+        aos_rpc_filesystem_close(aos_rpc_get_filesystem_channel(), fat_handle);
+        return -1;
+    }
+    buffer->window = FDTAB_READAHEAD_MIN;
+
     struct fdtab_entry e = {
             .type = FDTAB_TYPE_FILE,
             .handle = (void *)fat_handle,
             .epoll_fd = -1,
+            .buffer = buffer,
     };
 
     int fd = fdtab_alloc(&e);
     if (fd < 0) {
         aos_rpc_filesystem_close(aos_rpc_get_filesystem_channel(), fat_handle);
+        free(buffer);
         return -1;
     } else {
         return fd;
@@ -162,11 +387,60 @@ static int fs_libc_read(int fd, void *buf, size_t len)
         case FDTAB_TYPE_FILE:
         {
             struct fat32_handle *handle = e->handle;
+            struct fdtab_buffer *b = e->buffer;
             assert(e->handle);
-            err = aos_rpc_filesystem_read(aos_rpc_get_filesystem_channel(), handle, buf, len, &retlen);
+            buffer_rpcs_unbuffered++;
+
+            err = fdtab_buffer_flush(e);
             if (err_is_fail(err)) {
                 return -1;
             }
+
+            while (retlen < len) {
+                if (b->pos < b->len) {
+                    size_t n = MIN(len - retlen, b->len - b->pos);
+                    memcpy(buf + retlen, b->data + b->pos, n);
+                    b->pos += n;
+                    retlen += n;
+                    continue;
+                }
+
+                // Everything read ahead was consumed, the reader is sequential
+                b->offset += b->len;
+                b->len = 0;
+                b->pos = 0;
+
+                if (len - retlen >= b->window) {
+                    // Large reads go straight to the caller
+                    size_t n = 0;
+                    err = aos_rpc_filesystem_read(aos_rpc_get_filesystem_channel(), handle, buf + retlen,
+                                                  len - retlen, &n);
+                    buffer_rpcs_sent++;
+                    if (err_is_fail(err)) {
+                        return retlen > 0 ? (int)retlen : -1;
+                    }
+                    b->offset += n;
+                    retlen += n;
+                    break;
+                }
+
+                err = fdtab_buffer_reserve(b, b->window);
+                if (err_is_fail(err)) {
+                    return retlen > 0 ? (int)retlen : -1;
+                }
+                err = aos_rpc_filesystem_read(aos_rpc_get_filesystem_channel(), handle, b->data, b->window,
+                                              &b->len);
+                buffer_rpcs_sent++;
+                if (err_is_fail(err)) {
+                    b->len = 0;
+                    return retlen > 0 ? (int)retlen : -1;
+                }
+                b->window = MIN(b->window * 2, FDTAB_BUFFER_MAX);
+                if (b->len == 0) {
+                    // End of file
+                    break;
+                }
+            }
         }
             break;
         default :
@@ -189,10 +463,48 @@ static int fs_libc_write(int fd, void *buf, size_t len)
         case FDTAB_TYPE_FILE:
         {
             struct fat32_handle *handle = e->handle;
-            errval_t err = aos_rpc_filesystem_write(aos_rpc_get_filesystem_channel(), handle, buf, len, &retlen);
+            struct fdtab_buffer *b = e->buffer;
+            errval_t err;
+            buffer_rpcs_unbuffered++;
+
+            if (!b->dirty) {
+                err = fdtab_buffer_drop(e);
+                if (err_is_fail(err)) {
+                    return -1;
+                }
+            }
+
+            if (b->len + len > FDTAB_BUFFER_MAX) {
+                err = fdtab_buffer_flush(e);
+                if (err_is_fail(err)) {
+                    return -1;
+                }
+            }
+
+            if (len >= FDTAB_BUFFER_MAX) {
+                // Large writes go straight to the server
+                err = aos_rpc_filesystem_write(aos_rpc_get_filesystem_channel(), handle, buf, len, &retlen);
+                buffer_rpcs_sent++;
+                if (err_is_fail(err)) {
+                    return -1;
+                }
+                b->offset += retlen;
+                break;
+            }
+
+            err = fdtab_buffer_reserve(b, FDTAB_BUFFER_MAX);
             if (err_is_fail(err)) {
                 return -1;
             }
+            memcpy(b->data + b->len, buf, len);
+            b->len += len;
+            b->dirty = true;
+            retlen = len;
+
+            if (b->len == FDTAB_BUFFER_MAX) {
+                // The data is buffered already, a failure shows on the next flush
+                fdtab_buffer_flush(e);
+            }
         }
             break;
         default :
@@ -214,17 +526,22 @@ static int fs_libc_close(int fd)
 
     switch(e->type) {
         case FDTAB_TYPE_FILE:
-            // TODO: Replace with my code
+        {
+            errval_t flush_err = fdtab_buffer_flush(e);
             err = aos_rpc_filesystem_close(aos_rpc_get_filesystem_channel(), fat_handle);
-            if (err_is_fail(err)) {
+            // The descriptor is gone either way, data not flushed by now is lost
+            free(e->buffer->data);
+            free(e->buffer);
+            fdtab_free(fd);
+            if (err_is_fail(err) || err_is_fail(flush_err)) {
                 return -1;
             }
+        }
             break;
         default:
             return -1;
     }
 
-    fdtab_free(fd);
     return 0;
 }
 
@@ -256,17 +573,53 @@ static off_t fs_libc_lseek(int fd, off_t offset, int whence)
                     return -1;
             }
 
+            struct fdtab_buffer *b = e->buffer;
+            buffer_rpcs_unbuffered += 2;
+
+            // The position is known unless seeking from the end
+            size_t position = b->offset + (b->dirty ? b->len : b->pos);
+            if (fs_whence == FS_SEEK_CUR) {
+                offset += position;
+                fs_whence = FS_SEEK_SET;
+            }
+            if (fs_whence == FS_SEEK_SET && offset < 0) {
+                return -1;
+            }
+
+            if (fs_whence == FS_SEEK_SET && !b->dirty && (size_t)offset >= b->offset
+                && (size_t)offset <= b->offset + b->len) {
+                // Seeking within the data read ahead, the server stays where it is
+                b->pos = offset - b->offset;
+                return offset;
+            }
+
+            err = fdtab_buffer_flush(e);
+            if(err_is_fail(err)) {
+                return -1;
+            }
+            b->len = 0;
+            b->pos = 0;
+            b->window = FDTAB_READAHEAD_MIN;
+
             err = aos_rpc_filesystem_seek(aos_rpc_get_filesystem_channel(), fat_handle, offset,
-                                          whence);
+                                          fs_whence);
+            buffer_rpcs_sent++;
             if(err_is_fail(err)) {
                 DEBUG_ERR(err, "vfs_seek");
                 return -1;
             }
 
+            if (fs_whence == FS_SEEK_SET) {
+                b->offset = offset;
+                return offset;
+            }
+
             err = aos_rpc_filesystem_tell(aos_rpc_get_filesystem_channel(), fat_handle, &retpos);
+            buffer_rpcs_sent++;
             if(err_is_fail(err)) {
                 return -1;
             }
+            b->offset = retpos;
             return retpos;
         }
             break;
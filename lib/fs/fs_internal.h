@@ -39,6 +39,30 @@ enum fdtab_type {
 #include <signal.h>
 #include <sys/epoll.h>
 
+// Smallest and largest read-ahead, the buffer of a file grows up to FDTAB_BUFFER_MAX
+#define FDTAB_READAHEAD_MIN 512
+#define FDTAB_BUFFER_MAX    (64 * 1024)
+
+/*
+ * Client-side buffer of an open file. It holds either data read ahead of the
+ * reader or writes that were not sent yet, never both. The filesystem server
+ * is at position offset + len when reading ahead and at offset when writes are
+ * pending.
+ */
+struct fdtab_buffer {
+    char   *data;
+    size_t  capacity;
+    // File position of data[0]
+    size_t  offset;
+    // Bytes in data, read ahead or waiting to be written
+    size_t  len;
+    // Bytes of the read-ahead data already returned to the reader
+    size_t  pos;
+    bool    dirty;
+    // Size of the next read-ahead, doubles on every sequential refill
+    size_t  window;
+};
+
 struct fdtab_entry {
     enum fdtab_type     type;
 //    union {
@@ -47,6 +71,7 @@ struct fdtab_entry {
         int             inherited;
 //    };
     int epoll_fd;
+    struct fdtab_buffer *buffer;
 };
 
 /* for the newlib glue code */
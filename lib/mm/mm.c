@@ -19,7 +19,7 @@
 #include <mm/mm.h>
 
 #include <aos/threads.h>
-#include <aos/paging_types.h>
+#include <aos/paging.h>
 
 #define STATIC_SLAB_BUF_SIZE (4 * PAGE_SIZE)
 
@@ -28,49 +28,261 @@ static int slab_buf_used = 0;
 
 #define ALIGN_TO(x, align) ((((x) - 1) | (align - 1)) + 1)
 
-bool mm_mutex_init = false;
-struct thread_mutex mm_mutex;
-
 static errval_t tracked_slab_alloc(struct mm* mm, void** buf) {
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
 
     void* res = slab_alloc(&mm->slab);
     if (!res) {
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return MM_ERR_SLAB_ALLOC_FAIL;
     }
     *buf = res;
     mm->slab_free_slots -= 1;
 
-    thread_mutex_unlock(&mm_mutex);
+    thread_mutex_unlock(&mm->mutex);
     return SYS_ERR_OK;
 }
 
+// called without the lock: the frame for the slab may come from this very instance, and
+// mapping it takes the locks of the paging state, whose holders may wait for this instance
 static errval_t slab_try_refill(struct mm* mm) {
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
 
-    if (mm->refilling_slab) {
-        thread_mutex_unlock(&mm_mutex);
+    if (mm->refilling_slab || mm->slab_free_slots > 20) {
+        thread_mutex_unlock(&mm->mutex);
         return SYS_ERR_OK;
     }
     mm->refilling_slab = true;
-    errval_t err = SYS_ERR_OK;
-    if (mm->slab_free_slots <= 20) {
-        err = slab_refill_pages(&mm->slab, 4 * PAGE_SIZE);
-        mm->slab_free_slots = slab_freecount(&mm->slab);
+
+    thread_mutex_unlock(&mm->mutex);
+
+    struct capref frame;
+    size_t bytes = 0;
+    void* buf = NULL;
+    errval_t err = frame_alloc(&frame, 4 * PAGE_SIZE, &bytes);
+    if (err_is_ok(err)) {
+        err = paging_map_frame(get_current_paging_state(), &buf, bytes, frame);
         if (err_is_fail(err)) {
-            err = err_push(err, MM_ERR_SLAB_ALLOC_FAIL);
-            DEBUG_ERR(err, "slab refill");
+            cap_destroy(frame);
         }
     }
+    if (err_is_fail(err)) {
+        err = err_push(err, MM_ERR_SLAB_ALLOC_FAIL);
+        DEBUG_ERR(err, "slab refill");
+    }
+
+    thread_mutex_lock_nested(&mm->mutex);
+    if (err_is_ok(err)) {
+        slab_grow(&mm->slab, buf, bytes);
+    }
+    mm->slab_free_slots = slab_freecount(&mm->slab);
     mm->refilling_slab = false;
 
-    thread_mutex_unlock(&mm_mutex);
+    thread_mutex_unlock(&mm->mutex);
     return err;
 }
 
+// the power of two below the size, so every block of a class is at least that large
+static inline size_t _size_class(size_t size) {
+    return (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(size);
+}
+
+static inline uint32_t _block_priority(uintptr_t addr) {
+    uint64_t x = addr >> BASE_PAGE_BITS;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (uint32_t)x;
+}
+
+static void _class_insert(struct mm* mm, struct block_info* block) {
+    struct block_info** head = &mm->free_classes[_size_class(block->block_size)];
+    block->prev = NULL;
+    block->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = block;
+    }
+    *head = block;
+}
+
+static void _class_remove(struct mm* mm, struct block_info* block) {
+    if (block->prev != NULL) {
+        block->prev->next = block->next;
+    } else {
+        mm->free_classes[_size_class(block->block_size)] = block->next;
+    }
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    }
+}
+
+// splits the tree into the blocks below addr and the ones at or above it
+static void _tree_split(struct block_info* root, uintptr_t addr,
+                        struct block_info** below, struct block_info** above) {
+    if (root == NULL) {
+        *below = NULL;
+        *above = NULL;
+    } else if (root->block_addr < addr) {
+        _tree_split(root->right, addr, &root->right, above);
+        *below = root;
+    } else {
+        _tree_split(root->left, addr, below, &root->left);
+        *above = root;
+    }
+}
+
+// joins two trees, all blocks of below being below the ones of above
+static struct block_info* _tree_join(struct block_info* below, struct block_info* above) {
+    if (below == NULL) {
+        return above;
+    }
+    if (above == NULL) {
+        return below;
+    }
+    if (below->priority > above->priority) {
+        below->right = _tree_join(below->right, above);
+        return below;
+    }
+    above->left = _tree_join(below, above->left);
+    return above;
+}
+
+static struct block_info* _tree_insert(struct block_info* root, struct block_info* block) {
+    if (root == NULL) {
+        return block;
+    }
+    if (block->priority > root->priority) {
+        _tree_split(root, block->block_addr, &block->left, &block->right);
+        return block;
+    }
+    if (block->block_addr < root->block_addr) {
+        root->left = _tree_insert(root->left, block);
+    } else {
+        root->right = _tree_insert(root->right, block);
+    }
+    return root;
+}
+
+static struct block_info* _tree_remove(struct block_info* root, struct block_info* block) {
+    if (root == block) {
+        return _tree_join(block->left, block->right);
+    }
+    if (block->block_addr < root->block_addr) {
+        root->left = _tree_remove(root->left, block);
+    } else {
+        root->right = _tree_remove(root->right, block);
+    }
+    return root;
+}
+
+// finds the last free block starting below addr and the first one starting at or above it
+static void _tree_neighbours(struct block_info* root, uintptr_t addr,
+                             struct block_info** pred, struct block_info** succ) {
+    *pred = NULL;
+    *succ = NULL;
+    while (root != NULL) {
+        if (root->block_addr < addr) {
+            *pred = root;
+            root = root->right;
+        } else {
+            *succ = root;
+            root = root->left;
+        }
+    }
+}
+
+static void _block_insert(struct mm* mm, struct block_info* block) {
+    block->left = NULL;
+    block->right = NULL;
+    block->priority = _block_priority(block->block_addr);
+    mm->free_tree = _tree_insert(mm->free_tree, block);
+    _class_insert(mm, block);
+}
+
+static void _block_remove(struct mm* mm, struct block_info* block) {
+    mm->free_tree = _tree_remove(mm->free_tree, block);
+    _class_remove(mm, block);
+}
+
+// changes the range of a free block, which must stay between its neighbours
+static void _block_resize(struct mm* mm, struct block_info* block, uintptr_t addr, size_t size) {
+    _class_remove(mm, block);
+    block->block_addr = addr;
+    block->block_size = size;
+    _class_insert(mm, block);
+}
+
+// checks whether an allocation fits into the block, and where it would start
+static inline bool _block_fit(struct block_info* block, size_t base, size_t limit,
+                              size_t size, size_t alignment, uintptr_t* addr) {
+    uintptr_t block_end = block->block_addr + block->block_size;
+    uintptr_t aligned_addr = ALIGN_TO(MAX(block->block_addr, base), alignment);
+    if (aligned_addr < block->block_addr || aligned_addr >= block_end) {
+        return false;
+    }
+    if (block_end - aligned_addr < size || aligned_addr + size - 1 > limit) {
+        return false;
+    }
+    *addr = aligned_addr;
+    return true;
+}
+
+// lowest free block that fits within [base, limit], skipping subtrees outside of it
+static struct block_info* _tree_find(struct block_info* root, size_t base, size_t limit,
+                                     size_t size, size_t alignment, uintptr_t* addr) {
+    if (root == NULL) {
+        return NULL;
+    }
+    if (root->block_addr + root->block_size <= base) {
+        return _tree_find(root->right, base, limit, size, alignment, addr);
+    }
+    if (root->block_addr > limit) {
+        return _tree_find(root->left, base, limit, size, alignment, addr);
+    }
+
+    struct block_info* block = _tree_find(root->left, base, limit, size, alignment, addr);
+    if (block != NULL) {
+        return block;
+    }
+    if (_block_fit(root, base, limit, size, alignment, addr)) {
+        return root;
+    }
+    return _tree_find(root->right, base, limit, size, alignment, addr);
+}
+
+// blocks looked at in a size class before moving on to the next larger one
+#define MM_CLASS_SCAN 8
+
+// first block of the smallest size class with a block that fits, without range constraints
+static struct block_info* _class_find(struct mm* mm, size_t size, size_t alignment,
+                                      uintptr_t* addr) {
+    for (size_t class = _size_class(size); class < MM_NUM_CLASSES; class++) {
+        size_t scanned = 0;
+        for (struct block_info* block = mm->free_classes[class];
+             block != NULL && scanned < MM_CLASS_SCAN; block = block->next, scanned++) {
+            if (_block_fit(block, 0, -1, size, alignment, addr)) {
+                return block;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void _log_tree(struct block_info* block) {
+    if (block == NULL) {
+        return;
+    }
+    _log_tree(block->left);
+    debug_printf("  block: %lx, %lx, %lx\n",
+        block->block_addr,
+        block->block_addr + block->block_size,
+        block->block_size
+    );
+    _log_tree(block->right);
+}
+
 void mm_log(struct mm* mm) {
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
 
     debug_printf("=== LOG BEGIN ===\n");
     for (struct region_info* reg = mm->region_head; reg != NULL; reg = reg->next) {
@@ -79,20 +291,13 @@ void mm_log(struct mm* mm) {
             reg->reg_addr + reg->reg_size, 
             reg->reg_size
         );
-        for (struct block_info* block = reg->free_head; block != NULL; block = block->next) {
-            debug_printf("  block: %lx, %lx, %lx\n", 
-                block->block_addr, 
-                block->block_addr + block->block_size, 
-                block->block_size
-            );
-        }
     }
+    _log_tree(mm->free_tree);
     debug_printf("===  LOG END  ===\n");
 
-    thread_mutex_unlock(&mm_mutex);
+    thread_mutex_unlock(&mm->mutex);
 }
 
-
 /**
  * @brief initializes the memory manager instance
  *
@@ -113,11 +318,8 @@ errval_t mm_init(struct mm *mm, enum objtype objtype, struct slot_allocator *ca,
     // make compiler happy about unused parameters
     debug_printf("initializing mm\n");
 
-    // initialize the mutex & set it to be recursive
-    if (!mm_mutex_init) {
-        thread_mutex_init(&mm_mutex);
-        mm_mutex_init = true;
-    }
+    // the mutex is taken nested, as refilling the slot allocator may allocate from this instance
+    thread_mutex_init(&mm->mutex);
 
     mm->ca = ca;
     mm->refill = refill;
@@ -135,6 +337,10 @@ errval_t mm_init(struct mm *mm, enum objtype objtype, struct slot_allocator *ca,
     mm->slab_free_slots = slab_freecount(&mm->slab);
 
     mm->region_head = NULL;
+    mm->free_tree = NULL;
+    for (size_t i = 0; i < MM_NUM_CLASSES; i++) {
+        mm->free_classes[i] = NULL;
+    }
 
     mm->mem_available = 0;
     mm->mem_total = 0;
@@ -163,12 +369,12 @@ errval_t mm_destroy(struct mm *mm)
 {
     (void) mm;
 
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
 
     USER_PANIC_ERR(LIB_ERR_NOT_IMPLEMENTED, "hit mm destroy");
     UNIMPLEMENTED();
 
-    thread_mutex_unlock(&mm_mutex);
+    thread_mutex_unlock(&mm->mutex);
     return LIB_ERR_NOT_IMPLEMENTED;
 }
 
@@ -194,7 +400,7 @@ errval_t mm_destroy(struct mm *mm)
  */
 errval_t mm_add(struct mm *mm, struct capref cap)
 {
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
     errval_t err;
 
     struct capability thecap;
@@ -202,7 +408,7 @@ errval_t mm_add(struct mm *mm, struct capref cap)
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "identify capability");
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
 
@@ -213,7 +419,7 @@ errval_t mm_add(struct mm *mm, struct capref cap)
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "slab alloc");
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
     mm->slab_free_slots -= 1;
@@ -225,7 +431,7 @@ errval_t mm_add(struct mm *mm, struct capref cap)
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "slab alloc");
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
     mm->slab_free_slots -= 1;
@@ -236,24 +442,79 @@ errval_t mm_add(struct mm *mm, struct capref cap)
     reginfo->cap = cap;
     reginfo->reg_addr = thecap.u.ram.base;
     reginfo->reg_size = thecap.u.ram.bytes;
-    reginfo->free_head = blockinfo;
+    reginfo->free_size = reginfo->reg_size;
 
     blockinfo->block_addr = reginfo->reg_addr;
     blockinfo->block_size = reginfo->reg_size;
-    blockinfo->next = NULL;
+    blockinfo->region = reginfo;
+    _block_insert(mm, blockinfo);
 
     mm->mem_total += reginfo->reg_size;
     mm->mem_available += reginfo->reg_size;
 
+    thread_mutex_unlock(&mm->mutex);
+
     err = slab_try_refill(mm);
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "slab refill");
-
-        thread_mutex_unlock(&mm_mutex);
         return err;
     }
 
-    thread_mutex_unlock(&mm_mutex);
+    return SYS_ERR_OK;
+}
+
+
+/**
+ * @brief removes memory resources that were added to the memory manager
+ *
+ * @param[in]  mm      memory manager instance to remove resources from
+ * @param[in]  base    base address of the capability that was added
+ * @param[out] retcap  returns the capability that was added
+ *
+ * @return error value indicating the success of the operation
+ *  - @retval SYS_ERR_OK              on success
+ *  - @retval MM_ERR_NOT_FOUND        if no capability with this base address was added
+ *  - @retval MM_ERR_ALREADY_ALLOCATED if parts of the memory are still allocated
+ *
+ * @note: the ownership of the capability is transferred back to the caller
+ */
+errval_t mm_remove(struct mm *mm, genpaddr_t base, struct capref *retcap)
+{
+    thread_mutex_lock_nested(&mm->mutex);
+
+    struct region_info **reg = &mm->region_head;
+    for (; *reg != NULL; reg = &(*reg)->next) {
+        if ((*reg)->reg_addr == base) {
+            break;
+        }
+    }
+    if (*reg == NULL) {
+        thread_mutex_unlock(&mm->mutex);
+        return MM_ERR_NOT_FOUND;
+    }
+
+    // frees merge with their neighbours, so a region without allocations has one block
+    struct region_info *region = *reg;
+    if (region->free_size != region->reg_size) {
+        thread_mutex_unlock(&mm->mutex);
+        return MM_ERR_ALREADY_ALLOCATED;
+    }
+
+    struct block_info *pred, *block;
+    _tree_neighbours(mm->free_tree, region->reg_addr, &pred, &block);
+    assert(block != NULL && block->block_addr == region->reg_addr);
+    _block_remove(mm, block);
+
+    *reg = region->next;
+    *retcap = region->cap;
+
+    mm->mem_total -= region->reg_size;
+    mm->mem_available -= region->reg_size;
+
+    slab_free(&mm->slab, block);
+    slab_free(&mm->slab, region);
+
+    thread_mutex_unlock(&mm->mutex);
     return SYS_ERR_OK;
 }
 
@@ -313,14 +574,14 @@ errval_t mm_alloc_aligned(struct mm *mm, size_t size, size_t alignment, struct c
 errval_t mm_alloc_from_range_aligned(struct mm *mm, size_t base, size_t limit, size_t size,
                                      size_t alignment, struct capref *retcap)
 {
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
 
     errval_t err = SYS_ERR_OK;
 
     if (size == 0) {
         debug_printf("zero-sized allocation, skipping\n");
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
     
@@ -328,7 +589,7 @@ errval_t mm_alloc_from_range_aligned(struct mm *mm, size_t base, size_t limit, s
         err = MM_ERR_BAD_ALIGNMENT;
         DEBUG_ERR(err, "bad aligment for mm_alloc_aligned (not a power of two)");
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
 
@@ -336,37 +597,28 @@ errval_t mm_alloc_from_range_aligned(struct mm *mm, size_t base, size_t limit, s
         err = MM_ERR_OUT_OF_MEMORY;
         DEBUG_ERR(err, "not enough memory");
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
 
-    // 1. find suitable block
-    struct region_info* region = NULL;
-    struct block_info* prev = NULL;
+    // 1. find suitable block, in the size classes unless the range is constrained
+    uintptr_t aligned_addr = 0;
     struct block_info* curr = NULL;
-    for (region = mm->region_head; region != NULL; region = region->next) {
-        prev = NULL;
-        for (curr = region->free_head; curr != NULL; curr = curr->next) {
-            uintptr_t block_end = curr->block_addr + curr->block_size;
-            uintptr_t aligned_addr = ALIGN_TO(curr->block_addr, alignment);
-            if (aligned_addr <= block_end && base <= aligned_addr && aligned_addr <= limit) {
-                size_t real_size = block_end - aligned_addr;
-                if (real_size >= size) {
-                    goto done;
-                }
-            }
-            prev = curr;
-        }
+    if (base == 0 && limit == (size_t)-1) {
+        curr = _class_find(mm, size, alignment, &aligned_addr);
+    }
+    if (curr == NULL) {
+        curr = _tree_find(mm->free_tree, base, limit, size, alignment, &aligned_addr);
     }
-done:
 
-    if (region == NULL) {
+    if (curr == NULL) {
         err = MM_ERR_ALLOC_CONSTRAINTS;
         DEBUG_ERR(err, "mm_alloc_aligned could not find block");
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
+    struct region_info* region = curr->region;
 
     // 2.1 allocate cap return slot
 
@@ -376,66 +628,62 @@ done:
         DEBUG_ERR(err, "slot alloc could not get slot");
         err = err_push(err, MM_ERR_SLOT_ALLOC_FAIL);
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
 
     // 2.2 split off new capability using cap_retype
-    // TODO think about smarter ways to split the block to minimize fragmentation
-    uintptr_t aligned_addr = ALIGN_TO(curr->block_addr, alignment);
-
-    err = cap_retype(*retcap, region->cap, aligned_addr - region->reg_addr, mm->objtype, size);
 
-    if (err_is_fail(err)) {
-        DEBUG_ERR(err, "retype operation failed");
+    uintptr_t block_end = curr->block_addr + curr->block_size;
+    size_t remaining_size = block_end - (aligned_addr + size);
 
-        thread_mutex_unlock(&mm_mutex);
-        return err;
-    }
-    
-    // 3. create new block in alignment hole
-
-    // non-aligned split, create new block
-    // if split _was_ aligned, there is no need to create new block
-    if (aligned_addr != curr->block_addr) {
-        struct block_info* block;
+    // both the alignment hole and the rest need a block, get it before the retype
+    struct block_info* block = NULL;
+    if (aligned_addr != curr->block_addr && remaining_size > 0) {
         err = tracked_slab_alloc(mm, (void**)&block);
         if (err_is_fail(err)) {
             DEBUG_ERR(err, "alignment hole slab alloc");
+            mm->ca->free(mm->ca, *retcap);
 
-            thread_mutex_unlock(&mm_mutex);
+            thread_mutex_unlock(&mm->mutex);
             return err;
         }
-        block->block_addr = curr->block_addr;
-        block->block_size = aligned_addr - curr->block_addr;
+    }
 
-        block->next = curr;
-        if (prev != NULL) {
-            prev->next = block;
-        } else {
-            region->free_head = block;
+    err = cap_retype(*retcap, region->cap, aligned_addr - region->reg_addr, mm->objtype, size);
+
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "retype operation failed");
+        if (block != NULL) {
+            slab_free(&mm->slab, block);
         }
-        // newly created block is now previous of current
-        prev = block;
+
+        thread_mutex_unlock(&mm->mutex);
+        return err;
     }
 
-    // 4. resize block to exclude data just allocated
-    size_t remaining_size = (curr->block_addr + curr->block_size) - (aligned_addr + size);
-    if (remaining_size > 0) {
-        curr->block_addr = aligned_addr + size;
-        curr->block_size = remaining_size;
-    } else { // remaining_size == 0
-        // used up available space exactly
-        if (prev != NULL) {
-            prev->next = curr->next;
-        } else {
-            region->free_head = curr->next;
+    // 3. the alignment hole keeps the block, the rest after the allocation gets a new one
+    // 4. if there is only one of them, it keeps the block, if there is none, the block goes
+
+    if (aligned_addr != curr->block_addr) {
+        _block_resize(mm, curr, curr->block_addr, aligned_addr - curr->block_addr);
+        if (remaining_size > 0) {
+            block->block_addr = aligned_addr + size;
+            block->block_size = remaining_size;
+            block->region = region;
+            _block_insert(mm, block);
         }
+    } else if (remaining_size > 0) {
+        _block_resize(mm, curr, aligned_addr + size, remaining_size);
+    } else {
+        // used up available space exactly
+        _block_remove(mm, curr);
         slab_free(&mm->slab, curr);
     }
 
     // 5. update bookkeeping
     mm->mem_available -= size;
+    region->free_size -= size;
 
     // attempt to refill slot allocator
     if (!mm->refilling_slot && mm->ca->space <= 20) {
@@ -444,11 +692,12 @@ done:
         mm->refilling_slot = false;
     }
 
+    thread_mutex_unlock(&mm->mutex);
+
     slab_try_refill(mm);
 
     // 6. return split-off capability
 
-    thread_mutex_unlock(&mm_mutex);
     return SYS_ERR_OK;
 }
 
@@ -477,7 +726,7 @@ done:
  */
 errval_t mm_free(struct mm *mm, struct capref cap)
 {
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
 
     errval_t err;
 
@@ -486,7 +735,7 @@ errval_t mm_free(struct mm *mm, struct capref cap)
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "identify capability");
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
 
@@ -503,93 +752,84 @@ errval_t mm_free(struct mm *mm, struct capref cap)
         err = MM_ERR_NOT_FOUND;
         DEBUG_ERR(err, "could not region corresponding to block");
 
-        thread_mutex_unlock(&mm_mutex);
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
 
-    err = cap_delete(cap);
-    if (err_is_fail(err)) {
-        DEBUG_ERR(err, "failure when deleting cap in free");
-
-        thread_mutex_unlock(&mm_mutex);
-        return err;
-    }
-
-    err = mm->ca->free(mm->ca, cap);
-
     struct block_info* pred = NULL;
     struct block_info* succ = NULL;
-    for (succ = region->free_head; succ != NULL; succ = succ->next) {
-        // TODO check this
-        if (block_addr + block_size <= succ->block_addr) {
-            if (pred == NULL) {
-                break;
-            }
-            if (pred->block_addr + pred->block_size <= block_addr) {
-                break;
-            }
-        }
-        pred = succ;
-    }
-
-    // first, try to merge with predecessor
-    if (pred != NULL && pred->block_addr + pred->block_size == block_addr) {
-        pred->block_size += block_size;
-        // on success, try merging predecessor with successor
-        // printf("%lx, %lx, %lx, %lx\n", pred->block_addr, pred->block_size, succ->block)
-        if (succ != NULL && pred->block_addr + pred->block_size == succ->block_addr) {
-            pred->next = succ->next;
-            pred->block_size += succ->block_size;
-            slab_free(&mm->slab, succ);
-        }
+    _tree_neighbours(mm->free_tree, block_addr, &pred, &succ);
+    if (pred != NULL && pred->region != region) {
+        pred = NULL;
+    }
+    if (succ != NULL && succ->region != region) {
+        succ = NULL;
+    }
 
-        mm->mem_available += block_size;
+    if ((pred != NULL && pred->block_addr + pred->block_size > block_addr)
+        || (succ != NULL && succ->block_addr < block_addr + block_size)) {
+        err = MM_ERR_DOUBLE_FREE;
+        DEBUG_ERR(err, "freed memory overlaps free block");
 
-        thread_mutex_unlock(&mm_mutex);
-        return SYS_ERR_OK;
+        thread_mutex_unlock(&mm->mutex);
+        return err;
     }
 
-    // on failure to merge with predecessor, try to merge only with successor
-    if (succ != NULL && block_addr + block_size == succ->block_addr) {
-        succ->block_addr = block_addr;
-        succ->block_size += block_size;
+    bool merge_pred = pred != NULL && pred->block_addr + pred->block_size == block_addr;
+    bool merge_succ = succ != NULL && block_addr + block_size == succ->block_addr;
 
-        mm->mem_available += block_size;
+    // if cannot merge at all, the memory needs a new block
+    struct block_info* block = NULL;
+    if (!merge_pred && !merge_succ) {
+        err = tracked_slab_alloc(mm, (void**)&block);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "slab alloc");
 
-        thread_mutex_unlock(&mm_mutex);
-        return SYS_ERR_OK;
+            thread_mutex_unlock(&mm->mutex);
+            return err;
+        }
     }
 
-    // if cannot merge at all, allocate new block and insert into free list
-    void* buf = NULL;
-    err = tracked_slab_alloc(mm, &buf);
-    struct block_info* block = (struct block_info*)buf;
-
+    err = cap_delete(cap);
     if (err_is_fail(err)) {
-        DEBUG_ERR(err, "slab alloc");
-        thread_mutex_unlock(&mm_mutex);
+        DEBUG_ERR(err, "failure when deleting cap in free");
+        if (block != NULL) {
+            slab_free(&mm->slab, block);
+        }
+
+        thread_mutex_unlock(&mm->mutex);
         return err;
     }
-    block->block_addr = block_addr;
-    block->block_size = block_size;
-    block->next = succ;
 
-    if (pred == NULL) {
-        region->free_head = block;
+    err = mm->ca->free(mm->ca, cap);
+
+    if (merge_pred && merge_succ) {
+        // the successor goes, the predecessor covers all three
+        _block_remove(mm, succ);
+        _block_resize(mm, pred, pred->block_addr,
+                      pred->block_size + block_size + succ->block_size);
+        slab_free(&mm->slab, succ);
+    } else if (merge_pred) {
+        _block_resize(mm, pred, pred->block_addr, pred->block_size + block_size);
+    } else if (merge_succ) {
+        _block_resize(mm, succ, block_addr, succ->block_size + block_size);
     } else {
-        pred->next = block;
+        block->block_addr = block_addr;
+        block->block_size = block_size;
+        block->region = region;
+        _block_insert(mm, block);
     }
 
     mm->mem_available += block_size;
+    region->free_size += block_size;
 
+    thread_mutex_unlock(&mm->mutex);
 
     slab_try_refill(mm);
 
-    thread_mutex_unlock(&mm_mutex);
     return SYS_ERR_OK;
 }
 
-
 /**
  * @brief returns the amount of available (free) memory of the memory manager
  *
@@ -599,9 +839,9 @@ errval_t mm_free(struct mm *mm, struct capref cap)
  */
 size_t mm_mem_available(struct mm *mm)
 {
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
     size_t available = mm->mem_available;
-    thread_mutex_unlock(&mm_mutex);
+    thread_mutex_unlock(&mm->mutex);
     return available;
 }
 
@@ -615,13 +855,37 @@ size_t mm_mem_available(struct mm *mm)
  */
 size_t mm_mem_total(struct mm *mm)
 {
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
     size_t result = mm->mem_total;
-    thread_mutex_unlock(&mm_mutex);
+    thread_mutex_unlock(&mm->mutex);
     return result;
 }
 
 
+/**
+ * @brief returns the size of the largest free block of the memory manager
+ *
+ * @param[in] mm   memory manager instance to query
+ *
+ * @return the size in bytes of the largest allocation that can be satisfied
+ */
+size_t mm_mem_largest_free(struct mm *mm)
+{
+    thread_mutex_lock_nested(&mm->mutex);
+
+    size_t largest = 0;
+    for (size_t class = MM_NUM_CLASSES; class > 0 && largest == 0; class--) {
+        for (struct block_info* block = mm->free_classes[class - 1]; block != NULL;
+             block = block->next) {
+            largest = MAX(largest, block->block_size);
+        }
+    }
+
+    thread_mutex_unlock(&mm->mutex);
+    return largest;
+}
+
+
 /**
  * @brief obtains the range of free memory of the memory allocator instance
  *
@@ -635,7 +899,7 @@ size_t mm_mem_total(struct mm *mm)
  */
 void mm_mem_get_free_range(struct mm *mm, lpaddr_t *base, lpaddr_t *limit)
 {
-    thread_mutex_lock_nested(&mm_mutex);
+    thread_mutex_lock_nested(&mm->mutex);
 
     lpaddr_t minaddr = -1;
     lpaddr_t maxaddr = 0;
@@ -651,5 +915,5 @@ void mm_mem_get_free_range(struct mm *mm, lpaddr_t *base, lpaddr_t *limit)
     *base = minaddr;
     *limit = maxaddr;
 
-    thread_mutex_unlock(&mm_mutex);
+    thread_mutex_unlock(&mm->mutex);
 }
@@ -264,6 +264,168 @@ static inline errval_t _elf_alloc_function(void *child_page_state_arg, genvaddr_
     return SYS_ERR_OK;
 }
 
+/*
+ * Read-only segments are mapped into the child straight from the frames holding
+ * the image: the frame of a multiboot module, or the frames of the page cache for
+ * a program read from the card. All the instances of a program thus share their
+ * text and read-only data. Writable segments get a private copy, of which the
+ * parent only touches the pages holding data from the file: fresh frames are
+ * zeroed by the kernel, which leaves the rest of the BSS as it should be.
+ *
+ * This only applies to images without relocations, the others are loaded with
+ * elf_load() as before.
+ */
+
+// whether the segments of the image can be loaded by _load_segments()
+static bool _elf_can_share(struct elfimg *img)
+{
+    if (img->pages == NULL && capref_is_null(img->mem)) {
+        return false;
+    }
+
+    struct Elf64_Ehdr *head = img->buf;
+    if (img->size < sizeof(struct Elf64_Ehdr) || !IS_ELF(*head)
+        || head->e_ident[EI_CLASS] != ELFCLASS64 || head->e_machine != EM_AARCH64
+        || head->e_phentsize != sizeof(struct Elf64_Phdr)
+        || head->e_phoff + head->e_phnum * sizeof(struct Elf64_Phdr) > img->size
+        || head->e_shoff + head->e_shnum * sizeof(struct Elf64_Shdr) > img->size) {
+        return false;
+    }
+
+    struct Elf64_Shdr *shead = img->buf + head->e_shoff;
+    if (elf64_find_section_header_type(shead, head->e_shnum, SHT_RELA) != NULL) {
+        return false;
+    }
+
+    struct Elf64_Phdr *phead = img->buf + head->e_phoff;
+    for (int i = 0; i < head->e_phnum; i++) {
+        struct Elf64_Phdr *p = &phead[i];
+        if (p->p_type == PT_DYNAMIC) {
+            return false;
+        }
+        if (p->p_type == PT_LOAD
+            && (p->p_offset + p->p_filesz > img->size || p->p_filesz > p->p_memsz)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// maps the pages of the image holding a read-only segment into the child
+static errval_t _map_shared_segment(struct elfimg *img, struct paging_state *child_st,
+                                    struct Elf64_Phdr *p, int flags)
+{
+    errval_t err;
+
+    const lvaddr_t start  = ROUND_PAGE_DOWN(p->p_vaddr);
+    const size_t   offset = ROUND_PAGE_DOWN(p->p_offset);
+    const size_t   bytes  = ROUND_PAGE_UP(p->p_vaddr + p->p_filesz) - start;
+
+    if (img->pages == NULL) {
+        return paging_map_fixed_attr_offset(child_st, start, img->mem, bytes, offset, flags);
+    }
+
+    for (size_t page = 0; page < bytes / BASE_PAGE_SIZE; page++) {
+        // the child keeps its own copy, the caller releases the frames of the image
+        struct capref frame;
+        err = slot_alloc(&frame);
+        if (err_is_fail(err)) {
+            return err_push(err, LIB_ERR_SLOT_ALLOC);
+        }
+        err = cap_copy(frame, img->pages[offset / BASE_PAGE_SIZE + page]);
+        if (err_is_fail(err)) {
+            return err_push(err, LIB_ERR_CAP_COPY);
+        }
+
+        err = paging_map_fixed_attr_offset(child_st, start + page * BASE_PAGE_SIZE, frame,
+                                           BASE_PAGE_SIZE, 0, flags);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    return SYS_ERR_OK;
+}
+
+// copies a writable segment into fresh memory mapped into the child
+static errval_t _load_private_segment(struct elfimg *img, struct paging_state *child_st,
+                                      struct Elf64_Phdr *p, int flags)
+{
+    errval_t err;
+
+    const lvaddr_t start      = ROUND_PAGE_DOWN(p->p_vaddr);
+    const size_t   total_size = ROUND_PAGE_UP(p->p_vaddr + p->p_memsz) - start;
+    const size_t   data_size  = ROUND_PAGE_UP(p->p_vaddr + p->p_filesz) - start;
+
+    struct capref frame;
+    err = frame_alloc(&frame, total_size, NULL);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_FRAME_ALLOC);
+    }
+
+    if (p->p_filesz > 0) {
+        void *buf;
+        err = paging_map_frame_attr_offset(get_current_paging_state(), &buf, data_size, frame, 0,
+                                           VREGION_FLAGS_READ_WRITE);
+        if (err_is_fail(err)) {
+            return err_push(err, LIB_ERR_VSPACE_LAYOUT_INIT);
+        }
+
+        size_t page_offset = p->p_vaddr - start;
+        memcpy(buf + page_offset, img->buf + p->p_offset, p->p_filesz);
+        // the BSS starts on the last page holding data
+        memset(buf + page_offset + p->p_filesz, 0, data_size - page_offset - p->p_filesz);
+
+        err = paging_unmap(get_current_paging_state(), buf);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    err = paging_map_fixed_attr_offset(child_st, start, frame, total_size, 0, flags);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_VSPACE_LAYOUT_INIT);
+    }
+
+    return SYS_ERR_OK;
+}
+
+static errval_t _load_segments(struct elfimg *img, struct paging_state *child_st, lvaddr_t *entry)
+{
+    errval_t err;
+
+    struct Elf64_Ehdr *head  = img->buf;
+    struct Elf64_Phdr *phead = img->buf + head->e_phoff;
+
+    for (int i = 0; i < head->e_phnum; i++) {
+        struct Elf64_Phdr *p = &phead[i];
+        if (p->p_type != PT_LOAD) {
+            continue;
+        }
+
+        int flags = 0;
+        flags |= (p->p_flags & PF_R) ? VREGION_FLAGS_READ : 0;
+        flags |= (p->p_flags & PF_W) ? VREGION_FLAGS_WRITE : 0;
+        flags |= (p->p_flags & PF_X) ? VREGION_FLAGS_EXECUTE : 0;
+
+        // the page offsets in the file and in memory must match to map the image directly
+        bool shared = !(p->p_flags & PF_W) && p->p_filesz == p->p_memsz && p->p_filesz > 0
+                      && p->p_vaddr % BASE_PAGE_SIZE == p->p_offset % BASE_PAGE_SIZE;
+        if (shared) {
+            err = _map_shared_segment(img, child_st, p, flags);
+        } else {
+            err = _load_private_segment(img, child_st, p, flags);
+        }
+        if (err_is_fail(err)) {
+            return err_push(err, ELF_ERR_ALLOCATE);
+        }
+    }
+
+    *entry = head->e_entry;
+    return SYS_ERR_OK;
+}
+
 static inline errval_t _parse_elf_image(struct elfimg *img, struct paging_state *child_st,
                                         lvaddr_t *entry_point_elf_img,
                                         lvaddr_t *global_offset_table_address)
@@ -273,8 +435,12 @@ static inline errval_t _parse_elf_image(struct elfimg *img, struct paging_state
     genvaddr_t elf_base_address = (genvaddr_t)img->buf;
     genvaddr_t elf_size         = img->size;
 
-    err = elf_load(EM_AARCH64, _elf_alloc_function, (void *)child_st, elf_base_address, elf_size,
-                   entry_point_elf_img);
+    if (_elf_can_share(img)) {
+        err = _load_segments(img, child_st, entry_point_elf_img);
+    } else {
+        err = elf_load(EM_AARCH64, _elf_alloc_function, (void *)child_st, elf_base_address,
+                       elf_size, entry_point_elf_img);
+    }
     if (err_is_fail(err)) {
         return err_push(err, SPAWN_ERR_ELF_MAP);  // TODO: Maybe find a better error
     }
@@ -519,6 +685,15 @@ char **spawn_parse_args(const char *opts, int *argc_dest)
     return argv;
 }
 
+// Multiboot modules mapped by previous spawns
+struct spawn_module_mapping {
+    struct mem_region           *module;
+    void                        *buf;
+    struct spawn_module_mapping *next;
+};
+
+static struct spawn_module_mapping *spawn_module_mappings = NULL;
+
 errval_t spawn_load_elf(struct bootinfo *bi, const char *name, struct elfimg *img, int *argc,
                         char ***argv)
 {
@@ -538,12 +713,28 @@ errval_t spawn_load_elf(struct bootinfo *bi, const char *name, struct elfimg *im
         return SPAWN_ERR_DOMAIN_NOTFOUND;
     }
 
-    // - create the elfimg struct from the module
+    // - create the elfimg struct from the module, which stays mapped for the next spawns
     elfimg_init_from_module(img, module);
-    err = elfimg_map(img);
-    if (err_is_fail(err)) {
-        DEBUG_ERR(err, "elfimg_map failed");
-        return err;
+    struct spawn_module_mapping *mapping;
+    for (mapping = spawn_module_mappings; mapping != NULL; mapping = mapping->next) {
+        if (mapping->module == module) {
+            img->buf = mapping->buf;
+            break;
+        }
+    }
+    if (mapping == NULL) {
+        err = elfimg_map(img);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "elfimg_map failed");
+            return err;
+        }
+        mapping = malloc(sizeof(struct spawn_module_mapping));
+        if (mapping != NULL) {
+            mapping->module = module;
+            mapping->buf = img->buf;
+            mapping->next = spawn_module_mappings;
+            spawn_module_mappings = mapping;
+        }
     }
 
     static const char elf_header[] = { 0x7f, 'E', 'L', 'F' };
@@ -606,48 +797,14 @@ errval_t spawn_load_with_bootinfo(struct spawninfo *si, struct bootinfo *bi, con
 }
 
 
-errval_t spawn_load_filesystem(const char *path, struct elfimg *img, int *argc,
-                        char ***argv)
+errval_t spawn_load_filesystem(const char *path, void *buf, size_t size, struct capref *pages,
+                               struct elfimg *img, int *argc, char ***argv)
 {
-    errval_t err = SYS_ERR_OK;
-
-    struct fat32_filesystem *fs = get_mounted_filesystem();
-
-    char *file_path = NULL;
-    char *split = strchr(path, ' ');
-    if(split == NULL) {
-        file_path = (char*)path;
-    } else {
-        file_path = calloc(split - path + 1, 1);
-        memcpy(file_path, path, split - path);
-    }
-
-    assert(file_path != NULL);
-
-    struct fat32_handle *handle;
-    err = fat32_open(fs, file_path, &handle);
-    if(err_is_fail(err)) {
-        return err;
-    }
-
-    size_t elf_size = handle->entry.file_size;
-    void *buffer = malloc(ROUND_UP(elf_size,4096));
-    if(buffer == NULL) {
-        return LIB_ERR_MALLOC_FAIL;
-    }
-
-    size_t nb_bytes_read;
-    err = fat32_read(fs, handle, buffer, elf_size, &nb_bytes_read);
-    if(err_is_fail(err)) {
-        return err;
-    }
-
-    assert(nb_bytes_read == elf_size);
-
     struct elfimg image = {
         .mem = NULL_CAP,
-        .buf = buffer,
-        .size = elf_size,
+        .buf = buf,
+        .size = size,
+        .pages = pages,
     };
 
     *img = image;
@@ -32,6 +32,7 @@
 #include <aos/deferred.h>
 #include <dev/imx8x/sdhc_dev.h>
 #include <aos/systime.h>
+#include <aos/cache.h>
 
 // #define DEBUG_ON
 
@@ -101,6 +102,16 @@
 #define OCR_HCS  0x40000000
 #define OCR_S18R 0x1000000
 
+struct cmd {
+    uint16_t     cmdidx;
+    unsigned int cmdarg;
+    unsigned int resp_type;
+    unsigned int response[4];  // The response of the command
+    genpaddr_t   dma_base;     // If a data transfer is necessary, use this
+                               // physical base address for read/write.
+    size_t       blocks;       // Number of blocks for multi-block transfers
+};
+
 struct sdhc_s {
     sdhc_t    dev;
     uintptr_t vbase;
@@ -118,25 +129,68 @@ struct sdhc_s {
 
     // Cache
     struct cache *current_cache;
+
+    // Transfer started by sdhc_start_transfer
+    struct {
+        bool       active;
+        struct cmd cmd;
+        int        index;
+        lvaddr_t   vaddr;
+    } async;
+    bool blocklen_set;
 };
 
 
-struct cmd {
-    uint16_t     cmdidx;
-    unsigned int cmdarg;
-    unsigned int resp_type;
-    unsigned int response[4];  // The response of the command
-    genpaddr_t   dma_base;     // If a data transfer is necessary, use this
-                               // physical base address for read/write.
-};
+static inline bool cmd_is_read(struct cmd *cmd)
+{
+    return cmd->cmdidx == MMC_CMD_READ_SINGLE_BLOCK || cmd->cmdidx == MMC_CMD_READ_MULTIPLE_BLOCK;
+}
+
+static inline bool cmd_is_write(struct cmd *cmd)
+{
+    return cmd->cmdidx == MMC_CMD_WRITE_SINGLE_BLOCK || cmd->cmdidx == MMC_CMD_WRITE_MULTIPLE_BLOCK;
+}
 
+static inline bool cmd_is_multiple(struct cmd *cmd)
+{
+    return cmd->cmdidx == MMC_CMD_READ_MULTIPLE_BLOCK || cmd->cmdidx == MMC_CMD_WRITE_MULTIPLE_BLOCK;
+}
+
+
+/*
+ * Block cache
+ * ===========
+ * The cache is organised as nb_sets sets of nb_ways lines each. A block is
+ * hashed to exactly one set and can live in any line of that set, so both
+ * the lookup and the victim selection only touch nb_ways lines.
+ * The line storage is backed by a frame, which lets dirty lines be written
+ * back to the card directly by the DMA engine.
+ */
+struct cache_line {
+    int      block_idx;    // Block stored in this line, -1 if the line is empty
+    uint32_t timestamp;    // Last access, used for LRU within the set
+    bool     dirty;        // Line has to be written back before eviction
+    bool     in_dirty_list;
+};
 
 struct cache {
-    size_t size;
-    int current_timestamp;
-    int* timestamp;
-    int* blocks_idx;
+    size_t nb_sets;
+    size_t nb_ways;
+    uint8_t set_bits;
+    bool write_back;
+    uint32_t current_timestamp;
+    struct cache_line *lines;
+
+    // Lines that were dirtied since the last flush
+    uint32_t *dirty_lines;
+    size_t nb_dirty_lines;
+
+    // Backing store for the lines
+    struct capref frame;
     void *blocks;
+    lpaddr_t blocks_paddr;
+
+    struct sdhc_cache_stats stats;
 };
 
 #define dump(sd)                                                                                   \
@@ -199,7 +253,7 @@ static sdhc_cmd_xfr_typ_t xfr_typ_for_cmd(struct cmd *cmd)
 {
     sdhc_cmd_xfr_typ_t c = 0;
 
-    if (cmd->cmdidx == MMC_CMD_READ_SINGLE_BLOCK || cmd->cmdidx == MMC_CMD_WRITE_SINGLE_BLOCK) {
+    if (cmd_is_read(cmd) || cmd_is_write(cmd)) {
         c = sdhc_cmd_xfr_typ_dpsel_insert(c, 1);
     }
 
@@ -225,10 +279,8 @@ static sdhc_cmd_xfr_typ_t xfr_typ_for_cmd(struct cmd *cmd)
     return c;
 }
 
-static errval_t sdhc_send_cmd(struct sdhc_s *sd, struct cmd *cmd)
+static void sdhc_wait_inhibit(struct sdhc_s *sd, struct cmd *cmd)
 {
-    DEBUG("sdhc_send_cmd: cmdidx=%d,cmdarg=%d\n", cmd->cmdidx, cmd->cmdarg);
-
     uint32_t mask;  // TODO: in some cases we don't need to wait for all
     if (cmd->cmdidx == MMC_CMD_STOP_TRANSMISSION) {
         mask = 1;
@@ -236,14 +288,18 @@ static errval_t sdhc_send_cmd(struct sdhc_s *sd, struct cmd *cmd)
         mask = 3;
     }
 
-    // start here
     while (sdhc_pres_state_rawrd(&sd->dev) & mask) {
         DEBUG("Card busy!\n");
     }
     DEBUG("Card ready (data & cmd inhibit are clear)!\n");
-    // stop here
-    barrelfish_usleep(10000);
+}
 
+/*
+ * Program the controller for cmd and start it. With signal set, completion
+ * and errors of the command are signalled through the controller interrupt.
+ */
+static void sdhc_issue_cmd(struct sdhc_s *sd, struct cmd *cmd, bool signal)
+{
     // Clear interrupts
     sdhc_int_status_rawwr(&sd->dev, ~0x0);
 
@@ -254,48 +310,134 @@ static errval_t sdhc_send_cmd(struct sdhc_s *sd, struct cmd *cmd)
     sdhc_cmd_arg_wr(&sd->dev, cmd->cmdarg);
 
     // Mixer controler
-    int is_read  = cmd->cmdidx == MMC_CMD_READ_SINGLE_BLOCK;
-    int is_write = cmd->cmdidx == MMC_CMD_WRITE_SINGLE_BLOCK;
+    int is_read     = cmd_is_read(cmd);
+    int is_write    = cmd_is_write(cmd);
+    int is_multiple = cmd_is_multiple(cmd);
     sdhc_mix_ctrl_wr(&sd->dev, 0);
     sdhc_mix_ctrl_dmaen_wrf(&sd->dev, is_read || is_write);
     sdhc_mix_ctrl_dtdsel_wrf(&sd->dev, is_read);
 
+    if (is_multiple) {
+        // Let the controller count the blocks and stop the card with CMD12
+        assert(cmd->blocks > 0 && cmd->blocks <= SDHC_MAX_BLOCKS_PER_TRANSFER);
+        sdhc_mix_ctrl_msbsel_wrf(&sd->dev, 1);
+        sdhc_mix_ctrl_bcen_wrf(&sd->dev, 1);
+        sdhc_mix_ctrl_ac12en_wrf(&sd->dev, 1);
+    }
+
     if (is_read || is_write) {
         // DMA address setup
         assert((cmd->dma_base >> 32) == 0);
         sdhc_vend_spec2_acmd23_argu2_en_wrf(&sd->dev, 0);
         sdhc_ds_addr_wr(&sd->dev, cmd->dma_base);
 
+        sdhc_blk_att_t b = 0;
+        b                = sdhc_blk_att_blkcnt_insert(b, is_multiple ? cmd->blocks : 1);
+        b                = sdhc_blk_att_blksize_insert(b, SDHC_BLOCK_SIZE);
+        sdhc_blk_att_wr(&sd->dev, b);
+
         // Set watermark
         sdhc_wtmk_lvl_rd_wml_wrf(&sd->dev, 16);
         sdhc_wtmk_lvl_wr_wml_wrf(&sd->dev, 16);
     }
 
+    if (signal) {
+        sdhc_ir_t ir = 0;
+        ir           = sdhc_ir_ccen_insert(ir, 1);
+        ir           = sdhc_ir_tcen_insert(ir, 1);
+        ir           = sdhc_ir_dinten_insert(ir, 1);
+        ir           = sdhc_ir_ctoeen_insert(ir, 1);
+        ir           = sdhc_ir_cceen_insert(ir, 1);
+        ir           = sdhc_ir_dtoeen_insert(ir, 1);
+        ir           = sdhc_ir_dceen_insert(ir, 1);
+        ir           = sdhc_ir_debeen_insert(ir, 1);
+        ir           = sdhc_ir_dmaeen_insert(ir, 1);
+        sdhc_int_signal_en_wr(&sd->dev, ir);
+    }
+
     sdhc_cmd_xfr_typ_t c = xfr_typ_for_cmd(cmd);
     sdhc_cmd_xfr_typ_wr(&sd->dev, c);
+}
+
+/*
+ * Check the interrupt status for the completion of the command issued last.
+ */
+static errval_t sdhc_check_cmd(struct sdhc_s *sd, struct cmd *cmd, bool *done)
+{
+    int is_data = cmd_is_read(cmd) || cmd_is_write(cmd);
+
+    uint32_t ctoe = sdhc_int_status_ctoe_rdf(&sd->dev);
+    uint32_t cce  = sdhc_int_status_cce_rdf(&sd->dev);
+    uint32_t tc   = sdhc_int_status_tc_rdf(&sd->dev);
+    uint32_t cc   = sdhc_int_status_cc_rdf(&sd->dev);
+
+    // The simple DMA engine pauses on buffer boundaries, restart it where it stopped
+    if (cmd_is_multiple(cmd) && !tc && sdhc_int_status_dint_rdf(&sd->dev)) {
+        sdhc_int_status_rawwr(&sd->dev, sdhc_int_status_dint_insert(0, 1));
+        sdhc_ds_addr_wr(&sd->dev, sdhc_ds_addr_rd(&sd->dev));
+    }
+
+    if (ctoe == 0x1 && cce == 0x1) {
+        DEBUG("%s:%d: ctoe = 1 ccrc = 1: Conflict on cmd line.\n", __FUNCTION__, __LINE__);
+        dump(sd);
+        return SDHC_ERR_CMD_CONFLICT;
+    }
+    if (ctoe == 0x1 && cce == 0x0) {
+        DEBUG("%s:%d: cto = 1 ccrc = 0: Abort.\n", __FUNCTION__, __LINE__);
+        dump(sd);
+        return SDHC_ERR_CMD_TIMEOUT;
+    }
+    if (is_data
+        && (sdhc_int_status_dtoe_rdf(&sd->dev) || sdhc_int_status_dce_rdf(&sd->dev)
+            || sdhc_int_status_debe_rdf(&sd->dev) || sdhc_int_status_dmae_rdf(&sd->dev))) {
+        DEBUG("%s:%d: Data transfer error.\n", __FUNCTION__, __LINE__);
+        dump(sd);
+        return SDHC_ERR_DATA_ERROR;
+    }
+
+    *done = (tc && cc) || (cc && !is_data);
+    return SYS_ERR_OK;
+}
+
+static void sdhc_read_response(struct sdhc_s *sd, struct cmd *cmd)
+{
+    if (cmd->resp_type & MMC_RSP_136) {
+        uint32_t r0      = sdhc_cmd_rsp0_rd(&sd->dev);
+        uint32_t r1      = sdhc_cmd_rsp1_rd(&sd->dev);
+        uint32_t r2      = sdhc_cmd_rsp2_rd(&sd->dev);
+        uint32_t r3      = sdhc_cmd_rsp3_rd(&sd->dev);
+        cmd->response[0] = (r3 << 8) | (r2 >> 24);
+        cmd->response[1] = (r2 << 8) | (r1 >> 24);
+        cmd->response[2] = (r1 << 8) | (r0 >> 24);
+        cmd->response[3] = (r0 << 8);
+    } else {
+        cmd->response[0] = sdhc_cmd_rsp0_rd(&sd->dev);
+    }
+}
+
+static errval_t sdhc_send_cmd(struct sdhc_s *sd, struct cmd *cmd)
+{
+    errval_t err;
+    DEBUG("sdhc_send_cmd: cmdidx=%d,cmdarg=%d\n", cmd->cmdidx, cmd->cmdarg);
+
+    // The controller can only run one command at a time
+    assert(!sd->async.active);
+
+    sdhc_wait_inhibit(sd, cmd);
+    barrelfish_usleep(10000);
+
+    sdhc_issue_cmd(sd, cmd, false);
 
     // DEBUG("%s:%d: Wait until irq_stat.tc || irq_stat.cc \n", __FUNCTION__, __LINE__);
-    uint32_t tc = 0;
-    uint32_t cc = 0;
-    size_t   i  = 0;
+    bool   done = false;
+    size_t i    = 0;
 #ifdef BENCHMARK
     uint64_t start = systime_now();
 #endif
     do {
-        uint32_t ctoe = sdhc_int_status_ctoe_rdf(&sd->dev);
-        uint32_t cce  = sdhc_int_status_cce_rdf(&sd->dev);
-        tc            = sdhc_int_status_tc_rdf(&sd->dev);
-        cc            = sdhc_int_status_cc_rdf(&sd->dev);
-
-        if (ctoe == 0x1 && cce == 0x1) {
-            DEBUG("%s:%d: ctoe = 1 ccrc = 1: Conflict on cmd line.\n", __FUNCTION__, __LINE__);
-            dump(sd);
-            return SDHC_ERR_CMD_CONFLICT;
-        }
-        if (ctoe == 0x1 && cce == 0x0) {
-            DEBUG("%s:%d: cto = 1 ccrc = 0: Abort.\n", __FUNCTION__, __LINE__);
-            dump(sd);
-            return SDHC_ERR_CMD_TIMEOUT;
+        err = sdhc_check_cmd(sd, cmd, &done);
+        if (err_is_fail(err)) {
+            return err;
         }
 
         if (i++ > 1000) {
@@ -303,28 +445,14 @@ static errval_t sdhc_send_cmd(struct sdhc_s *sd, struct cmd *cmd)
             USER_PANIC("Command not Ackd?");
         }
         barrelfish_usleep(1000);
-        if ((tc && cc) || (cc && !is_read && !is_write)) {
-            break;
-        }
-    } while (true);
+    } while (!done);
 #ifdef BENCHMARK
     uint64_t end = systime_now();
     debug_printf("Time taken waiting : %d\n", systime_to_us(end - start));
 #endif
     DEBUG("Command complete!\n");
 
-    if (cmd->resp_type & MMC_RSP_136) {
-        uint32_t r0      = sdhc_cmd_rsp0_rd(&sd->dev);
-        uint32_t r1      = sdhc_cmd_rsp1_rd(&sd->dev);
-        uint32_t r2      = sdhc_cmd_rsp2_rd(&sd->dev);
-        uint32_t r3      = sdhc_cmd_rsp3_rd(&sd->dev);
-        cmd->response[0] = (r3 << 8) | (r2 >> 24);
-        cmd->response[1] = (r2 << 8) | (r1 >> 24);
-        cmd->response[2] = (r1 << 8) | (r0 >> 24);
-        cmd->response[3] = (r0 << 8);
-    } else {
-        cmd->response[0] = sdhc_cmd_rsp0_rd(&sd->dev);
-    }
+    sdhc_read_response(sd, cmd);
     return SYS_ERR_OK;
 }
 
@@ -471,78 +599,369 @@ static errval_t sdhc_card_init(struct sdhc_s *sd)
 }
 
 
-errval_t setup_cache(struct sdhc_s *sd);
-errval_t setup_cache(struct sdhc_s *sd) {
-    size_t size = 2048;
-    sd->current_cache = (struct cache*)malloc(sizeof(struct cache));
-    sd->current_cache->size = size;
-    sd->current_cache->current_timestamp = 1;
-    sd->current_cache->timestamp = malloc(size * sizeof(int));
-    sd->current_cache->blocks_idx = malloc(size * sizeof(int));
-    sd->current_cache->blocks = malloc(size * 512);
+static errval_t sdhc_send_write_block(struct sdhc_s *sd, int index, lpaddr_t source)
+{
+    errval_t err;
+
+    struct cmd set_blocklen
+        = { .cmdidx = MMC_CMD_SET_BLOCKLEN, .cmdarg = SDHC_BLOCK_SIZE, .resp_type = MMC_RSP_R1 };
+    err = sdhc_send_cmd(sd, &set_blocklen);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "set_blocklen");
+        return err;
+    }
+
+    struct cmd write_block = { .cmdidx    = MMC_CMD_WRITE_SINGLE_BLOCK,
+                               .cmdarg    = index,
+                               .resp_type = MMC_RSP_R1,
+                               .dma_base  = source
+
+    };
+    err = sdhc_send_cmd(sd, &write_block);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "write_block");
+        return err;
+    }
+
+    return SYS_ERR_OK;
+}
+
+static inline void *cache_line_data(struct cache *cache, size_t line)
+{
+    return cache->blocks + line * SDHC_BLOCK_SIZE;
+}
+
+static inline size_t cache_set_of(struct cache *cache, int idx)
+{
+    // Fibonacci hashing, the upper bits of the product are well mixed
+    uint32_t hash = (uint32_t)idx * 2654435769u;
+    return cache->set_bits == 0 ? 0 : hash >> (32 - cache->set_bits);
+}
+
+static void cache_mark_dirty(struct cache *cache, size_t line)
+{
+    cache->lines[line].dirty = true;
+    if (!cache->lines[line].in_dirty_list) {
+        cache->lines[line].in_dirty_list = true;
+        cache->dirty_lines[cache->nb_dirty_lines++] = line;
+    }
+}
+
+static errval_t cache_writeback_line(struct sdhc_s *sd, size_t line)
+{
+    struct cache *cache = sd->current_cache;
+    struct cache_line *l = &cache->lines[line];
+
+    if (!l->dirty) {
+        return SYS_ERR_OK;
+    }
+
+    arm64_dcache_wb_range((vm_offset_t)cache_line_data(cache, line), SDHC_BLOCK_SIZE);
+    errval_t err = sdhc_send_write_block(sd, l->block_idx,
+                                         cache->blocks_paddr + line * SDHC_BLOCK_SIZE);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    l->dirty = false;
+    cache->stats.writebacks++;
+    return SYS_ERR_OK;
+}
+
+static void teardown_cache(struct sdhc_s *sd)
+{
+    struct cache *cache = sd->current_cache;
+    if (cache == NULL) {
+        return;
+    }
+
+    paging_unmap(get_current_paging_state(), cache->blocks);
+    cap_destroy(cache->frame);
+    free(cache->lines);
+    free(cache->dirty_lines);
+    free(cache);
+    sd->current_cache = NULL;
+}
+
+static errval_t setup_cache(struct sdhc_s *sd, size_t nb_sets, size_t nb_ways)
+{
+    errval_t err;
+
+    // The set index is taken from the upper bits of the hash
+    if (nb_sets == 0 || nb_ways == 0 || (nb_sets & (nb_sets - 1)) != 0) {
+        return SYS_ERR_INVALID_SIZE;
+    }
+
+    struct cache *cache = calloc(1, sizeof(struct cache));
+    if (cache == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    const size_t nb_lines = nb_sets * nb_ways;
+    cache->nb_sets = nb_sets;
+    cache->nb_ways = nb_ways;
+    cache->write_back = true;
+    cache->current_timestamp = 1;
+    cache->lines = malloc(nb_lines * sizeof(struct cache_line));
+    cache->dirty_lines = malloc(nb_lines * sizeof(uint32_t));
+    if (cache->lines == NULL || cache->dirty_lines == NULL) {
+        free(cache->lines);
+        free(cache->dirty_lines);
+        free(cache);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    while ((1UL << cache->set_bits) < nb_sets) {
+        cache->set_bits++;
+    }
+
+    for (size_t i = 0; i < nb_lines; i++) {
+        cache->lines[i].block_idx = -1;
+        cache->lines[i].timestamp = 0;
+        cache->lines[i].dirty = false;
+        cache->lines[i].in_dirty_list = false;
+    }
+
+    size_t size;
+    err = frame_alloc(&cache->frame, ROUND_PAGE_UP(nb_lines * SDHC_BLOCK_SIZE), &size);
+    if (err_is_fail(err)) {
+        goto out_err;
+    }
+
+    err = paging_map_frame_attr(get_current_paging_state(), &cache->blocks, size, cache->frame,
+                                VREGION_FLAGS_READ_WRITE);
+    if (err_is_fail(err)) {
+        cap_destroy(cache->frame);
+        goto out_err;
+    }
 
-    for(size_t i = 0; i < size;i++) {
-        sd->current_cache->timestamp[i] = -1;
-        sd->current_cache->blocks_idx[i] = -1;
+    struct capability frame_identity;
+    err = cap_direct_identify(cache->frame, &frame_identity);
+    if (err_is_fail(err)) {
+        paging_unmap(get_current_paging_state(), cache->blocks);
+        cap_destroy(cache->frame);
+        goto out_err;
     }
+    cache->blocks_paddr = get_address(&frame_identity);
 
+    sd->current_cache = cache;
     return SYS_ERR_OK;
+
+out_err:
+    free(cache->lines);
+    free(cache->dirty_lines);
+    free(cache);
+    return err;
 }
 
-errval_t read_from_cache(struct sdhc_s *sd, int idx, lvaddr_t dest_virtual);
-errval_t read_from_cache(struct sdhc_s *sd, int idx, lvaddr_t dest_virtual) {
-    // Search if we find the bloc in the cache
-    for(size_t i = 0; i < sd->current_cache->size;i++) {
-        if(sd->current_cache->blocks_idx[i] == idx) {
-            memcpy((void*)dest_virtual,sd->current_cache->blocks + i*512,512);
+static errval_t cache_lookup(struct cache *cache, int idx, size_t *ret_line)
+{
+    const size_t first = cache_set_of(cache, idx) * cache->nb_ways;
+
+    for (size_t i = first; i < first + cache->nb_ways; i++) {
+        if (cache->lines[i].block_idx == idx) {
+            *ret_line = i;
             return SYS_ERR_OK;
         }
     }
+    return FS_CACHE_NOTPRESENT;
+}
+
+static errval_t read_from_cache(struct sdhc_s *sd, int idx, lvaddr_t dest_virtual)
+{
+    struct cache *cache = sd->current_cache;
+
+    size_t line;
+    errval_t err = cache_lookup(cache, idx, &line);
+    if (err_is_fail(err)) {
+        cache->stats.misses++;
+        return err;
+    }
 
-    // Bloc not found ==> We can return an error
-    return CMDPARSE_ERR_NOT_DEFINE; // TODO: Create custom error code
+    memcpy((void *)dest_virtual, cache_line_data(cache, line), SDHC_BLOCK_SIZE);
+    cache->lines[line].timestamp = cache->current_timestamp++;
+    cache->stats.hits++;
+    return SYS_ERR_OK;
 }
 
-errval_t update_cache(struct sdhc_s *sd, int idx, lvaddr_t dest_virtual);
-errval_t update_cache(struct sdhc_s *sd, int idx, lvaddr_t dest_virtual) {
-    int min_idx = 0;
-    int min_timestamp = INT_MAX;
+/**
+ * Returns the line holding idx, or an empty line of its set. If the set is
+ * full, the least recently used line is evicted (and written back if dirty).
+ */
+static errval_t cache_get_line(struct sdhc_s *sd, int idx, size_t *ret_line)
+{
+    struct cache *cache = sd->current_cache;
+    const size_t first = cache_set_of(cache, idx) * cache->nb_ways;
+
+    size_t   victim = first;
+    uint32_t min_timestamp = UINT32_MAX;
 
-    // Eviction policy : LRU
-    for(size_t i = 0; i < sd->current_cache->size;i++) {
-        if(sd->current_cache->timestamp[i] < min_timestamp) {
-            min_idx = i;
-            min_timestamp = sd->current_cache->timestamp[i];
+    for (size_t i = first; i < first + cache->nb_ways; i++) {
+        if (cache->lines[i].block_idx == idx) {
+            *ret_line = i;
+            return SYS_ERR_OK;
+        }
+        if (cache->lines[i].block_idx == -1) {
+            // Empty lines always win against valid ones
+            min_timestamp = 0;
+            victim = i;
+        } else if (cache->lines[i].timestamp < min_timestamp) {
+            min_timestamp = cache->lines[i].timestamp;
+            victim = i;
+        }
+    }
+
+    if (cache->lines[victim].block_idx != -1) {
+        errval_t err = cache_writeback_line(sd, victim);
+        if (err_is_fail(err)) {
+            return err;
+        }
+        cache->stats.evictions++;
+    }
+
+    cache->lines[victim].block_idx = idx;
+    *ret_line = victim;
+    return SYS_ERR_OK;
+}
+
+static errval_t update_cache(struct sdhc_s *sd, int idx, lvaddr_t source_virtual, bool dirty)
+{
+    struct cache *cache = sd->current_cache;
+
+    size_t line;
+    errval_t err = cache_get_line(sd, idx, &line);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    memcpy(cache_line_data(cache, line), (void *)source_virtual, SDHC_BLOCK_SIZE);
+    cache->lines[line].timestamp = cache->current_timestamp++;
+    if (dirty) {
+        cache_mark_dirty(cache, line);
+    } else {
+        cache->lines[line].dirty = false;
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * Writes back the entry holding idx, if any, so that the card is up to date.
+ * Used before bypassing the cache.
+ */
+static errval_t writeback_cache_entry(struct sdhc_s *sd, int idx)
+{
+    size_t line;
+    if (err_is_fail(cache_lookup(sd->current_cache, idx, &line))) {
+        return SYS_ERR_OK;
+    }
+    return cache_writeback_line(sd, line);
+}
+
+static errval_t invalidate_cache(struct sdhc_s *sd, int idx)
+{
+    struct cache *cache = sd->current_cache;
+    const size_t first = cache_set_of(cache, idx) * cache->nb_ways;
+
+    for (size_t i = first; i < first + cache->nb_ways; i++) {
+        if (cache->lines[i].block_idx == idx) {
+            cache->lines[i].block_idx = -1;
+            cache->lines[i].timestamp = 0;
+            cache->lines[i].dirty = false;
+        }
+    }
+    return SYS_ERR_OK;
+}
+
+static int compare_dirty_lines(void *arg, const void *a, const void *b)
+{
+    struct cache *cache = arg;
+    int idx_a = cache->lines[*(const uint32_t *)a].block_idx;
+    int idx_b = cache->lines[*(const uint32_t *)b].block_idx;
+    return (idx_a > idx_b) - (idx_a < idx_b);
+}
+
+errval_t sdhc_flush_cache(struct sdhc_s *sd)
+{
+    errval_t err;
+    struct cache *cache = sd->current_cache;
+
+    // Issue the writes in block order, the card handles sequential writes best
+    qsort_r(cache->dirty_lines, cache->nb_dirty_lines, sizeof(uint32_t), cache, compare_dirty_lines);
+
+    size_t i = 0;
+    for (; i < cache->nb_dirty_lines; i++) {
+        size_t line = cache->dirty_lines[i];
+        err = cache_writeback_line(sd, line);
+        if (err_is_fail(err)) {
+            // Keep the remaining lines queued for the next flush
+            memmove(cache->dirty_lines, cache->dirty_lines + i,
+                    (cache->nb_dirty_lines - i) * sizeof(uint32_t));
+            cache->nb_dirty_lines -= i;
+            return err;
         }
+        cache->lines[line].in_dirty_list = false;
+    }
+    cache->nb_dirty_lines = 0;
+
+    return SYS_ERR_OK;
+}
+
+errval_t sdhc_cache_resize(struct sdhc_s *sd, size_t nb_sets, size_t nb_ways)
+{
+    errval_t err = sdhc_flush_cache(sd);
+    if (err_is_fail(err)) {
+        return err;
     }
 
-    // Replace the evicted block
-    sd->current_cache->timestamp[min_idx] = sd->current_cache->current_timestamp++;
-    sd->current_cache->blocks_idx[min_idx] = idx;
-    memcpy(sd->current_cache->blocks + min_idx * 512, (void*)dest_virtual, 512);
+    struct cache *old_cache = sd->current_cache;
+    err = setup_cache(sd, nb_sets, nb_ways);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    struct cache *new_cache = sd->current_cache;
+    sd->current_cache = old_cache;
+    teardown_cache(sd);
+    sd->current_cache = new_cache;
+
     return SYS_ERR_OK;
 }
 
-errval_t invalidate_cache(struct sdhc_s *sd, int idx);
-errval_t invalidate_cache(struct sdhc_s *sd, int idx) {
-    // Invalidate the correct entry in the cache
-    for(size_t i = 0; i < sd->current_cache->size;i++) {
-        if(sd->current_cache->blocks_idx[i] == idx) {
-            sd->current_cache->blocks_idx[i] = -1;
-            sd->current_cache->timestamp[i] = -1;
+errval_t sdhc_cache_set_write_back(struct sdhc_s *sd, bool write_back)
+{
+    if (!write_back) {
+        errval_t err = sdhc_flush_cache(sd);
+        if (err_is_fail(err)) {
+            return err;
         }
     }
+    sd->current_cache->write_back = write_back;
     return SYS_ERR_OK;
 }
 
+void sdhc_cache_get_stats(struct sdhc_s *sd, struct sdhc_cache_stats *stats)
+{
+    *stats = sd->current_cache->stats;
+}
+
 errval_t sdhc_read_block(struct sdhc_s *sd, int index, lpaddr_t dest, lvaddr_t dest_virtual)
 {
     errval_t err;
-    (void)dest_virtual;
-    err = read_from_cache(sd, index, dest_virtual);
-    if(err_is_ok(err)) {
-        // Cache hit
-        return SYS_ERR_OK;
+
+    // Without a virtual address, we can neither serve from nor fill the cache
+    const bool cached = dest_virtual != 0;
+
+    if (cached) {
+        err = read_from_cache(sd, index, dest_virtual);
+        if (err_is_ok(err)) {
+            // Cache hit
+            return SYS_ERR_OK;
+        }
+    } else {
+        err = writeback_cache_entry(sd, index);
+        if (err_is_fail(err)) {
+            return err;
+        }
     }
 
     struct cmd set_blocklen
@@ -565,17 +984,80 @@ errval_t sdhc_read_block(struct sdhc_s *sd, int index, lpaddr_t dest, lvaddr_t d
         return err;
     }
 
-    err = update_cache(sd, index, dest_virtual);
-    if(err_is_fail(err)) {
+    if (cached) {
+        err = update_cache(sd, index, dest_virtual, false);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    return SYS_ERR_OK;
+}
+
+errval_t sdhc_write_block(struct sdhc_s *sd, int index, lpaddr_t source, lvaddr_t source_virtual)
+{
+    errval_t err;
+
+    // Write-back: the block only goes to the card on eviction or flush
+    if (sd->current_cache->write_back && source_virtual != 0) {
+        return update_cache(sd, index, source_virtual, true);
+    }
+
+    err = sdhc_send_write_block(sd, index, source);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    if (source_virtual != 0) {
+        err = update_cache(sd, index, source_virtual, false);
+    } else {
+        err = invalidate_cache(sd, index);
+    }
+    if (err_is_fail(err)) {
         return err;
     }
 
     return SYS_ERR_OK;
 }
 
-errval_t sdhc_write_block(struct sdhc_s *sd, int index, lpaddr_t source)
+errval_t sdhc_read_blocks(struct sdhc_s *sd, int index, size_t count, lpaddr_t dest,
+                          lvaddr_t dest_virtual)
 {
     errval_t err;
+    struct cache *cache = sd->current_cache;
+
+    if (count == 1) {
+        return sdhc_read_block(sd, index, dest, dest_virtual);
+    }
+    if (count == 0 || count > SDHC_MAX_BLOCKS_PER_TRANSFER || dest_virtual == 0) {
+        return SYS_ERR_INVALID_SIZE;
+    }
+
+    // Serve the request from the cache if every block is present, otherwise
+    // make sure the card holds the latest version of the blocks we read
+    size_t nb_hits = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t line;
+        if (err_is_ok(cache_lookup(cache, index + i, &line))) {
+            nb_hits++;
+        }
+    }
+
+    if (nb_hits == count) {
+        for (size_t i = 0; i < count; i++) {
+            err = read_from_cache(sd, index + i, dest_virtual + i * SDHC_BLOCK_SIZE);
+            assert(err_is_ok(err));
+        }
+        return SYS_ERR_OK;
+    }
+
+    for (size_t i = 0; nb_hits > 0 && i < count; i++) {
+        err = writeback_cache_entry(sd, index + i);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+    cache->stats.misses += count;
 
     struct cmd set_blocklen
         = { .cmdidx = MMC_CMD_SET_BLOCKLEN, .cmdarg = SDHC_BLOCK_SIZE, .resp_type = MMC_RSP_R1 };
@@ -585,22 +1067,179 @@ errval_t sdhc_write_block(struct sdhc_s *sd, int index, lpaddr_t source)
         return err;
     }
 
-    struct cmd write_block = { .cmdidx    = MMC_CMD_WRITE_SINGLE_BLOCK,
+    struct cmd read_blocks = { .cmdidx    = MMC_CMD_READ_MULTIPLE_BLOCK,
                                .cmdarg    = index,
                                .resp_type = MMC_RSP_R1,
-                               .dma_base  = source
+                               .dma_base  = dest,
+                               .blocks    = count };
+    err = sdhc_send_cmd(sd, &read_blocks);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "read_blocks");
+        return err;
+    }
 
-    };
-    err = sdhc_send_cmd(sd, &write_block);
+    for (size_t i = 0; i < count; i++) {
+        err = update_cache(sd, index + i, dest_virtual + i * SDHC_BLOCK_SIZE, false);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    return SYS_ERR_OK;
+}
+
+errval_t sdhc_write_blocks(struct sdhc_s *sd, int index, size_t count, lpaddr_t source,
+                           lvaddr_t source_virtual)
+{
+    errval_t err;
+
+    if (count == 1) {
+        return sdhc_write_block(sd, index, source, source_virtual);
+    }
+    if (count == 0 || count > SDHC_MAX_BLOCKS_PER_TRANSFER) {
+        return SYS_ERR_INVALID_SIZE;
+    }
+
+    // Bulk writes go straight to the card, buffering them in the cache would
+    // only split them again into single block writes on eviction
+    struct cmd set_blocklen
+        = { .cmdidx = MMC_CMD_SET_BLOCKLEN, .cmdarg = SDHC_BLOCK_SIZE, .resp_type = MMC_RSP_R1 };
+    err = sdhc_send_cmd(sd, &set_blocklen);
     if (err_is_fail(err)) {
-        DEBUG_ERR(err, "read_block");
+        DEBUG_ERR(err, "set_blocklen");
         return err;
     }
 
-    err = invalidate_cache(sd, index);
-    if(err_is_fail(err)) {
+    struct cmd write_blocks = { .cmdidx    = MMC_CMD_WRITE_MULTIPLE_BLOCK,
+                                .cmdarg    = index,
+                                .resp_type = MMC_RSP_R1,
+                                .dma_base  = source,
+                                .blocks    = count };
+    err = sdhc_send_cmd(sd, &write_blocks);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "write_blocks");
+        return err;
+    }
+
+    // Cached copies (possibly dirty) are now older than the card
+    for (size_t i = 0; i < count; i++) {
+        size_t line;
+        if (err_is_fail(cache_lookup(sd->current_cache, index + i, &line))) {
+            continue;
+        }
+        if (source_virtual != 0) {
+            err = update_cache(sd, index + i, source_virtual + i * SDHC_BLOCK_SIZE, false);
+        } else {
+            err = invalidate_cache(sd, index + i);
+        }
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    return SYS_ERR_OK;
+}
+
+errval_t sdhc_start_transfer(struct sdhc_s *sd, bool is_write, int index, size_t count,
+                             lpaddr_t paddr, lvaddr_t vaddr)
+{
+    errval_t err;
+
+    if (sd->async.active) {
+        return SDHC_ERR_TRANSFER_PENDING;
+    }
+    if (count == 0 || count > SDHC_MAX_BLOCKS_PER_TRANSFER) {
+        return SYS_ERR_INVALID_SIZE;
+    }
+
+    // The block length sticks, so it only has to be set before the first transfer
+    if (!sd->blocklen_set) {
+        struct cmd set_blocklen
+            = { .cmdidx = MMC_CMD_SET_BLOCKLEN, .cmdarg = SDHC_BLOCK_SIZE, .resp_type = MMC_RSP_R1 };
+        err = sdhc_send_cmd(sd, &set_blocklen);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "set_blocklen");
+            return err;
+        }
+        sd->blocklen_set = true;
+    }
+
+    // The card must hold the latest version of the blocks we read
+    if (!is_write) {
+        for (size_t i = 0; i < count; i++) {
+            err = writeback_cache_entry(sd, index + i);
+            if (err_is_fail(err)) {
+                return err;
+            }
+        }
+    }
+
+    struct cmd *cmd = &sd->async.cmd;
+    memset(cmd, 0, sizeof(*cmd));
+    if (is_write) {
+        cmd->cmdidx = count > 1 ? MMC_CMD_WRITE_MULTIPLE_BLOCK : MMC_CMD_WRITE_SINGLE_BLOCK;
+    } else {
+        cmd->cmdidx = count > 1 ? MMC_CMD_READ_MULTIPLE_BLOCK : MMC_CMD_READ_SINGLE_BLOCK;
+    }
+    cmd->cmdarg    = index;
+    cmd->resp_type = MMC_RSP_R1;
+    cmd->dma_base  = paddr;
+    cmd->blocks    = count;
+
+    sd->async.active = true;
+    sd->async.index  = index;
+    sd->async.vaddr  = vaddr;
+
+    sdhc_wait_inhibit(sd, cmd);
+    sdhc_issue_cmd(sd, cmd, true);
+
+    return SYS_ERR_OK;
+}
+
+errval_t sdhc_poll_transfer(struct sdhc_s *sd, bool *done)
+{
+    errval_t err;
+    struct cmd *cmd = &sd->async.cmd;
+
+    *done = false;
+    if (!sd->async.active) {
+        return SYS_ERR_OK;
+    }
+
+    err = sdhc_check_cmd(sd, cmd, done);
+    if (err_is_ok(err) && !*done) {
+        return SYS_ERR_OK;
+    }
+
+    // The transfer is over, acknowledge it and mask the interrupt again
+    sdhc_int_signal_en_rawwr(&sd->dev, 0);
+    sdhc_int_status_rawwr(&sd->dev, ~0x0);
+    sd->async.active = false;
+    *done            = true;
+
+    if (err_is_fail(err)) {
         return err;
     }
+    sdhc_read_response(sd, cmd);
+
+    // Keep the cache coherent with what is now on the card
+    for (size_t i = 0; i < cmd->blocks; i++) {
+        int idx = sd->async.index + i;
+        if (sd->async.vaddr != 0) {
+            if (cmd_is_write(cmd)) {
+                size_t line;
+                if (err_is_fail(cache_lookup(sd->current_cache, idx, &line))) {
+                    continue;
+                }
+            }
+            err = update_cache(sd, idx, sd->async.vaddr + i * SDHC_BLOCK_SIZE, false);
+        } else if (cmd_is_write(cmd)) {
+            err = invalidate_cache(sd, idx);
+        }
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
 
     return SYS_ERR_OK;
 }
@@ -650,7 +1289,7 @@ errval_t sdhc_test(struct sdhc_s *sd, void *scratch, lpaddr_t scratch_p)
         ((char *)scratch)[i] = test_data[i];
     }
 
-    err = sdhc_write_block(sd, SDHC_TEST_BLOCK, scratch_p);
+    err = sdhc_write_block(sd, SDHC_TEST_BLOCK, scratch_p, 0);
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "write block");
         return err;
@@ -767,7 +1406,7 @@ errval_t sdhc_init(struct sdhc_s **sd_ret, void *base)
         return err;
     }
 
-    err = setup_cache(sd);
+    err = setup_cache(sd, SDHC_CACHE_DEFAULT_SETS, SDHC_CACHE_DEFAULT_WAYS);
     if(err_is_fail(err)) {
         return err;
     }
@@ -0,0 +1,676 @@
+#include <aos/aos.h>
+#include <aos/aos_rpc.h>
+#include <aos/simple_async_channel.h>
+#include <fs/fat32.h>
+
+// Size of the buffer holding the response to a request without bulk data
+#define FS_SERVER_RESPONSE_SIZE 1024
+// A request that was passed over this many times by the elevator is served next
+#define FS_SERVER_DEADLINE 8
+// Upper bound on the number of sectors fetched by one coalesced read
+#define FS_SERVER_MAX_COALESCE 128
+
+/*
+ * Requests are queued as they arrive from init and served once the channel has
+ * no more pending events. Requests that do not touch file data (open, stat,
+ * directory operations, ...) go first in arrival order. File reads and writes
+ * are then served by a one-way elevator over the first sector they touch,
+ * unless one of them has been passed over FS_SERVER_DEADLINE times already.
+ * Reads that continue each other on the disk are fetched with one transfer
+ * into the block cache before being served one after the other.
+ *
+ * The frames the clients share for the bulk requests on their handles are
+ * passed on by init and stay mapped here until the handle is closed. Bulk
+ * reads and writes go straight between the frame and the file.
+ */
+struct fs_request {
+    void                   *data;
+    size_t                  size;
+    // capability received with the request, or NULL_CAP
+    struct capref           cap;
+    struct simple_response *res;
+    // Sectors the request touches, nb_sectors is 0 if it does not access file data
+    uint32_t                lba;
+    uint32_t                nb_sectors;
+    size_t                  passed_over;
+    struct fs_request      *next;
+};
+
+// Frame shared by a client for the bulk requests on a handle
+struct fs_bulk_frame {
+    struct fat32_handle  *fat32_handle_addr;
+    struct capref         frame;
+    void                 *buf;
+    size_t                size;
+    struct fs_bulk_frame *next;
+};
+
+struct fs_server_state {
+    struct fat32_filesystem     *fs;
+    // channel used to communicate with the init process
+    struct simple_async_channel *async;
+    // pending requests, in arrival order
+    struct fs_request           *queue;
+    // sector following the last one accessed by the elevator
+    uint32_t                     head_lba;
+    // frames shared for the bulk requests
+    struct fs_bulk_frame        *bulk_frames;
+};
+
+static struct fs_server_state _fs_state;
+
+// Identifies the file of a handle for the page cache of init
+static uint64_t _file_id(const struct fat32_handle *handle)
+{
+    return ((uint64_t)handle->parent_cluster_number << 32) | handle->parent_cluster_offset;
+}
+
+// Read a page at offset, the position of the handle is left where it was
+static errval_t _read_page(struct fat32_filesystem *fs, struct fat32_handle *handle, size_t offset,
+                           void *buf, size_t *len)
+{
+    errval_t err;
+    *len = 0;
+
+    if (handle == NULL || handle->is_directory || offset % BASE_PAGE_SIZE != 0) {
+        return ERR_INVALID_ARGS;
+    }
+    if (offset >= handle->entry.file_size) {
+        return SYS_ERR_OK;
+    }
+
+    uint32_t position = handle->file_position;
+    err = fat32_file_seek(fs, handle, offset);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    err = fat32_read(fs, handle, buf, BASE_PAGE_SIZE, len);
+    errval_t seek_err = fat32_file_seek(fs, handle, position);
+    return err_is_fail(err) ? err : seek_err;
+}
+
+static struct fs_bulk_frame *_find_bulk_frame(struct fat32_handle *fat32_handle_addr)
+{
+    for (struct fs_bulk_frame *bulk = _fs_state.bulk_frames; bulk != NULL; bulk = bulk->next) {
+        if (bulk->fat32_handle_addr == fat32_handle_addr) {
+            return bulk;
+        }
+    }
+    return NULL;
+}
+
+static void _release_bulk_frame(struct fat32_handle *fat32_handle_addr)
+{
+    struct fs_bulk_frame **prev = &_fs_state.bulk_frames;
+    for (struct fs_bulk_frame *bulk = _fs_state.bulk_frames; bulk != NULL; bulk = bulk->next) {
+        if (bulk->fat32_handle_addr == fat32_handle_addr) {
+            *prev = bulk->next;
+            paging_unmap(get_current_paging_state(), bulk->buf);
+            cap_destroy(bulk->frame);
+            free(bulk);
+            return;
+        }
+        prev = &bulk->next;
+    }
+}
+
+// Maps the frame shared for the handle, which then belongs to the server
+static errval_t _share_frame(struct fat32_handle *fat32_handle_addr, struct capref frame_cap)
+{
+    errval_t err;
+
+    if (capref_is_null(frame_cap)) {
+        return ERR_INVALID_ARGS;
+    }
+
+    struct capability frame;
+    err = cap_direct_identify(frame_cap, &frame);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    if (frame.type != ObjType_Frame) {
+        return ERR_INVALID_ARGS;
+    }
+
+    struct fs_bulk_frame *bulk = malloc(sizeof(struct fs_bulk_frame));
+    if (bulk == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    bulk->fat32_handle_addr = fat32_handle_addr;
+    bulk->frame = frame_cap;
+    bulk->size = get_size(&frame);
+
+    err = paging_map_frame(get_current_paging_state(), &bulk->buf, bulk->size, bulk->frame);
+    if (err_is_fail(err)) {
+        free(bulk);
+        return err;
+    }
+
+    // A handle has at most one frame
+    _release_bulk_frame(fat32_handle_addr);
+    bulk->next = _fs_state.bulk_frames;
+    _fs_state.bulk_frames = bulk;
+
+    return SYS_ERR_OK;
+}
+
+static void _serve_request(struct fs_request *request)
+{
+    struct fat32_filesystem *fs = _fs_state.fs;
+    const struct aos_filesystem_request *req = request->data;
+    struct simple_response *simple_res = request->res;
+
+    struct aos_filesystem_response *res = calloc(1, FS_SERVER_RESPONSE_SIZE);
+    if (res == NULL) {
+        USER_PANIC("filesystem: out of memory for a response\n");
+    }
+    simple_res->send.data = res;
+    simple_res->send.size = sizeof(struct aos_filesystem_response);
+
+    if (req->request_type == AOS_RPC_FILESYSTEM_OPEN) {
+        // Request
+        const struct aos_filesystem_rpc_open_request *open_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_open_response *response = (struct aos_filesystem_rpc_open_response *) res;
+        // Operation
+        res->base.err = fat32_open(fs, open_request->path, &response->fat32_handle_addr);
+        if (err_is_ok(res->base.err)) {
+            response->file_id = _file_id(response->fat32_handle_addr);
+        }
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_open_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_READ) {
+        // Request
+        const struct aos_filesystem_rpc_read_request *read_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_read_response *response = (struct aos_filesystem_rpc_read_response *) res;
+        response->fat32_handle_addr = read_request->fat32_handle_addr;
+        // Operation
+        res->base.err = fat32_read(fs, read_request->fat32_handle_addr, &response->buffer,
+                                   MIN(read_request->len, sizeof(response->buffer)), &response->len);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_read_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_WRITE) {
+        // Request
+        const struct aos_filesystem_rpc_write_request *write_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_write_response *response = (struct aos_filesystem_rpc_write_response *) res;
+        response->fat32_handle_addr = write_request->fat32_handle_addr;
+        // Operation
+        res->base.err = fat32_write(fs, write_request->fat32_handle_addr, write_request->buffer,
+                                    MIN(write_request->len, sizeof(write_request->buffer)), &response->bytes_written);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_write_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_SEEK) {
+        // Request
+        const struct aos_filesystem_rpc_seek_request *seek_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_seek_response *response = (struct aos_filesystem_rpc_seek_response *) res;
+        response->fat32_handle_addr = seek_request->fat32_handle_addr;
+        // Operation
+        res->base.err = fat32_seek(fs, seek_request->fat32_handle_addr, seek_request->whence, seek_request->offset);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_seek_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_TELL) {
+        // Request
+        const struct aos_filesystem_rpc_tell_request *tell_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_tell_response *response = (struct aos_filesystem_rpc_tell_response *) res;
+        // Operation
+        res->base.err = fat32_tell(fs, tell_request->fat32_handle_addr, &response->position);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_tell_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_CLOSE) {
+        // Request
+        const struct aos_filesystem_rpc_close_request *close_request = request->data;
+        // Operation
+        _release_bulk_frame(close_request->fat32_handle_addr);
+        res->base.err = fat32_close(fs, close_request->fat32_handle_addr);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_close_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_DIR_OPEN) {
+        // Request
+        const struct aos_filesystem_rpc_dir_open_request *dir_open_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_dir_open_response *response = (struct aos_filesystem_rpc_dir_open_response *) res;
+        // Operation
+        res->base.err = fat32_open_directory(fs, dir_open_request->path, &response->fat32_handle_addr);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_dir_open_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_DIR_NEXT) {
+        // Request
+        const struct aos_filesystem_rpc_dir_next_request *dir_next_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_dir_next_response *response = (struct aos_filesystem_rpc_dir_next_response *) res;
+        // Operation
+        char *path = NULL;
+        res->base.err = fat32_read_next_directory(fs, dir_next_request->fat32_handle_addr, &path);
+        // Copy into response - No risk of overflow size < 11
+        if (path != NULL) {
+            memcpy(response->name, path, strlen(path) + 1);
+        }
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_dir_next_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_DIR_CLOSE) {
+        // Request
+        const struct aos_filesystem_rpc_dir_close_request *dir_close_request = request->data;
+        // Operation
+        res->base.err = fat32_close_directory(fs, dir_close_request->fat32_handle_addr);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_dir_close_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_MKDIR) {
+        // Request
+        const struct aos_filesystem_rpc_mkdir_request *mkdir_request = request->data;
+        // Operation
+        struct fat32_handle *handle;
+        res->base.err = fat32_mkdir(fs, mkdir_request->path, &handle);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_mkdir_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_RMDIR) {
+        // Request
+        const struct aos_filesystem_rpc_rmdir_request *rmdir_request = request->data;
+        // Operation
+        res->base.err = fat32_remove_directory(fs, rmdir_request->path);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_rmdir_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_MKFILE) {
+        // Request
+        const struct aos_filesystem_rpc_mkfile_request *mkfile_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_mkfile_response *response = (struct aos_filesystem_rpc_mkfile_response *) res;
+        // Operation
+        res->base.err = fat32_create(fs, mkfile_request->path, &response->fat32_handle_addr);
+        if (err_is_ok(res->base.err)) {
+            response->file_id = _file_id(response->fat32_handle_addr);
+        }
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_mkfile_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_RMFILE) {
+        // Request
+        const struct aos_filesystem_rpc_rmfile_request *rmfile_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_rmfile_response *response = (struct aos_filesystem_rpc_rmfile_response *) res;
+        // Operation - init drops the cached pages of the file
+        struct fat32_handle handle;
+        if (err_is_ok(fat32_resolve_path(fs, rmfile_request->path, &handle))) {
+            response->file_id = _file_id(&handle);
+        }
+        res->base.err = fat32_remove(fs, rmfile_request->path);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_rmfile_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_IS_DIRECTORY) {
+        // Request
+        const struct aos_filesystem_rpc_is_directory_request *is_directory_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_is_directory_response *response = (struct aos_filesystem_rpc_is_directory_response *) res;
+        // Operation
+        res->base.err = fat32_is_directory(fs, is_directory_request->path, &response->is_directory);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_is_directory_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_STAT) {
+        // Request
+        const struct aos_filesystem_rpc_stat_request *stat_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_stat_response *response = (struct aos_filesystem_rpc_stat_response *) res;
+        // Operation
+        res->base.err = fat32_stat(fs, stat_request->fat32_handle_addr, &response->file_info);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_stat_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_READ_PAGE) {
+        // Request
+        const struct aos_filesystem_rpc_read_page_request *read_page_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_read_page_response *response = calloc(1, sizeof(*response));
+        if (response == NULL) {
+            USER_PANIC("filesystem: out of memory for a response\n");
+        }
+        free(res);
+        simple_res->send.data = response;
+        // Operation
+        response->base.base.err = _read_page(fs, read_page_request->fat32_handle_addr, read_page_request->offset,
+                                             response->buffer, &response->len);
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_read_page_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_SHARE_FRAME) {
+        // Request
+        const struct aos_filesystem_rpc_share_frame_request *share_request = request->data;
+        // Operation - the frame is kept until the handle is closed
+        res->base.err = _share_frame(share_request->fat32_handle_addr, request->cap);
+        if (err_is_ok(res->base.err)) {
+            request->cap = NULL_CAP;
+        }
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_share_frame_response);
+
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_READ_BULK || req->request_type == AOS_RPC_FILESYSTEM_WRITE_BULK) {
+        // Request
+        const struct aos_filesystem_rpc_bulk_request *bulk_request = request->data;
+        // Response
+        struct aos_filesystem_rpc_bulk_response *response = (struct aos_filesystem_rpc_bulk_response *) res;
+        response->fat32_handle_addr = bulk_request->fat32_handle_addr;
+        // Operation - directly on the frame of the client
+        struct fs_bulk_frame *bulk = _find_bulk_frame(bulk_request->fat32_handle_addr);
+        if (bulk == NULL) {
+            res->base.err = FS_ERR_INVALID_FH;
+        } else if (bulk_request->offset > bulk->size || bulk_request->len > bulk->size - bulk_request->offset) {
+            res->base.err = SYS_ERR_INVALID_SIZE;
+        } else if (req->request_type == AOS_RPC_FILESYSTEM_READ_BULK) {
+            res->base.err = fat32_read(fs, bulk_request->fat32_handle_addr, bulk->buf + bulk_request->offset,
+                                       bulk_request->len, &response->len);
+        } else {
+            res->base.err = fat32_write(fs, bulk_request->fat32_handle_addr, bulk->buf + bulk_request->offset,
+                                        bulk_request->len, &response->len);
+        }
+        // Size of the response
+        simple_res->send.size = sizeof(struct aos_filesystem_rpc_bulk_response);
+
+    } else {
+        res->base.err = ERR_INVALID_ARGS;
+    }
+}
+
+// Compute the sectors a read or a write touches with the current position of its handle
+static void _locate_request(struct fs_request *request)
+{
+    struct fat32_filesystem *fs = _fs_state.fs;
+    const struct aos_filesystem_request *req = request->data;
+
+    request->lba = 0;
+    request->nb_sectors = 0;
+
+    struct fat32_handle *handle;
+    size_t len;
+    // Page reads do not use the position of the handle
+    bool at_position = true;
+    size_t page_offset = 0;
+    if (req->request_type == AOS_RPC_FILESYSTEM_READ || req->request_type == AOS_RPC_FILESYSTEM_WRITE) {
+        // The read and write requests start with the same fields
+        const struct aos_filesystem_rpc_read_request *rw_request = request->data;
+        handle = rw_request->fat32_handle_addr;
+        len = MIN(rw_request->len, AOS_FILESYSTEM_INLINE_SIZE);
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_READ_BULK || req->request_type == AOS_RPC_FILESYSTEM_WRITE_BULK) {
+        const struct aos_filesystem_rpc_bulk_request *bulk_request = request->data;
+        handle = bulk_request->fat32_handle_addr;
+        len = bulk_request->len;
+    } else if (req->request_type == AOS_RPC_FILESYSTEM_READ_PAGE) {
+        const struct aos_filesystem_rpc_read_page_request *read_page_request = request->data;
+        handle = read_page_request->fat32_handle_addr;
+        len = BASE_PAGE_SIZE;
+        at_position = false;
+        page_offset = read_page_request->offset;
+    } else {
+        return;
+    }
+
+    if (handle == NULL || handle->is_directory || len == 0) {
+        return;
+    }
+    size_t offset = at_position ? handle->file_position : page_offset;
+    if (offset >= handle->entry.file_size) {
+        return;
+    }
+
+    // Appends past the end of the file are placed by the allocator, only the data
+    // in the file so far has a known position
+    const uint32_t bytes_per_cluster = FAT_BLOCK_SIZE * fs->sectors_per_cluster;
+    uint32_t cluster_number;
+    uint32_t nb_contiguous;
+    errval_t err = fat32_handle_lookup_cluster(fs, handle, offset / bytes_per_cluster, &cluster_number,
+                                               &nb_contiguous);
+    if (err_is_fail(err)) {
+        return;
+    }
+
+    uint32_t sector_in_cluster = (offset % bytes_per_cluster) / FAT_BLOCK_SIZE;
+    size_t end = MIN(offset + len, handle->entry.file_size);
+    uint32_t nb_sectors = DIVIDE_ROUND_UP(end - ROUND_DOWN(offset, FAT_BLOCK_SIZE), FAT_BLOCK_SIZE);
+
+    request->lba = get_lba_from_cluster(fs, cluster_number) + sector_in_cluster;
+    request->nb_sectors = MIN(nb_sectors, nb_contiguous * fs->sectors_per_cluster - sector_in_cluster);
+}
+
+static bool _is_read(struct fs_request *request)
+{
+    const struct aos_filesystem_request *req = request->data;
+    return req->request_type == AOS_RPC_FILESYSTEM_READ || req->request_type == AOS_RPC_FILESYSTEM_READ_BULK
+           || req->request_type == AOS_RPC_FILESYSTEM_READ_PAGE;
+}
+
+static void _dequeue(struct fs_request *request)
+{
+    for (struct fs_request **prev = &_fs_state.queue; *prev != NULL; prev = &(*prev)->next) {
+        if (*prev == request) {
+            *prev = request->next;
+            request->next = NULL;
+            return;
+        }
+    }
+}
+
+static void _respond(struct fs_request *request)
+{
+    _serve_request(request);
+    simple_async_respond(_fs_state.async, request->res);
+    if (!capref_is_null(request->cap)) {
+        cap_destroy(request->cap);
+    }
+    free(request->data);
+    free(request);
+}
+
+static struct fs_request *_pick_next(void)
+{
+    struct fs_request *oldest_late = NULL;
+    struct fs_request *ahead = NULL;
+    struct fs_request *lowest = NULL;
+
+    for (struct fs_request *request = _fs_state.queue; request != NULL; request = request->next) {
+        if (request->nb_sectors == 0) {
+            // Requests without file data are served in arrival order
+            return request;
+        }
+        if (request->passed_over >= FS_SERVER_DEADLINE && oldest_late == NULL) {
+            oldest_late = request;
+        }
+        if (request->lba >= _fs_state.head_lba && (ahead == NULL || request->lba < ahead->lba)) {
+            ahead = request;
+        }
+        if (lowest == NULL || request->lba < lowest->lba) {
+            lowest = request;
+        }
+    }
+
+    if (oldest_late != NULL) {
+        return oldest_late;
+    }
+    // Wrap around to the lowest sector once nothing is left ahead of the head
+    return ahead != NULL ? ahead : lowest;
+}
+
+// Fetch the reads that follow the given one on the disk in one transfer. The
+// block cache then serves each of them.
+static void _coalesce_reads(struct fs_request *first, struct fs_request **run, size_t *run_len)
+{
+    run[0] = first;
+    *run_len = 1;
+
+    uint32_t start = first->lba;
+    uint32_t end = first->lba + first->nb_sectors;
+    bool extended = true;
+    while (extended) {
+        extended = false;
+        for (struct fs_request *request = _fs_state.queue; request != NULL; request = request->next) {
+            if (request->nb_sectors == 0 || !_is_read(request) || request->lba < start || request->lba > end) {
+                continue;
+            }
+            bool in_run = false;
+            for (size_t i = 0; i < *run_len; i++) {
+                in_run |= run[i] == request;
+            }
+            uint32_t new_end = MAX(end, request->lba + request->nb_sectors);
+            if (in_run || new_end - start > FS_SERVER_MAX_COALESCE || *run_len == FS_SERVER_MAX_COALESCE) {
+                continue;
+            }
+            run[(*run_len)++] = request;
+            end = new_end;
+            extended = true;
+        }
+    }
+
+    if (*run_len == 1) {
+        return;
+    }
+
+    // A failed prefetch only costs the separate transfers the reads do anyway
+    void *scratch = malloc((end - start) * FAT_BLOCK_SIZE);
+    if (scratch != NULL) {
+        errval_t err = read_blocks(_fs_state.fs->b_driver, start, end - start, scratch);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "filesystem: coalesced read failed");
+        }
+        free(scratch);
+    }
+}
+
+static void _serve_queue(void)
+{
+    struct fs_request *run[FS_SERVER_MAX_COALESCE];
+
+    while (_fs_state.queue != NULL) {
+        struct fs_request *next = _pick_next();
+        size_t run_len = 1;
+        run[0] = next;
+        if (next->nb_sectors > 0 && _is_read(next)) {
+            _coalesce_reads(next, run, &run_len);
+        }
+
+        uint32_t head_lba = _fs_state.head_lba;
+        for (size_t i = 0; i < run_len; i++) {
+            if (run[i]->nb_sectors > 0) {
+                head_lba = MAX(head_lba, run[i]->lba + run[i]->nb_sectors);
+            }
+            _dequeue(run[i]);
+            _respond(run[i]);
+        }
+        _fs_state.head_lba = head_lba;
+
+        // Serving a request moves the position of its handle
+        for (struct fs_request *request = _fs_state.queue; request != NULL; request = request->next) {
+            if (request->nb_sectors > 0) {
+                request->passed_over++;
+            }
+            _locate_request(request);
+        }
+    }
+}
+
+static void async_request_handler(struct simple_async_channel *chan, void *data, size_t size,
+                                  struct simple_response *res)
+{
+    struct fs_request *request = calloc(1, sizeof(struct fs_request));
+    if (request == NULL) {
+        USER_PANIC("filesystem: out of memory for a request\n");
+    }
+    // The receive buffer is reused for the next message
+    request->data = malloc(size);
+    if (request->data == NULL) {
+        USER_PANIC("filesystem: out of memory for a request\n");
+    }
+    memcpy(request->data, data, size);
+    request->size = size;
+    request->cap = simple_async_recv_cap(chan);
+    request->res = res;
+    _locate_request(request);
+
+    struct fs_request **tail = &_fs_state.queue;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = request;
+}
+
+static errval_t filesystem_register(errval_t mount_err)
+{
+    errval_t err;
+
+    struct aos_filesystem_rpc_server_init_request init_req;
+    init_req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
+    init_req.base.request_type = AOS_RPC_FILESYSTEM_SERVER_INIT;
+    init_req.err = mount_err;
+    err = aos_rpc_send_blocking(get_init_rpc(), &init_req, sizeof(init_req), NULL_CAP);
+    if (err_is_fail(err))
+        return err;
+    err = aos_rpc_recv_blocking(get_init_rpc(), NULL, 0, NULL, NULL);
+    if (err_is_fail(err))
+        return err;
+
+    return SYS_ERR_OK;
+}
+
+int main(int argc, char **argv)
+{
+    errval_t err;
+    (void)argc;
+    (void)argv;
+
+    err = simple_async_proc_setup(async_request_handler);
+    if (err_is_fail(err))
+        DEBUG_ERR(err, "Failed to initialize async channel");
+    _fs_state.async = aos_rpc_get_async_channel();
+
+    errval_t mount_err = mount_filesystem();
+    if (err_is_fail(mount_err))
+        DEBUG_ERR(mount_err, "Failed to mount the filesystem");
+
+    err = filesystem_register(mount_err);
+    if (err_is_fail(err))
+        DEBUG_ERR(err, "Failed to register with init");
+
+    if (err_is_fail(mount_err))
+        return EXIT_FAILURE;
+
+    _fs_state.fs = get_mounted_filesystem();
+
+#ifdef FILESYSTEM_BENCHMARK
+    benchmark_read(_fs_state.fs->b_driver, 500);
+    benchmark_write(_fs_state.fs->b_driver, 500);
+    benchmark_cache(_fs_state.fs->b_driver, 500);
+    benchmark_async(_fs_state.fs->b_driver, 500);
+#endif
+
+    struct waitset *ws = get_default_waitset();
+    while (true) {
+        err = event_dispatch(ws);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "in event_dispatch");
+            abort();
+        }
+        // Queue everything that arrived meanwhile so that the scheduler sees it
+        while (err_is_ok(check_for_event(ws))) {
+            err = event_dispatch(ws);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "in event_dispatch");
+                abort();
+            }
+        }
+        _serve_queue();
+    }
+
+    return 0;
+}
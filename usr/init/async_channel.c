@@ -31,26 +31,24 @@ static void async_prepare_send(struct async_channel *async)
         ident = async->responses.head->identifier;
     }
 
-    size_t msg_size = sizeof(struct async_message) + sizeof(struct cap_transfer) * send->capc
-                      + send->size;
-    struct async_message *msg = malloc(msg_size);
-    msg->identifier           = ident;
-    msg->type                 = async->current_sending;
-    msg->size                 = send->size;
-    msg->capc                 = send->capc;
-
-    for (size_t i = 0; i < send->capc; i++) {
-        cap_transfer_move(send->capv[i], (struct cap_transfer *)msg->data + i);
+    size_t                msg_size = sizeof(struct async_message) + send->size;
+    struct async_message *msg      = malloc(msg_size);
+    msg->identifier                = ident;
+    msg->type                      = async->current_sending;
+    msg->size                      = send->size;
+    memcpy(msg->data, send->data, send->size);
+
+    // the channel moves the capabilities to the other core along with the message
+    async->rpc->send_buf.data  = msg;
+    async->rpc->send_buf.size  = msg_size;
+    async->rpc->send_size      = msg_size;
+    async->rpc->send_buf.caps  = send->capv;
+    async->rpc->send_caps_size = send->capc;
+
+    errval_t err = aos_rpc_send(async->rpc);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "aos_rpc_send");
     }
-    void *data = msg->data + sizeof(struct cap_transfer) * msg->capc;
-    memcpy(data, send->data, send->size);
-
-
-    async->rpc->send_buf.data = msg;
-    async->rpc->send_buf.size = msg_size;
-    async->rpc->send_size     = msg_size;
-
-    aos_rpc_send(async->rpc);
 }
 
 static void async_handle_send(struct aos_rpc *rpc, void *arg)
@@ -89,37 +87,19 @@ static void free_finalizer(struct response *res)
 
 static void async_handle_recv(struct aos_rpc *rpc, void *arg)
 {
-    errval_t              err   = SYS_ERR_OK;
     struct async_channel *async = arg;
     struct async_message *msg   = rpc->recv_buf.data;
 
-    struct capref *capv = NULL;
-    if (msg->capc > 0) {
-        struct cap_transfer *transfers = (struct cap_transfer *)msg->data;
-        capv                          = malloc(sizeof(struct capref) * msg->capc);
-        for (size_t i = 0; i < msg->capc; i++) {
-            struct cap_transfer* transfer = &transfers[i];
-            if (!cap_transfer_is_valid(transfer)) {
-                capv[i] = NULL_CAP;
-                continue;
-            }
-            err = slot_alloc(&capv[i]);
-            if (err_is_fail(err)) {
-                USER_PANIC_ERR(err, "slot_alloc failed");
-            }
-            err = cap_from_transfer(transfer, capv[i]);
-            if (err_is_fail(err)) {
-                USER_PANIC_ERR(err, "cap_from_transfer failed");
-            }
-        }
-    }
-    void *data = msg->data + sizeof(struct cap_transfer) * msg->capc;
+    // the channel recreated the capabilities in fresh slots, the array is reused for the next message
+    struct capref *capv = rpc->recv_caps_size > 0 ? rpc->recv_buf.caps : NULL;
+    size_t         capc = rpc->recv_caps_size;
+    void          *data = msg->data;
 
     if (msg->type == ASYNC_RESPONSE) {
         // find request with matching identifier
         struct request *req = msg->identifier;
         // call callback
-        req->callback(req, data, msg->size, capv, msg->capc);
+        req->callback(req, data, msg->size, capv, capc);
         // free request
         free(req);
     } else if (msg->type == ASYNC_REQUEST) {
@@ -129,11 +109,10 @@ static void async_handle_recv(struct aos_rpc *rpc, void *arg)
         res->finalizer       = free_finalizer;
         res->next            = NULL;
         // call correct handler and give it ref to response
-        async->response_handler(async, data, msg->size, capv, msg->capc, res);
+        async->response_handler(async, data, msg->size, capv, capc, res);
     } else {
         USER_PANIC("Invalid async message type");
     }
-    free(capv);
     aos_rpc_recv(rpc);
 }
 
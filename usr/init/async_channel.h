@@ -16,7 +16,6 @@ struct async_message {
     struct request     *identifier;
     enum async_msg_type type;
     size_t              size;
-    size_t              capc;
     char                data[];
 };
 
@@ -134,3 +134,29 @@ errval_t cap_from_transfer(struct cap_transfer *transfer, struct capref cap)
 bool cap_transfer_is_valid(struct cap_transfer *transfer) {
     return transfer->valid;
 }
+
+static errval_t _cap_transfer_encode(struct capref cap, void *buf)
+{
+    return cap_transfer_move(cap, buf);
+}
+
+static errval_t _cap_transfer_decode(void *buf, struct capref *cap)
+{
+    struct cap_transfer *transfer = buf;
+    if (!cap_transfer_is_valid(transfer)) {
+        *cap = NULL_CAP;
+        return SYS_ERR_OK;
+    }
+
+    errval_t err = slot_alloc(cap);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_SLOT_ALLOC);
+    }
+    return cap_from_transfer(transfer, *cap);
+}
+
+const struct aos_rpc_cap_codec cap_transfer_codec = {
+    .size   = sizeof(struct cap_transfer),
+    .encode = _cap_transfer_encode,
+    .decode = _cap_transfer_decode,
+};
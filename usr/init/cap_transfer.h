@@ -2,6 +2,7 @@
 #define CAP_TRANSFER_H
 
 #include <aos/aos.h>
+#include <aos/aos_rpc.h>
 
 struct cap_transfer {
     struct capability cap;
@@ -16,4 +17,7 @@ errval_t cap_transfer_move(struct capref cap, struct cap_transfer *transfer);
 errval_t cap_from_transfer(struct cap_transfer *transfer, struct capref cap);
 bool     cap_transfer_is_valid(struct cap_transfer *transfer);
 
+// moves the capabilities sent over the UMP channel between the cores
+extern const struct aos_rpc_cap_codec cap_transfer_codec;
+
 #endif  // CAP_TRANSFER_H
\ No newline at end of file
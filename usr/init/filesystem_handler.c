@@ -0,0 +1,650 @@
+#include "filesystem_handler.h"
+
+#include <aos/aos.h>
+#include <aos/simple_async_channel.h>
+#include <spawn/spawn.h>
+
+#include "page_cache.h"
+#include "proc_mgmt.h"
+
+/*
+ * The FAT32 filesystem is served by its own domain, so that init does not
+ * stall on the card. Init forwards the filesystem requests of its clients to
+ * the server and sends the response back once the server has answered. The
+ * frames shared for the bulk requests are passed on to the server, which reads
+ * and writes them directly, so only offsets and lengths go through init.
+ *
+ * Init also keeps the page cache behind the file mappings: the pages of a file
+ * are read once from the server and every domain mapping them gets the same
+ * frame. It learns the file of each handle when the handle is opened, and drops
+ * the pages of a file once it was written to or removed.
+ */
+
+enum fs_server_state {
+    FS_SERVER_STARTING,
+    FS_SERVER_RUNNING,
+    FS_SERVER_FAILED,
+};
+
+static struct {
+    enum fs_server_state         state;
+    errval_t                     err;
+    domainid_t                   pid;
+    struct simple_async_channel *async;
+} fs_server;
+
+// File behind each handle opened through init
+struct fs_open_file {
+    struct fat32_handle *fat32_handle_addr;
+    uint64_t             file_id;
+    struct fs_open_file *next;
+};
+
+static struct fs_open_file *fs_open_files = NULL;
+
+// A request forwarded to the server
+struct fs_forward {
+    struct aos_rpc_handler_data handler;
+    // type of the request of the client
+    int                   request_type;
+    struct fat32_handle  *fat32_handle_addr;
+    // offset of the page to map
+    size_t                offset;
+    // capability sent along to the server, destroyed once it has answered
+    struct capref         cap;
+};
+
+errval_t filesystem_handler_init(void)
+{
+    errval_t err;
+
+    fs_server.state = FS_SERVER_STARTING;
+    err = proc_mgmt_spawn_with_cmdline("filesystem", 0, &fs_server.pid);
+    if (err_is_fail(err)) {
+        fs_server.state = FS_SERVER_FAILED;
+        return err;
+    }
+
+    // The server registers once it has mounted the card
+    struct waitset *ws = get_default_waitset();
+    while (fs_server.state == FS_SERVER_STARTING) {
+        err = event_dispatch(ws);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    return fs_server.err;
+}
+
+// The server maps the capability sent with a share request, it has to be a frame
+static errval_t _filesystem_check_frame(struct aos_rpc_handler_data *data)
+{
+    if (data->recv.caps_size != 1) {
+        return ERR_INVALID_ARGS;
+    }
+
+    struct capability frame;
+    errval_t err = cap_direct_identify(data->recv.caps[0], &frame);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    if (frame.type != ObjType_Frame) {
+        return ERR_INVALID_ARGS;
+    }
+    return SYS_ERR_OK;
+}
+
+static void _filesystem_track_file(struct fat32_handle *fat32_handle_addr, uint64_t file_id)
+{
+    struct fs_open_file *file = malloc(sizeof(struct fs_open_file));
+    if (file == NULL) {
+        // The handle cannot be mapped, its other requests still work
+        return;
+    }
+    file->fat32_handle_addr = fat32_handle_addr;
+    file->file_id = file_id;
+    file->next = fs_open_files;
+    fs_open_files = file;
+}
+
+static bool _filesystem_file_id(struct fat32_handle *fat32_handle_addr, uint64_t *file_id)
+{
+    for (struct fs_open_file *file = fs_open_files; file != NULL; file = file->next) {
+        if (file->fat32_handle_addr == fat32_handle_addr) {
+            *file_id = file->file_id;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _filesystem_forget_file(struct fat32_handle *fat32_handle_addr)
+{
+    struct fs_open_file **prev = &fs_open_files;
+    for (struct fs_open_file *file = fs_open_files; file != NULL; file = file->next) {
+        if (file->fat32_handle_addr == fat32_handle_addr) {
+            *prev = file->next;
+            free(file);
+            return;
+        }
+        prev = &file->next;
+    }
+}
+
+// Keeps the open files and the page cache up to date with a response of the server
+static void _filesystem_observe_response(struct fs_forward *forward, void *data, size_t size)
+{
+    uint64_t file_id;
+
+    switch (forward->request_type) {
+    case AOS_RPC_FILESYSTEM_OPEN: {
+        struct aos_filesystem_rpc_open_response *response = data;
+        if (size >= sizeof(*response) && err_is_ok(response->base.base.err)) {
+            _filesystem_track_file(response->fat32_handle_addr, response->file_id);
+        }
+        break;
+    }
+    case AOS_RPC_FILESYSTEM_MKFILE: {
+        struct aos_filesystem_rpc_mkfile_response *response = data;
+        if (size >= sizeof(*response) && err_is_ok(response->base.base.err)) {
+            _filesystem_track_file(response->fat32_handle_addr, response->file_id);
+        }
+        break;
+    }
+    case AOS_RPC_FILESYSTEM_RMFILE: {
+        struct aos_filesystem_rpc_rmfile_response *response = data;
+        if (size >= sizeof(*response) && err_is_ok(response->base.base.err)) {
+            page_cache_invalidate(response->file_id);
+        }
+        break;
+    }
+    case AOS_RPC_FILESYSTEM_WRITE:
+    case AOS_RPC_FILESYSTEM_WRITE_BULK:
+        // Even a failed write may have changed part of the file
+        if (_filesystem_file_id(forward->fat32_handle_addr, &file_id)) {
+            page_cache_invalidate(file_id);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Puts a page read by the server into a frame of the page cache, the frame stays owned by the cache
+static errval_t _filesystem_cache_page(uint64_t file_id, size_t offset, void *data, size_t size,
+                                       struct capref *frame, size_t *len)
+{
+    errval_t err;
+    struct aos_filesystem_rpc_read_page_response *read_res = data;
+
+    if (size < sizeof(*read_res)) {
+        return SYS_ERR_INVALID_SIZE;
+    }
+    if (err_is_fail(read_res->base.base.err)) {
+        return read_res->base.base.err;
+    }
+
+    err = frame_alloc(frame, BASE_PAGE_SIZE, NULL);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    void *buf;
+    err = paging_map_frame(get_current_paging_state(), &buf, BASE_PAGE_SIZE, *frame);
+    if (err_is_fail(err)) {
+        cap_destroy(*frame);
+        return err;
+    }
+    *len = MIN(read_res->len, BASE_PAGE_SIZE);
+    memcpy(buf, read_res->buffer, *len);
+    memset(buf + *len, 0, BASE_PAGE_SIZE - *len);
+    paging_unmap(get_current_paging_state(), buf);
+
+    err = page_cache_insert(file_id, offset, *frame, *len);
+    if (err_is_fail(err)) {
+        cap_destroy(*frame);
+        return err;
+    }
+
+    return SYS_ERR_OK;
+}
+
+// Hands the page read by the server to the client which asked to map it
+static void _filesystem_map_page_response(struct fs_forward *forward, void *data, size_t size)
+{
+    struct aos_rpc_handler_data *handler = &forward->handler;
+    struct aos_filesystem_rpc_map_page_response *res = handler->send.data;
+    *handler->send.datasize = sizeof(*res);
+    res->len = 0;
+
+    uint64_t file_id;
+    if (!_filesystem_file_id(forward->fat32_handle_addr, &file_id)) {
+        // The handle was closed meanwhile
+        res->base.base.err = FS_ERR_INVALID_FH;
+        return;
+    }
+
+    struct capref frame;
+    size_t len;
+    res->base.base.err = _filesystem_cache_page(file_id, forward->offset, data, size, &frame, &len);
+    if (err_is_fail(res->base.base.err)) {
+        return;
+    }
+
+    res->len = len;
+    handler->send.caps[0] = frame;
+    *handler->send.caps_size = 1;
+}
+
+// called when the server answers a forwarded request
+static void _filesystem_forward_response(struct simple_request *req, void *data, size_t size)
+{
+    struct fs_forward *forward = req->meta;
+    struct aos_rpc_handler_data *handler = &forward->handler;
+    free(req->send.data);
+    if (!capref_is_null(forward->cap)) {
+        cap_destroy(forward->cap);
+    }
+
+    if (forward->request_type == AOS_RPC_FILESYSTEM_MAP_PAGE) {
+        _filesystem_map_page_response(forward, data, size);
+        handler->resume_fn.handler(handler->resume_fn.arg);
+        free(forward);
+        return;
+    }
+    _filesystem_observe_response(forward, data, size);
+
+    memcpy(handler->send.data, data, MIN(size, handler->send.bufsize));
+    *handler->send.datasize = MIN(size, handler->send.bufsize);
+    handler->resume_fn.handler(handler->resume_fn.arg);
+    free(forward);
+}
+
+// Sends a request allocated for the server, it is freed once the server has answered
+static void _filesystem_forward(struct aos_rpc_handler_data *data, void *req, size_t size,
+                                struct capref cap, size_t offset)
+{
+    struct fs_forward *forward = malloc(sizeof(struct fs_forward));
+    if (forward == NULL) {
+        USER_PANIC("init: out of memory for a filesystem request\n");
+    }
+    const struct aos_filesystem_request *client_req = data->recv.data;
+    forward->handler = *data;
+    forward->request_type = client_req->request_type;
+    forward->fat32_handle_addr = NULL;
+    if (client_req->request_type == AOS_RPC_FILESYSTEM_WRITE) {
+        forward->fat32_handle_addr = ((const struct aos_filesystem_rpc_write_request *)client_req)->fat32_handle_addr;
+    } else if (client_req->request_type == AOS_RPC_FILESYSTEM_WRITE_BULK) {
+        forward->fat32_handle_addr = ((const struct aos_filesystem_rpc_bulk_request *)client_req)->fat32_handle_addr;
+    } else if (client_req->request_type == AOS_RPC_FILESYSTEM_MAP_PAGE) {
+        forward->fat32_handle_addr = ((const struct aos_filesystem_rpc_map_page_request *)client_req)->fat32_handle_addr;
+    }
+    forward->offset = offset;
+    forward->cap = cap;
+
+    simple_async_request_with_cap(fs_server.async, req, size, cap, _filesystem_forward_response, forward);
+}
+
+// Forwards the request of the client as it is. The request may wait in the queue of the
+// channel to the server while the receive buffer already holds the next message, so the
+// server gets a copy.
+static bool _filesystem_forward_copy(struct aos_rpc_handler_data *data, struct capref cap)
+{
+    void *req = malloc(data->recv.datasize);
+    if (req == NULL) {
+        struct aos_filesystem_response *res = data->send.data;
+        res->base.err = LIB_ERR_MALLOC_FAIL;
+        if (!capref_is_null(cap)) {
+            cap_destroy(cap);
+        }
+        return true;
+    }
+    memcpy(req, data->recv.data, data->recv.datasize);
+    _filesystem_forward(data, req, data->recv.datasize, cap, 0);
+    return false;
+}
+
+// Hands out the frame of a page from the page cache, which reads it from the server on a miss
+static bool _filesystem_map_page(struct aos_rpc_handler_data *data)
+{
+    const struct aos_filesystem_rpc_map_page_request *req = data->recv.data;
+    struct aos_filesystem_rpc_map_page_response *res = data->send.data;
+    *data->send.datasize = sizeof(struct aos_filesystem_rpc_map_page_response);
+    res->len = 0;
+
+    if (data->recv.datasize < sizeof(*req) || req->offset % BASE_PAGE_SIZE != 0) {
+        res->base.base.err = ERR_INVALID_ARGS;
+        return true;
+    }
+
+    uint64_t file_id;
+    if (!_filesystem_file_id(req->fat32_handle_addr, &file_id)) {
+        res->base.base.err = FS_ERR_INVALID_FH;
+        return true;
+    }
+
+    struct capref frame;
+    size_t len;
+    if (page_cache_lookup(file_id, req->offset, &frame, &len)) {
+        res->base.base.err = SYS_ERR_OK;
+        res->len = len;
+        data->send.caps[0] = frame;
+        *data->send.caps_size = 1;
+        return true;
+    }
+
+    struct aos_filesystem_rpc_read_page_request *read_req = malloc(sizeof(*read_req));
+    if (read_req == NULL) {
+        res->base.base.err = LIB_ERR_MALLOC_FAIL;
+        return true;
+    }
+    read_req->base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
+    read_req->base.request_type = AOS_RPC_FILESYSTEM_READ_PAGE;
+    read_req->fat32_handle_addr = req->fat32_handle_addr;
+    read_req->offset = req->offset;
+    _filesystem_forward(data, read_req, sizeof(*read_req), NULL_CAP, req->offset);
+    return false;
+}
+
+bool filesystem_handle_rpc_request(struct aos_rpc_handler_data *data)
+{
+    const struct aos_filesystem_request *req = data->recv.data;
+    struct aos_filesystem_response *res = data->send.data;
+
+    *data->send.datasize = sizeof(struct aos_filesystem_response);
+
+    if (req->request_type == AOS_RPC_FILESYSTEM_SERVER_INIT) {
+        const struct aos_filesystem_rpc_server_init_request *init_req = data->recv.data;
+        assert(data->spawninfo != NULL);
+        fs_server.async = &data->spawninfo->async;
+        fs_server.err = init_req->err;
+        fs_server.state = err_is_ok(init_req->err) ? FS_SERVER_RUNNING : FS_SERVER_FAILED;
+        res->base.err = SYS_ERR_OK;
+        return true;
+    }
+
+    if (fs_server.state != FS_SERVER_RUNNING) {
+        res->base.err = FS_ERR_SERVER_NOT_RUNNING;
+        return true;
+    }
+
+    switch (req->request_type) {
+    case AOS_RPC_FILESYSTEM_SHARE_FRAME:
+        // The server maps the frame and serves the bulk requests of the handle with it
+        res->base.err = _filesystem_check_frame(data);
+        if (err_is_fail(res->base.err)) {
+            for (size_t i = 0; i < data->recv.caps_size; i++) {
+                cap_destroy(data->recv.caps[i]);
+            }
+            *data->send.datasize = sizeof(struct aos_filesystem_rpc_share_frame_response);
+            return true;
+        }
+        return _filesystem_forward_copy(data, data->recv.caps[0]);
+
+    case AOS_RPC_FILESYSTEM_MAP_PAGE:
+        return _filesystem_map_page(data);
+
+    case AOS_RPC_FILESYSTEM_READ_PAGE:
+        // Only init reads pages for the page cache
+        res->base.err = ERR_INVALID_ARGS;
+        return true;
+
+    case AOS_RPC_FILESYSTEM_CLOSE: {
+        const struct aos_filesystem_rpc_close_request *close_request = data->recv.data;
+        _filesystem_forget_file(close_request->fat32_handle_addr);
+        return _filesystem_forward_copy(data, NULL_CAP);
+    }
+
+    default:
+        return _filesystem_forward_copy(data, NULL_CAP);
+    }
+}
+
+struct fs_sync_call {
+    bool   done;
+    void  *res;
+    size_t size;
+};
+
+static void _filesystem_sync_call_done(struct simple_request *req, void *data, size_t size)
+{
+    struct fs_sync_call *call = req->meta;
+    call->res = malloc(size);
+    if (call->res != NULL) {
+        memcpy(call->res, data, size);
+    }
+    call->size = size;
+    call->done = true;
+}
+
+// Sends a request to the server and waits for the response. Init keeps serving
+// its other channels meanwhile.
+static errval_t _filesystem_sync_call(void *req, size_t size, size_t res_size, void **res)
+{
+    struct fs_sync_call call = { .done = false, .res = NULL, .size = 0 };
+    simple_async_request(fs_server.async, req, size, _filesystem_sync_call_done, &call);
+
+    while (!call.done) {
+        errval_t err = event_dispatch(get_default_waitset());
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "in event_dispatch");
+            abort();
+        }
+    }
+
+    if (call.res == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    if (call.size < res_size) {
+        free(call.res);
+        return SYS_ERR_INVALID_SIZE;
+    }
+
+    *res = call.res;
+    errval_t err = ((struct aos_filesystem_response *)call.res)->base.err;
+    if (err_is_fail(err)) {
+        free(call.res);
+    }
+    return err;
+}
+
+// A page of a file mapped by init which is read from the server
+struct fs_page_read {
+    struct aos_filesystem_rpc_read_page_request req;
+    struct filesystem_mapping                  *mapping;
+    uint64_t                                    file_id;
+    size_t                                      index;
+    // pages still being read, and the first error, shared by the reads of a mapping
+    size_t                                     *pending;
+    errval_t                                   *err;
+};
+
+static void _filesystem_page_read_done(struct simple_request *req, void *data, size_t size)
+{
+    struct fs_page_read *read = req->meta;
+
+    struct capref frame;
+    size_t len;
+    errval_t err = _filesystem_cache_page(read->file_id, read->req.offset, data, size, &frame, &len);
+    if (err_is_ok(err)) {
+        // the mapping keeps its own copy, the cache may drop its one
+        struct capref copy;
+        err = slot_alloc(&copy);
+        if (err_is_ok(err)) {
+            err = cap_copy(copy, frame);
+        }
+        if (err_is_ok(err)) {
+            read->mapping->pages[read->index] = copy;
+        }
+    }
+    if (err_is_fail(err) && err_is_ok(*read->err)) {
+        *read->err = err;
+    }
+    (*read->pending)--;
+}
+
+// provides the pages of a file mapped by init, which were all read beforehand
+static errval_t _filesystem_mapping_fill(void *arg, size_t offset, struct capref *frame)
+{
+    struct filesystem_mapping *m = arg;
+    errval_t err = slot_alloc(frame);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    return cap_copy(*frame, m->pages[offset / BASE_PAGE_SIZE]);
+}
+
+// Takes the pages of the file from the page cache, and reads the other ones. All
+// the missing pages are requested at once so that the server can merge the reads.
+static errval_t _filesystem_load_pages(struct filesystem_mapping *m, struct fat32_handle *handle,
+                                       uint64_t file_id)
+{
+    errval_t err = SYS_ERR_OK;
+
+    struct fs_page_read *reads = calloc(m->nb_pages, sizeof(struct fs_page_read));
+    if (reads == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    size_t pending = 0;
+    for (size_t i = 0; i < m->nb_pages && err_is_ok(err); i++) {
+        struct capref frame;
+        size_t len;
+        if (page_cache_lookup(file_id, i * BASE_PAGE_SIZE, &frame, &len)) {
+            err = slot_alloc(&m->pages[i]);
+            if (err_is_ok(err)) {
+                err = cap_copy(m->pages[i], frame);
+            }
+            continue;
+        }
+
+        struct fs_page_read *read = &reads[i];
+        read->req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
+        read->req.base.request_type = AOS_RPC_FILESYSTEM_READ_PAGE;
+        read->req.fat32_handle_addr = handle;
+        read->req.offset = i * BASE_PAGE_SIZE;
+        read->mapping = m;
+        read->file_id = file_id;
+        read->index = i;
+        read->pending = &pending;
+        read->err = &err;
+        pending++;
+        simple_async_request(fs_server.async, &read->req, sizeof(read->req),
+                             _filesystem_page_read_done, read);
+    }
+
+    // the requests must stay around until they are answered
+    while (pending > 0) {
+        errval_t dispatch_err = event_dispatch(get_default_waitset());
+        if (err_is_fail(dispatch_err)) {
+            DEBUG_ERR(dispatch_err, "in event_dispatch");
+            abort();
+        }
+    }
+
+    free(reads);
+    return err;
+}
+
+void filesystem_unmap_file(struct filesystem_mapping *m)
+{
+    if (m->buf != NULL) {
+        paging_unmap(get_current_paging_state(), m->buf);
+    }
+    for (size_t i = 0; i < m->nb_pages; i++) {
+        if (!capref_is_null(m->pages[i])) {
+            cap_destroy(m->pages[i]);
+        }
+    }
+    free(m->pages);
+    free(m);
+}
+
+errval_t filesystem_map_file(const char *path, struct filesystem_mapping **mapping)
+{
+    errval_t err;
+
+    if (fs_server.state != FS_SERVER_RUNNING) {
+        return FS_ERR_SERVER_NOT_RUNNING;
+    }
+
+    struct aos_filesystem_rpc_open_request open_req;
+    open_req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
+    open_req.base.request_type = AOS_RPC_FILESYSTEM_OPEN;
+    if (strlen(path) >= sizeof(open_req.path)) {
+        return ERR_INVALID_ARGS;
+    }
+    strcpy(open_req.path, path);
+
+    struct aos_filesystem_rpc_open_response *open_res;
+    err = _filesystem_sync_call(&open_req, sizeof(open_req), sizeof(*open_res), (void **)&open_res);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    struct fat32_handle *handle = open_res->fat32_handle_addr;
+    uint64_t file_id = open_res->file_id;
+    free(open_res);
+
+    struct filesystem_mapping *m = calloc(1, sizeof(struct filesystem_mapping));
+    if (m == NULL) {
+        err = LIB_ERR_MALLOC_FAIL;
+    }
+
+    struct aos_filesystem_rpc_stat_request stat_req;
+    stat_req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
+    stat_req.base.request_type = AOS_RPC_FILESYSTEM_STAT;
+    stat_req.fat32_handle_addr = handle;
+
+    struct aos_filesystem_rpc_stat_response *stat_res;
+    if (err_is_ok(err)) {
+        err = _filesystem_sync_call(&stat_req, sizeof(stat_req), sizeof(*stat_res),
+                                    (void **)&stat_res);
+    }
+    if (err_is_ok(err)) {
+        m->size = stat_res->file_info.size;
+        m->nb_pages = DIVIDE_ROUND_UP(m->size, BASE_PAGE_SIZE);
+        free(stat_res);
+
+        if (m->nb_pages == 0) {
+            err = SPAWN_ERR_ELF_MAP;
+        } else {
+            // calloc leaves the capabilities at NULL_CAP
+            m->pages = calloc(m->nb_pages, sizeof(struct capref));
+            err = m->pages == NULL ? LIB_ERR_MALLOC_FAIL
+                                   : _filesystem_load_pages(m, handle, file_id);
+        }
+    }
+
+    struct aos_filesystem_rpc_close_request close_req;
+    close_req.base.base.type = AOS_RPC_REQUEST_TYPE_FILESYSTEM;
+    close_req.base.request_type = AOS_RPC_FILESYSTEM_CLOSE;
+    close_req.fat32_handle_addr = handle;
+
+    struct aos_filesystem_rpc_close_response *close_res;
+    errval_t close_err = _filesystem_sync_call(&close_req, sizeof(close_req), sizeof(*close_res),
+                                               (void **)&close_res);
+    if (err_is_ok(close_err)) {
+        free(close_res);
+    } else if (err_is_ok(err)) {
+        err = close_err;
+    }
+
+    // init only touches the pages it reads, e.g. the headers and the writable segments
+    if (err_is_ok(err)) {
+        err = paging_map_pager(get_current_paging_state(), &m->buf, m->nb_pages * BASE_PAGE_SIZE,
+                               VREGION_FLAGS_READ, _filesystem_mapping_fill, m);
+        if (err_is_fail(err)) {
+            m->buf = NULL;
+        }
+    }
+    if (err_is_fail(err)) {
+        if (m != NULL) {
+            filesystem_unmap_file(m);
+        }
+        return err;
+    }
+
+    *mapping = m;
+    return SYS_ERR_OK;
+}
@@ -0,0 +1,28 @@
+#ifndef _INIT_FILESYSTEM_HANDLER_H_
+#define _INIT_FILESYSTEM_HANDLER_H_
+
+#include <aos/aos.h>
+#include <aos/aos_rpc.h>
+
+// to be called from main, spawns the filesystem server and waits until it has mounted the card
+errval_t filesystem_handler_init(void);
+
+// handles a filesystem request on core 0, returns true if the response can be sent right away
+bool filesystem_handle_rpc_request(struct aos_rpc_handler_data *data);
+
+// A file mapped read-only in init, whose pages are shared with the page cache
+struct filesystem_mapping {
+    void          *buf;
+    size_t         size;
+    // frame of each page of the file
+    struct capref *pages;
+    size_t         nb_pages;
+};
+
+// maps a whole file through the page cache, used to spawn programs from the card
+errval_t filesystem_map_file(const char *path, struct filesystem_mapping **mapping);
+
+// releases a file mapped with filesystem_map_file, the spawned domains keep their pages
+void filesystem_unmap_file(struct filesystem_mapping *mapping);
+
+#endif
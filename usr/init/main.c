@@ -44,11 +44,10 @@
 #include "distops/deletestep.h"
 #include "distcap_handler.h"
 #include "network_handler.h"
+#include "filesystem_handler.h"
 
 #include "../shell/serial/serial.h"
 
-#include <fs/fat32.h>
-
 struct bootinfo *bi;
 
 coreid_t             my_core_id;
@@ -137,7 +136,7 @@ static int bsp_main(int argc, char *argv[]) {
     struct capref  remote_core_urpc_frame;
     struct aos_rpc remote_core_rpc;
 
-    err = frame_alloc(&remote_core_urpc_frame, BASE_PAGE_SIZE, NULL);
+    err = frame_alloc(&remote_core_urpc_frame, UMP_CHAN_DEFAULT_FRAME_SIZE, NULL);
     if (err_is_fail(err)) {
         USER_PANIC_ERR(err, "unable to allocate frame for remote core URPC");
     }
@@ -145,14 +144,22 @@ static int bsp_main(int argc, char *argv[]) {
     if (err_is_fail(err)) {
         USER_PANIC_ERR(err, "unable to connect to remote core URPC");
     }
+    aos_rpc_ump_set_cap_codec(&remote_core_rpc, &cap_transfer_codec);
+    // the second core gets core id 1
+    aos_rpc_ump_set_doorbell(&remote_core_rpc, 1);
 
 
-    // allocate 512 mb of ram for the remote core (may want to change this later)
+    // the remote core requests more memory in batches once it runs low
     struct capref remote_core_ram_cap;
-    err = ram_alloc(&remote_core_ram_cap, 512 * 1024 * 1024);
+    err = ram_alloc(&remote_core_ram_cap, MEM_CORE_BOOT_SIZE);
     if (err_is_fail(err)) {
         USER_PANIC_ERR(err, "unable to allocate ram for remote core");
     }
+    // the memory is sent by address, it must leave the zero pool of this core first
+    err = mem_alloc_grant(remote_core_ram_cap);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "unable to grant ram to remote core");
+    }
 
     switch (platform_info.platform) {
     case PI_PLATFORM_IMX8X: {
@@ -247,13 +254,22 @@ static int bsp_main(int argc, char *argv[]) {
     //async_request(&async, (void*)data, sizeof(data), print_callback, NULL);
 
     barrelfish_usleep(250000);
+
+    struct waitset *default_ws = get_default_waitset();
+    delete_steps_init(default_ws);
+    caplock_init(default_ws);
+    err = distcap_init();
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "distcap_init");
+    }
+
     if(platform_info.platform == PI_PLATFORM_IMX8X) {
 
 #define SD_CARD_BOARD
 #ifdef SD_CARD_BOARD
-        err = mount_filesystem();
+        err = filesystem_handler_init();
         if (err_is_fail(err)) {
-            USER_PANIC_ERR(err, "Failed to mount the filesystem driver\n");
+            USER_PANIC_ERR(err, "Failed to start the filesystem server\n");
         }
 #endif
 
@@ -262,8 +278,6 @@ static int bsp_main(int argc, char *argv[]) {
 
         assert(err_is_ok(proc_mgmt_spawn_program("/SDCARD/HELLOFAT arg1 arg2 arg3", 0, &fs_test_pid)));
 
-        struct waitset *default_ws = get_default_waitset();
-        delete_steps_init(default_ws);
         while (true) {
             err = event_dispatch(default_ws);
             if (err_is_fail(err)) {
@@ -277,8 +291,6 @@ static int bsp_main(int argc, char *argv[]) {
         domainid_t fs_test_pid;
         err = proc_mgmt_spawn_program("filereader", /*core*/ 0, &fs_test_pid);
 
-        struct waitset *default_ws = get_default_waitset();
-        delete_steps_init(default_ws);
         while (true) {
             err = event_dispatch(default_ws);
             if (err_is_fail(err)) {
@@ -287,20 +299,6 @@ static int bsp_main(int argc, char *argv[]) {
             }
         }
 #endif
-
-
-#ifdef FILESYSTEM_BENCHMARK
-        benchmark_read(get_mounted_filesystem()->b_driver, 500);
-        benchmark_write(get_mounted_filesystem()->b_driver, 500);
-#endif
-    }
-
-    struct waitset *default_ws = get_default_waitset();
-    delete_steps_init(default_ws);
-    caplock_init(default_ws);
-    err = distcap_init();
-    if (err_is_fail(err)) {
-        USER_PANIC_ERR(err, "distcap_init");
     }
 
     domainid_t shell_pid;
@@ -352,6 +350,8 @@ static int app_main(int argc, char *argv[])
     if (err_is_fail(err)) {
         USER_PANIC_ERR(err, "unable to connect to BSP core URPC");
     }
+    aos_rpc_ump_set_cap_codec(&bsp_core_rpc, &cap_transfer_codec);
+    aos_rpc_ump_set_doorbell(&bsp_core_rpc, 0);
 
     ////////////////////
     // Bootinfo Setup //
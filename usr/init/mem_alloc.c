@@ -11,7 +11,14 @@
 #include "mem_alloc.h"
 #include <mm/mm.h>
 #include <aos/paging.h>
+#include <aos/aos_rpc_types.h>
+#include <aos/kernel_cap_invocations.h>
 #include <grading/grading.h>
+#include <barrelfish_kpi/distcaps.h>
+
+#include "async_channel.h"
+#include "rpc_handler.h"
+#include "distops/invocations.h"
 
 /// MM allocator instance data
 static struct mm aos_mm;
@@ -19,6 +26,29 @@ static struct mm aos_mm;
 /// slot allocator instance used by MM
 static struct slot_prealloc init_slot_alloc;
 
+struct mem_refill_waiter {
+    void (*done)(void *arg);
+    void                     *arg;
+    struct mem_refill_waiter *next;
+};
+
+struct mem_batch {
+    genpaddr_t        base;
+    struct mem_batch *next;
+};
+
+struct mem_return {
+    struct aos_memserver_return_rpc_request req;
+    struct capref                           cap;
+};
+
+/// batches obtained from the BSP core, and the allocations waiting for the next one
+static struct {
+    bool                      pending;
+    struct mem_refill_waiter *waiters;
+    struct mem_batch         *batches;
+} mem_refill;
+
 /**
  * @brief wrapper around the slot allocator refill function
  *
@@ -33,6 +63,23 @@ static errval_t mm_slot_alloc_refill(struct slot_allocator *ca)
 }
 
 
+/**
+ * @brief hands free memory to the CPU driver to be zeroed while the core is idle
+ *
+ * @param cap  RAM capability to the memory
+ *
+ * The CPU driver refuses memory that is in use or owned by another core. Such memory
+ * is simply zeroed when it gets retyped, hence the refusal is not an error.
+ */
+static void mem_zero_pool_add(struct capref cap)
+{
+    errval_t err = invoke_kernel_zero_pool_add(cap);
+    if (err_no(err) == SYS_ERR_ZERO_POOL_FULL) {
+        DEBUG_ERR(err, "donating free memory to the zero pool");
+    }
+}
+
+
 /**
  * @brief initializes the ram allocator (MM)
  *
@@ -120,6 +167,8 @@ errval_t initialize_ram_alloc(struct bootinfo *bi)
             if (err_is_fail(err)) {
                 DEBUG_ERR(err, "Warning: adding RAM region %d (%p/%zu) FAILED", i,
                           bi->regions[i].mr_base, bi->regions[i].mr_bytes);
+            } else {
+                mem_zero_pool_add(mem_cap);
             }
 
             mem_cap.slot++;
@@ -212,6 +261,8 @@ errval_t initialize_ram_alloc_range(struct bootinfo *bi, genpaddr_t ram_base, ge
             if (err_is_fail(err)) {
                 DEBUG_ERR(err, "Warning: adding RAM region %d (%p/%zu) FAILED", i,
                           bi->regions[i].mr_base, bi->regions[i].mr_bytes);
+            } else {
+                mem_zero_pool_add(ram_range);
             }
 
             mem_cap.slot++;
@@ -252,7 +303,147 @@ errval_t aos_ram_alloc_aligned(struct capref *cap, size_t size, size_t alignment
  */
 errval_t aos_ram_free(struct capref cap)
 {
+    // before the allocator possibly merges and deletes the capability
+    mem_zero_pool_add(cap);
     return mm_free(&aos_mm, cap);
 }
 
 
+/**
+ * @brief marks memory as given to another core that forges its own capability for it
+ *
+ * @param cap  RAM capability to the memory, stays with this core
+ *
+ * @return SYS_ERR_OK on success, or error value on failure
+ *
+ * The capability counts as having a copy on the other core. The CPU driver of this core
+ * stops zeroing the memory while idle and refuses to take it into its zero pool again.
+ */
+errval_t mem_alloc_grant(struct capref cap)
+{
+    uint8_t relations;
+    return monitor_remote_relations(cap, RRELS_COPY_BIT, RRELS_COPY_BIT, &relations);
+}
+
+
+static void _mem_refill_response(struct request *req, void *data, size_t size,
+                                 struct capref *capv, size_t capc)
+{
+    free(req->send.data);
+
+    struct aos_memserver_rpc_response *res = data;
+    errval_t err = size < sizeof(*res) ? SYS_ERR_INVALID_SIZE : res->base.err;
+    if (err_is_ok(err) && capc != 1) {
+        err = MM_ERR_CAP_INVALID;
+    }
+
+    struct capability c;
+    if (err_is_ok(err)) {
+        err = cap_direct_identify(capv[0], &c);
+    }
+    if (err_is_ok(err)) {
+        err = mm_add(&aos_mm, capv[0]);
+    }
+    if (err_is_ok(err)) {
+        struct mem_batch *batch = malloc(sizeof(struct mem_batch));
+        batch->base             = c.u.ram.base;
+        batch->next             = mem_refill.batches;
+        mem_refill.batches      = batch;
+    } else {
+        DEBUG_ERR(err, "requesting memory from the BSP core");
+    }
+
+    mem_refill.pending = false;
+
+    struct mem_refill_waiter *waiter = mem_refill.waiters;
+    mem_refill.waiters               = NULL;
+    while (waiter != NULL) {
+        struct mem_refill_waiter *next = waiter->next;
+        waiter->done(waiter->arg);
+        free(waiter);
+        waiter = next;
+    }
+}
+
+void mem_alloc_refill(size_t size, void (*done)(void *arg), void *arg)
+{
+    assert(disp_get_core_id() != 0);
+
+    if (done != NULL) {
+        struct mem_refill_waiter *waiter = malloc(sizeof(struct mem_refill_waiter));
+        waiter->done                     = done;
+        waiter->arg                      = arg;
+        waiter->next                     = mem_refill.waiters;
+        mem_refill.waiters               = waiter;
+    }
+
+    if (mem_refill.pending) {
+        return;
+    }
+    mem_refill.pending = true;
+
+    struct aos_memserver_rpc_request *req = malloc(sizeof(struct aos_memserver_rpc_request));
+    req->base.type = AOS_RPC_REQUEST_TYPE_MEMSERVER;
+    req->size      = MAX(ROUND_UP(size, MEM_REFILL_BATCH), MEM_REFILL_BATCH);
+    req->alignment = BASE_PAGE_SIZE;
+    async_request(get_cross_core_channel(), req, sizeof(*req), NULL, 0, _mem_refill_response,
+                  NULL);
+}
+
+static void _mem_return_response(struct request *req, void *data, size_t size,
+                                 struct capref *capv, size_t capc)
+{
+    (void)capv;
+    (void)capc;
+    struct mem_return *ret = req->send.data;
+
+    struct aos_memserver_return_rpc_response *res = data;
+    errval_t err = size < sizeof(*res) ? SYS_ERR_INVALID_SIZE : res->base.err;
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "returning memory to the BSP core");
+    }
+
+    // the BSP core owns the memory again, whether or not it managed to free it. Sending
+    // the cap moved it out of the slot already, so only the slot is left to free
+    err = slot_free(ret->cap);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "freeing the slot of returned memory");
+    }
+    free(ret);
+}
+
+errval_t mem_alloc_balance(void)
+{
+    if (disp_get_core_id() == 0 || get_cross_core_channel() == NULL) {
+        return SYS_ERR_OK;
+    }
+
+    if (mm_mem_available(&aos_mm) < MEM_REFILL_LOW) {
+        mem_alloc_refill(0, NULL, NULL);
+        return SYS_ERR_OK;
+    }
+
+    // only batches without any allocation left in them can be handed back
+    struct mem_batch **batch = &mem_refill.batches;
+    while (*batch != NULL && mm_mem_available(&aos_mm) > MEM_RETURN_HIGH) {
+        struct mem_return *ret = malloc(sizeof(struct mem_return));
+        if (ret == NULL) {
+            return LIB_ERR_MALLOC_FAIL;
+        }
+        errval_t err = mm_remove(&aos_mm, (*batch)->base, &ret->cap);
+        if (err_is_fail(err)) {
+            free(ret);
+            batch = &(*batch)->next;
+            continue;
+        }
+
+        ret->req.base.type = AOS_RPC_REQUEST_TYPE_MEMSERVER_RETURN;
+        async_request(get_cross_core_channel(), ret, sizeof(ret->req), &ret->cap, 1,
+                      _mem_return_response, NULL);
+
+        struct mem_batch *returned = *batch;
+        *batch                     = returned->next;
+        free(returned);
+    }
+    return SYS_ERR_OK;
+}
@@ -18,6 +18,21 @@
 #include <stdio.h>
 #include <aos/aos.h>
 
+/*
+ * The BSP core owns all physical memory. The other cores start out with a chunk of
+ * it and request more in batches once they run low, handing batches back once they
+ * have too much of it, so that the domains on every core are served locally.
+ */
+
+/// memory the BSP core hands to another core at boot
+#define MEM_CORE_BOOT_SIZE (128 * 1024 * 1024)
+/// memory another core requests from the BSP core at once
+#define MEM_REFILL_BATCH (32 * 1024 * 1024)
+/// another core requests a batch once it has less memory available than this
+#define MEM_REFILL_LOW (16 * 1024 * 1024)
+/// and hands unused batches back once it has more than this
+#define MEM_RETURN_HIGH (4 * MEM_REFILL_BATCH)
+
 
 /**
  * @brief initializes the local memory allocator, adding memory from the bootinfo
@@ -76,6 +91,35 @@ static inline errval_t aos_ram_alloc(struct capref *cap, size_t size)
  */
 errval_t aos_ram_free(struct capref cap);
 
+/**
+ * @brief marks memory as given to another core that forges its own capability for it
+ *
+ * @param cap  RAM capability to the memory, stays with this core
+ *
+ * @return SYS_ERR_OK on success, or error value on failure
+ */
+errval_t mem_alloc_grant(struct capref cap);
+
+/**
+ * @brief requests a batch of memory from the BSP core
+ *
+ * @param[in] size  size of the allocation that failed, the batch is at least as large
+ * @param[in] done  called once the batch was added or the request failed, may be NULL
+ * @param[in] arg   argument passed to done
+ *
+ * Only one batch is requested at a time, later requests wait for the pending one.
+ */
+void mem_alloc_refill(size_t size, void (*done)(void *arg), void *arg);
+
+/**
+ * @brief keeps the memory available on a core other than the BSP core between the watermarks
+ *
+ * Must not be called from within the allocator, as it sends messages to the BSP core.
+ *
+ * @return SYS_ERR_OK on success, or error value on failure
+ */
+errval_t mem_alloc_balance(void);
+
 
 
 #endif /* _INIT_MEM_ALLOC_H_ */
@@ -0,0 +1,122 @@
+#include "page_cache.h"
+
+/*
+ * Pages of files read through the filesystem server, keyed by the file and the
+ * offset of the page. Every mapping of a page gets a copy of the same frame
+ * capability, so all the domains mapping a file share the physical memory.
+ * Evicting or invalidating a page only drops the copy held here, the domains
+ * that mapped it keep it until they unmap it.
+ */
+
+#define PAGE_CACHE_BUCKETS 256
+
+struct page_cache_entry {
+    uint64_t                 file_id;
+    size_t                   offset;
+    struct capref            frame;
+    // bytes of the page inside the file, the rest is zero
+    size_t                   len;
+    uint64_t                 last_use;
+    struct page_cache_entry *next;
+};
+
+static struct {
+    struct page_cache_entry *buckets[PAGE_CACHE_BUCKETS];
+    size_t                   nb_pages;
+    uint64_t                 clock;
+} page_cache;
+
+static inline size_t _page_cache_bucket(uint64_t file_id, size_t offset)
+{
+    uint64_t key = file_id * 0x9e3779b97f4a7c15ULL + offset / BASE_PAGE_SIZE;
+    return (key ^ (key >> 32)) % PAGE_CACHE_BUCKETS;
+}
+
+static void _page_cache_free(struct page_cache_entry *entry)
+{
+    cap_destroy(entry->frame);
+    free(entry);
+    page_cache.nb_pages--;
+}
+
+// drops the least recently used page
+static void _page_cache_evict(void)
+{
+    struct page_cache_entry **victim = NULL;
+    for (size_t i = 0; i < PAGE_CACHE_BUCKETS; i++) {
+        for (struct page_cache_entry **e = &page_cache.buckets[i]; *e != NULL; e = &(*e)->next) {
+            if (victim == NULL || (*e)->last_use < (*victim)->last_use) {
+                victim = e;
+            }
+        }
+    }
+    if (victim != NULL) {
+        struct page_cache_entry *entry = *victim;
+        *victim = entry->next;
+        _page_cache_free(entry);
+    }
+}
+
+bool page_cache_lookup(uint64_t file_id, size_t offset, struct capref *frame, size_t *len)
+{
+    size_t bucket = _page_cache_bucket(file_id, offset);
+    for (struct page_cache_entry *e = page_cache.buckets[bucket]; e != NULL; e = e->next) {
+        if (e->file_id == file_id && e->offset == offset) {
+            e->last_use = ++page_cache.clock;
+            *frame = e->frame;
+            *len = e->len;
+            return true;
+        }
+    }
+    return false;
+}
+
+errval_t page_cache_insert(uint64_t file_id, size_t offset, struct capref frame, size_t len)
+{
+    size_t bucket = _page_cache_bucket(file_id, offset);
+
+    // Two mappings missed on the same page, keep the newer frame
+    for (struct page_cache_entry **e = &page_cache.buckets[bucket]; *e != NULL; e = &(*e)->next) {
+        if ((*e)->file_id == file_id && (*e)->offset == offset) {
+            struct page_cache_entry *old = *e;
+            *e = old->next;
+            _page_cache_free(old);
+            break;
+        }
+    }
+
+    if (page_cache.nb_pages >= PAGE_CACHE_MAX_PAGES) {
+        _page_cache_evict();
+    }
+
+    struct page_cache_entry *entry = malloc(sizeof(struct page_cache_entry));
+    if (entry == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    entry->file_id = file_id;
+    entry->offset = offset;
+    entry->frame = frame;
+    entry->len = len;
+    entry->last_use = ++page_cache.clock;
+    entry->next = page_cache.buckets[bucket];
+    page_cache.buckets[bucket] = entry;
+    page_cache.nb_pages++;
+
+    return SYS_ERR_OK;
+}
+
+void page_cache_invalidate(uint64_t file_id)
+{
+    for (size_t i = 0; i < PAGE_CACHE_BUCKETS; i++) {
+        struct page_cache_entry **e = &page_cache.buckets[i];
+        while (*e != NULL) {
+            if ((*e)->file_id == file_id) {
+                struct page_cache_entry *entry = *e;
+                *e = entry->next;
+                _page_cache_free(entry);
+            } else {
+                e = &(*e)->next;
+            }
+        }
+    }
+}
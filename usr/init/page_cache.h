@@ -0,0 +1,18 @@
+#ifndef _INIT_PAGE_CACHE_H_
+#define _INIT_PAGE_CACHE_H_
+
+#include <aos/aos.h>
+
+// Maximum number of file pages kept by init, mappings hold their own copies of the frames
+#define PAGE_CACHE_MAX_PAGES 2048
+
+// looks up the page of a file at offset, on success the frame stays owned by the cache
+bool page_cache_lookup(uint64_t file_id, size_t offset, struct capref *frame, size_t *len);
+
+// adds the page of a file to the cache, which takes ownership of the frame
+errval_t page_cache_insert(uint64_t file_id, size_t offset, struct capref frame, size_t len);
+
+// drops the pages of a file after it was written to or removed
+void page_cache_invalidate(uint64_t file_id);
+
+#endif
@@ -30,6 +30,7 @@
 
 #include "proc_mgmt.h"
 #include "rpc_handler.h"
+#include "filesystem_handler.h"
 
 extern struct bootinfo *bi;
 extern coreid_t         my_core_id;
@@ -143,9 +144,32 @@ errval_t proc_mgmt_init(void)
  * ------------------------------------------------------------------------------------------------
  */
 
-static errval_t _load_elf_internal(const char *path, struct elfimg *img, int *argc, char ***argv) {
+// a program of the card stays mapped in *mapping until it was spawned, NULL for multiboot modules
+static errval_t _load_elf_internal(const char *path, struct elfimg *img, int *argc, char ***argv,
+                                   struct filesystem_mapping **mapping) {
+    *mapping = NULL;
     if((strnlen(path, 7) >= 7 && strncasecmp("/SDCARD/", path,7) == 0)) {
-        return spawn_load_filesystem(path, img, argc, argv);
+        // The card belongs to the filesystem server, only the path is sent to it
+        size_t path_len = strcspn(path, " ");
+        char *file_path = malloc(path_len + 1);
+        if (file_path == NULL) {
+            return LIB_ERR_MALLOC_FAIL;
+        }
+        memcpy(file_path, path, path_len);
+        file_path[path_len] = '\0';
+
+        errval_t err = filesystem_map_file(file_path, mapping);
+        free(file_path);
+        if (err_is_fail(err)) {
+            return err;
+        }
+        struct filesystem_mapping *m = *mapping;
+        err = spawn_load_filesystem(path, m->buf, m->size, m->pages, img, argc, argv);
+        if (err_is_fail(err)) {
+            filesystem_unmap_file(m);
+            *mapping = NULL;
+        }
+        return err;
     } else {
         return spawn_load_elf(bi, path, img, argc, argv);
     }
@@ -207,13 +231,18 @@ errval_t proc_mgmt_spawn_mapped(int argc, const char *argv[], int capc, struct c
     struct elfimg img;
     const char   *path = argv[0];
 
-    err = _load_elf_internal(path, &img, NULL, NULL);
+    struct filesystem_mapping *mapping;
+    err = _load_elf_internal(path, &img, NULL, NULL, &mapping);
     if(err_is_fail(err)) {
         return err;
     }
 
     // Note: With multicore support, you many need to send a message to the other core
-    return _proc_mgmt_spawn_internal(&img, argc, argv, capc, capv, core, pid, stdin_frame, stdout_frame);
+    err = _proc_mgmt_spawn_internal(&img, argc, argv, capc, capv, core, pid, stdin_frame, stdout_frame);
+    if (mapping != NULL) {
+        filesystem_unmap_file(mapping);
+    }
+    return err;
 }
 
 /**
@@ -291,13 +320,17 @@ errval_t proc_mgmt_spawn_program(const char *path, coreid_t core, domainid_t *pi
     int           argc;
     char        **argv;
 
-    err = _load_elf_internal(path, &img, &argc, &argv);
+    struct filesystem_mapping *mapping;
+    err = _load_elf_internal(path, &img, &argc, &argv, &mapping);
     if (err_is_fail(err)) {
        return err;
     }
 
     // Note: With multicore support, you many need to send a message to the other core
     err = _proc_mgmt_spawn_internal(&img, argc, (const char **)argv, 0, NULL, core, pid, NULL_CAP, NULL_CAP);
+    if (mapping != NULL) {
+        filesystem_unmap_file(mapping);
+    }
     if(err_is_fail(err)) {
        return err;
     }
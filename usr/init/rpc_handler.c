@@ -13,6 +13,9 @@
 #include "proc_mgmt.h"
 #include "distcap_handler.h"
 #include "network_handler.h"
+#include "filesystem_handler.h"
+#include "span_handler.h"
+#include "mem_alloc.h"
 
 #include "../shell/serial/serial.h"
 
@@ -85,25 +88,46 @@ static void _rpc_transmit(struct aos_rpc_handler_data *data)
     return _rpc_transmit_with_handler(data, _handle_rpc_transmit_response);
 }
 
+struct memserver_refill {
+    struct aos_rpc_handler_data handler;
+    size_t                      size;
+    size_t                      alignment;
+};
+
+// called once a core other than the BSP core got a batch of memory for a request it could not serve
+static void _memserver_refilled(void *arg)
+{
+    struct memserver_refill           *refill  = arg;
+    struct aos_rpc_handler_data       *handler = &refill->handler;
+    struct aos_memserver_rpc_response *res     = handler->send.data;
+
+    res->base.type = AOS_RPC_RESPONSE_TYPE_MEMSERVER;
+    res->base.err  = ram_alloc_aligned(&handler->send.caps[0], refill->size, refill->alignment);
+    if (err_is_ok(res->base.err)) {
+        res->retbytes = refill->size;
+        if (handler->spawninfo) {
+            handler->spawninfo->mem += refill->size;
+        }
+    } else {
+        handler->send.caps[0] = NULL_CAP;
+    }
+
+    *handler->send.datasize  = sizeof(struct aos_memserver_rpc_response);
+    *handler->send.caps_size = capref_is_null(handler->send.caps[0]) ? 0 : 1;
+    handler->resume_fn.handler(handler->resume_fn.arg);
+    free(refill);
+}
+
 static errval_t _handle_memserver_rpc_request(struct aos_rpc_handler_data       *data,
                                               struct aos_memserver_rpc_request  *req,
                                               struct aos_memserver_rpc_response *res,
                                               struct capref *cap, struct spawninfo *spawninfo,
                                               bool *send_immediately)
 {
-    if (disp_get_core_id() != 0) {
-        // forward to core 0
-        _rpc_transmit(data);
-        *send_immediately = false;
-        return SYS_ERR_OK;
-    }
-    (void)data;
-    (void)send_immediately;
     grading_rpc_handler_ram_cap(req->size, req->alignment);
     errval_t err   = SYS_ERR_OK;
     res->base.type = AOS_RPC_RESPONSE_TYPE_MEMSERVER;
-    if (req->alignment != BASE_PAGE_SIZE) {
-        // TODO(jlscheerer) support different alignments.
+    if (req->alignment < BASE_PAGE_SIZE || (req->alignment & (req->alignment - 1)) != 0) {
         return MM_ERR_BAD_ALIGNMENT;
     }
 
@@ -114,7 +138,20 @@ static errval_t _handle_memserver_rpc_request(struct aos_rpc_handler_data
     }
 
     debug_printf("size: %zu | alignment: %zu\n", req->size, req->alignment);
-    err = ram_alloc(cap, req->size);
+    err = ram_alloc_aligned(cap, req->size, req->alignment);
+    if (err_is_fail(err) && disp_get_core_id() != 0 && get_cross_core_channel() != NULL) {
+        // this core ran out of memory, answer once the BSP core handed us another batch
+        struct memserver_refill *refill = malloc(sizeof(struct memserver_refill));
+        if (refill == NULL) {
+            return LIB_ERR_MALLOC_FAIL;
+        }
+        memcpy(&refill->handler, data, sizeof(struct aos_rpc_handler_data));
+        refill->size      = req->size;
+        refill->alignment = req->alignment;
+        mem_alloc_refill(req->size + req->alignment - BASE_PAGE_SIZE, _memserver_refilled, refill);
+        *send_immediately = false;
+        return SYS_ERR_OK;
+    }
     if (err_is_fail(err)) {
         return err;
     }
@@ -124,9 +161,34 @@ static errval_t _handle_memserver_rpc_request(struct aos_rpc_handler_data
     if (spawninfo) {
         spawninfo->mem += req->size;
     }
+
+    // the request was served, rebalancing is retried with the next one
+    err = mem_alloc_balance();
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "mem_alloc_balance");
+    }
     return SYS_ERR_OK;
 }
 
+static errval_t _handle_memserver_return_rpc_request(struct aos_rpc_handler_data              *data,
+                                                     struct aos_memserver_return_rpc_request  *req,
+                                                     struct aos_memserver_return_rpc_response *res,
+                                                     struct capref *cap, struct spawninfo *spawninfo,
+                                                     bool *send_immediately)
+{
+    (void)req;
+    (void)cap;
+    (void)send_immediately;
+    res->base.type = AOS_RPC_RESPONSE_TYPE_MEMSERVER;
+
+    // only the other cores hand back the batches they got from the BSP core
+    if (spawninfo != NULL || disp_get_core_id() != 0 || data->recv.caps_size != 1) {
+        return LIB_ERR_RPC_MEMSERVER_RETURN;
+    }
+
+    return aos_ram_free(data->recv.caps[0]);
+}
+
 static errval_t _handle_terminal_rpc_request(struct aos_rpc_handler_data      *data,
                                              struct aos_terminal_rpc_request  *req,
                                              struct aos_terminal_rpc_response *res,
@@ -516,167 +578,58 @@ static errval_t _handle_test_suite_rpc_request(struct aos_rpc_handler_data
 }
 
 static bool _handle_filesystem_rpc_request(struct aos_rpc_handler_data *data) {
-    const struct aos_filesystem_request *req = data->recv.data;
-    struct aos_filesystem_response *res = data->send.data;
-
     if (disp_get_core_id() != 0) {
         // forward to core 0
         _rpc_transmit(data);
         return false;
     }
 
-    if (req->request_type == AOS_RPC_FILESYSTEM_OPEN) {
-        // Request
-        const struct aos_filesystem_rpc_open_request *open_request = data->recv.data;
-        // Response
-        struct aos_filesystem_rpc_open_response *response = (struct aos_filesystem_rpc_open_response *) res;
-        // Operation
-        res->base.err = fat32_open(get_mounted_filesystem(), open_request->path, &response->fat32_handle_addr);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_open_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_READ) {
-        // Request
-        const struct aos_filesystem_rpc_read_request *read_request = data->recv.data;
-        // Response
-        struct aos_filesystem_rpc_read_response *response = (struct aos_filesystem_rpc_read_response *) res;
-        response->fat32_handle_addr = read_request->fat32_handle_addr;
-        // Operation
-        res->base.err = fat32_read(get_mounted_filesystem(), read_request->fat32_handle_addr, &response->buffer,
-                                   read_request->len, &response->len);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_read_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_WRITE) {
-        // Request
-        const struct aos_filesystem_rpc_write_request *write_request = data->recv.data;
-        // Response
-        struct aos_filesystem_rpc_write_response *response = (struct aos_filesystem_rpc_write_response *) res;
-        response->fat32_handle_addr = write_request->fat32_handle_addr;
-        // Operation
-        res->base.err = fat32_write(get_mounted_filesystem(), write_request->fat32_handle_addr,write_request->buffer,
-                                    write_request->len, &response->bytes_written);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_write_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_SEEK) {
-        // Request
-        const struct aos_filesystem_rpc_seek_request *read_request = data->recv.data;
-        // Response
-        struct aos_filesystem_rpc_seek_response *response = (struct aos_filesystem_rpc_seek_response *) res;
-        response->fat32_handle_addr = read_request->fat32_handle_addr;
-        // Operation
-        res->base.err = fat32_seek(get_mounted_filesystem(), read_request->fat32_handle_addr, read_request->whence,
-                                   read_request->offset);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_seek_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_TELL) {
-        // Request
-        const struct aos_filesystem_rpc_tell_request *read_request = data->recv.data;
-        // Response
-        struct aos_filesystem_rpc_tell_response *response = (struct aos_filesystem_rpc_tell_response *) res;
-        // Operation
-        res->base.err = fat32_tell(get_mounted_filesystem(), read_request->fat32_handle_addr, &response->position);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_tell_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_CLOSE) {
-        // Request
-        const struct aos_filesystem_rpc_close_request *close_request = data->recv.data;
-        // Operation
-        res->base.err = fat32_close(get_mounted_filesystem(), close_request->fat32_handle_addr);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_close_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_DIR_OPEN) {
-        // Request
-        const struct aos_filesystem_rpc_dir_open_request *dir_open_request = data->recv.data;
-        // Response
-        struct aos_filesystem_rpc_dir_open_response *response = (struct aos_filesystem_rpc_dir_open_response *) res;
-        // Operation
-        res->base.err = fat32_open_directory(get_mounted_filesystem(), dir_open_request->path, &response->fat32_handle_addr);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_dir_open_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_DIR_NEXT) {
-        // Request
-        const struct aos_filesystem_rpc_dir_next_request *read_request = data->recv.data;
-        // Response
-        struct aos_filesystem_rpc_dir_next_response *response = (struct aos_filesystem_rpc_dir_next_response *) res;
-        // Operation
-        char *path = NULL;
-        res->base.err = fat32_read_next_directory(get_mounted_filesystem(), read_request->fat32_handle_addr, &path);
-        // Copy into response - No risk of overflow size < 11
-        if(path != NULL) {
-            memcpy(response->name, path, strlen(path)+1);
+    // The filesystem server runs on core 0 next to us
+    return filesystem_handle_rpc_request(data);
+}
+
+static bool _handle_span_rpc_request(struct aos_rpc_handler_data *data)
+{
+    struct aos_span_rpc_request  *req = (struct aos_span_rpc_request *)data->recv.data;
+    struct aos_span_rpc_response *res = (struct aos_span_rpc_response *)data->send.data;
+
+    *data->send.datasize = sizeof(*res);
+    if (data->recv.datasize != sizeof(*req)) {
+        _send_err_rpc_response(&res->base, SYS_ERR_INVALID_SIZE);
+        return true;
+    }
+    if (req->core != disp_get_core_id()) {
+        // the dispatcher has to be started by the CPU driver of its core, only the
+        // other core can be reached through the cross core channel
+        if (req->core != 1 - disp_get_core_id() || get_cross_core_channel() == NULL) {
+            _send_err_rpc_response(&res->base, MON_ERR_INVALID_CORE_ID);
+            return true;
         }
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_dir_next_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_DIR_CLOSE) {
-        // Request
-        const struct aos_filesystem_rpc_tell_request *dir_close_request = data->recv.data;
-        // Operation
-        res->base.err = fat32_close_directory(get_mounted_filesystem(), dir_close_request->fat32_handle_addr);
-        // Size of the responseaos_rpc
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_dir_close_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_MKDIR) {
-        // Request
-        const struct aos_filesystem_rpc_mkdir_request *mkdir_request = data->recv.data;
-        // Operation
-        struct fat32_handle *handle;
-        res->base.err = fat32_mkdir(get_mounted_filesystem(), mkdir_request->path, &handle);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_mkdir_response);
-
-    } else if (req->request_type == AOS_RPC_FILESYSTEM_RMDIR)  {
-        // Request
-        const struct aos_filesystem_rpc_rmdir_request *rmdir_request = data->recv.data;
-        // Operation
-        res->base.err = fat32_remove_directory(get_mounted_filesystem(), rmdir_request->path);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_rmdir_response);
-
-    } else if(req->request_type == AOS_RPC_FILESYSTEM_MKFILE) {
-        // Request
-        const struct aos_filesystem_rpc_mkfile_request *mkfile_request = data->recv.data;
-        // Operation
-        // Response
-        struct aos_filesystem_rpc_mkfile_response *response = (struct aos_filesystem_rpc_mkfile_response *) res;
-        res->base.err = fat32_create(get_mounted_filesystem(), mkfile_request->path, &response->fat32_handle_addr);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_mkfile_response);
-
-    } else if(req->request_type == AOS_RPC_FILESYSTEM_RMFILE) {
-        // Request
-        const struct aos_filesystem_rpc_rmfile_request *rmfile_request = data->recv.data;
-        // Operation
-        res->base.err = fat32_remove(get_mounted_filesystem(), rmfile_request->path);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_rmfile_response);
-
-    } else if(req->request_type == AOS_RPC_FILESYSTEM_IS_DIRECTORY) {
-        // Request
-        const struct aos_filesystem_rpc_is_directory_request *is_directory_request = data->recv.data;
-        // Operation
-        struct aos_filesystem_rpc_is_directory_response *response = (struct aos_filesystem_rpc_is_directory_response *) res;
-        res->base.err = fat32_is_directory(get_mounted_filesystem(), is_directory_request->path, &response->is_directory);
-        // Size of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_is_directory_response);
-    } else if(req->request_type == AOS_RPC_FILESYSTEM_STAT) {
-        // Request
-        const struct aos_filesystem_rpc_stat_request *stat_request = data->recv.data;
-        // Operation
-        struct aos_filesystem_rpc_stat_response *response = (struct aos_filesystem_rpc_stat_response *) res;
-        res->base.err = fat32_stat(get_mounted_filesystem(), stat_request->fat32_handle_addr, &response->file_info);
-        // Sie of the response
-        *data->send.datasize = sizeof(struct aos_filesystem_rpc_stat_response);
-    } else {
-        //assert(false);
+        _rpc_transmit(data);
+        return false;
     }
 
+    res->base.type = AOS_RPC_RESPONSE_TYPE_SPAN;
+    switch (req->stype) {
+    case AOS_RPC_SPAN_START:
+        if (data->recv.caps_size != 2) {
+            res->base.err = SYS_ERR_INVALID_SIZE;
+            break;
+        }
+        res->base.err = span_start(data->recv.caps[0], data->recv.caps[1], req->vroot,
+                                   req->dispframe);
+        break;
+    case AOS_RPC_SPAN_STOP:
+        if (data->recv.caps_size != 1) {
+            res->base.err = SYS_ERR_INVALID_SIZE;
+            break;
+        }
+        res->base.err = span_stop(data->recv.caps[0]);
+        break;
+    default:
+        res->base.err = ERR_INVALID_ARGS;
+        break;
+    }
     return true;
 }
 
@@ -768,7 +721,8 @@ static bool _handle_network_rpc_request(struct aos_rpc_handler_data* data){
 static void _simple_async_rpc_request_handler(struct simple_async_channel *chan, void *data, size_t size,
                                struct simple_response *res);
 
-static errval_t _handle_setup_channel_request(struct aos_rpc_handler_data *data) {
+// connects to the endpoint sent along with the request and answers it
+static errval_t _connect_channel(struct aos_rpc_handler_data *data, struct aos_rpc **ret_rpc) {
     errval_t err;
     struct capref remote_cap = *data->recv.caps;
 
@@ -777,6 +731,9 @@ static errval_t _handle_setup_channel_request(struct aos_rpc_handler_data *data)
     if(err_is_fail(err))
         return err;
 
+    struct aos_generic_rpc_response *res = data->send.data;
+    res->type = AOS_RPC_RESPONSE_TYPE_NONE;
+    res->err = SYS_ERR_OK;
     *data->send.datasize = 16;
 
     // note: we use send_blocking to force it to use lmp_late_init
@@ -791,12 +748,39 @@ static errval_t _handle_setup_channel_request(struct aos_rpc_handler_data *data)
 
     data->resume_fn.handler(data->resume_fn.arg);
 
+    *ret_rpc = rpc;
+    return SYS_ERR_OK;
+}
+
+static errval_t _handle_setup_channel_request(struct aos_rpc_handler_data *data) {
+    struct aos_rpc *rpc;
+    errval_t err = _connect_channel(data, &rpc);
+    if(err_is_fail(err))
+        return err;
+
     assert(data->spawninfo != NULL);
     simple_async_init(&data->spawninfo->async, rpc, _simple_async_rpc_request_handler);
 
     return SYS_ERR_OK;
 }
 
+static void _rpc_channel_sent(struct aos_rpc *rpc, void *arg)
+{
+    (void)arg;
+    aos_rpc_recv(rpc);
+}
+
+// A further channel of the domain, served like the one it was spawned with
+static errval_t _handle_setup_rpc_channel_request(struct aos_rpc_handler_data *data) {
+    struct aos_rpc *rpc;
+    errval_t err = _connect_channel(data, &rpc);
+    if(err_is_fail(err))
+        return err;
+
+    rpc->send_handler = MKHANDLER(_rpc_channel_sent, NULL);
+    return aos_rpc_recv_with_handler(rpc, MKHANDLER(sync_rpc_request_handler, data->spawninfo));
+}
+
 static bool _handle_generic_rpc_request(struct aos_rpc_handler_data data) {
     struct aos_generic_rpc_request *req = (struct aos_generic_rpc_request *) data.recv.data;
     struct aos_generic_rpc_response *res = (struct aos_generic_rpc_response *) data.send.data;
@@ -817,9 +801,19 @@ static bool _handle_generic_rpc_request(struct aos_rpc_handler_data data) {
             return false;
         }
 
+        case AOS_RPC_REQUEST_TYPE_SETUP_RPC_CHANNEL: {
+            errval_t err = _handle_setup_rpc_channel_request(&data);
+            if(err_is_fail(err))
+                USER_PANIC_ERR(err, "Could not setup channel");
+            return false;
+        }
+
         case AOS_RPC_REQUEST_TYPE_MEMSERVER:
             HANDLE_RPC_REQUEST(memserver);
 
+        case AOS_RPC_REQUEST_TYPE_MEMSERVER_RETURN:
+            HANDLE_RPC_REQUEST(memserver_return);
+
         case AOS_RPC_REQUEST_TYPE_PROC_MGMT:
             return _handle_proc_mgmt_rpc_request(&data);
 
@@ -841,6 +835,19 @@ static bool _handle_generic_rpc_request(struct aos_rpc_handler_data data) {
         case AOS_RPC_REQUEST_TYPE_DISTCAP:
             return handle_distcap_rpc_request(&data);
 
+        case AOS_RPC_REQUEST_TYPE_SPAN:
+            return _handle_span_rpc_request(&data);
+
+        case AOS_RPC_REQUEST_TYPE_ECHO: {
+            size_t size = MIN(data.recv.datasize - sizeof(struct aos_echo_rpc_request),
+                              data.send.bufsize - sizeof(struct aos_echo_rpc_response));
+            res->type = AOS_RPC_RESPONSE_TYPE_ECHO;
+            res->err  = SYS_ERR_OK;
+            memcpy((struct aos_echo_rpc_response *)res + 1, (struct aos_echo_rpc_request *)req + 1, size);
+            *data.send.datasize = sizeof(struct aos_echo_rpc_response) + size;
+            return true;
+        }
+
         default:
             debug_printf("invalid rpc request type: %d\n", req->type);
             *data.send.datasize = 0;
@@ -0,0 +1,52 @@
+#include "span_handler.h"
+
+#include <aos/aos.h>
+#include <aos/invocations.h>
+
+// reference to a slot in the cspace of another domain, given its root CNode in our cspace
+static struct capref _span_capref(struct capref rootcn, capaddr_t addr)
+{
+    struct capref ref = {
+        .cnode = {
+            .croot = get_cap_addr(rootcn),
+            .cnode = get_capaddr_cnode_addr(addr),
+            .level = CNODE_TYPE_OTHER,
+        },
+        .slot = get_capaddr_slot(addr),
+    };
+    return ref;
+}
+
+errval_t span_start(struct capref dcb, struct capref rootcn, capaddr_t vroot, capaddr_t dispframe)
+{
+    // the kernel keeps its own references to the cspace and the dispatcher frame
+    errval_t err = invoke_dispatcher(dcb, cap_dispatcher, rootcn, _span_capref(rootcn, vroot),
+                                     _span_capref(rootcn, dispframe), true);
+    if (err_is_fail(err)) {
+        err = err_push(err, LIB_ERR_DOMAIN_SPAN_START);
+    }
+
+    errval_t err2 = cap_destroy(rootcn);
+    if (err_is_fail(err2)) {
+        DEBUG_ERR(err2, "failed to destroy the root CNode of the spanned domain");
+    }
+    err2 = cap_destroy(dcb);
+    if (err_is_fail(err2)) {
+        DEBUG_ERR(err2, "failed to destroy the dispatcher of the spanned domain");
+    }
+    return err;
+}
+
+errval_t span_stop(struct capref dcb)
+{
+    errval_t err = invoke_dispatcher_stop(dcb);
+    if (err_is_fail(err)) {
+        err = err_push(err, SPAWN_ERR_DISPATCHER_STOP);
+    }
+
+    errval_t err2 = cap_destroy(dcb);
+    if (err_is_fail(err2)) {
+        DEBUG_ERR(err2, "failed to destroy the dispatcher of the spanned domain");
+    }
+    return err;
+}
@@ -0,0 +1,12 @@
+#ifndef _INIT_SPAN_HANDLER_H_
+#define _INIT_SPAN_HANDLER_H_
+
+#include <aos/aos.h>
+
+// starts a dispatcher of a spanned domain on this core, consumes dcb and rootcn
+errval_t span_start(struct capref dcb, struct capref rootcn, capaddr_t vroot, capaddr_t dispframe);
+
+// stops a dispatcher of a spanned domain running on this core, consumes dcb
+errval_t span_stop(struct capref dcb);
+
+#endif
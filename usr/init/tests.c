@@ -4,10 +4,19 @@
 
 #include <mm/mm.h>
 #include <aos/paging.h>
+#include <aos/malloc.h>
+#include <aos/systime.h>
+#include <aos/deferred.h>
+#include <aos/kernel_cap_invocations.h>
+#include <aos/taskpool.h>
+#include <barrelfish_kpi/distcaps.h>
+#include <barrelfish_kpi/platform.h>
 #include <proc_mgmt.h>
 
 #include "errors/errno.h"
 #include "mem_alloc.h"
+#include "rpc_handler.h"
+#include "distops/invocations.h"
 
 #define TEST_PAGES       10
 #define TEST_ALLOC_COUNT ((TEST_PAGES * BASE_PAGE_SIZE) / sizeof(struct capref))
@@ -18,6 +27,32 @@
 #define CONCURRENT_PAGING_TEST_THREADS 5
 #define CONCURRENT_PAGING_TEST_SIZE    (1 << 10)
 
+#define UMP_BENCH_ROUNDS   1000
+#define UMP_BENCH_MAX_SIZE 2048
+
+#define MM_BENCH_MEMORY (64 * 1024 * 1024)
+#define MM_BENCH_LIVE   512
+#define MM_BENCH_OPS    20000
+
+#define MALLOC_BENCH_LIVE    4096
+#define MALLOC_BENCH_OPS     200000
+#define MALLOC_BENCH_THREADS 4
+#define MALLOC_BENCH_BLOCKS  16
+
+#define STRING_BENCH_MAX   (4 * 1024 * 1024)
+#define STRING_BENCH_BYTES (64 * 1024 * 1024)
+#define STRING_CHECK_MAX   300
+
+#define ZERO_POOL_BENCH_BYTES   (16 * 1024 * 1024)
+#define ZERO_POOL_BENCH_IDLE_US 200000
+#define ZERO_POOL_GRANT_BYTES   (1024 * 1024)
+
+#define TASKPOOL_TEST_WORKERS 4
+#define TASKPOOL_TEST_ITEMS   (1 << 20)
+#define TASKPOOL_TEST_FIB     20
+
+extern struct platform_info platform_info;
+
 #define FAIL_ON_ERR(x)                                                                             \
     err = (x);                                                                                     \
     if (err_is_fail(err)) {                                                                        \
@@ -317,6 +352,48 @@ TEST_SUITE_DEFINE_FN(frame_page_fault_handler_no_write)
     return SYS_ERR_OK;
 }
 
+TEST_SUITE_DEFINE_FN(fault_around)
+{
+    errval_t err = SYS_ERR_OK;
+
+    size_t size = 16 << 20;
+    if (quick) {
+        size = 1 << 20;
+    }
+
+    struct paging_state *st = get_current_paging_state();
+    void                *buf;
+    FAIL_ON_ERR(paging_alloc(st, &buf, size, BASE_PAGE_SIZE));
+    FAIL_ON_ERR(paging_set_fault_around(st, (lvaddr_t)buf, 64 * BASE_PAGE_SIZE));
+
+    size_t faults_before, pages_before, mapped;
+    paging_get_fault_stats(st, &faults_before, &pages_before, &mapped);
+
+    // touching the pages in order lets the window grow up to the limit of the region
+    char *data = (char *)buf;
+    for (size_t i = 0; i < size; i += BASE_PAGE_SIZE) {
+        data[i] = 'a' + ((i / BASE_PAGE_SIZE) % 26);
+    }
+
+    size_t faults, pages;
+    paging_get_fault_stats(st, &faults, &pages, &mapped);
+    faults -= faults_before;
+    pages -= pages_before;
+    if (verbose) {
+        printf("%zu page faults mapped %zu pages\n", faults, pages);
+    }
+    ASSERT_ERR(pages >= size / BASE_PAGE_SIZE);
+    ASSERT_ERR(faults < pages);
+
+    for (size_t i = 0; i < size; i += BASE_PAGE_SIZE) {
+        ASSERT_ERR(data[i] == 'a' + ((i / BASE_PAGE_SIZE) % 26));
+    }
+
+    FAIL_ON_ERR(paging_unmap(st, buf));
+    printf("Completed test_fault_around\n");
+    return SYS_ERR_OK;
+}
+
 TEST_SUITE_DEFINE_FN(frame_map_huge_frame)
 {
     (void)verbose;
@@ -716,6 +793,765 @@ TEST_SUITE_DEFINE_FN(stress_proc_mgmt)
     return SYS_ERR_OK;
 }
 
+static void _test_ump_bench_response(struct request *req, void *data, size_t size,
+                                     struct capref *capv, size_t capc)
+{
+    (void)data, (void)size, (void)capv, (void)capc;
+    size_t *pending = req->meta;
+    (*pending)--;
+}
+
+static void _test_ump_bench_wait(size_t *pending)
+{
+    while (*pending > 0) {
+        errval_t err = event_dispatch(get_default_waitset());
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "in event_dispatch");
+        }
+    }
+}
+
+// measures round trips to the other core, one at a time and all of them in flight
+TEST_SUITE_DEFINE_FN(ump_bench)
+{
+    (void)verbose;
+    struct async_channel *chan = get_cross_core_channel();
+    if (chan == NULL) {
+        debug_printf("test_ump_bench: no other core to talk to\n");
+        return SYS_ERR_OK;
+    }
+
+    size_t rounds = quick ? UMP_BENCH_ROUNDS / 10 : UMP_BENCH_ROUNDS;
+    struct aos_echo_rpc_request *req = calloc(1, sizeof(*req) + UMP_BENCH_MAX_SIZE);
+    if (req == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    req->base.type = AOS_RPC_REQUEST_TYPE_ECHO;
+
+    for (size_t size = 8; size <= UMP_BENCH_MAX_SIZE; size *= 4) {
+        size_t pending;
+
+        systime_t start = systime_now();
+        for (size_t i = 0; i < rounds; i++) {
+            pending = 1;
+            async_request(chan, req, sizeof(*req) + size, NULL, 0, _test_ump_bench_response,
+                          &pending);
+            _test_ump_bench_wait(&pending);
+        }
+        uint64_t latency_us = systime_to_us(systime_now() - start);
+
+        start   = systime_now();
+        pending = rounds;
+        for (size_t i = 0; i < rounds; i++) {
+            async_request(chan, req, sizeof(*req) + size, NULL, 0, _test_ump_bench_response,
+                          &pending);
+        }
+        _test_ump_bench_wait(&pending);
+        uint64_t total_us = MAX(systime_to_us(systime_now() - start), 1);
+
+        debug_printf("test_ump_bench: %4zu bytes: %lu us per round trip, %lu KiB/s pipelined\n",
+                     size, latency_us / rounds, (rounds * size * 1000000 / 1024) / total_us);
+    }
+
+    free(req);
+    printf("Completed test_ump_bench.\n");
+    return SYS_ERR_OK;
+}
+
+static errval_t _test_mm_bench_refill(struct slot_allocator *ca)
+{
+    // the default slot allocator refills itself
+    (void)ca;
+    return SYS_ERR_OK;
+}
+
+// mostly small allocations, some medium ones and a few large aligned ones
+static size_t _test_mm_bench_size(uint64_t *seed, size_t *alignment)
+{
+    *seed      = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint64_t r = *seed >> 33;
+
+    *alignment = BASE_PAGE_SIZE;
+    if (r % 100 < 70) {
+        return (1 + (r >> 8) % 4) * BASE_PAGE_SIZE;
+    } else if (r % 100 < 95) {
+        return (16 + (r >> 8) % 48) * BASE_PAGE_SIZE;
+    }
+    *alignment = 16 * BASE_PAGE_SIZE;
+    return (256 + (r >> 8) % 256) * BASE_PAGE_SIZE;
+}
+
+// measures allocations and frees of a private mm instance under a mixed workload
+TEST_SUITE_DEFINE_FN(mm_bench)
+{
+    errval_t err;
+    static char slab_buf[16 * BASE_PAGE_SIZE];
+
+    struct capref ram;
+    FAIL_ON_ERR(aos_ram_alloc_aligned(&ram, MM_BENCH_MEMORY, BASE_PAGE_SIZE));
+    struct capability c;
+    FAIL_ON_ERR(cap_direct_identify(ram, &c));
+
+    struct mm mm;
+    FAIL_ON_ERR(mm_init(&mm, ObjType_RAM, get_default_slot_allocator(), _test_mm_bench_refill,
+                        slab_buf, sizeof(slab_buf)));
+    FAIL_ON_ERR(mm_add(&mm, ram));
+
+    struct capref *live = calloc(MM_BENCH_LIVE, sizeof(struct capref));
+    if (live == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    size_t   ops    = quick ? MM_BENCH_OPS / 10 : MM_BENCH_OPS;
+    size_t   allocs = 0, frees = 0, failed = 0;
+    uint64_t seed   = 42;
+
+    systime_t start = systime_now();
+    for (size_t i = 0; i < ops; i++) {
+        size_t slot = (seed >> 40) % MM_BENCH_LIVE;
+        if (!capref_is_null(live[slot])) {
+            FAIL_ON_ERR(mm_free(&mm, live[slot]));
+            live[slot] = NULL_CAP;
+            frees++;
+        }
+
+        size_t alignment;
+        size_t size = _test_mm_bench_size(&seed, &alignment);
+        err         = mm_alloc_aligned(&mm, size, alignment, &live[slot]);
+        if (err_is_fail(err)) {
+            live[slot] = NULL_CAP;
+            failed++;
+        } else {
+            allocs++;
+        }
+    }
+    uint64_t total_us = MAX(systime_to_us(systime_now() - start), 1);
+
+    size_t available = mm_mem_available(&mm);
+    size_t largest   = mm_mem_largest_free(&mm);
+    debug_printf("test_mm_bench: %zu allocs, %zu frees, %zu failed, %lu ops/ms\n", allocs, frees,
+                 failed, (allocs + frees) * 1000 / total_us);
+    debug_printf("test_mm_bench: %zu KiB free, largest block %zu KiB, %zu%% fragmented\n",
+                 available / 1024, largest / 1024,
+                 available ? 100 - largest * 100 / available : 0);
+    if (verbose) {
+        mm_log(&mm);
+    }
+
+    for (size_t i = 0; i < MM_BENCH_LIVE; i++) {
+        if (!capref_is_null(live[i])) {
+            FAIL_ON_ERR(mm_free(&mm, live[i]));
+        }
+    }
+    free(live);
+
+    // everything was freed, so the memory has to be back in one piece
+    FAIL_ON_ERR(mm_remove(&mm, c.u.ram.base, &ram));
+    FAIL_ON_ERR(aos_ram_free(ram));
+
+    printf("Completed test_mm_bench.\n");
+    return SYS_ERR_OK;
+}
+
+// mostly small objects as for messages and list nodes, some buffers and a few large blocks
+static size_t _test_malloc_bench_size(uint64_t *seed)
+{
+    *seed      = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint64_t r = *seed >> 33;
+
+    if (r % 100 < 80) {
+        return 8 + (r >> 8) % 248;
+    } else if (r % 100 < 98) {
+        return 256 + (r >> 8) % (MALLOC_SMALL_MAX - 256);
+    }
+    return MALLOC_SMALL_MAX + (r >> 8) % (256 * 1024);
+}
+
+static int _test_malloc_bench_thread(void *arg)
+{
+    size_t ops = (size_t)arg;
+
+    // pairs of malloc and free as done for every message
+    void *recent[16] = { NULL };
+    for (size_t i = 0; i < ops; i++) {
+        size_t slot = i % 16;
+        free(recent[slot]);
+        recent[slot] = malloc(16 + (i * 37) % 512);
+        if (recent[slot] == NULL) {
+            return 1;
+        }
+        *(volatile char *)recent[slot] = (char)i;
+    }
+    for (size_t i = 0; i < 16; i++) {
+        free(recent[i]);
+    }
+    return 0;
+}
+
+// measures malloc and free under a mixed workload, and how much memory the allocator holds for it
+TEST_SUITE_DEFINE_FN(malloc_bench)
+{
+    (void)verbose;
+    errval_t err;
+
+    void  **live  = calloc(MALLOC_BENCH_LIVE, sizeof(void *));
+    size_t *sizes = calloc(MALLOC_BENCH_LIVE, sizeof(size_t));
+    if (live == NULL || sizes == NULL) {
+        free(live);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    struct aos_malloc_stats before, after;
+    aos_malloc_get_stats(&before);
+
+    size_t   ops    = quick ? MALLOC_BENCH_OPS / 10 : MALLOC_BENCH_OPS;
+    size_t   allocs = 0, frees = 0;
+    size_t   requested = 0;
+    uint64_t seed      = 42;
+
+    systime_t start = systime_now();
+    for (size_t i = 0; i < ops; i++) {
+        size_t slot = (seed >> 40) % MALLOC_BENCH_LIVE;
+        if (live[slot] != NULL) {
+            free(live[slot]);
+            requested -= sizes[slot];
+            frees++;
+        }
+
+        sizes[slot] = _test_malloc_bench_size(&seed);
+        live[slot]  = malloc(sizes[slot]);
+        if (live[slot] == NULL) {
+            printf("test_malloc_bench: malloc of %zu bytes failed\n", sizes[slot]);
+            err = LIB_ERR_MALLOC_FAIL;
+            goto out;
+        }
+        // touch both ends, so the memory is really committed
+        ((volatile char *)live[slot])[0]                = (char)i;
+        ((volatile char *)live[slot])[sizes[slot] - 1] = (char)i;
+        requested += sizes[slot];
+        allocs++;
+    }
+    uint64_t total_us = MAX(systime_to_us(systime_now() - start), 1);
+
+    aos_malloc_get_stats(&after);
+    size_t used = after.used_bytes - before.used_bytes;
+    size_t held = after.span_bytes - before.span_bytes;
+    size_t large = after.large_bytes - before.large_bytes;
+    debug_printf("test_malloc_bench: %zu allocs, %zu frees, %lu ops/ms\n", allocs, frees,
+                 (allocs + frees) * 1000 / total_us);
+    debug_printf("test_malloc_bench: %zu KiB requested, %zu KiB in objects, %zu KiB in spans, "
+                 "%zu KiB in large blocks\n",
+                 requested / 1024, used / 1024, held / 1024, large / 1024);
+    if (used + large > 0 && held + large > 0) {
+        debug_printf("test_malloc_bench: %zu%% lost to rounding, %zu%% of the spans unused\n",
+                     100 - MIN(requested, used + large) * 100 / (used + large),
+                     held > used ? 100 - used * 100 / held : 0);
+    }
+
+    // the same small objects allocated and freed by several threads at once
+    size_t         thread_ops = ops / MALLOC_BENCH_THREADS;
+    struct thread *threads[MALLOC_BENCH_THREADS];
+    start = systime_now();
+    for (size_t i = 0; i < MALLOC_BENCH_THREADS; i++) {
+        threads[i] = thread_create(_test_malloc_bench_thread, (void *)thread_ops);
+        if (threads[i] == NULL) {
+            err = LIB_ERR_THREAD_CREATE;
+            goto out;
+        }
+    }
+    for (size_t i = 0; i < MALLOC_BENCH_THREADS; i++) {
+        int ret;
+        FAIL_ON_ERR(thread_join(threads[i], &ret));
+        if (ret != 0) {
+            printf("test_malloc_bench: thread %zu ran out of memory\n", i);
+            err = LIB_ERR_MALLOC_FAIL;
+            goto out;
+        }
+    }
+    total_us = MAX(systime_to_us(systime_now() - start), 1);
+    debug_printf("test_malloc_bench: %d threads, %lu ops/ms\n", MALLOC_BENCH_THREADS,
+                 MALLOC_BENCH_THREADS * thread_ops * 2 * 1000 / total_us);
+
+    err = SYS_ERR_OK;
+out:
+    for (size_t i = 0; i < MALLOC_BENCH_LIVE; i++) {
+        free(live[i]);
+    }
+    free(live);
+    free(sizes);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    // large blocks are unmapped right away
+    aos_malloc_get_stats(&after);
+    if (after.large_blocks != before.large_blocks) {
+        printf("test_malloc_bench: %zu large blocks left\n",
+               after.large_blocks - before.large_blocks);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    // and their memory goes back as well, not only the address space
+    struct paging_state *st = get_current_paging_state();
+    size_t               faults, pages, mapped_peak, mapped_after;
+    void                *blocks[MALLOC_BENCH_BLOCKS];
+    for (size_t i = 0; i < MALLOC_BENCH_BLOCKS; i++) {
+        blocks[i] = malloc(MALLOC_SMALL_MAX * 4);
+        if (blocks[i] == NULL) {
+            err = LIB_ERR_MALLOC_FAIL;
+        } else {
+            memset(blocks[i], (int)i, MALLOC_SMALL_MAX * 4);
+        }
+    }
+    paging_get_fault_stats(st, &faults, &pages, &mapped_peak);
+    for (size_t i = 0; i < MALLOC_BENCH_BLOCKS; i++) {
+        free(blocks[i]);
+    }
+    paging_get_fault_stats(st, &faults, &pages, &mapped_after);
+    FAIL_ON_ERR(err);
+    size_t returned = mapped_peak > mapped_after ? mapped_peak - mapped_after : 0;
+    if (verbose) {
+        printf("test_malloc_bench: freeing large blocks returned %zu pages\n", returned);
+    }
+    if (returned < MALLOC_BENCH_BLOCKS * MALLOC_SMALL_MAX * 4 / BASE_PAGE_SIZE) {
+        printf("test_malloc_bench: freed large blocks kept %zu pages\n",
+               MALLOC_BENCH_BLOCKS * MALLOC_SMALL_MAX * 4 / BASE_PAGE_SIZE - returned);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    printf("Completed test_malloc_bench.\n");
+    return SYS_ERR_OK;
+}
+
+// a word at a time, as the generic C versions do
+static void _test_string_ref_copy(void *dst, const void *src, size_t n)
+{
+    volatile uint64_t *d = dst;
+    const uint64_t    *s = src;
+    for (size_t i = 0; i < n / 8; i++) {
+        d[i] = s[i];
+    }
+}
+
+static void _test_string_ref_set(void *dst, int c, size_t n)
+{
+    volatile uint64_t *d       = dst;
+    uint64_t           pattern = 0x0101010101010101ULL * (uint8_t)c;
+    for (size_t i = 0; i < n / 8; i++) {
+        d[i] = pattern;
+    }
+}
+
+static bool _test_string_check_range(const uint8_t *buf, size_t from, size_t to, uint8_t value)
+{
+    for (size_t i = from; i < to; i++) {
+        if (buf[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// compares the results of the string functions with the expected bytes for all small sizes and alignments
+static errval_t _test_string_check(uint8_t *a, uint8_t *b)
+{
+    size_t len = STRING_CHECK_MAX + 64;
+    for (size_t n = 0; n <= STRING_CHECK_MAX; n++) {
+        for (size_t da = 0; da < 16; da++) {
+            for (size_t sa = 0; sa < 16; sa++) {
+                for (size_t i = 0; i < len; i++) {
+                    a[i] = (uint8_t)(i * 7 + 1);
+                    b[i] = 0xee;
+                }
+                memcpy(b + da, a + sa, n);
+                for (size_t i = 0; i < n; i++) {
+                    if (b[da + i] != a[sa + i]) {
+                        printf("test_string_bench: memcpy of %zu bytes (%zu, %zu) wrong\n", n, da, sa);
+                        return SYS_ERR_GUARD_MISMATCH;
+                    }
+                }
+                if (!_test_string_check_range(b, 0, da, 0xee)
+                    || !_test_string_check_range(b, da + n, len, 0xee)) {
+                    printf("test_string_bench: memcpy of %zu bytes (%zu, %zu) overflows\n", n, da, sa);
+                    return SYS_ERR_GUARD_MISMATCH;
+                }
+
+                // overlapping in both directions, the source is the pattern in a
+                memmove(a + da, a + sa, n);
+                for (size_t i = 0; i < n; i++) {
+                    if (a[da + i] != (uint8_t)((sa + i) * 7 + 1)) {
+                        printf("test_string_bench: memmove of %zu bytes (%zu, %zu) wrong\n", n, da, sa);
+                        return SYS_ERR_GUARD_MISMATCH;
+                    }
+                }
+            }
+
+            for (int c = 0; c < 0x100; c += 0xa5) {
+                memset(b, 0xee, len);
+                memset(b + da, c, n);
+                if (!_test_string_check_range(b, da, da + n, c)
+                    || !_test_string_check_range(b, 0, da, 0xee)
+                    || !_test_string_check_range(b, da + n, len, 0xee)) {
+                    printf("test_string_bench: memset of %zu bytes at %zu wrong\n", n, da);
+                    return SYS_ERR_GUARD_MISMATCH;
+                }
+            }
+
+            memset(b, 'x', len);
+            b[da + n] = '\0';
+            if (strlen((char *)b + da) != n) {
+                printf("test_string_bench: strlen of %zu bytes at %zu wrong\n", n, da);
+                return SYS_ERR_GUARD_MISMATCH;
+            }
+        }
+    }
+    return SYS_ERR_OK;
+}
+
+static uint64_t _test_string_rate(size_t bytes, systime_t start)
+{
+    // bytes per microsecond are megabytes per second
+    return bytes / MAX(systime_to_us(systime_now() - start), 1);
+}
+
+// checks the string functions and prints their throughput next to the one of word-sized loops
+TEST_SUITE_DEFINE_FN(string_bench)
+{
+    (void)verbose;
+    errval_t err;
+
+    uint8_t *src = malloc(STRING_BENCH_MAX + 64);
+    uint8_t *dst = malloc(STRING_BENCH_MAX + 64);
+    if (src == NULL || dst == NULL) {
+        free(src);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    err = _test_string_check(src, dst);
+    if (err_is_fail(err)) {
+        goto out;
+    }
+
+    // touch everything once, so no page faults end up in the numbers
+    memset(src, 0x5a, STRING_BENCH_MAX + 64);
+    memset(dst, 0, STRING_BENCH_MAX + 64);
+
+    size_t total = quick ? STRING_BENCH_BYTES / 16 : STRING_BENCH_BYTES;
+    printf("%10s %12s %12s %12s %12s %12s\n", "bytes", "memcpy MB/s", "loop MB/s",
+           "memset MB/s", "zero MB/s", "loop MB/s");
+    static const size_t sizes[] = { 8,         64,         512,        4 * 1024,
+                                    32 * 1024, 256 * 1024, 1024 * 1024, STRING_BENCH_MAX };
+    for (size_t s = 0; s < ARRAY_LENGTH(sizes); s++) {
+        size_t   n      = sizes[s];
+        size_t   rounds = MAX(total / n, 1);
+        uint64_t rate[5];
+
+        systime_t start = systime_now();
+        for (size_t i = 0; i < rounds; i++) {
+            memcpy(dst, src, n);
+            __asm volatile("" ::: "memory");
+        }
+        rate[0] = _test_string_rate(rounds * n, start);
+
+        start = systime_now();
+        for (size_t i = 0; i < rounds; i++) {
+            _test_string_ref_copy(dst, src, n);
+        }
+        rate[1] = _test_string_rate(rounds * n, start);
+
+        start = systime_now();
+        for (size_t i = 0; i < rounds; i++) {
+            memset(dst, 0x5a, n);
+            __asm volatile("" ::: "memory");
+        }
+        rate[2] = _test_string_rate(rounds * n, start);
+
+        start = systime_now();
+        for (size_t i = 0; i < rounds; i++) {
+            memset(dst, 0, n);
+            __asm volatile("" ::: "memory");
+        }
+        rate[3] = _test_string_rate(rounds * n, start);
+
+        start = systime_now();
+        for (size_t i = 0; i < rounds; i++) {
+            _test_string_ref_set(dst, 0, n);
+        }
+        rate[4] = _test_string_rate(rounds * n, start);
+
+        printf("%10zu %12lu %12lu %12lu %12lu %12lu\n", n, rate[0], rate[1], rate[2], rate[3],
+               rate[4]);
+    }
+
+    printf("Completed test_string_bench.\n");
+out:
+    free(src);
+    free(dst);
+    return err;
+}
+
+// retypes the memory into a frame, checks that it reads as zero and leaves it dirty again
+static errval_t _test_zero_pool_retype(struct capref ram, size_t bytes, const char *what)
+{
+    errval_t err;
+
+    struct zero_pool_stats before, after;
+    FAIL_ON_ERR(invoke_kernel_zero_pool_stats(&before));
+
+    struct capref frame;
+    FAIL_ON_ERR(slot_alloc(&frame));
+    systime_t start = systime_now();
+    FAIL_ON_ERR(cap_retype(frame, ram, 0, ObjType_Frame, bytes));
+    uint64_t retype_us = systime_to_us(systime_now() - start);
+
+    FAIL_ON_ERR(invoke_kernel_zero_pool_stats(&after));
+    printf("test_zero_pool: retype %s: %lu us, %lu KiB zeroed in the retype, %lu KiB pre-zeroed\n",
+           what, retype_us, (after.sync_bytes - before.sync_bytes) / 1024,
+           (after.prezeroed_bytes - before.prezeroed_bytes) / 1024);
+
+    struct paging_state *st = get_current_paging_state();
+    uint64_t            *buf;
+    FAIL_ON_ERR(paging_map_frame_attr_offset(st, (void **)&buf, bytes, frame, 0,
+                                             VREGION_FLAGS_READ_WRITE));
+    for (size_t i = 0; i < bytes / sizeof(uint64_t); i++) {
+        if (buf[i] != 0) {
+            printf("test_zero_pool: retype %s: word at offset %zu is %lx\n", what,
+                   i * sizeof(uint64_t), buf[i]);
+            err = SYS_ERR_GUARD_MISMATCH;
+            break;
+        }
+    }
+    memset(buf, 0xa5, bytes);
+    errval_t unmap_err = paging_unmap(st, buf);
+    cap_destroy(frame);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    return unmap_err;
+}
+
+// compares retypes zeroing the frame synchronously with retypes of memory zeroed while idle
+TEST_SUITE_DEFINE_FN(zero_pool)
+{
+    (void)verbose;
+    errval_t err;
+
+    size_t bytes = quick ? ZERO_POOL_BENCH_BYTES / 4 : ZERO_POOL_BENCH_BYTES;
+    struct capref ram;
+    FAIL_ON_ERR(aos_ram_alloc_aligned(&ram, bytes, BASE_PAGE_SIZE));
+
+    // leaves the memory dirty and outside of the pool
+    FAIL_ON_ERR(_test_zero_pool_retype(ram, bytes, "of fresh memory"));
+
+    err = invoke_kernel_zero_pool_add(ram);
+    if (err_no(err) == SYS_ERR_ZERO_POOL_SHARED) {
+        // memory obtained from another core stays with its owner's CPU driver
+        printf("test_zero_pool: memory is owned by another core, skipping\n");
+        return aos_ram_free(ram);
+    }
+    FAIL_ON_ERR(err);
+    FAIL_ON_ERR(_test_zero_pool_retype(ram, bytes, "right after donating"));
+
+    FAIL_ON_ERR(invoke_kernel_zero_pool_add(ram));
+    FAIL_ON_ERR(barrelfish_usleep(ZERO_POOL_BENCH_IDLE_US));
+    FAIL_ON_ERR(_test_zero_pool_retype(ram, bytes, "after idling"));
+
+    struct zero_pool_stats stats;
+    FAIL_ON_ERR(invoke_kernel_zero_pool_stats(&stats));
+    printf("test_zero_pool: %lu KiB pending, %lu KiB zeroed, idle %lu KiB in %lu us, "
+           "retypes %lu KiB in %lu us\n",
+           stats.pending_bytes / 1024, stats.zeroed_bytes / 1024, stats.idle_bytes / 1024,
+           stats.idle_ns / 1000, stats.sync_bytes / 1024, stats.sync_ns / 1000);
+
+    FAIL_ON_ERR(aos_ram_free(ram));
+
+    printf("Completed test_zero_pool.\n");
+    return SYS_ERR_OK;
+}
+
+// memory given to another core is left alone by the idle loop of this one
+TEST_SUITE_DEFINE_FN(zero_pool_grant)
+{
+    (void)quick;
+    (void)verbose;
+    errval_t err;
+
+    struct capref ram;
+    FAIL_ON_ERR(aos_ram_alloc_aligned(&ram, ZERO_POOL_GRANT_BYTES, BASE_PAGE_SIZE));
+
+    // in the pool like the free memory the other core gets its memory from
+    err = invoke_kernel_zero_pool_add(ram);
+    if (err_no(err) == SYS_ERR_ZERO_POOL_SHARED) {
+        printf("test_zero_pool_grant: memory is owned by another core, skipping\n");
+        return aos_ram_free(ram);
+    }
+    FAIL_ON_ERR(err);
+
+    FAIL_ON_ERR(mem_alloc_grant(ram));
+    err = invoke_kernel_zero_pool_add(ram);
+    if (err_no(err) != SYS_ERR_ZERO_POOL_SHARED) {
+        printf("test_zero_pool_grant: granted memory was taken into the pool again\n");
+        return err_is_fail(err) ? err : SYS_ERR_GUARD_MISMATCH;
+    }
+
+    // the other core may be using the memory, none of it may be zeroed meanwhile
+    FAIL_ON_ERR(barrelfish_usleep(ZERO_POOL_BENCH_IDLE_US));
+    struct zero_pool_stats before, after;
+    FAIL_ON_ERR(invoke_kernel_zero_pool_stats(&before));
+    FAIL_ON_ERR(_test_zero_pool_retype(ram, ZERO_POOL_GRANT_BYTES, "of granted memory"));
+    FAIL_ON_ERR(invoke_kernel_zero_pool_stats(&after));
+    if (after.prezeroed_bytes != before.prezeroed_bytes) {
+        printf("test_zero_pool_grant: %lu KiB of granted memory were zeroed while idle\n",
+               (after.prezeroed_bytes - before.prezeroed_bytes) / 1024);
+        return SYS_ERR_GUARD_MISMATCH;
+    }
+
+    // as if the other core handed the memory back
+    uint8_t relations;
+    FAIL_ON_ERR(monitor_remote_relations(ram, 0, RRELS_COPY_BIT, &relations));
+    FAIL_ON_ERR(aos_ram_free(ram));
+
+    printf("Completed test_zero_pool_grant.\n");
+    return SYS_ERR_OK;
+}
+
+struct _test_taskpool_fib {
+    struct task_group *group;
+    unsigned n;
+    uint64_t result;
+};
+
+// spawns one half of the recursion and computes the other one itself
+static void _test_taskpool_fib(void *arg)
+{
+    struct _test_taskpool_fib *fib = arg;
+    if (fib->n < 2) {
+        fib->result = fib->n;
+        return;
+    }
+
+    struct task_group group;
+    task_group_init(&group, fib->group->pool);
+    struct _test_taskpool_fib a = { .group = &group, .n = fib->n - 1 };
+    struct _test_taskpool_fib b = { .group = &group, .n = fib->n - 2 };
+    if (err_is_fail(task_spawn(&group, _test_taskpool_fib, &a))) {
+        _test_taskpool_fib(&a);
+    }
+    _test_taskpool_fib(&b);
+    task_sync(&group);
+    fib->result = a.result + b.result;
+}
+
+static void _test_taskpool_square(void *arg, size_t begin, size_t end)
+{
+    uint64_t *items = arg;
+    for (size_t i = begin; i < end; i++) {
+        items[i] = (uint64_t)i * i;
+    }
+}
+
+static void *_test_taskpool_sum(void *arg)
+{
+    uint64_t *items = arg;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < TASKPOOL_TEST_ITEMS; i++) {
+        sum += items[i];
+    }
+    return (void *)(uintptr_t)sum;
+}
+
+static void _test_taskpool_event(void *arg)
+{
+    *(bool *)arg = true;
+}
+
+TEST_SUITE_DEFINE_FN(taskpool)
+{
+    (void)quick;
+    errval_t err;
+
+    struct taskpool *pool;
+    FAIL_ON_ERR(taskpool_create(TASKPOOL_TEST_WORKERS, &pool));
+
+    // parallel for, checked by a future computed in the pool
+    uint64_t *items = calloc(TASKPOOL_TEST_ITEMS, sizeof(*items));
+    ASSERT_ERR(items != NULL);
+    systime_t start = systime_now();
+    FAIL_ON_ERR(task_parallel_for(pool, 0, TASKPOOL_TEST_ITEMS, 0, _test_taskpool_square, items));
+    systime_t time = systime_now() - start;
+
+    struct waitset ws;
+    waitset_init(&ws);
+    struct task_future future;
+    task_future_init(&future);
+    bool delivered = false;
+    FAIL_ON_ERR(task_async(pool, &future, _test_taskpool_sum, items));
+    FAIL_ON_ERR(task_future_register(&future, &ws, MKCLOSURE(_test_taskpool_event, &delivered)));
+    uint64_t sum = (uintptr_t)task_future_wait(&future, &ws);
+    while (!delivered) {
+        FAIL_ON_ERR(event_dispatch(&ws));
+    }
+    FAIL_ON_ERR(waitset_destroy(&ws));
+
+    uint64_t expected = 0;
+    for (size_t i = 0; i < TASKPOOL_TEST_ITEMS; i++) {
+        expected += (uint64_t)i * i;
+    }
+    ASSERT_ERR(sum == expected);
+    free(items);
+
+    // nested spawns
+    struct task_group group;
+    task_group_init(&group, pool);
+    struct _test_taskpool_fib fib = { .group = &group, .n = TASKPOOL_TEST_FIB };
+    FAIL_ON_ERR(task_spawn(&group, _test_taskpool_fib, &fib));
+    task_sync(&group);
+    ASSERT_ERR(fib.result == 6765);
+
+    if (verbose) {
+        printf("test_taskpool: parallel for over %d items took %lu us\n", TASKPOOL_TEST_ITEMS,
+               systime_to_us(time));
+    }
+
+    taskpool_destroy(pool);
+
+    printf("Completed test_taskpool.\n");
+    return SYS_ERR_OK;
+}
+
+static void _test_fs_buffering_exited(void *arg)
+{
+    *(bool *)arg = true;
+}
+
+// the buffering of file descriptors is checked by the filereader, which has the filesystem library
+TEST_SUITE_DEFINE_FN(fs_buffering)
+{
+    (void)quick;
+    (void)verbose;
+    errval_t err;
+
+    if (platform_info.platform != PI_PLATFORM_IMX8X) {
+        // the filesystem server only runs with the sd card of the board
+        printf("test_fs_buffering: no filesystem on this platform, skipping\n");
+        return SYS_ERR_OK;
+    }
+
+    domainid_t pid;
+    FAIL_ON_ERR(proc_mgmt_spawn_program("filereader buffering", /*core*/ 0, &pid));
+
+    bool exited = false;
+    int  exit_code;
+    FAIL_ON_ERR(proc_mgmt_register_wait(pid, MKCLOSURE(_test_fs_buffering_exited, &exited), &exit_code));
+    while (!exited) {
+        FAIL_ON_ERR(event_dispatch(get_default_waitset()));
+    }
+    ASSERT_ERR(exit_code == EXIT_SUCCESS);
+
+    printf("Completed test_fs_buffering.\n");
+    return SYS_ERR_OK;
+}
+
 #define TEST_SUITE_CALL(TEST)                                                                      \
     if (TEST_SUITE_CONFIG_IS_TEST_ENABLED(config, TEST)) {                                         \
         err = test_##TEST(config.quick, config.verbose);                                           \
@@ -5,28 +5,105 @@
 #include <stddef.h>
 #include <ctype.h>
 
+#include <aos/taskpool.h>
+
+// inputs from this size on are counted on all cores
+#define WC_SPAN_THRESHOLD (1024 * 1024)
+
+// the input is counted in chunks of this size in parallel
+#define WC_CHUNK_BYTES (64 * 1024)
+
+struct wc_counts {
+    size_t lines, words;
+};
+
+struct wc_input {
+    char             *buf;
+    size_t            size;
+    struct wc_counts *chunks;
+};
+
+// reads stdin up to the terminating '\0'
+static void wc_read_input(struct wc_input *input)
+{
+    size_t capacity = 4096;
+    input->buf = malloc(capacity);
+    input->size = 0;
+    if (input->buf == NULL) {
+        builtin_fail_err(LIB_ERR_MALLOC_FAIL);
+    }
+
+    char c;
+    while ((c = getchar()) != '\0') {
+        if (input->size == capacity) {
+            capacity *= 2;
+            input->buf = realloc(input->buf, capacity);
+            if (input->buf == NULL) {
+                builtin_fail_err(LIB_ERR_MALLOC_FAIL);
+            }
+        }
+        input->buf[input->size++] = c;
+    }
+}
+
+// a word ends wherever a space follows a non-space, the input starts after a non-space
+static void wc_count_chunks(void *arg, size_t first, size_t last)
+{
+    struct wc_input *input = arg;
+    for (size_t chunk = first; chunk < last; chunk++) {
+        size_t begin = chunk * WC_CHUNK_BYTES;
+        size_t end = MIN(begin + WC_CHUNK_BYTES, input->size);
+        char p = begin == 0 ? '\0' : input->buf[begin - 1];
+        size_t lines = 0, words = 0;
+        for (size_t i = begin; i < end; i++) {
+            char c = input->buf[i];
+            if (isspace(c) && !isspace(p)) {
+                ++words;
+            }
+            if (c == '\n') {
+                ++lines;
+            }
+            p = c;
+        }
+        input->chunks[chunk].lines = lines;
+        input->chunks[chunk].words = words;
+    }
+}
+
 int main(int argc, char *argv[]) {
     builtin_init("wc", argc, argv);
     if (builtin_getargc() != 0) {
         builtin_fail("unexpected number of arguments.");
     }
-    size_t lines = 0, words = 0, chars = 0;
-    char p = '\0', c;
-    bool read = false;
-    while ((c = getchar()) != '\0') {
-        read = true;
-        if (isspace(c) && !isspace(p)) {
-            ++words;
-        }
-        if (c== '\n') {
-            ++lines;
-        }
-        p = c;
-        ++chars;
+
+    struct wc_input input;
+    wc_read_input(&input);
+
+    if (input.size >= WC_SPAN_THRESHOLD) {
+        // worth using the other core as well, count on this one if that fails
+        domain_new_dispatcher(1 - disp_get_core_id(), NULL, NULL);
     }
-    if (read && !isspace(p)) {
+
+    size_t nchunks = DIVIDE_ROUND_UP(input.size, WC_CHUNK_BYTES);
+    input.chunks = calloc(nchunks, sizeof(*input.chunks));
+    if (nchunks > 0 && input.chunks == NULL) {
+        builtin_fail_err(LIB_ERR_MALLOC_FAIL);
+    }
+
+    struct taskpool *pool;
+    builtin_fail_if_err(taskpool_create(0, &pool));
+    builtin_fail_if_err(task_parallel_for(pool, 0, nchunks, 1, wc_count_chunks, &input));
+    taskpool_destroy(pool);
+
+    size_t lines = 0, words = 0, chars = input.size;
+    for (size_t chunk = 0; chunk < nchunks; chunk++) {
+        lines += input.chunks[chunk].lines;
+        words += input.chunks[chunk].words;
+    }
+    if (input.size > 0 && !isspace(input.buf[input.size - 1])) {
         ++words;
     }
+
     bool show_lines = builtin_getflag('l');
     bool show_words = builtin_getflag('w');
     bool show_chars = builtin_getflag('c');
@@ -44,4 +121,4 @@ int main(int argc, char *argv[]) {
         printf("%7zu ", chars);
     }
     printf("\n");
-}
\ No newline at end of file
+}
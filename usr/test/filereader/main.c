@@ -34,6 +34,7 @@ static uint64_t systime_to_ms(systime_t time){
 #define DIR_NOT_EXIST  "/not-exist"
 #define FILENAME       "/myfile2.txt"
 #define FILENAME2      "/myfile3.txt"
+#define BUFFERFILE     "/buffered.txt"
 #define LONGFILENAME   "/mylongfilenamefile.txt"
 #define LONGFILENAME2  "/mylongfilenamefilesecond.txt"
 #define FILE_NOT_EXIST "/not-exist.txt"
@@ -301,6 +302,90 @@ static errval_t test_fwrite3(char *file)
     return SYS_ERR_OK;
 }
 
+// checks the number of requests sent since the last check
+static errval_t expect_rpcs(struct fs_buffer_stats *last, size_t expected, const char *what)
+{
+    struct fs_buffer_stats now;
+    fs_get_buffer_stats(&now);
+    size_t sent = now.rpcs_sent - last->rpcs_sent;
+    *last = now;
+
+    printf("%s: %zu requests, %zu saved so far\n", what, sent, now.rpcs_saved);
+    if (sent != expected) {
+        printf("FAILURE: %s expected %zu requests\n", what, expected);
+        return SYS_ERR_GUARD_MISMATCH;
+    }
+    return SYS_ERR_OK;
+}
+
+static errval_t test_buffering(char *file)
+{
+    errval_t err;
+    TEST_PREAMBLE(file)
+
+    FILE *f = fopen(file, "w+");
+    if (f == NULL) {
+        return FS_ERR_OPEN;
+    }
+    // every call reaches the file descriptor, only its buffer is under test
+    setvbuf(f, NULL, _IONBF, 0);
+
+    const char chunk[] = "0123456789abcdef";
+    const size_t len = sizeof(chunk) - 1;
+    char buf[sizeof(chunk)];
+
+    struct fs_buffer_stats stats;
+    fs_get_buffer_stats(&stats);
+
+    // small writes are collected and sent with a single request
+    for (int i = 0; i < 4; i++) {
+        if (fwrite(chunk, 1, len, f) != len) {
+            err = FS_ERR_WRITE;
+            goto out;
+        }
+    }
+    err = expect_rpcs(&stats, 0, "buffered writes");
+    if (err_is_fail(err)) {
+        goto out;
+    }
+    err = fs_fsync(fileno(f));
+    if (err_is_ok(err)) {
+        err = expect_rpcs(&stats, 1, "sync");
+    }
+    if (err_is_fail(err)) {
+        goto out;
+    }
+
+    // a seek sends what was written before it moves
+    if (fwrite(chunk, 1, len, f) != len || fseek(f, 0, SEEK_SET) != 0) {
+        err = FS_ERR_WRITE;
+        goto out;
+    }
+    err = expect_rpcs(&stats, 2, "write and seek");
+    if (err_is_fail(err)) {
+        goto out;
+    }
+
+    // the first read fetches ahead, the second is served from the buffer
+    for (int i = 0; i < 2; i++) {
+        if (fread(buf, 1, len, f) != len || memcmp(buf, chunk, len) != 0) {
+            err = FS_ERR_READ;
+            goto out;
+        }
+        err = expect_rpcs(&stats, i == 0 ? 1 : 0, i == 0 ? "read ahead" : "read ahead hit");
+        if (err_is_fail(err)) {
+            goto out;
+        }
+    }
+
+out:
+    if (fclose(f) != 0 && err_is_ok(err)) {
+        err = FS_ERR_CLOSE;
+    }
+    errval_t rm_err = rm(file);
+    return err_is_fail(err) ? err : rm_err;
+}
+
 void testOpen(void);
 void testOpen(void) {
     fs_dirhandle_t dh;
@@ -356,8 +441,6 @@ void _test_mk_rm(void) {
 
 int main(int argc, char *argv[])
 {
-    (void)argc;
-    (void)argv;
     errval_t err;
     uint64_t tstart, tend;
 
@@ -367,6 +450,12 @@ int main(int argc, char *argv[])
     err = filesystem_init();
     EXPECT_SUCCESS(err, "fs init", 0);
 
+    // only the buffering test, run by the test suite of init
+    if (argc > 1 && strcmp(argv[1], "buffering") == 0) {
+        run_test(test_buffering, MOUNTPOINT BUFFERFILE);
+        return err_is_ok(err) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     for(int i = 0; i <= 50;i++) {
         testOpen();
     }
@@ -0,0 +1,193 @@
+/**
+ * \file
+ * \brief Measures the speedup of a compute bound job on a spanned domain
+ *
+ * The same job is split into chunks that are computed by one thread per
+ * chunk. The threads first all run on the core the domain was started on,
+ * and then are spread over all the cores the domain spans. Finally, the
+ * chunks are run as tasks of a task pool with a worker on every core.
+ */
+
+/*
+ * Copyright (c) 2022 The University of British Columbia.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, CAB F.78, Universitaetstr. 6, CH-8092 Zurich,
+ * Attn: Systems Group.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <aos/aos.h>
+#include <aos/systime.h>
+#include <aos/taskpool.h>
+
+/// number of cores the domain is spanned to at most
+#define SPANBENCH_MAX_CORES 4
+
+/// number of chunks the job is split into
+#define SPANBENCH_CHUNKS 8
+
+/// default number of iterations of each chunk
+#define SPANBENCH_ITERATIONS (1 << 24)
+
+struct chunk {
+    uint64_t seed;
+    uint64_t iterations;
+    uint64_t result;
+};
+
+static struct chunk chunks[SPANBENCH_CHUNKS];
+
+static int compute(void *arg)
+{
+    struct chunk *chunk = arg;
+
+    // xorshift, so that the compiler cannot fold the loop
+    uint64_t x = chunk->seed;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < chunk->iterations; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sum += x;
+    }
+    chunk->result = sum;
+    return 0;
+}
+
+/**
+ * \brief Runs all chunks spread round robin over the first ncores cores.
+ *
+ * \return the time the whole job took
+ */
+static systime_t run(coreid_t *cores, size_t ncores, uint64_t iterations, uint64_t *result)
+{
+    struct thread *threads[SPANBENCH_CHUNKS];
+
+    systime_t start = systime_now();
+
+    for (size_t i = 0; i < SPANBENCH_CHUNKS; i++) {
+        chunks[i].seed = i + 1;
+        chunks[i].iterations = iterations;
+        chunks[i].result = 0;
+
+        errval_t err = domain_thread_create_on(cores[i % ncores], compute, &chunks[i],
+                                               &threads[i]);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "creating thread %zu on core %d", i, cores[i % ncores]);
+        }
+    }
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < SPANBENCH_CHUNKS; i++) {
+        errval_t err = thread_join(threads[i], NULL);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "joining thread %zu", i);
+        }
+        sum += chunks[i].result;
+    }
+
+    *result = sum;
+    return systime_now() - start;
+}
+
+static void compute_range(void *arg, size_t begin, size_t end)
+{
+    (void)arg;
+    for (size_t i = begin; i < end; i++) {
+        compute(&chunks[i]);
+    }
+}
+
+/**
+ * \brief Runs all chunks as tasks of a pool with one worker per core
+ *
+ * \return the time the whole job took
+ */
+static systime_t run_pool(struct taskpool *pool, uint64_t iterations, uint64_t *result)
+{
+    systime_t start = systime_now();
+
+    for (size_t i = 0; i < SPANBENCH_CHUNKS; i++) {
+        chunks[i].seed = i + 1;
+        chunks[i].iterations = iterations;
+        chunks[i].result = 0;
+    }
+
+    errval_t err = task_parallel_for(pool, 0, SPANBENCH_CHUNKS, 1, compute_range, NULL);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "running the chunks in the task pool");
+    }
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < SPANBENCH_CHUNKS; i++) {
+        sum += chunks[i].result;
+    }
+
+    *result = sum;
+    return systime_now() - start;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t iterations = SPANBENCH_ITERATIONS;
+    if (argc > 1) {
+        iterations = strtoull(argv[1], NULL, 0);
+    }
+
+    coreid_t cores[SPANBENCH_MAX_CORES];
+    size_t ncores = 0;
+    cores[ncores++] = disp_get_core_id();
+
+    for (coreid_t core = 0; core < SPANBENCH_MAX_CORES; core++) {
+        if (core == disp_get_core_id()) {
+            continue;
+        }
+        errval_t err = domain_new_dispatcher(core, NULL, NULL);
+        if (err_is_fail(err)) {
+            // the platform has no more cores we can use
+            break;
+        }
+        cores[ncores++] = core;
+    }
+
+    printf("spanbench: %zu chunks of %" PRIu64 " iterations, spanned to %zu cores\n",
+           (size_t)SPANBENCH_CHUNKS, iterations, ncores);
+
+    uint64_t result_one, result_all;
+    uint64_t us_one = systime_to_us(run(cores, 1, iterations, &result_one));
+    printf("spanbench: 1 core:   %" PRIu64 " us\n", us_one);
+
+    uint64_t us_all = systime_to_us(run(cores, ncores, iterations, &result_all));
+    printf("spanbench: %zu cores: %" PRIu64 " us\n", ncores, us_all);
+
+    struct taskpool *pool;
+    errval_t err = taskpool_create(0, &pool);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "creating the task pool");
+    }
+
+    uint64_t result_pool;
+    uint64_t us_pool = systime_to_us(run_pool(pool, iterations, &result_pool));
+    printf("spanbench: task pool of %zu workers: %" PRIu64 " us\n",
+           taskpool_get_nworkers(pool), us_pool);
+    taskpool_destroy(pool);
+
+    if (result_one != result_all || result_one != result_pool) {
+        printf("spanbench: results differ: %" PRIx64 " != %" PRIx64 " != %" PRIx64 "\n",
+               result_one, result_all, result_pool);
+        return EXIT_FAILURE;
+    }
+
+    if (us_all > 0) {
+        printf("spanbench: speedup %" PRIu64 ".%02" PRIu64 "x\n", us_one / us_all,
+               (us_one * 100 / us_all) % 100);
+    }
+
+    return EXIT_SUCCESS;
+}